@@ -0,0 +1,68 @@
+/*
+ * Measures the throughput of each checksum algorithm, on the implementation
+ * chosen for the running CPU. Setting CHECKSUM_PORTABLE in the environment
+ * measures the portable implementations instead.
+ *
+ * Usage: ./checksum_bench [buffer size in MB] [passes]
+ *
+ * Build from the repository root with "make checksum_bench".
+ */
+#include <stdio.h>
+#include <stdlib.h> //atol
+#include <time.h> //clock_gettime
+
+#include "../src/checksum.h"
+
+#define DEFAULT_BUFFER_MB 64
+#define DEFAULT_PASSES 8
+#define UPDATE_LEN (1 << 18) ///< the length of each update, as fed by the digest pipeline
+
+/**
+ * @brief Gets the elapsed time of a monotonic clock.
+ *
+ * @return the elapsed time in seconds
+ **/
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(const int argc, const char** argv) {
+    const size_t buffer_len = (argc > 1 ? atol(argv[1]) : DEFAULT_BUFFER_MB) << 20;
+    const long passes = argc > 2 ? atol(argv[2]) : DEFAULT_PASSES;
+    uint8_t* buffer = malloc(buffer_len);
+    if (buffer == NULL || buffer_len == 0 || passes <= 0) {
+        fprintf(stderr, "Usage: %s [buffer size in MB] [passes]\n", argv[0]);
+        free(buffer);
+        return 1;
+    }
+    srand(1);
+    for (size_t i = 0; i < buffer_len; ++i) {
+        buffer[i] = rand();
+    }
+
+    printf("%-8s %-10s %10s  %s\n", "name", "kernel", "GB/s", "checksum");
+    for (checksum_algorithm algorithm = CHECKSUM_SHA512; is_checksum_supported(algorithm); ++algorithm) {
+        uint8_t checksum[CHECKSUM_MAX_LENGTH] = {0};
+        checksum_ctx_t ctx;
+        const double start = now();
+        for (long pass = 0; pass < passes; ++pass) {
+            checksum_init(&ctx, algorithm);
+            for (size_t offset = 0; offset < buffer_len; offset += UPDATE_LEN) {
+                checksum_update(&ctx, buffer + offset, buffer_len - offset < UPDATE_LEN ? buffer_len - offset : UPDATE_LEN);
+            }
+            checksum_final(&ctx, checksum);
+        }
+        const double elapsed = now() - start;
+
+        printf("%-8s %-10s %10.2f  ", get_checksum_name(algorithm), get_checksum_kernel(algorithm),
+            (double)buffer_len * passes / elapsed / 1e9);
+        for (size_t i = 0; i < get_checksum_length(algorithm) && i < 8; ++i) {
+            printf("%02x", checksum[i]);
+        }
+        printf("...\n");
+    }
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#!/bin/sh
+#
+# End-to-end benchmark over loopback: starts the server once per transfer
+# mode and drives it with load_gen, whose files are generated in memory, for
+# every file size and concurrency level of the matrix. Prints a table and
+# writes every result to a JSON file, to be compared across commits.
+#
+# System calls are counted on both sides: "syscalls" are the ones load_gen
+# issued through the SAL to move data, "server_rw_syscalls" the read and
+# write family calls of the server as accounted in /proc/<pid>/io, i.e. its
+# file writes (socket calls such as recv() are not accounted there).
+#
+# Usage: bench/e2e_bench.sh [output JSON file]
+#
+# The matrix is set through the environment:
+#   SIZES        file sizes, K/M/G suffixes (default "1K 64K 1M 64M 1G")
+#   CONNECTIONS  concurrent connections (default "1 8")
+#   MODES        transfer modes (default "blocking session event-loop workers splice io-uring xxh3")
+#   RUN_BYTES    bytes sent per run, spread over files of the given size (default 1G)
+#   MAX_FILES    files per run at most, for the smallest sizes (default 10000)
+#   STORAGE      server storage directory (default a temporary directory)
+# The whole 1K to 10G matrix takes SIZES="1K 64K 1M 64M 1G 10G", and as much
+# free storage as the largest size times the largest concurrency level.
+#
+# Run from the repository root with "make bench".
+
+SIZES=${SIZES:-"1K 64K 1M 64M 1G"}
+CONNECTIONS=${CONNECTIONS:-"1 8"}
+MODES=${MODES:-"blocking session event-loop workers splice io-uring xxh3"}
+RUN_BYTES=${RUN_BYTES:-1G}
+MAX_FILES=${MAX_FILES:-10000}
+PORT=${PORT:-$((20000 + $$ % 20000))}
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+OUTPUT=${1:-bench-$COMMIT.json}
+WORK_DIR=$(mktemp -d)
+STORAGE=${STORAGE:-$WORK_DIR/storage}
+trap 'rm -rf "$WORK_DIR"' EXIT
+mkdir -p "$STORAGE"
+
+TICKS_PER_SECOND=$(getconf CLK_TCK)
+
+# Converts a size with an optional K, M or G suffix to bytes.
+to_bytes() {
+    case $1 in
+    *G) echo $((${1%G} << 30)) ;;
+    *M) echo $((${1%M} << 20)) ;;
+    *K) echo $((${1%K} << 10)) ;;
+    *) echo "$1" ;;
+    esac
+}
+
+# Prints the CPU time (user + system) of a process, in clock ticks.
+cpu_ticks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+# Prints the read and write family system calls of a process, 0 if not accounted.
+io_syscalls() {
+    awk '/^sysc[rw]:/ { n += $2 } END { print n + 0 }' "/proc/$1/io" 2>/dev/null || echo 0
+}
+
+# Awk function picking a number out of the flat JSON object on the current line.
+JSON_FIELD='function field(name) {
+    return match($0, "\"" name "\": [0-9.]+") ? substr($0, RSTART + length(name) + 4, RLENGTH - length(name) - 4) + 0 : 0
+}'
+
+# Sets the server and load_gen options of a transfer mode.
+set_mode() {
+    case $1 in
+    blocking) server_options=""; load_options="" ;;
+    session) server_options=""; load_options="--session" ;;
+    event-loop) server_options="--event-loop"; load_options="--session" ;;
+    workers) server_options="--workers $(nproc)"; load_options="--session" ;;
+    splice) server_options="--splice"; load_options="--session" ;;
+    io-uring) server_options="--io-uring"; load_options="--session" ;;
+    xxh3) server_options=""; load_options="--session --checksum xxh3" ;;
+    *) echo "Unknown mode $1" >&2; return 1 ;;
+    esac
+}
+
+run_bytes=$(to_bytes "$RUN_BYTES")
+first=1
+printf '{"commit": "%s", "date": "%s", "results": [\n' "$COMMIT" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" > "$OUTPUT"
+printf '%-10s %6s %5s %7s %10s %10s %9s %9s %9s %11s\n' \
+    mode size conns files MB/s files/s p50_ms p99_ms CPU_s/GB syscalls/MB
+for mode in $MODES; do
+    set_mode "$mode" || continue
+    ./server "$STORAGE" 127.0.0.1 "$PORT" $server_options >/dev/null 2>&1 &
+    server_pid=$!
+    sleep 0.5
+    for size in $SIZES; do
+        file_size=$(to_bytes "$size")
+        for connections in $CONNECTIONS; do
+            # Files per connection
+            files=$((run_bytes / ((file_size + 1) * connections)))
+            [ "$files" -gt $((MAX_FILES / connections)) ] && files=$((MAX_FILES / connections))
+            [ "$files" -lt 1 ] && files=1
+
+            start_ticks=$(cpu_ticks "$server_pid")
+            start_syscalls=$(io_syscalls "$server_pid")
+            result=$(./load_gen "$size" 127.0.0.1 "$PORT" \
+                --files "$files" --connections "$connections" $load_options)
+            [ $? -ne 0 ] && echo "$mode $size x$connections: some transfers failed" >&2
+            end_ticks=$(cpu_ticks "$server_pid")
+            end_syscalls=$(io_syscalls "$server_pid")
+            rm -f "$STORAGE"/load-*
+            [ -z "$result" ] && continue
+
+            # Server figures are appended to the load_gen ones
+            result=$(echo "$result" | awk -v mode="$mode" -v hz="$TICKS_PER_SECOND" \
+                -v ticks="$((end_ticks - start_ticks))" -v syscalls="$((end_syscalls - start_syscalls))" "$JSON_FIELD"'{
+                gb = field("files") * field("file_size") / 1073741824
+                cpu = field("cpu_seconds")
+                sub(/}$/, "")
+                printf "%s, \"mode\": \"%s\", \"server_cpu_seconds\": %.6f, \"server_rw_syscalls\": %d, \"total_cpu_s_per_gb\": %.6f}\n",
+                    $0, mode, ticks / hz, syscalls, (gb > 0 ? (cpu + ticks / hz) / gb : 0)
+            }')
+            [ "$first" -eq 0 ] && printf ',\n' >> "$OUTPUT"
+            printf '    %s' "$result" >> "$OUTPUT"
+            first=0
+
+            echo "$result" | awk -v mode="$mode" -v size="$size" "$JSON_FIELD"'{
+                mb = field("files") * field("file_size") / 1048576
+                printf "%-10s %6s %5d %7d %10.1f %10.1f %9.3f %9.3f %9.3f %11.1f\n", mode, size,
+                    field("connections"), field("files"), field("mb_per_s"), field("files_per_s"),
+                    field("p50_ms"), field("p99_ms"), field("total_cpu_s_per_gb"),
+                    (mb > 0 ? field("syscalls") / mb : 0)
+            }'
+        done
+    done
+    kill "$server_pid"
+    wait "$server_pid" 2>/dev/null
+    PORT=$((PORT + 1))
+done
+printf '\n]}\n' >> "$OUTPUT"
+echo "Results written to $OUTPUT"
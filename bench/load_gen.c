@@ -0,0 +1,381 @@
+/*
+ * Synthetic load generator: sends files generated in memory to a running
+ * server, so that neither disk speed nor the page cache of the sender side
+ * is measured. Each connection runs on its own thread and sends its files
+ * one after the other, timing each file from its header to its reply.
+ *
+ * Usage: ./load_gen <file size> <ip> <port> [--files N] [--connections N]
+ *                   [--session] [--checksum sha512|blake3|xxh3|crc32c]
+ *
+ * File sizes take a K, M or G suffix. Without --session, every file gets
+ * its own connection. Results are printed as a single JSON object.
+ *
+ * Build from the repository root with "make load_gen".
+ */
+#include <stdio.h>
+#include <stdlib.h> //atol
+#include <string.h> //strcmp
+#include <pthread.h>
+#include <time.h> //clock_gettime
+#include <sys/resource.h> //getrusage
+
+#include "../src/sal.h"
+#include "../src/common.h"
+#include "../src/tlv.h"
+#include "../src/protocol.h"
+#include "../src/checksum.h"
+
+#define PAYLOAD_LEN (1 << 20) ///< the generated content, repeated over the whole file
+#define SLICE_LEN (256 << 10) ///< the content sent per system call, as the client does
+#define FRAME_LEN (16 << 20) ///< the requested frame length, the client default
+#define LOAD_CAPABILITIES (PROTOCOL_CAPABILITY_EXTENDED_FRAMES | PROTOCOL_CAPABILITY_CHECKSUMS | \
+    PROTOCOL_CAPABILITY_SESSION) ///< the capabilities offered, so that the server sends no other reply
+
+typedef struct {
+    struct sockaddr_in server_addr; ///< the server address
+    long file_size; ///< the size of every file
+    long files; ///< the amount of files per connection
+    long connections; ///< the amount of concurrent connections
+    bool session; ///< send all files of a connection over a single session
+    checksum_algorithm checksum; ///< the requested checksum algorithm
+} load_config;
+
+typedef struct {
+    const load_config* config; ///< the shared configuration
+    long index; ///< the connection index, naming its files
+    sal_socket_t socket; ///< the current connection
+    tlv_arena_t* arena; ///< the arena holding the TLVs exchanged through the connection
+    protocol_hello protocol; ///< the protocol parameters agreed with the server
+    double* latencies; ///< the time taken by each file, in seconds
+    long sent; ///< the amount of files sent and acknowledged
+    long failed; ///< the amount of files that failed
+    unsigned long syscalls; ///< the system calls the connection thread issued to move data
+    pthread_t thread; ///< the connection thread
+} load_connection;
+
+static uint8_t payload[PAYLOAD_LEN];
+
+/**
+ * @brief Gets the elapsed time of a monotonic clock.
+ *
+ * @return the elapsed time in seconds
+ **/
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Parses a size with an optional K, M or G suffix.
+ *
+ * @param arg The size argument
+ *
+ * @return the size in bytes
+ * @return -1 if the size is invalid
+ **/
+static long parse_size(const char* arg) {
+    char* end = NULL;
+    long size = strtol(arg, &end, 10);
+    switch (*end) {
+    case 'G': size <<= 10; /* fall through */
+    case 'M': size <<= 10; /* fall through */
+    case 'K': size <<= 10; ++end; break;
+    default: break;
+    }
+    return end == arg || *end != '\0' || size < 0 ? -1 : size;
+}
+
+/**
+ * @brief Gets the CPU time (user and system) used by the process.
+ *
+ * @return the CPU time in seconds
+ **/
+static double get_cpu_time() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * @brief Connects to the server and negotiates the protocol parameters.
+ *
+ * @param connection The connection data
+ *
+ * @return true if the server speaks protocol version 2
+ * @return false otherwise
+ **/
+static bool open_load_connection(load_connection* connection) {
+    const protocol_hello local = {
+        .version = PROTOCOL_VERSION_2,
+        .capabilities = LOAD_CAPABILITIES,
+        .max_frame_length = FRAME_LEN,
+        .max_streams = 1
+    };
+    if ((connection->socket = sal_create_socket()) == NULL) {
+        return false;
+    }
+    if (sal_connect(connection->socket, (struct sockaddr_in*)&connection->config->server_addr) != SAL_OK ||
+        !exchange_hello(connection->socket, connection->arena, &local, &connection->protocol)) {
+        sal_close(connection->socket);
+        sal_destroy_socket(connection->socket);
+        connection->socket = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Closes the current connection.
+ *
+ * @param connection The connection data
+ *
+ * @return No return
+ **/
+static void close_load_connection(load_connection* connection) {
+    sal_close(connection->socket);
+    sal_destroy_socket(connection->socket);
+    connection->socket = NULL;
+}
+
+/**
+ * @brief Builds the header announcing a file on the connection arena.
+ *
+ * @param connection The connection data
+ * @param file_index The file index within the connection
+ * @param checksum The checksum algorithm, if the server agreed on choosing it
+ *
+ * @return the header TLV
+ **/
+static tlv_t new_load_header_tlv(load_connection* connection, const long file_index, const checksum_algorithm checksum) {
+    char name[64] = {0};
+    const int name_len = snprintf(name, sizeof(name), "load-%ld-%ld", connection->index, file_index);
+
+    tlv_t tlv_header = new_tlv(connection->arena, TLV_TYPE_HEADER, 0);
+    tlv_t sub_tlv_file_name = new_tlv(connection->arena, TLV_TYPE_FILE_NAME, name_len);
+    set_tlv_value_raw(&sub_tlv_file_name, name);
+    tlv_t sub_tlv_file_size = new_tlv(connection->arena, TLV_TYPE_FILE_SIZE, sizeof(long));
+    set_tlv_value_long(&sub_tlv_file_size, connection->config->file_size);
+    set_next_tlv(&sub_tlv_file_name, &sub_tlv_file_size);
+    tlv_t sub_tlv_checksum_algorithm = {0};
+    if (connection->protocol.capabilities & PROTOCOL_CAPABILITY_CHECKSUMS) {
+        sub_tlv_checksum_algorithm = new_tlv(connection->arena, TLV_TYPE_CHECKSUM_ALGORITHM, sizeof(long));
+        set_tlv_value_long(&sub_tlv_checksum_algorithm, checksum);
+        set_next_tlv(&sub_tlv_file_size, &sub_tlv_checksum_algorithm);
+    }
+    set_sub_tlv_list(&tlv_header, &sub_tlv_file_name);
+    tlv_header.sub_tlv = NULL;
+    return tlv_header;
+}
+
+/**
+ * @brief Sends a file made of the repeated payload, followed by its
+ * checksum, and waits for the reply. The header goes along the first
+ * content slice, so that small files take a single system call.
+ *
+ * @param connection The connection data
+ * @param file_index The file index within the connection
+ *
+ * @return true if the server acknowledged the file
+ * @return false otherwise
+ **/
+static bool send_load_file(load_connection* connection, const long file_index) {
+    const long file_size = connection->config->file_size;
+    const checksum_algorithm checksum = connection->protocol.capabilities & PROTOCOL_CAPABILITY_CHECKSUMS ?
+        connection->config->checksum : CHECKSUM_DEFAULT;
+    const long max_frame_length = connection->protocol.max_frame_length == PROTOCOL_UNLIMITED_FRAME_LENGTH ?
+        file_size : connection->protocol.max_frame_length;
+    checksum_ctx_t checksum_ctx;
+    checksum_init(&checksum_ctx, checksum);
+    uint8_t digest[CHECKSUM_MAX_LENGTH] = {0};
+    tlv_gather_t gather;
+    init_tlv_gather(&gather);
+    tlv_t tlv_header = new_load_header_tlv(connection, file_index, checksum);
+    add_tlv_to_gather(&gather, &tlv_header);
+    long frame_end = 0;
+    for (long offset = 0; offset < file_size;) {
+        const size_t position = offset % PAYLOAD_LEN;
+        const size_t length = MIN(MIN(SLICE_LEN, PAYLOAD_LEN - position), (size_t)(file_size - offset));
+        checksum_update(&checksum_ctx, payload + position, length);
+        if (offset == frame_end) {
+            frame_end = MIN(file_size, offset + max_frame_length);
+            add_tlv_header_to_gather(&gather, TLV_TYPE_FILE_CONTENT, frame_end - offset);
+        }
+        add_buffer_to_gather(&gather, payload + position, length);
+        offset += length;
+        if (offset == file_size) {
+            checksum_final(&checksum_ctx, digest);
+            tlv_t tlv_checksum = new_checksum_tlv(connection->arena, &connection->protocol, checksum, digest);
+            add_tlv_to_gather(&gather, &tlv_checksum);
+        }
+        const bool sent = send_tlv_gather(connection->socket, &gather);
+        reset_tlv_arena(connection->arena);
+        init_tlv_gather(&gather);
+        if (!sent) {
+            return false;
+        }
+    }
+    if (file_size == 0) {
+        checksum_final(&checksum_ctx, digest);
+        tlv_t tlv_checksum = new_checksum_tlv(connection->arena, &connection->protocol, checksum, digest);
+        add_tlv_to_gather(&gather, &tlv_checksum);
+        const bool sent = send_tlv_gather(connection->socket, &gather);
+        reset_tlv_arena(connection->arena);
+        if (!sent) {
+            return false;
+        }
+    }
+
+    tlv_t tlv_reply = {0};
+    const bool ack = receive_tlv_data(connection->socket, connection->arena, &tlv_reply) &&
+        get_tlv_type(&tlv_reply) == TLV_TYPE_ACK;
+    reset_tlv_arena(connection->arena);
+    return ack;
+}
+
+/**
+ * @brief Connection thread entry point: sends all files of a connection.
+ *
+ * @param arg The connection data
+ *
+ * @return NULL
+ **/
+static void* run_connection(void* arg) {
+    load_connection* connection = arg;
+    const load_config* config = connection->config;
+    for (long i = 0; i < config->files; ++i) {
+        const double start = now();
+        bool sent = (connection->socket != NULL || open_load_connection(connection)) &&
+            send_load_file(connection, i);
+        if (connection->socket != NULL &&
+            (!sent || !config->session || !(connection->protocol.capabilities & PROTOCOL_CAPABILITY_SESSION))) {
+            close_load_connection(connection);
+        }
+        if (sent) {
+            connection->latencies[connection->sent++] = now() - start;
+        } else {
+            ++connection->failed;
+        }
+    }
+    if (connection->socket != NULL) {
+        close_load_connection(connection);
+    }
+    connection->syscalls = sal_get_syscall_count();
+    return NULL;
+}
+
+/**
+ * @brief Orders latencies, for percentiles to be picked.
+ **/
+static int compare_latencies(const void* a, const void* b) {
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Parses input arguments.
+ *
+ * @param argc The amount of arguments
+ * @param argv The arguments
+ * @param[out] config The load configuration
+ *
+ * @return true if given arguments are valid
+ * @return false otherwise
+ **/
+static bool parse_input(const int argc, const char** argv, load_config* config) {
+    if (argc < 4 || (config->file_size = parse_size(argv[1])) < 0 ||
+        inet_aton(argv[2], &config->server_addr.sin_addr) == 0 || atoi(argv[3]) <= 0 || atoi(argv[3]) > 65535) {
+        return false;
+    }
+    config->server_addr.sin_family = AF_INET;
+    config->server_addr.sin_port = htons(atoi(argv[3]));
+    config->files = 1;
+    config->connections = 1;
+    config->checksum = CHECKSUM_DEFAULT;
+    for (int i = 4; i < argc; ++i) {
+        if (strcmp(argv[i], "--session") == 0) {
+            config->session = true;
+        } else if (i + 1 == argc) {
+            return false;
+        } else if (strcmp(argv[i], "--files") == 0) {
+            config->files = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--connections") == 0) {
+            config->connections = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--checksum") == 0) {
+            config->checksum = get_checksum_by_name(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return config->files > 0 && config->connections > 0 && config->checksum != 0;
+}
+
+int main(const int argc, const char** argv) {
+    load_config config;
+    bzero(&config, sizeof(config));
+    if (!parse_input(argc, argv, &config)) {
+        fprintf(stderr, "Usage: %s <file size> <ip> <port> [--files N] [--connections N] [--session] "
+            "[--checksum sha512|blake3|xxh3|crc32c]\n", argv[0]);
+        return 1;
+    }
+    /* Incompressible content, so that compressing servers gain nothing */
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < PAYLOAD_LEN; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        payload[i] = state;
+    }
+
+    load_connection* connections = calloc(config.connections, sizeof(*connections));
+    double* latencies = calloc(config.connections * config.files, sizeof(*latencies));
+    if (connections == NULL || latencies == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(connections);
+        free(latencies);
+        return 1;
+    }
+    const double start_cpu = get_cpu_time();
+    const double start = now();
+    long started = 0;
+    for (; started < config.connections; ++started) {
+        load_connection* connection = &connections[started];
+        connection->config = &config;
+        connection->index = started;
+        connection->latencies = latencies + started * config.files;
+        if ((connection->arena = acquire_tlv_arena()) == NULL ||
+            pthread_create(&connection->thread, NULL, run_connection, connection) != 0) {
+            release_tlv_arena(connection->arena);
+            break;
+        }
+    }
+    long sent = 0;
+    unsigned long syscalls = 0;
+    long failed = (config.connections - started) * config.files;
+    for (long i = 0; i < started; ++i) {
+        pthread_join(connections[i].thread, NULL);
+        release_tlv_arena(connections[i].arena);
+        /* Latencies are gathered at the beginning, for percentiles to be picked */
+        memmove(latencies + sent, connections[i].latencies, connections[i].sent * sizeof(*latencies));
+        sent += connections[i].sent;
+        failed += connections[i].failed;
+        syscalls += connections[i].syscalls;
+    }
+    const double elapsed = now() - start;
+    const double cpu = get_cpu_time() - start_cpu;
+
+    qsort(latencies, sent, sizeof(*latencies), compare_latencies);
+    const double bytes = (double)sent * config.file_size;
+    printf("{\"file_size\": %ld, \"connections\": %ld, \"files\": %ld, \"failed\": %ld, \"session\": %s, "
+        "\"checksum\": \"%s\", \"seconds\": %.6f, \"mb_per_s\": %.3f, \"files_per_s\": %.3f, "
+        "\"p50_ms\": %.3f, \"p99_ms\": %.3f, \"cpu_seconds\": %.6f, \"cpu_s_per_gb\": %.6f, \"syscalls\": %lu}\n",
+        config.file_size, config.connections, sent, failed, config.session ? "true" : "false",
+        get_checksum_name(config.checksum), elapsed, bytes / elapsed / (1 << 20), sent / elapsed,
+        sent ? latencies[(sent - 1) / 2] * 1e3 : 0, sent ? latencies[(sent * 99 - 1) / 100] * 1e3 : 0,
+        cpu, bytes > 0 ? cpu / (bytes / (1 << 30)) : 0, syscalls);
+    free(connections);
+    free(latencies);
+    return failed == 0 ? 0 : 1;
+}
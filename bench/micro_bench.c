@@ -0,0 +1,357 @@
+/*
+ * Measures the cost of the building blocks of a transfer on their own: TLV
+ * building and parsing, the SAL socket calls over a local socket pair at
+ * several message sizes, and SHA-512 updates. Each case runs for a fixed
+ * time and reports ns per operation and GB/s.
+ *
+ * Usage: ./micro_bench [--json output] [--baseline baseline] [--tolerance percent]
+ *
+ * With a baseline, as written by a previous --json run, every case slower
+ * than the baseline by more than the tolerance (default 15%) is reported
+ * and the exit status is 1.
+ *
+ * Build from the repository root with "make micro_bench", or run it against
+ * bench/micro_baseline.json with "make microbench".
+ */
+#include <stdio.h>
+#include <stdlib.h> //atof
+#include <string.h> //strcmp
+#include <pthread.h>
+#include <time.h> //clock_gettime
+
+#include "../src/sal.h"
+#include "../src/tlv.h"
+#include "../src/checksum.h"
+
+#define MIN_CASE_TIME 0.25 ///< the time each case runs for at least, in seconds
+#define BATCH_OPS 1024 ///< the operations run between clock reads
+#define MAX_RESULTS 32
+#define MAX_NAME_LEN 63
+#define DEFAULT_TOLERANCE 15.0
+#define ARENA_RESET_OPS 1024 ///< the TLVs built on an arena before resetting it, far from filling it
+#define HASHED_LEN (1 << 20) ///< the buffer hashed by the SHA-512 cases
+
+typedef struct {
+    char name[MAX_NAME_LEN + 1]; ///< the case name
+    double ns_per_op; ///< the time per operation
+    double gb_per_s; ///< the throughput, 0 if the case moves no data
+} micro_result;
+
+typedef struct {
+    sal_socket_t socket; ///< the receiving end of the socket pair
+    uint8_t* buffer; ///< the receive buffer
+    size_t length; ///< the message length
+} receiver_data;
+
+/**
+ * @brief Runs a batch of operations of a case.
+ *
+ * @param arg The case data
+ * @param ops The amount of operations
+ **/
+typedef void (*micro_case)(void* arg, const long ops);
+
+static micro_result results[MAX_RESULTS];
+static int result_count = 0;
+static uint8_t hashed[HASHED_LEN];
+static volatile long sink = 0; ///< keeps the compiler from dropping unused results
+
+/**
+ * @brief Gets the elapsed time of a monotonic clock.
+ *
+ * @return the elapsed time in seconds
+ **/
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Records the outcome of a case and prints it.
+ *
+ * @param name The case name
+ * @param ops The amount of operations run
+ * @param bytes_per_op The bytes processed per operation, 0 if none
+ * @param elapsed The time they took, in seconds
+ **/
+static void add_result(const char* name, const long ops, const size_t bytes_per_op, const double elapsed) {
+    if (result_count == MAX_RESULTS) {
+        return;
+    }
+    micro_result* result = &results[result_count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->ns_per_op = elapsed * 1e9 / ops;
+    result->gb_per_s = (double)bytes_per_op * ops / elapsed / 1e9;
+    printf("%-28s %12.2f ns/op %10.3f GB/s\n", result->name, result->ns_per_op, result->gb_per_s);
+}
+
+/**
+ * @brief Runs a case in batches until MIN_CASE_TIME elapsed.
+ *
+ * @param name The case name
+ * @param run The case
+ * @param arg The case data
+ * @param bytes_per_op The bytes processed per operation, 0 if none
+ **/
+static void measure(const char* name, micro_case run, void* arg, const size_t bytes_per_op) {
+    run(arg, BATCH_OPS); /* warm up */
+    long ops = 0;
+    const double start = now();
+    double elapsed = 0;
+    do {
+        run(arg, BATCH_OPS);
+        ops += BATCH_OPS;
+    } while ((elapsed = now() - start) < MIN_CASE_TIME);
+    add_result(name, ops, bytes_per_op, elapsed);
+}
+
+static void run_new_tlv(void* arg, const long ops) {
+    tlv_arena_t* arena = arg;
+    for (long i = 0; i < ops; ++i) {
+        if (i % ARENA_RESET_OPS == 0) {
+            reset_tlv_arena(arena);
+        }
+        tlv_t tlv = new_tlv(arena, TLV_TYPE_FILE_SIZE, sizeof(long));
+        sink += tlv.length;
+    }
+    reset_tlv_arena(arena);
+}
+
+static void run_reset_tlv_arena(void* arg, const long ops) {
+    tlv_arena_t* arena = arg;
+    for (long i = 0; i < ops; ++i) {
+        reset_tlv_arena(arena);
+    }
+}
+
+static void run_parse_tlv(void* arg, const long ops) {
+    uint8_t* buffer = arg;
+    tlv_t tlv = {0};
+    for (long i = 0; i < ops; ++i) {
+        parse_tlv(buffer, &tlv);
+        sink += tlv.length;
+    }
+}
+
+static void run_fill_tlv_length(void* arg, const long ops) {
+    tlv_t* tlv_header = arg;
+    for (long i = 0; i < ops; ++i) {
+        fill_tlv_length(tlv_header);
+    }
+    sink += tlv_header->length;
+}
+
+static void run_get_tlv_value_long(void* arg, const long ops) {
+    tlv_t* tlv = arg;
+    for (long i = 0; i < ops; ++i) {
+        sink += get_tlv_value_long(tlv);
+    }
+}
+
+static void run_sha512_update(void* arg, const long ops) {
+    const size_t length = *(const size_t*)arg;
+    checksum_ctx_t ctx;
+    checksum_init(&ctx, CHECKSUM_SHA512);
+    for (long i = 0; i < ops; ++i) {
+        checksum_update(&ctx, hashed + (i * length) % HASHED_LEN, length);
+    }
+    uint8_t checksum[CHECKSUM_MAX_LENGTH];
+    checksum_final(&ctx, checksum);
+    sink += checksum[0];
+}
+
+/**
+ * @brief Receiver thread entry point: receives messages until the last one,
+ * whose first byte is set.
+ *
+ * @param arg The receiver data
+ *
+ * @return NULL
+ **/
+static void* run_receiver(void* arg) {
+    receiver_data* receiver = arg;
+    while (sal_receive_msg(receiver->socket, receiver->buffer, receiver->length) == SAL_OK &&
+           receiver->buffer[0] == 0) {
+    }
+    return NULL;
+}
+
+/**
+ * @brief Measures sal_send_msg() and sal_receive_msg() over a local socket
+ * pair, one message of the given length per operation, the receiver running
+ * on its own thread.
+ *
+ * @param length The message length
+ **/
+static void measure_socket_pair(const size_t length) {
+    sal_socket_t sender = NULL;
+    receiver_data receiver = {0};
+    uint8_t* buffer = calloc(2, length);
+    if (buffer == NULL || sal_create_socket_pair(&sender, &receiver.socket) != SAL_OK) {
+        free(buffer);
+        return;
+    }
+    receiver.buffer = buffer + length;
+    receiver.length = length;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, run_receiver, &receiver) != 0) {
+        goto CLOSE_SOCKETS;
+    }
+
+    long ops = 0;
+    const double start = now();
+    while (now() - start < MIN_CASE_TIME) {
+        for (int i = 0; i < BATCH_OPS / 16; ++i) {
+            sal_send_msg(sender, buffer, length);
+        }
+        ops += BATCH_OPS / 16;
+    }
+    /* The last message ends the receiver once it got everything */
+    buffer[0] = 1;
+    sal_send_msg(sender, buffer, length);
+    pthread_join(thread, NULL);
+    const double elapsed = now() - start;
+    char name[MAX_NAME_LEN + 1];
+    snprintf(name, sizeof(name), "sal_send_receive_%zu", length);
+    add_result(name, ops + 1, length, elapsed);
+
+CLOSE_SOCKETS:
+    sal_close(sender);
+    sal_destroy_socket(sender);
+    sal_close(receiver.socket);
+    sal_destroy_socket(receiver.socket);
+    free(buffer);
+}
+
+/**
+ * @brief Writes all results as JSON, one case per line.
+ *
+ * @param path The output file
+ *
+ * @return true if results were written successfully
+ * @return false otherwise
+ **/
+static bool write_results(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(fp, "{\"results\": [\n");
+    for (int i = 0; i < result_count; ++i) {
+        fprintf(fp, "    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"gb_per_s\": %.6f}%s\n",
+            results[i].name, results[i].ns_per_op, results[i].gb_per_s, i + 1 < result_count ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+    return fclose(fp) == 0;
+}
+
+/**
+ * @brief Compares all results against a baseline written by write_results().
+ *
+ * @param path The baseline file
+ * @param tolerance The slowdown tolerated, in percent
+ *
+ * @return the amount of regressed cases
+ * @return -1 if the baseline could not be read
+ **/
+static int compare_results(const char* path, const double tolerance) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    int regressions = 0;
+    char line[256];
+    printf("\nAgainst %s (tolerance %.0f%%):\n", path, tolerance);
+    while (fgets(line, sizeof(line), fp)) {
+        char name[MAX_NAME_LEN + 1] = {0};
+        double baseline = 0;
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"ns_per_op\": %lf", name, &baseline) != 2) {
+            continue;
+        }
+        for (int i = 0; i < result_count; ++i) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+            const double change = (results[i].ns_per_op / baseline - 1) * 100;
+            const bool regressed = change > tolerance;
+            printf("%-28s %12.2f ns/op %+8.1f%%%s\n", name, baseline, change, regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+        }
+    }
+    fclose(fp);
+    return regressions;
+}
+
+int main(const int argc, const char** argv) {
+    const char* json_path = NULL;
+    const char* baseline_path = NULL;
+    double tolerance = DEFAULT_TOLERANCE;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--json output] [--baseline baseline] [--tolerance percent]\n", argv[0]);
+            return 1;
+        }
+    }
+    tlv_arena_t* arena = acquire_tlv_arena();
+    if (arena == NULL) {
+        return 1;
+    }
+    for (size_t i = 0; i < HASHED_LEN; ++i) {
+        hashed[i] = i * 2654435761u >> 24;
+    }
+
+    /* A header as sent by the client: file name, size and checksum algorithm */
+    tlv_t tlv_header = new_tlv(arena, TLV_TYPE_HEADER, 0);
+    tlv_t sub_tlv_file_name = new_tlv(arena, TLV_TYPE_FILE_NAME, 12);
+    set_tlv_value_raw(&sub_tlv_file_name, (const uint8_t*)"payload.bin\0");
+    tlv_t sub_tlv_file_size = new_tlv(arena, TLV_TYPE_FILE_SIZE, sizeof(long));
+    set_tlv_value_long(&sub_tlv_file_size, 1L << 30);
+    tlv_t sub_tlv_checksum_algorithm = new_tlv(arena, TLV_TYPE_CHECKSUM_ALGORITHM, sizeof(long));
+    set_tlv_value_long(&sub_tlv_checksum_algorithm, CHECKSUM_SHA512);
+    set_next_tlv(&sub_tlv_file_name, &sub_tlv_file_size);
+    set_next_tlv(&sub_tlv_file_size, &sub_tlv_checksum_algorithm);
+    set_sub_tlv_list(&tlv_header, &sub_tlv_file_name);
+    uint8_t encoded[TLV_HEADER_LENGTH + sizeof(long)];
+    memcpy(encoded, get_tlv_data(&sub_tlv_file_size), sizeof(encoded));
+
+    measure("fill_tlv_length", run_fill_tlv_length, &tlv_header, 0);
+    measure("get_tlv_value_long", run_get_tlv_value_long, &sub_tlv_file_size, 0);
+    measure("parse_tlv", run_parse_tlv, encoded, 0);
+    reset_tlv_arena(arena);
+    measure("new_tlv", run_new_tlv, arena, 0);
+    measure("reset_tlv_arena", run_reset_tlv_arena, arena, 0);
+    const size_t message_lengths[] = {64, 1 << 10, 16 << 10, 64 << 10, 1 << 20};
+    for (size_t i = 0; i < sizeof(message_lengths) / sizeof(message_lengths[0]); ++i) {
+        measure_socket_pair(message_lengths[i]);
+    }
+    const size_t update_lengths[] = {1 << 10, 64 << 10};
+    for (size_t i = 0; i < sizeof(update_lengths) / sizeof(update_lengths[0]); ++i) {
+        char name[MAX_NAME_LEN + 1];
+        snprintf(name, sizeof(name), "sha512_update_%zu", update_lengths[i]);
+        measure(name, run_sha512_update, (void*)&update_lengths[i], update_lengths[i]);
+    }
+    release_tlv_arena(arena);
+
+    if (json_path && !write_results(json_path)) {
+        return 1;
+    }
+    if (baseline_path) {
+        const int regressions = compare_results(baseline_path, tolerance);
+        if (regressions < 0) {
+            return 1;
+        } else if (regressions > 0) {
+            fprintf(stderr, "%d case(s) regressed against %s\n", regressions, baseline_path);
+            return 1;
+        }
+    }
+    return 0;
+}
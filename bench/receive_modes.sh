@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Compares the server CPU time spent per ingested GB by the stdio receive
+# path against the splice() and io_uring receive paths, over loopback.
+#
+# Usage: bench/receive_modes.sh [file size in MB] [transfers per mode]
+#
+# Run from the repository root after building both server and client.
+
+SIZE_MB=${1:-256}
+TRANSFERS=${2:-4}
+PORT=${PORT:-$((20000 + $$ % 20000))}
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+mkdir -p "$WORK_DIR/storage"
+dd if=/dev/urandom of="$WORK_DIR/payload" bs=1M count="$SIZE_MB" 2>/dev/null
+
+# Prints the CPU time (user + system) of a process, in clock ticks.
+cpu_ticks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+TICKS_PER_SECOND=$(getconf CLK_TCK)
+
+run_mode() {
+    mode_name=$1
+    shift
+    ./server "$WORK_DIR/storage" 127.0.0.1 "$PORT" "$@" >/dev/null &
+    server_pid=$!
+    sleep 0.5
+
+    start_ticks=$(cpu_ticks "$server_pid")
+    start_ns=$(date +%s%N)
+    i=0
+    while [ "$i" -lt "$TRANSFERS" ]; do
+        ./client "$WORK_DIR/payload" 127.0.0.1 "$PORT" --sendfile >/dev/null || echo "transfer failed" >&2
+        i=$((i + 1))
+    done
+    end_ns=$(date +%s%N)
+    end_ticks=$(cpu_ticks "$server_pid")
+
+    kill "$server_pid"
+    wait "$server_pid" 2>/dev/null
+    PORT=$((PORT + 1))
+
+    awk -v name="$mode_name" -v mb="$((SIZE_MB * TRANSFERS))" \
+        -v ticks="$((end_ticks - start_ticks))" -v hz="$TICKS_PER_SECOND" \
+        -v ns="$((end_ns - start_ns))" 'BEGIN {
+        cpu = ticks / hz
+        printf "%-8s %10.1f MB/s %10.3f CPU s/GB\n", name, mb / (ns / 1e9), cpu / (mb / 1024)
+    }'
+}
+
+echo "$TRANSFERS transfers of $SIZE_MB MB per mode"
+run_mode stdio
+run_mode splice --splice
+run_mode io_uring --io-uring
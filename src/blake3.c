@@ -0,0 +1,569 @@
+#include <string.h> //memcpy
+#include <pthread.h>
+
+#include "checksum_imp.h"
+#include "common.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BLAKE3_AVX2 //checked at runtime
+#endif
+
+#define CHUNK_START (1 << 0)
+#define CHUNK_END (1 << 1)
+#define PARENT (1 << 2)
+#define ROOT (1 << 3)
+#define ROUNDS 7
+#define LANES 8 ///< the amount of inputs hashed at once by the SIMD implementation
+#define MAX_SUBTREE_CHUNKS 64 ///< the most chunks hashed at once, before merging their chaining values
+
+typedef void (*hash_many_kernel_t)(
+    const uint8_t* const* inputs,
+    size_t count,
+    size_t blocks,
+    uint64_t counter,
+    bool increment_counter,
+    uint8_t flags,
+    uint8_t flags_start,
+    uint8_t flags_end,
+    uint8_t (*cvs)[BLAKE3_CV_LEN]);
+
+static const uint32_t IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+/**
+ * @brief The message words used by each round, i.e. the message permutation applied round after round.
+ **/
+static const uint8_t MSG_SCHEDULE[ROUNDS][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+    { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+    { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+    { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+    { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+    { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static hash_many_kernel_t hash_many = NULL; ///< the implementation chosen for the running CPU
+static const char* kernel_name = NULL;
+
+static inline uint32_t read_le32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void write_le32(uint8_t* p, const uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static inline void store_cv(uint8_t* p, const uint32_t cv[8]) {
+    for (int i = 0; i < 8; ++i) {
+        write_le32(p + 4 * i, cv[i]);
+    }
+}
+
+static inline uint32_t rotr32(const uint32_t x, const int bits) {
+    return (x >> bits) | (x << (32 - bits));
+}
+
+static inline void g(uint32_t* v, int a, int b, int c, int d, uint32_t x, uint32_t y) {
+    v[a] = v[a] + v[b] + x;
+    v[d] = rotr32(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = rotr32(v[b] ^ v[c], 12);
+    v[a] = v[a] + v[b] + y;
+    v[d] = rotr32(v[d] ^ v[a], 8);
+    v[c] = v[c] + v[d];
+    v[b] = rotr32(v[b] ^ v[c], 7);
+}
+
+/**
+ * @brief Compresses a block.
+ *
+ * @param cv The input chaining value
+ * @param block The block, padded with zeros
+ * @param block_len The block length before padding
+ * @param counter The chunk index, or the output block index for the root node
+ * @param flags The domain separation flags
+ * @param[out] out The output chaining value
+ *
+ * @return No return
+ **/
+static void compress(
+    const uint32_t cv[8],
+    const uint8_t block[BLAKE3_BLOCK_LEN],
+    const uint8_t block_len,
+    const uint64_t counter,
+    const uint8_t flags,
+    uint32_t out[8]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = read_le32(block + 4 * i);
+    }
+    uint32_t v[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        IV[0], IV[1], IV[2], IV[3], (uint32_t)counter, (uint32_t)(counter >> 32), block_len, flags
+    };
+    for (int r = 0; r < ROUNDS; ++r) {
+        const uint8_t* s = MSG_SCHEDULE[r];
+        g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+        g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+        g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+        g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; ++i) {
+        out[i] = v[i] ^ v[i + 8];
+    }
+}
+
+/**
+ * @brief Hashes several inputs of the same amount of whole blocks, e.g.
+ * chunks or parent nodes, one after the other.
+ *
+ * @param inputs The inputs
+ * @param count The amount of inputs
+ * @param blocks The amount of blocks of each input
+ * @param counter The counter of the first input
+ * @param increment_counter Whether each input uses the counter following the previous one
+ * @param flags The flags of all blocks
+ * @param flags_start The additional flags of the first block of each input
+ * @param flags_end The additional flags of the last block of each input
+ * @param[out] cvs The output chaining values, one per input
+ *
+ * @return No return
+ **/
+static void hash_many_portable(
+    const uint8_t* const* inputs,
+    size_t count,
+    size_t blocks,
+    uint64_t counter,
+    bool increment_counter,
+    uint8_t flags,
+    uint8_t flags_start,
+    uint8_t flags_end,
+    uint8_t (*cvs)[BLAKE3_CV_LEN]) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t cv[8];
+        memcpy(cv, IV, sizeof(IV));
+        uint8_t block_flags = flags | flags_start;
+        for (size_t block = 0; block < blocks; ++block) {
+            if (block + 1 == blocks) {
+                block_flags |= flags_end;
+            }
+            compress(cv, inputs[i] + block * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN,
+                counter + (increment_counter ? i : 0), block_flags, cv);
+            block_flags = flags;
+        }
+        store_cv(cvs[i], cv);
+    }
+}
+
+#if defined(BLAKE3_AVX2)
+#define ROTR16_MASK 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13
+#define ROTR8_MASK 1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12
+
+/**
+ * @brief Transposes a 8x8 matrix of 32 bits words, in place.
+ *
+ * @param rows The matrix rows
+ *
+ * @return No return
+ **/
+__attribute__((target("avx2")))
+static inline void transpose8(__m256i rows[8]) {
+    const __m256i ab_0145 = _mm256_unpacklo_epi32(rows[0], rows[1]);
+    const __m256i ab_2367 = _mm256_unpackhi_epi32(rows[0], rows[1]);
+    const __m256i cd_0145 = _mm256_unpacklo_epi32(rows[2], rows[3]);
+    const __m256i cd_2367 = _mm256_unpackhi_epi32(rows[2], rows[3]);
+    const __m256i ef_0145 = _mm256_unpacklo_epi32(rows[4], rows[5]);
+    const __m256i ef_2367 = _mm256_unpackhi_epi32(rows[4], rows[5]);
+    const __m256i gh_0145 = _mm256_unpacklo_epi32(rows[6], rows[7]);
+    const __m256i gh_2367 = _mm256_unpackhi_epi32(rows[6], rows[7]);
+
+    const __m256i abcd_04 = _mm256_unpacklo_epi64(ab_0145, cd_0145);
+    const __m256i abcd_15 = _mm256_unpackhi_epi64(ab_0145, cd_0145);
+    const __m256i abcd_26 = _mm256_unpacklo_epi64(ab_2367, cd_2367);
+    const __m256i abcd_37 = _mm256_unpackhi_epi64(ab_2367, cd_2367);
+    const __m256i efgh_04 = _mm256_unpacklo_epi64(ef_0145, gh_0145);
+    const __m256i efgh_15 = _mm256_unpackhi_epi64(ef_0145, gh_0145);
+    const __m256i efgh_26 = _mm256_unpacklo_epi64(ef_2367, gh_2367);
+    const __m256i efgh_37 = _mm256_unpackhi_epi64(ef_2367, gh_2367);
+
+    rows[0] = _mm256_permute2x128_si256(abcd_04, efgh_04, 0x20);
+    rows[1] = _mm256_permute2x128_si256(abcd_15, efgh_15, 0x20);
+    rows[2] = _mm256_permute2x128_si256(abcd_26, efgh_26, 0x20);
+    rows[3] = _mm256_permute2x128_si256(abcd_37, efgh_37, 0x20);
+    rows[4] = _mm256_permute2x128_si256(abcd_04, efgh_04, 0x31);
+    rows[5] = _mm256_permute2x128_si256(abcd_15, efgh_15, 0x31);
+    rows[6] = _mm256_permute2x128_si256(abcd_26, efgh_26, 0x31);
+    rows[7] = _mm256_permute2x128_si256(abcd_37, efgh_37, 0x31);
+}
+
+__attribute__((target("avx2")))
+static inline void g8(__m256i* v, int a, int b, int c, int d, __m256i x, __m256i y) {
+    const __m256i rotr16 = _mm256_setr_epi8(ROTR16_MASK, ROTR16_MASK);
+    const __m256i rotr8 = _mm256_setr_epi8(ROTR8_MASK, ROTR8_MASK);
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), x);
+    v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rotr16);
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = _mm256_xor_si256(v[b], v[c]);
+    v[b] = _mm256_or_si256(_mm256_srli_epi32(v[b], 12), _mm256_slli_epi32(v[b], 20));
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), y);
+    v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rotr8);
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = _mm256_xor_si256(v[b], v[c]);
+    v[b] = _mm256_or_si256(_mm256_srli_epi32(v[b], 7), _mm256_slli_epi32(v[b], 25));
+}
+
+/* Rounds are unrolled by hand, so that the message schedule is resolved at compile time */
+#define ROUND8(v, m, r) \
+    do { \
+        g8(v, 0, 4, 8, 12, m[MSG_SCHEDULE[r][0]], m[MSG_SCHEDULE[r][1]]); \
+        g8(v, 1, 5, 9, 13, m[MSG_SCHEDULE[r][2]], m[MSG_SCHEDULE[r][3]]); \
+        g8(v, 2, 6, 10, 14, m[MSG_SCHEDULE[r][4]], m[MSG_SCHEDULE[r][5]]); \
+        g8(v, 3, 7, 11, 15, m[MSG_SCHEDULE[r][6]], m[MSG_SCHEDULE[r][7]]); \
+        g8(v, 0, 5, 10, 15, m[MSG_SCHEDULE[r][8]], m[MSG_SCHEDULE[r][9]]); \
+        g8(v, 1, 6, 11, 12, m[MSG_SCHEDULE[r][10]], m[MSG_SCHEDULE[r][11]]); \
+        g8(v, 2, 7, 8, 13, m[MSG_SCHEDULE[r][12]], m[MSG_SCHEDULE[r][13]]); \
+        g8(v, 3, 4, 9, 14, m[MSG_SCHEDULE[r][14]], m[MSG_SCHEDULE[r][15]]); \
+    } while (0)
+
+/**
+ * @brief Hashes up to LANES inputs with AVX2, one input per 32 bits lane.
+ * @see hash_many_portable()
+ *
+ * @param inputs The inputs, exactly LANES of them
+ * @param count The amount of chaining values to be stored
+ **/
+__attribute__((target("avx2")))
+static void hash8_avx2(
+    const uint8_t* const* inputs,
+    size_t count,
+    size_t blocks,
+    uint64_t counter,
+    bool increment_counter,
+    uint8_t flags,
+    uint8_t flags_start,
+    uint8_t flags_end,
+    uint8_t (*cvs)[BLAKE3_CV_LEN]) {
+    __m256i h[8];
+    for (int i = 0; i < 8; ++i) {
+        h[i] = _mm256_set1_epi32((int)IV[i]);
+    }
+    uint32_t counter_low[LANES];
+    uint32_t counter_high[LANES];
+    for (int lane = 0; lane < LANES; ++lane) {
+        const uint64_t lane_counter = counter + (increment_counter ? lane : 0);
+        counter_low[lane] = (uint32_t)lane_counter;
+        counter_high[lane] = (uint32_t)(lane_counter >> 32);
+    }
+    const __m256i counter_low_vec = _mm256_loadu_si256((const __m256i*)counter_low);
+    const __m256i counter_high_vec = _mm256_loadu_si256((const __m256i*)counter_high);
+    const __m256i block_len_vec = _mm256_set1_epi32(BLAKE3_BLOCK_LEN);
+
+    uint8_t block_flags = flags | flags_start;
+    for (size_t block = 0; block < blocks; ++block) {
+        if (block + 1 == blocks) {
+            block_flags |= flags_end;
+        }
+        __m256i m[16];
+        for (int lane = 0; lane < LANES; ++lane) {
+            const uint8_t* p = inputs[lane] + block * BLAKE3_BLOCK_LEN;
+            m[lane] = _mm256_loadu_si256((const __m256i*)p);
+            m[8 + lane] = _mm256_loadu_si256((const __m256i*)(p + 32));
+        }
+        transpose8(m);
+        transpose8(m + 8);
+
+        __m256i v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            _mm256_set1_epi32((int)IV[0]), _mm256_set1_epi32((int)IV[1]),
+            _mm256_set1_epi32((int)IV[2]), _mm256_set1_epi32((int)IV[3]),
+            counter_low_vec, counter_high_vec, block_len_vec, _mm256_set1_epi32(block_flags)
+        };
+        ROUND8(v, m, 0);
+        ROUND8(v, m, 1);
+        ROUND8(v, m, 2);
+        ROUND8(v, m, 3);
+        ROUND8(v, m, 4);
+        ROUND8(v, m, 5);
+        ROUND8(v, m, 6);
+        for (int i = 0; i < 8; ++i) {
+            h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+        }
+        block_flags = flags;
+    }
+
+    /* Chaining values are stored as little endian words, which is the x86 byte order */
+    transpose8(h);
+    for (size_t lane = 0; lane < count; ++lane) {
+        _mm256_storeu_si256((__m256i*)cvs[lane], h[lane]);
+    }
+}
+
+/**
+ * @brief Hashes several inputs with AVX2, LANES at a time.
+ * @see hash_many_portable()
+ **/
+static void hash_many_avx2(
+    const uint8_t* const* inputs,
+    size_t count,
+    size_t blocks,
+    uint64_t counter,
+    bool increment_counter,
+    uint8_t flags,
+    uint8_t flags_start,
+    uint8_t flags_end,
+    uint8_t (*cvs)[BLAKE3_CV_LEN]) {
+    for (size_t i = 0; i < count; i += LANES) {
+        /* Missing inputs of the last group are replaced by the first one, their results are dropped */
+        const uint8_t* lane_inputs[LANES];
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            lane_inputs[lane] = inputs[i + (i + lane < count ? lane : 0)];
+        }
+        hash8_avx2(lane_inputs, MIN(count - i, LANES), blocks, counter + (increment_counter ? i : 0),
+            increment_counter, flags, flags_start, flags_end, cvs + i);
+    }
+}
+#endif
+
+/**
+ * @brief Chooses the fastest implementation supported by the running CPU.
+ *
+ * @return No return
+ **/
+static void select_kernel() {
+    hash_many = hash_many_portable;
+    kernel_name = "portable";
+    if (is_portable_checksum_forced()) {
+        return;
+    }
+#if defined(BLAKE3_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        hash_many = hash_many_avx2;
+        kernel_name = "avx2";
+    }
+#endif
+}
+
+static inline size_t get_chunk_length(const blake3_state_t* state) {
+    return (size_t)state->blocks_compressed * BLAKE3_BLOCK_LEN + state->block_len;
+}
+
+static inline uint8_t get_chunk_start_flag(const blake3_state_t* state) {
+    return state->blocks_compressed == 0 ? CHUNK_START : 0;
+}
+
+/**
+ * @brief Adds data to the current chunk. A block is compressed only when
+ * more data follows, since the last one is compressed with different flags.
+ *
+ * @param state The hasher state
+ * @param data The data
+ * @param length The data length, not exceeding the chunk
+ *
+ * @return No return
+ **/
+static void update_chunk(blake3_state_t* state, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        if (state->block_len == BLAKE3_BLOCK_LEN) {
+            compress(state->cv, state->block, BLAKE3_BLOCK_LEN, state->chunk_counter,
+                get_chunk_start_flag(state), state->cv);
+            state->blocks_compressed++;
+            state->block_len = 0;
+        }
+        const size_t take = MIN((size_t)(BLAKE3_BLOCK_LEN - state->block_len), length);
+        memcpy(state->block + state->block_len, data, take);
+        state->block_len += take;
+        data += take;
+        length -= take;
+    }
+}
+
+/**
+ * @brief Completes the current chunk and starts the following one.
+ *
+ * @param state The hasher state
+ * @param[out] cv The chaining value of the completed chunk
+ *
+ * @return No return
+ **/
+static void finish_chunk(blake3_state_t* state, uint8_t cv[BLAKE3_CV_LEN]) {
+    uint32_t chunk_cv[8];
+    compress(state->cv, state->block, state->block_len, state->chunk_counter,
+        get_chunk_start_flag(state) | CHUNK_END, chunk_cv);
+    store_cv(cv, chunk_cv);
+    memcpy(state->cv, IV, sizeof(IV));
+    state->chunk_counter++;
+    state->block_len = 0;
+    state->blocks_compressed = 0;
+}
+
+/**
+ * @brief Merges the stacked subtrees that are complete, leaving one
+ * chaining value per bit set in total_chunks.
+ *
+ * @param state The hasher state
+ * @param total_chunks The amount of chunks hashed so far
+ *
+ * @return No return
+ **/
+static void merge_cv_stack(blake3_state_t* state, const uint64_t total_chunks) {
+    const int post_merge_len = __builtin_popcountll(total_chunks);
+    while (state->cv_stack_len > post_merge_len) {
+        /* Both children are adjacent on the stack, so they already form the parent block */
+        uint8_t* left = state->cv_stack[state->cv_stack_len - 2];
+        uint32_t parent_cv[8];
+        compress(IV, left, BLAKE3_BLOCK_LEN, 0, PARENT, parent_cv);
+        store_cv(left, parent_cv);
+        state->cv_stack_len--;
+    }
+}
+
+/**
+ * @brief Stacks the chaining value of a subtree. The stack is merged
+ * lazily, i.e. before pushing, so the last subtree is never merged
+ * until more input proves that it is not the root.
+ *
+ * @param state The hasher state
+ * @param cv The subtree chaining value
+ * @param chunk_counter The index of the first chunk of the subtree
+ *
+ * @return No return
+ **/
+static void push_cv(blake3_state_t* state, const uint8_t cv[BLAKE3_CV_LEN], const uint64_t chunk_counter) {
+    merge_cv_stack(state, chunk_counter);
+    memcpy(state->cv_stack[state->cv_stack_len++], cv, BLAKE3_CV_LEN);
+}
+
+/**
+ * @brief Hashes a subtree of whole chunks down to the chaining values of its two children.
+ *
+ * @param data The subtree data
+ * @param chunks The amount of chunks, a power of 2 from 2 to MAX_SUBTREE_CHUNKS
+ * @param chunk_counter The index of the first chunk
+ * @param[out] cvs The chaining values of the left and right children, followed by scratch space
+ *
+ * @return No return
+ **/
+static void hash_subtree(const uint8_t* data, size_t chunks, const uint64_t chunk_counter, uint8_t (*cvs)[BLAKE3_CV_LEN]) {
+    const uint8_t* inputs[MAX_SUBTREE_CHUNKS];
+    for (size_t i = 0; i < chunks; ++i) {
+        inputs[i] = data + i * BLAKE3_CHUNK_LEN;
+    }
+    hash_many(inputs, chunks, BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, chunk_counter, true, 0, CHUNK_START, CHUNK_END, cvs);
+
+    /* Each level is hashed in place: parent i only overwrites children already hashed */
+    for (; chunks > 2; chunks /= 2) {
+        for (size_t i = 0; i < chunks / 2; ++i) {
+            inputs[i] = cvs[2 * i];
+        }
+        hash_many(inputs, chunks / 2, 1, 0, false, PARENT, 0, 0, cvs);
+    }
+}
+
+void blake3_init(blake3_state_t* state) {
+    pthread_once(&kernel_once, select_kernel);
+    memcpy(state->cv, IV, sizeof(IV));
+    state->chunk_counter = 0;
+    state->block_len = 0;
+    state->blocks_compressed = 0;
+    state->cv_stack_len = 0;
+}
+
+void blake3_update(blake3_state_t* state, const uint8_t* data, size_t length) {
+    uint8_t cvs[MAX_SUBTREE_CHUNKS][BLAKE3_CV_LEN];
+
+    /* Complete the pending chunk first, only if more input follows since it may be the root */
+    if (get_chunk_length(state) > 0) {
+        const size_t take = MIN(BLAKE3_CHUNK_LEN - get_chunk_length(state), length);
+        update_chunk(state, data, take);
+        data += take;
+        length -= take;
+        if (length == 0) {
+            return;
+        }
+        const uint64_t chunk_counter = state->chunk_counter;
+        finish_chunk(state, cvs[0]);
+        push_cv(state, cvs[0], chunk_counter);
+    }
+
+    /* Then hash the largest subtrees allowed by the input length and the chunk alignment */
+    while (length > BLAKE3_CHUNK_LEN) {
+        size_t chunks = MAX_SUBTREE_CHUNKS;
+        while (chunks > length / BLAKE3_CHUNK_LEN || (state->chunk_counter & (chunks - 1)) != 0) {
+            chunks /= 2;
+        }
+        const uint64_t chunk_counter = state->chunk_counter;
+        if (chunks == 1) {
+            update_chunk(state, data, BLAKE3_CHUNK_LEN);
+            finish_chunk(state, cvs[0]);
+            push_cv(state, cvs[0], chunk_counter);
+        } else {
+            hash_subtree(data, chunks, chunk_counter, cvs);
+            push_cv(state, cvs[0], chunk_counter);
+            push_cv(state, cvs[1], chunk_counter + chunks / 2);
+            state->chunk_counter += chunks;
+        }
+        data += chunks * BLAKE3_CHUNK_LEN;
+        length -= chunks * BLAKE3_CHUNK_LEN;
+    }
+
+    if (length > 0) {
+        update_chunk(state, data, length);
+        merge_cv_stack(state, state->chunk_counter);
+    }
+}
+
+void blake3_final(const blake3_state_t* state, uint8_t* checksum) {
+    /* The root node is the last chunk if alone, else the parent rolling up all the stacked subtrees */
+    uint32_t input_cv[8];
+    uint8_t block[BLAKE3_BLOCK_LEN] = {0};
+    uint8_t block_len = 0;
+    uint64_t counter = 0;
+    uint8_t flags = 0;
+    size_t remaining = state->cv_stack_len;
+    if (get_chunk_length(state) > 0 || remaining == 0) {
+        memcpy(input_cv, state->cv, sizeof(input_cv));
+        memcpy(block, state->block, state->block_len);
+        block_len = state->block_len;
+        counter = state->chunk_counter;
+        flags = get_chunk_start_flag(state) | CHUNK_END;
+    } else {
+        /* Input ended on a subtree boundary, so the two last stacked subtrees were not merged yet */
+        remaining -= 2;
+        memcpy(input_cv, IV, sizeof(IV));
+        memcpy(block, state->cv_stack[remaining], BLAKE3_BLOCK_LEN);
+        block_len = BLAKE3_BLOCK_LEN;
+        flags = PARENT;
+    }
+
+    while (remaining > 0) {
+        --remaining;
+        uint32_t cv[8];
+        compress(input_cv, block, block_len, counter, flags, cv);
+        memcpy(block, state->cv_stack[remaining], BLAKE3_CV_LEN);
+        store_cv(block + BLAKE3_CV_LEN, cv);
+        memcpy(input_cv, IV, sizeof(IV));
+        block_len = BLAKE3_BLOCK_LEN;
+        counter = 0;
+        flags = PARENT;
+    }
+
+    uint32_t root[8];
+    compress(input_cv, block, block_len, 0, flags | ROOT, root);
+    store_cv(checksum, root);
+}
+
+const char* blake3_kernel() {
+    pthread_once(&kernel_once, select_kernel);
+    return kernel_name;
+}
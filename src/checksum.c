@@ -0,0 +1,116 @@
+#define OPENSSL_API_COMPAT 10101 //SHA512_Init and friends, deprecated since OpenSSL 3.0
+#include <string.h> //strcmp
+#include <stdlib.h> //getenv
+
+#include "checksum_imp.h"
+
+bool is_portable_checksum_forced() {
+    return getenv(CHECKSUM_PORTABLE_ENV) != NULL;
+}
+
+bool is_checksum_supported(const long algorithm) {
+    return algorithm >= CHECKSUM_SHA512 && algorithm <= CHECKSUM_CRC32C;
+}
+
+checksum_algorithm get_checksum_by_name(const char* name) {
+    for (checksum_algorithm algorithm = CHECKSUM_SHA512; algorithm <= CHECKSUM_CRC32C; ++algorithm) {
+        if (strcmp(name, get_checksum_name(algorithm)) == 0) {
+            return algorithm;
+        }
+    }
+    return 0;
+}
+
+const char* get_checksum_name(const checksum_algorithm algorithm) {
+    switch (algorithm) {
+    case CHECKSUM_SHA512:
+        return "sha512";
+    case CHECKSUM_BLAKE3:
+        return "blake3";
+    case CHECKSUM_XXH3_128:
+        return "xxh3";
+    case CHECKSUM_CRC32C:
+        return "crc32c";
+    }
+    return "unknown";
+}
+
+const char* get_checksum_kernel(const checksum_algorithm algorithm) {
+    switch (algorithm) {
+    case CHECKSUM_SHA512:
+        return "openssl";
+    case CHECKSUM_BLAKE3:
+        return blake3_kernel();
+    case CHECKSUM_XXH3_128:
+        return xxh3_128_kernel();
+    case CHECKSUM_CRC32C:
+        return crc32c_kernel();
+    }
+    return "unknown";
+}
+
+size_t get_checksum_length(const checksum_algorithm algorithm) {
+    switch (algorithm) {
+    case CHECKSUM_SHA512:
+        return SHA512_DIGEST_LENGTH;
+    case CHECKSUM_BLAKE3:
+        return BLAKE3_LENGTH;
+    case CHECKSUM_XXH3_128:
+        return XXH3_128_LENGTH;
+    case CHECKSUM_CRC32C:
+        return CRC32C_LENGTH;
+    }
+    return 0;
+}
+
+void checksum_init(checksum_ctx_t* ctx, const checksum_algorithm algorithm) {
+    ctx->algorithm = algorithm;
+    switch (algorithm) {
+    case CHECKSUM_SHA512:
+        SHA512_Init(&ctx->state.sha512);
+        break;
+    case CHECKSUM_BLAKE3:
+        blake3_init(&ctx->state.blake3);
+        break;
+    case CHECKSUM_XXH3_128:
+        xxh3_128_init(&ctx->state.xxh3);
+        break;
+    case CHECKSUM_CRC32C:
+        crc32c_init(&ctx->state.crc32c);
+        break;
+    }
+}
+
+void checksum_update(checksum_ctx_t* ctx, const uint8_t* data, const size_t length) {
+    switch (ctx->algorithm) {
+    case CHECKSUM_SHA512:
+        SHA512_Update(&ctx->state.sha512, data, length);
+        break;
+    case CHECKSUM_BLAKE3:
+        blake3_update(&ctx->state.blake3, data, length);
+        break;
+    case CHECKSUM_XXH3_128:
+        xxh3_128_update(&ctx->state.xxh3, data, length);
+        break;
+    case CHECKSUM_CRC32C:
+        crc32c_update(&ctx->state.crc32c, data, length);
+        break;
+    }
+}
+
+void checksum_final(checksum_ctx_t* ctx, uint8_t* checksum) {
+    switch (ctx->algorithm) {
+    case CHECKSUM_SHA512:
+        SHA512_Final(checksum, &ctx->state.sha512);
+        break;
+    case CHECKSUM_BLAKE3:
+        blake3_final(&ctx->state.blake3, checksum);
+        break;
+    case CHECKSUM_XXH3_128:
+        xxh3_128_final(&ctx->state.xxh3, checksum);
+        break;
+    case CHECKSUM_CRC32C:
+        crc32c_final(&ctx->state.crc32c, checksum);
+        break;
+    }
+}
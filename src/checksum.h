@@ -0,0 +1,138 @@
+#ifndef _CHECKSUM_H_
+#define _CHECKSUM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <openssl/sha.h>
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+typedef enum {
+    CHECKSUM_SHA512 = 1, ///< the SHA-512 cryptographic digest, the protocol default
+    CHECKSUM_BLAKE3, ///< the BLAKE3 cryptographic digest, 32 bytes long
+    CHECKSUM_XXH3_128, ///< the XXH3 128 bits non-cryptographic hash
+    CHECKSUM_CRC32C ///< the CRC-32C (Castagnoli) checksum
+} checksum_algorithm;
+
+#define CHECKSUM_DEFAULT CHECKSUM_SHA512 ///< the algorithm used when none was negotiated
+#define CHECKSUM_MAX_LENGTH SHA512_DIGEST_LENGTH ///< the length of the longest checksum
+
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_CV_LEN 32 ///< the length of a chaining value, i.e. of an inner node hash
+#define BLAKE3_MAX_DEPTH 54 ///< the height of the tree of 2^64 bytes long inputs
+
+typedef struct {
+    uint32_t cv[8]; ///< the chaining value of the current chunk
+    uint64_t chunk_counter; ///< the index of the current chunk
+    uint8_t block[BLAKE3_BLOCK_LEN]; ///< the pending bytes of the current block
+    uint8_t block_len; ///< the amount of pending bytes
+    uint8_t blocks_compressed; ///< the amount of compressed blocks of the current chunk
+    uint8_t cv_stack[BLAKE3_MAX_DEPTH + 1][BLAKE3_CV_LEN]; ///< the chaining values of subtrees not merged yet
+    uint8_t cv_stack_len; ///< the amount of stacked chaining values
+} blake3_state_t;
+
+#define XXH3_STRIPE_LEN 64
+#define XXH3_BUFFER_LEN 256
+
+typedef struct {
+    uint64_t acc[8]; ///< the accumulators
+    uint8_t buffer[XXH3_BUFFER_LEN]; ///< the input not consumed yet, always holding the last stripe
+    size_t buffered; ///< the amount of buffered bytes
+    size_t stripes_so_far; ///< the amount of stripes consumed in the current block
+    uint64_t total_len; ///< the amount of hashed bytes
+} xxh3_state_t;
+
+typedef struct {
+    checksum_algorithm algorithm; ///< the algorithm in use
+    union {
+        SHA512_CTX sha512;
+        blake3_state_t blake3;
+        xxh3_state_t xxh3;
+        uint32_t crc32c;
+    } state; ///< the algorithm-specific state
+} checksum_ctx_t;
+
+/**
+ * @brief Checks whether an algorithm identifier, as received from a peer, is supported.
+ *
+ * @param algorithm The algorithm identifier
+ *
+ * @return true if algorithm is supported
+ * @return false otherwise
+ **/
+bool is_checksum_supported(const long algorithm);
+
+/**
+ * @brief Gets the algorithm identified by a name, as given on command line.
+ *
+ * @param name The algorithm name: sha512, blake3, xxh3 or crc32c
+ *
+ * @return the algorithm
+ * @return 0 if name is unknown
+ **/
+checksum_algorithm get_checksum_by_name(const char* name);
+
+/**
+ * @brief Gets the algorithm name.
+ *
+ * @param algorithm The given algorithm
+ *
+ * @return the algorithm name
+ **/
+const char* get_checksum_name(const checksum_algorithm algorithm);
+
+/**
+ * @brief Gets the name of the implementation chosen for the running CPU,
+ * e.g. "avx2" or "portable".
+ *
+ * @param algorithm The given algorithm
+ *
+ * @return the implementation name
+ **/
+const char* get_checksum_kernel(const checksum_algorithm algorithm);
+
+/**
+ * @brief Gets the length of the checksums computed by an algorithm.
+ *
+ * @param algorithm The given algorithm
+ *
+ * @return the checksum length, up to CHECKSUM_MAX_LENGTH
+ **/
+size_t get_checksum_length(const checksum_algorithm algorithm);
+
+/**
+ * @brief Starts a new checksum computation.
+ *
+ * @param[out] ctx The checksum context
+ * @param algorithm The algorithm to be used
+ *
+ * @return No return
+ **/
+void checksum_init(checksum_ctx_t* ctx, const checksum_algorithm algorithm);
+
+/**
+ * @brief Adds data to a checksum computation.
+ *
+ * @param ctx The checksum context
+ * @param data The data
+ * @param length The data length
+ *
+ * @return No return
+ **/
+void checksum_update(checksum_ctx_t* ctx, const uint8_t* data, const size_t length);
+
+/**
+ * @brief Gets the checksum of all added data. The context shall be
+ * initialized again before being reused.
+ *
+ * @param ctx The checksum context
+ * @param[out] checksum The checksum, get_checksum_length() bytes long
+ *
+ * @return No return
+ **/
+void checksum_final(checksum_ctx_t* ctx, uint8_t* checksum);
+
+#endif /* _CHECKSUM_H_ */
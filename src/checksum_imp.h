@@ -0,0 +1,92 @@
+#ifndef _CHECKSUM_IMP_H_
+#define _CHECKSUM_IMP_H_
+
+#include "checksum.h"
+
+#define BLAKE3_LENGTH 32
+#define XXH3_128_LENGTH 16
+#define CRC32C_LENGTH 4
+#define CHECKSUM_PORTABLE_ENV "CHECKSUM_PORTABLE" ///< when set, SIMD and hardware implementations are not used
+
+/**
+ * @brief Checks whether the portable implementations were requested through
+ * the CHECKSUM_PORTABLE_ENV environment variable, e.g. for benchmarking.
+ *
+ * @return true if portable implementations shall be used
+ * @return false otherwise
+ **/
+bool is_portable_checksum_forced();
+
+/**
+ * @brief Implements checksum_init() for CHECKSUM_BLAKE3
+ * @see checksum_init()
+ */
+void blake3_init(blake3_state_t* state);
+
+/**
+ * @brief Implements checksum_update() for CHECKSUM_BLAKE3
+ * @see checksum_update()
+ */
+void blake3_update(blake3_state_t* state, const uint8_t* data, size_t length);
+
+/**
+ * @brief Implements checksum_final() for CHECKSUM_BLAKE3
+ * @see checksum_final()
+ */
+void blake3_final(const blake3_state_t* state, uint8_t* checksum);
+
+/**
+ * @brief Implements get_checksum_kernel() for CHECKSUM_BLAKE3
+ * @see get_checksum_kernel()
+ */
+const char* blake3_kernel();
+
+/**
+ * @brief Implements checksum_init() for CHECKSUM_XXH3_128
+ * @see checksum_init()
+ */
+void xxh3_128_init(xxh3_state_t* state);
+
+/**
+ * @brief Implements checksum_update() for CHECKSUM_XXH3_128
+ * @see checksum_update()
+ */
+void xxh3_128_update(xxh3_state_t* state, const uint8_t* data, size_t length);
+
+/**
+ * @brief Implements checksum_final() for CHECKSUM_XXH3_128
+ * @see checksum_final()
+ */
+void xxh3_128_final(const xxh3_state_t* state, uint8_t* checksum);
+
+/**
+ * @brief Implements get_checksum_kernel() for CHECKSUM_XXH3_128
+ * @see get_checksum_kernel()
+ */
+const char* xxh3_128_kernel();
+
+/**
+ * @brief Implements checksum_init() for CHECKSUM_CRC32C
+ * @see checksum_init()
+ */
+void crc32c_init(uint32_t* state);
+
+/**
+ * @brief Implements checksum_update() for CHECKSUM_CRC32C
+ * @see checksum_update()
+ */
+void crc32c_update(uint32_t* state, const uint8_t* data, size_t length);
+
+/**
+ * @brief Implements checksum_final() for CHECKSUM_CRC32C
+ * @see checksum_final()
+ */
+void crc32c_final(const uint32_t* state, uint8_t* checksum);
+
+/**
+ * @brief Implements get_checksum_kernel() for CHECKSUM_CRC32C
+ * @see get_checksum_kernel()
+ */
+const char* crc32c_kernel();
+
+#endif /* _CHECKSUM_IMP_H_ */
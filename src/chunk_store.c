@@ -0,0 +1,405 @@
+#include <stdlib.h>
+#include <string.h> //memcpy
+
+#include "chunk_store.h"
+#include "fastcdc.h"
+#include "sal.h"
+#include "trace.h"
+#include "common.h"
+
+#define CHUNK_MANIFEST_HEADER "chunk-manifest 1" ///< the first line of a manifest, followed by the file size
+#define CHUNK_PATH_LEN (MAX_PATH_LEN + sizeof(CHUNK_STORE_DIR) + 2 * CHUNK_HASH_LENGTH + 32)
+
+struct Schunk_writer {
+    const char* storage_dir; ///< the storage directory
+    FILE* manifest; ///< the manifest file
+    long file_size; ///< the file size
+    checksum_ctx_t* checksum_ctx; ///< the file checksum
+    uint8_t buffer[FASTCDC_MAX_LEN]; ///< the content of the chunk being received
+    size_t buffered; ///< the buffered content length
+    bool written; ///< whether some file content was received
+    uint8_t* entries; ///< the chunks of the current batch, NULL if the writer cuts chunks itself
+    long chunk_count; ///< the amount of chunks announced in the current batch
+    long first_chunk; ///< the index in the file of the first chunk of the current batch
+    long announced_length; ///< the total length of the announced chunks
+    bool listed; ///< whether the current batch was announced whole
+    uint8_t missing[CHUNK_LIST_BATCH_LEN / 8]; ///< a bit per chunk of the current batch, set if the store is missing it
+    long next_chunk; ///< the first chunk of the current batch not stored yet
+};
+
+/**
+ * @brief Builds the path of a chunk: chunks are spread over 256 directories,
+ * named after the first byte of their hash.
+ *
+ * @param storage_dir The storage directory
+ * @param hash The chunk hash
+ * @param[out] path The chunk path, CHUNK_PATH_LEN long
+ * @param[out] dir The chunk directory path, CHUNK_PATH_LEN long, or NULL
+ *
+ * @return No return
+ **/
+static void get_chunk_path(const char* storage_dir, const uint8_t* hash, char* path, char* dir) {
+    char hex[2 * CHUNK_HASH_LENGTH + 1];
+    for (int i = 0; i < CHUNK_HASH_LENGTH; ++i) {
+        snprintf(hex + 2 * i, 3, "%02x", hash[i]);
+    }
+    snprintf(path, CHUNK_PATH_LEN, "%s/%s/%.2s/%s", storage_dir, CHUNK_STORE_DIR, hex, hex + 2);
+    if (dir) {
+        snprintf(dir, CHUNK_PATH_LEN, "%s/%s/%.2s", storage_dir, CHUNK_STORE_DIR, hex);
+    }
+}
+
+/**
+ * @brief Checks whether the store has a chunk.
+ *
+ * @param storage_dir The storage directory
+ * @param hash The chunk hash
+ *
+ * @return true if the chunk is stored
+ * @return false otherwise
+ **/
+static bool has_chunk(const char* storage_dir, const uint8_t* hash) {
+    char path[CHUNK_PATH_LEN];
+    get_chunk_path(storage_dir, hash, path, NULL);
+    return sal_is_file_readable(path) == SAL_OK;
+}
+
+/**
+ * @brief Stores a chunk, unless the store has it. Chunks are written under a
+ * temporary name and renamed, so a chunk is either whole or missing, even
+ * when several connections store it at once.
+ *
+ * @param storage_dir The storage directory
+ * @param hash The chunk hash
+ * @param chunk The chunk
+ * @param length The chunk length
+ *
+ * @return true if the chunk is stored
+ * @return false otherwise
+ **/
+static bool put_chunk(const char* storage_dir, const uint8_t* hash, const uint8_t* chunk, const size_t length) {
+    char path[CHUNK_PATH_LEN];
+    char dir[CHUNK_PATH_LEN];
+    get_chunk_path(storage_dir, hash, path, dir);
+    if (sal_is_file_readable(path) == SAL_OK) {
+        return true;
+    }
+    uint64_t unique = 0;
+    char temp_path[CHUNK_PATH_LEN + 32];
+    if (sal_create_dir(dir) != SAL_OK || sal_get_random((uint8_t*)&unique, sizeof(unique)) != SAL_OK) {
+        return false;
+    }
+    snprintf(temp_path, sizeof(temp_path), "%s.%016llx.tmp", path, (unsigned long long)unique);
+    FILE* fp = fopen(temp_path, "wb");
+    if (fp == NULL) {
+        reset_error_description();
+        print_error("Storing chunk failed");
+        return false;
+    }
+    const bool written = trace_fwrite(chunk, 1, length, fp) == length;
+    if (fclose(fp) != 0 || !written || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        reset_error_description();
+        print_error("Storing chunk failed");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a stored chunk.
+ *
+ * @param storage_dir The storage directory
+ * @param hash The chunk hash
+ * @param[out] chunk The chunk
+ * @param length The chunk length
+ *
+ * @return true if the chunk was read successfully
+ * @return false otherwise
+ **/
+static bool get_chunk(const char* storage_dir, const uint8_t* hash, uint8_t* chunk, const size_t length) {
+    char path[CHUNK_PATH_LEN];
+    get_chunk_path(storage_dir, hash, path, NULL);
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        reset_error_description();
+        print_error("Reading chunk failed");
+        return false;
+    }
+    /* A stored chunk is never longer than announced, as its hash would differ */
+    const bool read = trace_fread(chunk, 1, length, fp) == length && fgetc(fp) == EOF;
+    fclose(fp);
+    if (!read) {
+        set_error_description("%s", path);
+        print_error("Invalid stored chunk");
+    }
+    return read;
+}
+
+/**
+ * @brief Adds a chunk to the file: to its checksum and to its manifest.
+ *
+ * @param writer The given writer
+ * @param hash The chunk hash
+ * @param chunk The chunk
+ * @param length The chunk length
+ *
+ * @return true if the chunk was added successfully
+ * @return false otherwise
+ **/
+static bool add_to_manifest(chunk_writer_t* writer, const uint8_t* hash, const uint8_t* chunk, const size_t length) {
+    trace_checksum_update(writer->checksum_ctx, chunk, length);
+    for (int i = 0; i < CHUNK_HASH_LENGTH; ++i) {
+        fprintf(writer->manifest, "%02x", hash[i]);
+    }
+    return fprintf(writer->manifest, " %zu\n", length) > 0;
+}
+
+/**
+ * @brief Stores a chunk and adds it to the file.
+ *
+ * @param writer The given writer
+ * @param chunk The chunk
+ * @param length The chunk length
+ * @param expected_hash The hash announced by the client, or NULL
+ *
+ * @return true if the chunk was stored successfully
+ * @return false otherwise
+ **/
+static bool store_chunk(chunk_writer_t* writer, const uint8_t* chunk, const size_t length, const uint8_t* expected_hash) {
+    uint8_t hash[CHUNK_HASH_LENGTH];
+    chunk_hash(chunk, length, hash);
+    /* Storing a chunk under another hash would corrupt every file sharing it */
+    if (expected_hash && memcmp(hash, expected_hash, CHUNK_HASH_LENGTH) != 0) {
+        set_error_description("Chunk %ld", writer->first_chunk + writer->next_chunk);
+        print_error("Chunk validation failed");
+        return false;
+    }
+    return put_chunk(writer->storage_dir, hash, chunk, length) && add_to_manifest(writer, hash, chunk, length);
+}
+
+/**
+ * @brief Reads the length of an announced chunk.
+ *
+ * @param writer The given writer
+ * @param chunk The chunk index
+ *
+ * @return the chunk length
+ **/
+static size_t get_entry_length(const chunk_writer_t* writer, const long chunk) {
+    const uint8_t* entry = writer->entries + chunk * CHUNK_ENTRY_LENGTH;
+    return (size_t)entry[0] << 24 | entry[1] << 16 | entry[2] << 8 | entry[3];
+}
+
+/**
+ * @brief Adds the announced chunks the store already has, up to the next
+ * missing one, to the file.
+ *
+ * @param writer The given writer
+ *
+ * @return true if the chunks were added successfully
+ * @return false otherwise
+ **/
+static bool add_stored_chunks(chunk_writer_t* writer) {
+    while (writer->next_chunk < writer->chunk_count &&
+           !(writer->missing[writer->next_chunk / 8] & (0x80 >> writer->next_chunk % 8))) {
+        const uint8_t* hash = writer->entries + writer->next_chunk * CHUNK_ENTRY_LENGTH + CHUNK_LENGTH_LENGTH;
+        const size_t length = get_entry_length(writer, writer->next_chunk);
+        if (!get_chunk(writer->storage_dir, hash, writer->buffer, length) ||
+            !add_to_manifest(writer, hash, writer->buffer, length)) {
+            return false;
+        }
+        ++writer->next_chunk;
+    }
+    return true;
+}
+
+void chunk_hash(const uint8_t* chunk, const size_t length, uint8_t* hash) {
+    checksum_ctx_t ctx;
+    checksum_init(&ctx, CHECKSUM_BLAKE3);
+    trace_checksum_update(&ctx, chunk, length);
+    checksum_final(&ctx, hash);
+}
+
+void chunk_write_entry(uint8_t* entry, const uint8_t* chunk, const size_t length) {
+    entry[0] = (length >> 24) & 0xFF;
+    entry[1] = (length >> 16) & 0xFF;
+    entry[2] = (length >> 8) & 0xFF;
+    entry[3] = length & 0xFF;
+    chunk_hash(chunk, length, entry + CHUNK_LENGTH_LENGTH);
+}
+
+bool chunk_store_init(const char* storage_dir) {
+    char dir[CHUNK_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%s/%s", storage_dir, CHUNK_STORE_DIR);
+    return sal_create_dir(dir) == SAL_OK;
+}
+
+chunk_writer_t* chunk_writer_create(
+    const char* storage_dir,
+    FILE* manifest,
+    const long file_size,
+    checksum_ctx_t* checksum_ctx) {
+    chunk_writer_t* writer = calloc(1, sizeof(chunk_writer_t));
+    if (writer == NULL) {
+        set_error_description("Out of memory");
+        print_error("Storing chunks failed");
+        return NULL;
+    }
+    writer->storage_dir = storage_dir;
+    writer->manifest = manifest;
+    writer->file_size = file_size;
+    writer->checksum_ctx = checksum_ctx;
+    if (fprintf(manifest, "%s %ld\n", CHUNK_MANIFEST_HEADER, file_size) < 0) {
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+void chunk_writer_destroy(chunk_writer_t* writer) {
+    if (writer) {
+        free(writer->entries);
+        free(writer);
+    }
+}
+
+bool chunk_writer_add_chunks(chunk_writer_t* writer, const uint8_t* entries, const size_t count, bool* complete) {
+    *complete = false;
+    if (writer->entries == NULL && writer->written) {
+        set_error_description("Unexpected chunk list");
+        return false;
+    }
+    if (writer->listed) {
+        /* The next batch follows the content of the missing chunks of this one */
+        if (writer->buffered > 0 || !add_stored_chunks(writer) || writer->next_chunk != writer->chunk_count) {
+            set_error_description("Unexpected chunk list");
+            return false;
+        }
+        writer->first_chunk += writer->chunk_count;
+        writer->chunk_count = 0;
+        writer->next_chunk = 0;
+        writer->listed = false;
+    }
+    if (writer->entries == NULL && (writer->entries = malloc(CHUNK_LIST_BATCH_LEN * CHUNK_ENTRY_LENGTH)) == NULL) {
+        set_error_description("Out of memory");
+        return false;
+    }
+    if (count > (size_t)(CHUNK_LIST_BATCH_LEN - writer->chunk_count)) {
+        set_error_description("Chunk list batch too long");
+        return false;
+    }
+    memcpy(writer->entries + writer->chunk_count * CHUNK_ENTRY_LENGTH, entries, count * CHUNK_ENTRY_LENGTH);
+    for (size_t i = 0; i < count; ++i) {
+        const size_t length = get_entry_length(writer, writer->chunk_count);
+        /* Only the last chunk of the file may be cut short of the minimum */
+        if (length == 0 || length > FASTCDC_MAX_LEN || writer->announced_length > writer->file_size - (long)length ||
+            (length < FASTCDC_MIN_LEN && writer->announced_length + (long)length != writer->file_size)) {
+            set_error_description("Invalid chunk list");
+            return false;
+        }
+        writer->announced_length += length;
+        ++writer->chunk_count;
+    }
+    if (writer->chunk_count < CHUNK_LIST_BATCH_LEN && writer->announced_length < writer->file_size) {
+        return true;
+    }
+
+    memset(writer->missing, 0, sizeof(writer->missing));
+    for (long chunk = 0; chunk < writer->chunk_count; ++chunk) {
+        const uint8_t* hash = writer->entries + chunk * CHUNK_ENTRY_LENGTH + CHUNK_LENGTH_LENGTH;
+        if (!has_chunk(writer->storage_dir, hash)) {
+            writer->missing[chunk / 8] |= 0x80 >> chunk % 8;
+        }
+    }
+    writer->listed = true;
+    *complete = true;
+    return true;
+}
+
+const uint8_t* chunk_writer_get_missing(const chunk_writer_t* writer, size_t* length) {
+    *length = (writer->chunk_count + 7) / 8;
+    return writer->missing;
+}
+
+bool chunk_writer_write(chunk_writer_t* writer, const uint8_t* content, const size_t length) {
+    size_t offset = 0;
+    writer->written = true;
+    if (writer->entries == NULL) {
+        while (offset < length) {
+            const size_t copied = MIN(length - offset, FASTCDC_MAX_LEN - writer->buffered);
+            memcpy(writer->buffer + writer->buffered, content + offset, copied);
+            writer->buffered += copied;
+            offset += copied;
+            if (writer->buffered == FASTCDC_MAX_LEN) {
+                const size_t cut = fastcdc_cut(writer->buffer, writer->buffered);
+                if (!store_chunk(writer, writer->buffer, cut, NULL)) {
+                    return false;
+                }
+                memmove(writer->buffer, writer->buffer + cut, writer->buffered - cut);
+                writer->buffered -= cut;
+            }
+        }
+        return true;
+    }
+
+    if (!writer->listed) {
+        set_error_description("Content before chunk list");
+        print_error("Protocol error");
+        return false;
+    }
+    while (offset < length) {
+        if (writer->buffered == 0 && !add_stored_chunks(writer)) {
+            return false;
+        }
+        if (writer->next_chunk == writer->chunk_count) {
+            set_error_description("More content than announced");
+            print_error("Protocol error");
+            return false;
+        }
+        const uint8_t* hash = writer->entries + writer->next_chunk * CHUNK_ENTRY_LENGTH + CHUNK_LENGTH_LENGTH;
+        const size_t chunk_length = get_entry_length(writer, writer->next_chunk);
+        /* Whole chunks are stored straight from the received content */
+        if (writer->buffered == 0 && length - offset >= chunk_length) {
+            if (!store_chunk(writer, content + offset, chunk_length, hash)) {
+                return false;
+            }
+            offset += chunk_length;
+            ++writer->next_chunk;
+            continue;
+        }
+        const size_t copied = MIN(length - offset, chunk_length - writer->buffered);
+        memcpy(writer->buffer + writer->buffered, content + offset, copied);
+        writer->buffered += copied;
+        offset += copied;
+        if (writer->buffered == chunk_length) {
+            if (!store_chunk(writer, writer->buffer, chunk_length, hash)) {
+                return false;
+            }
+            writer->buffered = 0;
+            ++writer->next_chunk;
+        }
+    }
+    return true;
+}
+
+bool chunk_writer_finish(chunk_writer_t* writer) {
+    if (writer->entries == NULL) {
+        while (writer->buffered > 0) {
+            const size_t cut = fastcdc_cut(writer->buffer, writer->buffered);
+            if (!store_chunk(writer, writer->buffer, cut, NULL)) {
+                return false;
+            }
+            memmove(writer->buffer, writer->buffer + cut, writer->buffered - cut);
+            writer->buffered -= cut;
+        }
+        return true;
+    }
+    if (!writer->listed || writer->buffered > 0 || !add_stored_chunks(writer) ||
+        writer->next_chunk != writer->chunk_count || writer->announced_length != writer->file_size) {
+        set_error_description("Missing chunk content");
+        print_error("Protocol error");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,136 @@
+#ifndef _CHUNK_STORE_H_
+#define _CHUNK_STORE_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "checksum.h"
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define CHUNK_STORE_DIR ".chunks" ///< the directory of the storage directory holding the chunks
+#define CHUNK_HASH_LENGTH 32 ///< the chunk key, its BLAKE3 hash
+#define CHUNK_LENGTH_LENGTH 4 ///< the chunk length leading a chunk entry
+#define CHUNK_ENTRY_LENGTH (CHUNK_LENGTH_LENGTH + CHUNK_HASH_LENGTH) ///< a chunk as announced by a client
+#define CHUNK_LIST_BATCH_LEN 8192 ///< the most chunks announced before the server replies which ones it is missing
+
+/**
+ * @brief Stores a file as a manifest of chunks: each chunk is kept once in
+ * the chunk store, named after its hash, and the manifest lists the chunks
+ * of the file in order. Chunks are either cut by the writer itself, with
+ * FastCDC, or announced by the client, which then only sends the chunks the
+ * store is missing.
+ **/
+typedef struct Schunk_writer chunk_writer_t;
+
+/**
+ * @brief Computes the key of a chunk.
+ *
+ * @param chunk The chunk
+ * @param length The chunk length
+ * @param[out] hash The chunk hash, CHUNK_HASH_LENGTH bytes long
+ *
+ * @return No return
+ **/
+void chunk_hash(const uint8_t* chunk, const size_t length, uint8_t* hash);
+
+/**
+ * @brief Writes a chunk entry, as announced by a client.
+ *
+ * @param[out] entry The entry, CHUNK_ENTRY_LENGTH bytes long
+ * @param chunk The chunk
+ * @param length The chunk length
+ *
+ * @return No return
+ **/
+void chunk_write_entry(uint8_t* entry, const uint8_t* chunk, const size_t length);
+
+/**
+ * @brief Creates the chunk store of a storage directory, unless it exists.
+ *
+ * @param storage_dir The storage directory
+ *
+ * @return true if the chunk store is usable
+ * @return false otherwise
+ **/
+bool chunk_store_init(const char* storage_dir);
+
+/**
+ * @brief Prepares the storage of a file as chunks.
+ * @note The created writer shall be released by chunk_writer_destroy().
+ *
+ * @param storage_dir The storage directory
+ * @param manifest The file the manifest is written to
+ * @param file_size The file size
+ * @param checksum_ctx The checksum the file content is added to, in file order
+ *
+ * @return the created writer
+ * @return NULL otherwise
+ **/
+chunk_writer_t* chunk_writer_create(
+    const char* storage_dir,
+    FILE* manifest,
+    const long file_size,
+    checksum_ctx_t* checksum_ctx);
+
+/**
+ * @brief Releases a writer.
+ *
+ * @param writer The given writer
+ *
+ * @return No return
+ **/
+void chunk_writer_destroy(chunk_writer_t* writer);
+
+/**
+ * @brief Adds chunks announced by the client. Chunks are announced in batches
+ * of CHUNK_LIST_BATCH_LEN, the last one ending the file: once a batch is
+ * complete, the writer looks up which of its chunks the store is missing, and
+ * the next batch may only follow their content.
+ *
+ * @param writer The given writer
+ * @param entries The chunk entries, CHUNK_ENTRY_LENGTH bytes each
+ * @param count The amount of entries
+ * @param[out] complete Whether the current batch is complete
+ *
+ * @return true if the entries are valid
+ * @return false otherwise
+ **/
+bool chunk_writer_add_chunks(chunk_writer_t* writer, const uint8_t* entries, const size_t count, bool* complete);
+
+/**
+ * @brief Gets which chunks of the current batch the client shall send.
+ *
+ * @param writer The given writer
+ * @param[out] length The bitmap length, a bit per chunk of the batch
+ *
+ * @return the bitmap, the most significant bit of its first byte standing for the first chunk
+ **/
+const uint8_t* chunk_writer_get_missing(const chunk_writer_t* writer, size_t* length);
+
+/**
+ * @brief Adds received file content: the content of the missing chunks of the
+ * current batch, in order, if chunks were announced, all file content otherwise.
+ *
+ * @param writer The given writer
+ * @param content The file content
+ * @param length The file content length
+ *
+ * @return true if the content was stored successfully
+ * @return false otherwise
+ **/
+bool chunk_writer_write(chunk_writer_t* writer, const uint8_t* content, const size_t length);
+
+/**
+ * @brief Stores the last chunks, once all file content was received.
+ *
+ * @param writer The given writer
+ *
+ * @return true if the whole file was stored successfully
+ * @return false otherwise
+ **/
+bool chunk_writer_finish(chunk_writer_t* writer);
+
+#endif /* _CHUNK_STORE_H_ */
@@ -1,30 +1,203 @@
 #include <stdio.h>
 #include <stdlib.h> //atoi
+#include <limits.h> //LONG_MAX
 #include <string.h> //str functions
-#include <openssl/sha.h> //sha512
+#include <pthread.h>
+#include <errno.h> //ETIMEDOUT
+#include <inttypes.h> //PRIu64
 
 #include "sal.h"
 #include "common.h"
 #include "tlv.h"
+#include "protocol.h"
+#include "digest.h"
+#include "checksum.h"
+#include "compress.h"
+#include "delta.h"
+#include "fastcdc.h"
+#include "chunk_store.h"
+#include "trace.h"
+#include "walker.h"
+#include "probes.h"
 
 /* ========================================================================== *
  * Data definitions                                                           *
  * ========================================================================== */
+/**
+ * @brief The progress of files sent through concurrent connections.
+ **/
+typedef struct {
+    unsigned long files_sent; ///< the files sent and acknowledged
+    unsigned long files_failed; ///< the files that could not be sent
+    uint64_t bytes_sent; ///< the size of the sent files
+    uint64_t start_ns; ///< when sending started
+    long running; ///< the connection workers still running
+    pthread_mutex_t lock; ///< guards running
+    pthread_cond_t finished; ///< signaled when a connection worker finishes
+} transfer_progress;
+
 typedef struct {
     struct sockaddr_in server_addr; ///< the remote server address
-    char* path; ///< the file path
+    path_walker_t* walker; ///< the walk of the given paths the files to be sent are taken from, NULL for a single file
+    char** paths; ///< the paths of the files taken so far, as a ring holding those not replied yet
+    size_t path_capacity; ///< the capacity of the paths ring, beyond the session window
+    size_t path_count; ///< the amount of files taken so far
+    size_t* name_offsets; ///< the offsets of the file names in their paths, parallel to paths, see path_walker_next()
+    char* path; ///< the path of the file being sent, one of paths
+    size_t name_offset; ///< the offset of the name the file being sent is stored under in its path, 0 for its base name
     sal_socket_t transmission_socket; ///< the transmission socket
+    tlv_arena_t* arena; ///< the arena holding the TLVs exchanged through the connection
+    bool zero_copy; ///< send file content straight from the file with sendfile()
+    bool mapped; ///< hash and send file content straight from a memory mapping of the file
+    bool digest_thread; ///< hash file content on a separate thread, overlapped with I/O
+    long protocol_version; ///< the highest protocol version to be negotiated
+    long frame_length; ///< the requested file content frame length, or PROTOCOL_UNLIMITED_FRAME_LENGTH
+    checksum_algorithm checksum; ///< the file checksum algorithm, CHECKSUM_DEFAULT unless negotiated
+    compression_algorithm compression; ///< the file content compression, COMPRESSION_NONE unless negotiated
+    int compression_level; ///< the compression level (Zstandard only)
+    long retries; ///< the amount of reconnections after a failed transfer
+    long file_identity; ///< the identity of the file contents, offered for resuming (0 if unknown)
+    long resume_offset; ///< the file offset the server resumes the transfer from
+    long streams; ///< the requested amount of parallel streams per file, 0 to tune it to the file size
+    long transfer_id; ///< the identifier shared by all streams of a multi-stream transfer
+    long stream_count; ///< the amount of streams the file is split into, 1 if not split
+    long range_offset; ///< the file offset of the range sent through the connection
+    long range_length; ///< the length of the range sent through the connection
+    long window; ///< the amount of files of a session sent ahead of their reply
+    bool delta; ///< send large files as a delta against the server existing copy
+    bool rejected; ///< the server rejected the file being sent, so it is not worth retrying
+    bool nacked; ///< the server received the file being sent but refused it, as opposed to the connection failing
+    protocol_hello protocol; ///< the protocol parameters agreed with the server
+    uint64_t connect_ns; ///< the time establishing the connection took, traced with the first file sent through it
+    long wire_bytes; ///< the bytes sent for the file being sent, over all its attempts and streams
+    trace_file_t trace; ///< the trace of the file being sent, if tracing is enabled
+    long connections; ///< the amount of connections files are sent through concurrently
+    bool recursive; ///< directories are walked into their subdirectories too
+    bool concurrent; ///< files are sent from several threads, so each outcome is printed as a whole line
+    bool line_started; ///< the line reporting the file being sent was started, its outcome is left to be printed
+    transfer_progress* progress; ///< the progress shared by all connections, NULL if not counted
 } client_data;
 
+typedef struct {
+    client_data data; ///< the worker copy of client data, owning its connection and paths
+    pthread_t thread; ///< the worker thread
+} worker_data;
+
+/**
+ * @brief The start of the streams of a file: stream threads only connect once
+ * all of them were started, as the server keeps the file until it got every range.
+ **/
+typedef struct {
+    bool decided; ///< whether all stream threads were started, or one failed to
+    bool started; ///< whether all stream threads were started
+    pthread_mutex_t lock; ///< guards decided and started
+    pthread_cond_t decision; ///< signaled once decided
+} stream_start;
+
+typedef struct {
+    client_data data; ///< the stream copy of client data, owning its connection and range
+    bool sent; ///< the range was sent and acknowledged
+    pthread_t thread; ///< the stream thread
+    stream_start* start; ///< the start shared by all streams of the file
+} stream_data;
+
+typedef struct {
+    const uint8_t* file; ///< the mapped file
+    tlv_gather_t gather; ///< the TLVs not yet sent
+    uint8_t references[TLV_GATHER_MAX_BUFFERS][BLOCK_REFERENCE_LENGTH]; ///< the values of the gathered block references
+    int reference_count; ///< the amount of gathered block references
+    long block_index; ///< the first block of the reference being extended
+    long block_count; ///< the amount of blocks of the reference being extended, 0 if none
+} delta_sender;
+
+typedef struct {
+    size_t index; ///< the file index on client paths
+    long file_size; ///< the file size
+    long wire_bytes; ///< the bytes sent for the file
+    trace_file_t trace; ///< the file trace, ended when its reply arrives
+} pending_file;
+
+typedef struct {
+    pending_file files[PROTOCOL_MAX_SESSION_WINDOW]; ///< the files sent and not yet replied, as a ring
+    size_t head; ///< the ring position of the oldest file
+    size_t count; ///< the amount of files waiting for their reply
+} session_window;
+
+#define DIGEST_MAP_WINDOW_LEN (SAL_MAP_ALIGNMENT * 128) ///< the file region mapped at once for hashing
+#define SEND_MAP_WINDOW_LEN (SAL_MAP_ALIGNMENT * 256) ///< the file region mapped at once for sending, the next one being prefetched
+#define SEND_MAP_CHUNK_LEN (256 << 10) ///< the mapped file content hashed right before being sent, while still cached
+#define DEFAULT_FRAME_LENGTH (16 << 20) ///< the default file content frame length on protocol version 2
+#define SMALL_FILE_MAX_LEN TLV_MAX_VALUE_LENGTH ///< the largest file sent with a single system call
+#define DEFAULT_RETRIES 3 ///< the default amount of reconnections after a failed transfer
+#define RETRY_DELAY_MS 500 ///< the delay before the first reconnection, growing with each retry
+#define STREAM_RANGE_LEN (64 << 20) ///< the file length per stream when the stream count is tuned to the file size
+#define DEFAULT_WINDOW 16 ///< the default amount of files of a session sent ahead of their reply
+#define MAX_CONNECTIONS 256 ///< the most connections files may be sent through concurrently
+#define PROGRESS_INTERVAL_MS 1000 ///< the period of the progress printed while sending through concurrent connections
+
 /* ========================================================================== *
  * Forward declarations to avoid concerning about function definition order   *
  * ========================================================================== */
 void print_usage(const char* app_name);
 long get_filesize(FILE* fp);
+bool is_resumable(const client_data* data, const long file_size);
+bool is_delta(const client_data* data, const long file_size);
+bool is_dedup(const client_data* data, const long file_size);
+bool has_admission(const client_data* data, const long file_size);
+tlv_t new_header_tlv(client_data* data, const long file_size);
 bool send_header(client_data* data, FILE* fp);
-bool send_file_content(sal_socket_t socket, FILE* fp);
-void send_file(client_data* data);
-bool check_reply(sal_socket_t socket);
+bool receive_admission(client_data* data);
+bool receive_resume_offset(client_data* data, const long file_size);
+bool send_small_file(client_data* data, FILE* fp);
+uint64_t get_frame_length(const long file_size, const long offset, const long max_frame_length);
+void add_content_to_gather(tlv_gather_t* gather, compressor_t* compressor, const uint8_t* content, const size_t length);
+bool send_file_content(client_data* data, FILE* fp, digest_pipeline_t* pipeline, compressor_t* compressor);
+bool digest_mapped_file(FILE* fp, const long offset, const long length, checksum_ctx_t* checksum_ctx);
+bool send_file_content_zero_copy(client_data* data, FILE* fp);
+bool send_file_content_mapped(client_data* data, FILE* fp, compressor_t* compressor);
+bool send_file_delta(client_data* data, FILE* fp, compressor_t* compressor);
+uint8_t* receive_block_signatures(client_data* data, long* block_length, long* block_count);
+bool add_block_reference(client_data* data, delta_sender* sender, const long block_index);
+bool flush_block_reference(client_data* data, delta_sender* sender);
+bool add_literal_content(
+    client_data* data,
+    delta_sender* sender,
+    compressor_t* compressor,
+    const long offset,
+    const size_t length);
+bool send_delta_gather(client_data* data, delta_sender* sender);
+bool send_file_chunks(client_data* data, FILE* fp, compressor_t* compressor);
+bool send_chunk_list(client_data* data, const uint8_t* entries, const long chunk_count);
+bool receive_missing_chunks(client_data* data, uint8_t* missing, const long chunk_count);
+bool send_chunk_content(client_data* data, compressor_t* compressor, const uint8_t* content, const size_t length);
+bool open_connection(client_data* data);
+bool send_file(client_data* data);
+bool try_send_file(client_data* data, FILE* fp);
+bool send_file_range(client_data* data, FILE* fp);
+long get_stream_count(const client_data* data, const long file_size);
+bool send_file_streams(client_data* data, FILE* fp);
+void* run_stream(void* arg);
+void decide_stream_start(stream_start* start, const bool started);
+bool wait_stream_start(stream_start* start);
+bool check_reply(client_data* data);
+bool send_tree(client_data* data);
+void* run_worker(void* arg);
+void print_progress(const client_data* data, const transfer_progress* progress, const char* label);
+bool take_path(client_data* data);
+char* get_path(const client_data* data, const size_t index);
+void select_path(client_data* data, const size_t index);
+void send_files(client_data* data);
+bool send_session_files(client_data* data, size_t* next);
+bool receive_session_replies(client_data* data, session_window* window, const size_t limit);
+void print_file_start(client_data* data, const char* path, const long file_size);
+void report_file_outcome(
+    client_data* data,
+    trace_file_t* trace,
+    const char* path,
+    const long file_size,
+    const long wire_bytes,
+    bool sent);
+void add_progress(client_data* data, const unsigned long files, const bool sent, const long bytes);
 bool parse_input(const int argc, const char** argv, client_data* data);
 void release_client_data(client_data* data);
 
@@ -39,12 +212,22 @@ int main(const int argc, const char** argv) {
         print_usage(argv[0]);
         return EXIT_CODE_ON_ERROR;
     }
+    if ((data.arena = acquire_tlv_arena()) == NULL) {
+        release_client_data(&data);
+        return EXIT_CODE_ON_ERROR;
+    }
 
-    /* Send the specified file and exit */
-    send_file(&data);
+    /* Send the specified files and exit */
+    bool sent = false;
+    if (data.walker == NULL) {
+        data.path = data.paths[0];
+        sent = send_file(&data);
+    } else {
+        sent = send_tree(&data);
+    }
     release_client_data(&data);
 
-    return EXIT_CODE_ON_SUCCESS;
+    return sent ? EXIT_CODE_ON_SUCCESS : EXIT_CODE_ON_ERROR;
 }
 
 /* ========================================================================== *
@@ -61,8 +244,50 @@ void print_usage(const char* app_name) {
     reset_error_description();
     fprintf(
         stderr,
-        "Usage: %s <file path> <destination IP address> <destination port>\n",
-        app_name
+        "Usage: %s <file or directory path>... <destination IP address> <destination port> [options]\n"
+        "Many files, or the files of a directory, are sent one after the other over a single connection\n"
+        "if the server supports it, or over several connections at once with --connections.\n"
+        "Options:\n"
+        "    --sendfile                  Send file content with sendfile(), without copying it through user space\n"
+        "    --digest-thread             Hash file content on a separate thread, overlapped with I/O\n"
+        "    --mmap                      Hash and send file content straight from a memory mapping of the file,\n"
+        "                                instead of reading it into a buffer (not with --sendfile or --digest-thread)\n"
+        "    --protocol <version>        Use at most the given protocol version (default %d)\n"
+        "    --frame-length <bytes>      Request file content frames up to the given length, 0 for unlimited\n"
+        "                                (default %d, protocol version 2 only)\n"
+        "    --checksum <algorithm>      Verify file content with sha512, blake3, xxh3 or crc32c\n"
+        "                                (default %s, others need protocol version 2)\n"
+        "    --compress <algorithm>      Compress file content chunks with lz4 or zstd, sending the chunks\n"
+        "                                that do not shrink as they are (default none, not with --sendfile)\n"
+        "    --compress-level <level>    Use the given zstd level, from 1 to %d (default %d)\n"
+        "    --retries <count>           Reconnect up to <count> times after a failed transfer, resuming\n"
+        "                                it where the server left off if supported (default %d)\n"
+        "    --streams <count>           Split large files in ranges sent over <count> parallel connections,\n"
+        "                                0 for one per %d MB up to what the server allows (default 0)\n"
+        "    --window <count>            Send up to <count> small files ahead of their reply when sending\n"
+        "                                many files (default %d, at most %d)\n"
+        "    --delta                     Send only what changed in large files the server already has a copy\n"
+        "                                of, as blocks of it and new content (not with --sendfile)\n"
+        "    --trace <file>              Append the timing of each sent file to <file> as a JSON line\n"
+        "                                (\"-\" for the standard error)\n"
+        "    --recursive                 Send the files of subdirectories too, without following links, each\n"
+        "                                one stored under its path relative to the given directory\n"
+        "    --files-from <file>         Send the files or directories listed in <file>, one per line, after\n"
+        "                                the given paths, which may then be omitted (\"-\" for the standard input)\n"
+        "    --connections <count>       Send files through <count> concurrent connections, each one taking\n"
+        "                                the next file as it goes, and print the overall progress (default 1,\n"
+        "                                at most %d)\n",
+        app_name,
+        PROTOCOL_VERSION,
+        DEFAULT_FRAME_LENGTH,
+        get_checksum_name(CHECKSUM_DEFAULT),
+        COMPRESSION_MAX_LEVEL,
+        COMPRESSION_DEFAULT_LEVEL,
+        DEFAULT_RETRIES,
+        STREAM_RANGE_LEN >> 20,
+        DEFAULT_WINDOW,
+        PROTOCOL_MAX_SESSION_WINDOW,
+        MAX_CONNECTIONS
     );
 }
 
@@ -71,234 +296,2082 @@ void print_usage(const char* app_name) {
  *
  * @param fp The pointer to the opened file
  *
- * @returns the file size
+ * @returns the file size, -1 if unknown
  **/
 long get_filesize(FILE* fp) {
-    fpos_t position;
-    fgetpos(fp, &position);
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    fsetpos (fp, &position);
+    long file_size = -1;
+    sal_get_file_size(fp, &file_size);
     return file_size;
 }
 
 /**
- * @brief Sends TLV with header information.
+ * @brief Checks whether the server may resume an interrupted transfer of the file.
+ * Small files are always sent at once, so they are never resumed.
  *
  * @param data The client internal data
- * @param fp The pointer to the opened file
+ * @param file_size The file size
  *
- * @return true if header information was sent successfully
+ * @return true if resuming is offered on the header
  * @return false otherwise
  **/
-bool send_header(client_data* data, FILE* fp) {
-    const long file_size = get_filesize(fp);
-    char* filename = sal_get_filename(data->path);
+bool is_resumable(const client_data* data, const long file_size) {
+    return (data->protocol.capabilities & PROTOCOL_CAPABILITY_RESUME) &&
+        data->file_identity != 0 &&
+        data->stream_count <= 1 &&
+        file_size > SMALL_FILE_MAX_LEN &&
+        !is_delta(data, file_size);
+}
+
+/**
+ * @brief Checks whether the file is sent as a delta against the server copy.
+ * Small files cost less to send than the signatures of their copy, and files
+ * split in several streams are sent as a whole.
+ *
+ * @param data The client internal data
+ * @param file_size The file size
+ *
+ * @return true if a delta is asked for on the header
+ * @return false otherwise
+ **/
+bool is_delta(const client_data* data, const long file_size) {
+    return data->delta &&
+        (data->protocol.capabilities & PROTOCOL_CAPABILITY_DELTA) &&
+        data->stream_count <= 1 &&
+        file_size > SMALL_FILE_MAX_LEN;
+}
+
+/**
+ * @brief Checks whether the chunks of the file are offered to the server
+ * chunk store, which replies which ones it is missing. Small files are sent
+ * at once, the server chunking them itself.
+ *
+ * @param data The client internal data
+ * @param file_size The file size
+ *
+ * @return true if the chunks are offered on the header
+ * @return false otherwise
+ **/
+bool is_dedup(const client_data* data, const long file_size) {
+    return (data->protocol.capabilities & PROTOCOL_CAPABILITY_DEDUP) &&
+        !data->zero_copy &&
+        data->stream_count <= 1 &&
+        file_size > SMALL_FILE_MAX_LEN;
+}
+
+/**
+ * @brief Checks whether the server accepts or rejects the file before its
+ * content is sent.
+ *
+ * @param data The client internal data
+ * @param file_size The file size
+ *
+ * @return true if the server replies an admission to the header
+ * @return false otherwise
+ **/
+bool has_admission(const client_data* data, const long file_size) {
+    return (data->protocol.capabilities & PROTOCOL_CAPABILITY_ADMISSION) &&
+        file_size >= PROTOCOL_ADMISSION_MIN_LEN;
+}
+
+/**
+ * @brief Builds the TLV with header information.
+ *
+ * @param data The client internal data
+ * @param file_size The file size
+ *
+ * @return the header TLV, or an empty TLV if file name is unavailable
+ **/
+tlv_t new_header_tlv(client_data* data, const long file_size) {
+    char* filename = data->name_offset > 0 ? strdup(&data->path[data->name_offset]) : sal_get_filename(data->path);
+    if (filename == NULL) {
+        return (tlv_t){0};
+    }
     const int filename_len = strlen(filename);
 
-    tlv_t tlv_header = new_tlv(TLV_TYPE_HEADER, 0);
-    tlv_t sub_tlv_file_name = new_tlv(TLV_TYPE_FILE_NAME, filename_len);
+    tlv_t tlv_header = new_tlv(data->arena, TLV_TYPE_HEADER, 0);
+    tlv_t sub_tlv_file_name = new_tlv(data->arena, TLV_TYPE_FILE_NAME, filename_len);
     set_tlv_value_raw(&sub_tlv_file_name, filename);
-    tlv_t sub_tlv_file_size = new_tlv(TLV_TYPE_FILE_SIZE, sizeof(long));
+    tlv_t sub_tlv_file_size = new_tlv(data->arena, TLV_TYPE_FILE_SIZE, sizeof(long));
     set_tlv_value_long(&sub_tlv_file_size, file_size);
 
+    tlv_t sub_tlv_checksum_algorithm = {0};
+    tlv_t sub_tlv_compression = {0};
+    tlv_t sub_tlv_file_identity = {0};
+    tlv_t sub_tlv_delta = {0};
+    tlv_t sub_tlv_dedup = {0};
+    tlv_t sub_tlv_streams[4] = {{0}};
+
     set_next_tlv(&sub_tlv_file_name, &sub_tlv_file_size);
-    set_sub_tlv_list(&tlv_header, &sub_tlv_file_name);
-    if (!send_tlv_data(data->transmission_socket, &tlv_header)) {
-        goto RELEASE_ON_ERROR;
+    tlv_t* last_sub_tlv = &sub_tlv_file_size;
+    if (data->protocol.capabilities & PROTOCOL_CAPABILITY_CHECKSUMS) {
+        sub_tlv_checksum_algorithm = new_tlv(data->arena, TLV_TYPE_CHECKSUM_ALGORITHM, sizeof(long));
+        set_tlv_value_long(&sub_tlv_checksum_algorithm, data->checksum);
+        set_next_tlv(last_sub_tlv, &sub_tlv_checksum_algorithm);
+        last_sub_tlv = &sub_tlv_checksum_algorithm;
     }
-    tlv_release_tlvs();
-    free(filename);
-    filename = NULL;
-    return true;
-
-RELEASE_ON_ERROR:
-    tlv_release_tlvs();
+    if (data->compression != COMPRESSION_NONE) {
+        sub_tlv_compression = new_tlv(data->arena, TLV_TYPE_COMPRESSION, sizeof(long));
+        set_tlv_value_long(&sub_tlv_compression, data->compression);
+        set_next_tlv(last_sub_tlv, &sub_tlv_compression);
+        last_sub_tlv = &sub_tlv_compression;
+    }
+    if (is_resumable(data, file_size)) {
+        sub_tlv_file_identity = new_tlv(data->arena, TLV_TYPE_FILE_IDENTITY, sizeof(long));
+        set_tlv_value_long(&sub_tlv_file_identity, data->file_identity);
+        set_next_tlv(last_sub_tlv, &sub_tlv_file_identity);
+        last_sub_tlv = &sub_tlv_file_identity;
+    }
+    if (is_delta(data, file_size)) {
+        sub_tlv_delta = new_tlv(data->arena, TLV_TYPE_DELTA, 0);
+        set_next_tlv(last_sub_tlv, &sub_tlv_delta);
+        last_sub_tlv = &sub_tlv_delta;
+    }
+    if (is_dedup(data, file_size)) {
+        sub_tlv_dedup = new_tlv(data->arena, TLV_TYPE_DEDUP, 0);
+        set_next_tlv(last_sub_tlv, &sub_tlv_dedup);
+        last_sub_tlv = &sub_tlv_dedup;
+    }
+    if (data->stream_count > 1) {
+        const tlv_type types[] = {
+            TLV_TYPE_TRANSFER_ID, TLV_TYPE_STREAM_COUNT, TLV_TYPE_RANGE_OFFSET, TLV_TYPE_RANGE_LENGTH
+        };
+        const long values[] = {data->transfer_id, data->stream_count, data->range_offset, data->range_length};
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+            sub_tlv_streams[i] = new_tlv(data->arena, types[i], sizeof(long));
+            set_tlv_value_long(&sub_tlv_streams[i], values[i]);
+            set_next_tlv(last_sub_tlv, &sub_tlv_streams[i]);
+            last_sub_tlv = &sub_tlv_streams[i];
+        }
+    }
+    set_sub_tlv_list(&tlv_header, &sub_tlv_file_name);
+    tlv_header.sub_tlv = NULL;
     free(filename);
     filename = NULL;
-    return false;
+    return tlv_header;
 }
 
 /**
- * @brief Sends file content and digest.
+ * @brief Sends TLV with header information. Servers with admissions reply
+ * whether the file is accepted, before any content is sent. If resuming was
+ * offered, the server then replies where the file content shall be sent from.
  *
- * @param socket The socket to be used
+ * @param data The client internal data
  * @param fp The pointer to the opened file
  *
  * @return true if header information was sent successfully
  * @return false otherwise
  **/
-bool send_file_content(sal_socket_t socket, FILE* fp) {
-    static uint8_t buffer[TLV_MAX_VALUE_LENGTH] = {0};
+bool send_header(client_data* data, FILE* fp) {
+    const long file_size = get_filesize(fp);
+    tlv_t tlv_header = new_header_tlv(data, file_size);
+    bool sent = get_tlv_type(&tlv_header) == TLV_TYPE_HEADER &&
+        send_tlv_data(data->transmission_socket, &tlv_header);
+    reset_tlv_arena(data->arena);
+    data->resume_offset = data->range_offset;
+    sent = sent &&
+        (!has_admission(data, file_size) || receive_admission(data)) &&
+        (!is_resumable(data, file_size) || receive_resume_offset(data, file_size));
+    data->trace.header_ns = trace_elapsed(&data->trace);
+    return sent;
+}
 
-    if (ferror(fp)) {
+/**
+ * @brief Receives whether the server accepts the file announced on the header.
+ *
+ * @param data The client internal data
+ *
+ * @return true if the file was accepted
+ * @return false otherwise, the file being marked as rejected if the server rejected it
+ **/
+bool receive_admission(client_data* data) {
+    tlv_t tlv_admission = {0};
+    if (!receive_tlv_data(data->transmission_socket, data->arena, &tlv_admission)) {
+        reset_tlv_arena(data->arena);
+        return false;
+    }
+    const bool valid = get_tlv_type(&tlv_admission) == TLV_TYPE_ADMISSION &&
+        get_tlv_length(&tlv_admission) == sizeof(long);
+    const long admission = valid ? get_tlv_value_long(&tlv_admission) : PROTOCOL_ADMISSION_FAILED;
+    reset_tlv_arena(data->arena);
+    if (!valid) {
+        set_error_description("Invalid admission");
+        print_error("Protocol error");
+        return false;
+    }
+    if (admission != PROTOCOL_ADMISSION_ACCEPTED) {
+        data->rejected = true;
+        set_error_description("%s", admission == PROTOCOL_ADMISSION_NO_SPACE ? "Not enough space" : "Server failure");
+        print_error("File rejected by server");
         return false;
     }
+    return true;
+}
 
-    SHA512_CTX sha512_ctx;
-    SHA512_Init(&sha512_ctx);
-    do {
-        const size_t read_bytes = fread(buffer, 1, sizeof(buffer), fp);
-        if (ferror(fp)) {
-            goto RELEASE_ON_ERROR;
-        }
-        if (read_bytes > 0) {
-            tlv_t tlv_content = new_tlv(TLV_TYPE_FILE_CONTENT, read_bytes);
-            set_tlv_value_raw(&tlv_content, buffer);
-            if (!send_tlv_data(socket, &tlv_content)) {
-                goto RELEASE_ON_ERROR;
-            }
-            SHA512_Update(&sha512_ctx, buffer, read_bytes);
-            tlv_release_tlvs();
-        }
-    } while (!feof(fp));
-    SHA512_Final(buffer, &sha512_ctx);
-    tlv_t tlv_sha512 = new_tlv(TLV_TYPE_CHECKSUM_SHA512, SHA512_DIGEST_LENGTH);
-    set_tlv_value_raw(&tlv_sha512, buffer);
-    if (!send_tlv_data(socket, &tlv_sha512)) {
+/**
+ * @brief Receives the file offset the server resumes the transfer from.
+ *
+ * @param data The client internal data
+ * @param file_size The file size
+ *
+ * @return true if a valid offset was received
+ * @return false otherwise
+ **/
+bool receive_resume_offset(client_data* data, const long file_size) {
+    tlv_t tlv_offset = {0};
+    if (!receive_tlv_data(data->transmission_socket, data->arena, &tlv_offset)) {
+        reset_tlv_arena(data->arena);
+        return false;
+    }
+    const bool valid = get_tlv_type(&tlv_offset) == TLV_TYPE_RESUME_OFFSET &&
+        get_tlv_length(&tlv_offset) == sizeof(long) &&
+        get_tlv_value_long(&tlv_offset) >= 0 &&
+        get_tlv_value_long(&tlv_offset) <= file_size;
+    if (valid) {
+        data->resume_offset = get_tlv_value_long(&tlv_offset);
+    }
+    reset_tlv_arena(data->arena);
+    if (!valid) {
+        set_error_description("Invalid resume offset");
+        print_error("Protocol error");
+        return false;
+    }
+    if (data->resume_offset > 0) {
+        print_msg(" resuming from byte %ld...", data->resume_offset);
+        fflush(stdout);
+    }
+    return true;
+}
+
+/**
+ * @brief Sends a file that fits a single TLV: header, content and digest
+ * are gathered into a single system call. The content is compressed as a
+ * single chunk, if compression was negotiated and it shrinks.
+ *
+ * @param data The client internal data
+ * @param fp The pointer to the opened file
+ *
+ * @return true if file was sent successfully, its reply is left to the caller
+ * @return false otherwise
+ **/
+bool send_small_file(client_data* data, FILE* fp) {
+    static __thread uint8_t buffer[TLV_MAX_VALUE_LENGTH] = {0};
+
+    const long file_size = get_filesize(fp);
+    if (trace_fread(buffer, 1, file_size, fp) != (size_t)file_size) {
+        set_error_description("%s", ferror(fp) ? "I/O error" : "Unexpected end of file");
+        print_error("Read file failed");
         return false;
     }
-    tlv_release_tlvs();
+    checksum_ctx_t checksum_ctx;
+    checksum_init(&checksum_ctx, data->checksum);
+    trace_checksum_update(&checksum_ctx, buffer, file_size);
+    uint8_t digest[CHECKSUM_MAX_LENGTH] = {0};
+    checksum_final(&checksum_ctx, digest);
 
-    return check_reply(socket);
+    compressor_t compressor;
+    if (!compressor_init(&compressor, data->compression, data->compression_level)) {
+        return false;
+    }
+    tlv_gather_t gather;
+    init_tlv_gather(&gather);
+    tlv_t tlv_header = new_header_tlv(data, file_size);
+    if (get_tlv_type(&tlv_header) != TLV_TYPE_HEADER) {
+        goto RELEASE_ON_ERROR;
+    }
+    tlv_t tlv_checksum = new_checksum_tlv(data->arena, &data->protocol, data->checksum, digest);
+    add_tlv_to_gather(&gather, &tlv_header);
+    if (file_size > 0) {
+        add_content_to_gather(&gather, &compressor, buffer, file_size);
+    }
+    add_tlv_to_gather(&gather, &tlv_checksum);
+    if (!send_tlv_gather(data->transmission_socket, &gather)) {
+        goto RELEASE_ON_ERROR;
+    }
+    reset_tlv_arena(data->arena);
+    compressor_release(&compressor);
+    return true;
 
 RELEASE_ON_ERROR:
-    tlv_release_tlvs();
+    reset_tlv_arena(data->arena);
+    compressor_release(&compressor);
     return false;
 }
 
 /**
- * @brief Establishes a connection and sends a file through it.
+ * @brief Adds a file content chunk as a TLV of its own to a gather: a
+ * compressed content TLV if the chunk shrinks, a file content TLV otherwise.
  *
- * @param data The client internal data
+ * @param gather The gather
+ * @param compressor The compressor, disabled if compression was not negotiated
+ * @param content The file content chunk, up to PROTOCOL_MAX_COMPRESSED_CHUNK_LEN bytes long
+ * @param length The file content chunk length
  *
- * @return true if file content was received, written and validated successfully
- * @return false otherwise
+ * @return No return
  **/
-void send_file(client_data* data) {
-    FILE* fp = NULL;
-    if ((fp = fopen(data->path, "rb")) == NULL) {
-        print_error("Open file failed");
+void add_content_to_gather(tlv_gather_t* gather, compressor_t* compressor, const uint8_t* content, const size_t length) {
+    /* The original length leads the compressed chunk, and both are sent before the next call */
+    static __thread uint8_t compressed[TLV_MAX_VALUE_LENGTH] = {0};
+
+    const size_t compressed_length = compressor_compress(
+        compressor,
+        content,
+        length,
+        compressed + COMPRESSED_CHUNK_LENGTH_LENGTH);
+    if (compressed_length == 0) {
+        add_tlv_header_to_gather(gather, TLV_TYPE_FILE_CONTENT, length);
+        add_buffer_to_gather(gather, content, length);
         return;
     }
+    compressed[0] = (length >> 24) & 0xFF;
+    compressed[1] = (length >> 16) & 0xFF;
+    compressed[2] = (length >> 8) & 0xFF;
+    compressed[3] = length & 0xFF;
+    add_tlv_header_to_gather(gather, TLV_TYPE_COMPRESSED_CONTENT, COMPRESSED_CHUNK_LENGTH_LENGTH + compressed_length);
+    add_buffer_to_gather(gather, compressed, COMPRESSED_CHUNK_LENGTH_LENGTH + compressed_length);
+}
 
-    if ((data->transmission_socket = sal_create_socket()) == NULL) {
-        goto CLOSE_FILE;
+/**
+ * @brief Gets the length of the next file content frame.
+ *
+ * @param file_size The file size
+ * @param offset The frame offset on file
+ * @param max_frame_length The agreed maximum frame length, or PROTOCOL_UNLIMITED_FRAME_LENGTH
+ *
+ * @returns the frame length
+ **/
+uint64_t get_frame_length(const long file_size, const long offset, const long max_frame_length) {
+    if (max_frame_length == PROTOCOL_UNLIMITED_FRAME_LENGTH) {
+        return file_size - offset;
     }
+    return MIN(file_size - offset, max_frame_length);
+}
+
+/**
+ * @brief Sends the file range content and its digest. The content the server
+ * already has when resuming is only hashed, from the page cache. With
+ * compression, each chunk is a frame of its own, compressed independently,
+ * while the digest still covers the original content.
+ *
+ * @param data The client internal data
+ * @param fp The pointer to the opened file
+ * @param pipeline The pipeline hashing file content on a separate thread, or NULL to hash it inline
+ * @param compressor The compressor, disabled if compression was not negotiated
+ *
+ * @return true if header information was sent successfully
+ * @return false otherwise
+ **/
+bool send_file_content(client_data* data, FILE* fp, digest_pipeline_t* pipeline, compressor_t* compressor) {
+    static __thread uint8_t inline_buffer[TLV_MAX_VALUE_LENGTH] = {0};
 
-    if (sal_connect(data->transmission_socket, &data->server_addr) != SAL_OK) {
-        goto DESTROY_SOCKET;
+    if (ferror(fp)) {
+        return false;
     }
 
-    print_msg("Sending file \"%s\" containing %ld bytes...", data->path, get_filesize(fp));
-    fflush(stdout);
-    if (!send_header(data, fp)) {
-        goto CLOSE_SOCKET;
+    sal_socket_t socket = data->transmission_socket;
+    long max_frame_length = data->protocol.max_frame_length;
+    if (compressor->algorithm != COMPRESSION_NONE) {
+        max_frame_length = max_frame_length == PROTOCOL_UNLIMITED_FRAME_LENGTH ?
+            PROTOCOL_MAX_COMPRESSED_CHUNK_LEN :
+            MIN(max_frame_length, PROTOCOL_MAX_COMPRESSED_CHUNK_LEN);
+    }
+    checksum_ctx_t checksum_ctx;
+    checksum_init(&checksum_ctx, data->checksum);
+    const long range_end = data->range_offset + data->range_length;
+    if (data->resume_offset > data->range_offset) {
+        if (!digest_mapped_file(fp, data->range_offset, data->resume_offset - data->range_offset, &checksum_ctx)) {
+            return false;
+        }
+        if (pipeline) {
+            digest_pipeline_restore(pipeline, &checksum_ctx);
+        }
     }
-    if (!send_file_content(data->transmission_socket, fp)) {
-        goto CLOSE_SOCKET;
+    if (fseek(fp, data->resume_offset, SEEK_SET) != 0) {
+        set_error_description("Seek failed");
+        print_error("Read file failed");
+        return false;
     }
-    print_msg(" done\n");
+    uint8_t digest[CHECKSUM_MAX_LENGTH] = {0};
+    tlv_gather_t gather;
+    for (long offset = data->resume_offset; offset < range_end;) {
+        const uint64_t length = get_frame_length(range_end, offset, max_frame_length);
+        for (uint64_t sent = 0; sent < length;) {
+            uint8_t* buffer = pipeline ? digest_pipeline_acquire(pipeline) : inline_buffer;
+            const size_t buffer_len = pipeline ? DIGEST_CHUNK_LEN : sizeof(inline_buffer);
+            const size_t read_bytes = trace_fread(buffer, 1, MIN(buffer_len, length - sent), fp);
+            if (read_bytes == 0) {
+                set_error_description("%s", ferror(fp) ? "I/O error" : "Unexpected end of file");
+                print_error("Read file failed");
+                return false;
+            }
+            /* A submitted chunk is hashed while it is being sent */
+            if (pipeline) {
+                digest_pipeline_submit(pipeline, read_bytes);
+            } else {
+                trace_checksum_update(&checksum_ctx, buffer, read_bytes);
+            }
 
-    sal_close(data->transmission_socket);
-    sal_destroy_socket(data->transmission_socket);
-    data->transmission_socket = NULL;
-    fclose(fp);
-    fp = NULL;
-    return;
+            /* Frame header goes along the first chunk and digest along the last one */
+            init_tlv_gather(&gather);
+            if (compressor->algorithm != COMPRESSION_NONE) {
+                add_content_to_gather(&gather, compressor, buffer, read_bytes);
+            } else {
+                if (sent == 0) {
+                    add_tlv_header_to_gather(&gather, TLV_TYPE_FILE_CONTENT, length);
+                }
+                add_buffer_to_gather(&gather, buffer, read_bytes);
+            }
+            sent += read_bytes;
+            if (offset + sent == (uint64_t)range_end) {
+                if (pipeline) {
+                    digest_pipeline_finish(pipeline, digest);
+                } else {
+                    checksum_final(&checksum_ctx, digest);
+                }
+                tlv_t tlv_checksum = new_checksum_tlv(data->arena, &data->protocol, data->checksum, digest);
+                add_tlv_to_gather(&gather, &tlv_checksum);
+            }
+            const bool sent_chunk = send_tlv_gather(socket, &gather);
+            if (offset + sent == (uint64_t)range_end) {
+                reset_tlv_arena(data->arena);
+            }
+            if (!sent_chunk) {
+                return false;
+            }
+        }
+        offset += length;
+    }
+    /* Nothing was left to be sent, either an empty file or one the server fully has */
+    if (data->resume_offset == range_end) {
+        checksum_final(&checksum_ctx, digest);
+        tlv_t tlv_checksum = new_checksum_tlv(data->arena, &data->protocol, data->checksum, digest);
+        bool sent = send_tlv_data(socket, &tlv_checksum);
+        reset_tlv_arena(data->arena);
+        if (!sent) {
+            return false;
+        }
+    }
 
-CLOSE_SOCKET:
-    print_msg(" error\n");
-    sal_close(data->transmission_socket);
-DESTROY_SOCKET:
-    sal_destroy_socket(data->transmission_socket);
-    data->transmission_socket = NULL;
-CLOSE_FILE:
-    fclose(fp);
-    fp = NULL;
+    return check_reply(data);
 }
 
 /**
- * @brief Checks server reply to ensure that file was received successfully.
+ * @brief Hashes a file region straight from the page cache, by mapping the
+ * file instead of reading it into a user space buffer.
  *
- * @param socket The used socket
+ * @param fp The pointer to the opened file
+ * @param offset The region offset on file
+ * @param length The region length
+ * @param checksum_ctx The checksum the file content is added to
  *
- * @return No return
+ * @return true if file content was hashed successfully
+ * @return false otherwise
  **/
-bool check_reply(sal_socket_t socket) {
-    tlv_t tlv = {0};
-    if (!receive_tlv_data(socket, &tlv)) {
-        print_warning("Reply check failed");
+bool digest_mapped_file(FILE* fp, const long offset, const long length, checksum_ctx_t* checksum_ctx) {
+    for (long position = offset; position < offset + length;) {
+        const long map_offset = position - position % SAL_MAP_ALIGNMENT;
+        const size_t skipped = position - map_offset;
+        const size_t window_length = MIN(offset + length - position, DIGEST_MAP_WINDOW_LEN);
+        const uint8_t* data = NULL;
+        if (sal_map_file(fp, map_offset, skipped + window_length, &data) != SAL_OK) {
+            return false;
+        }
+        trace_checksum_update(checksum_ctx, data + skipped, window_length);
+        const bool valid = sal_check_mapped_file(data) == SAL_OK;
+        sal_unmap_file(data, skipped + window_length);
+        if (!valid) {
+            return false;
+        }
+        position += window_length;
     }
-    bool ack = get_tlv_type(&tlv) == TLV_TYPE_ACK;
-    tlv_release_tlvs();
-    return ack;
+    return true;
 }
 
 /**
- * @brief Parses input arguments and validate them.
+ * @brief Sends the file range content and its digest without copying file content through
+ * user space: each TLV header is followed by the matching file region sent
+ * with sendfile(), and the digest is computed afterwards from the page cache.
  *
- * @param argc The number of arguments
- * @param argv The arguments values
- * @param[out] data The client internal data
+ * @param data The client internal data
+ * @param fp The pointer to the opened file
  *
- * @return true if given arguments are valid
+ * @return true if file content was sent and acknowledged successfully
  * @return false otherwise
  **/
-bool parse_input(const int argc, const char** argv, client_data* data) {
-    if (argc != 4) {
-        return false;
+bool send_file_content_zero_copy(client_data* data, FILE* fp) {
+    sal_socket_t socket = data->transmission_socket;
+    const long max_frame_length = data->protocol.max_frame_length;
+    const long range_end = data->range_offset + data->range_length;
+    uint8_t header[TLV_EXTENDED_HEADER_LENGTH] = {0};
+    for (long offset = data->resume_offset; offset < range_end;) {
+        const uint64_t length = get_frame_length(range_end, offset, max_frame_length);
+        const size_t header_length = write_tlv_stream_header(header, TLV_TYPE_FILE_CONTENT, length);
+        PROBE2(frame_sent, TLV_TYPE_FILE_CONTENT, length);
+        if (sal_send_msg(socket, header, header_length) != SAL_OK ||
+            sal_send_file(socket, fp, offset, length) != SAL_OK) {
+            return false;
+        }
+        offset += length;
     }
 
-    const char* path = argv[1];
-    switch (sal_is_file_readable(path)) {
-    case SAL_FILE_NOT_FOUND:
-        set_error_description("%s", path);
-        print_error("File not found");
-        return false;
-        break;
-    case SAL_FILE_NOT_READABLE:
-        set_error_description("%s", path);
-        print_error("File is not readable");
+    uint8_t digest[CHECKSUM_MAX_LENGTH] = {0};
+    checksum_ctx_t checksum_ctx;
+    checksum_init(&checksum_ctx, data->checksum);
+    if (!digest_mapped_file(fp, data->range_offset, data->range_length, &checksum_ctx)) {
         return false;
-        break;
-    default:
-        break;
     }
+    checksum_final(&checksum_ctx, digest);
+    tlv_t tlv_checksum = new_checksum_tlv(data->arena, &data->protocol, data->checksum, digest);
+    bool sent = send_tlv_data(socket, &tlv_checksum);
+    reset_tlv_arena(data->arena);
 
-    struct in_addr server_ip_addr = {0};
-    if (inet_aton(argv[2], &server_ip_addr) == 0) {
-        set_error_description("%s", argv[2]);
-        print_error("Invalid destination IP");
-        return false;
-    }
+    return sent && check_reply(data);
+}
 
-    const int server_port = atoi(argv[3]);
-    if ((server_port <= 0) || (server_port > 65535)) {
-        set_error_description("%d", server_port);
-        print_error("Invalid destination port");
+/**
+ * @brief Sends the file range content and its digest straight from a memory
+ * mapping of the file, without copying it into a buffer first. The range is
+ * mapped a window at a time, the next window being prefetched meanwhile, and
+ * each chunk is hashed right before being sent, so that it is read from
+ * memory once for both. Content is only sent once its hashing found the file
+ * was not truncated meanwhile.
+ *
+ * @param data The client internal data
+ * @param fp The pointer to the opened file
+ * @param compressor The compressor, disabled if compression was not negotiated
+ *
+ * @return true if file content was sent and acknowledged successfully
+ * @return false otherwise
+ **/
+bool send_file_content_mapped(client_data* data, FILE* fp, compressor_t* compressor) {
+    sal_socket_t socket = data->transmission_socket;
+    long max_frame_length = data->protocol.max_frame_length;
+    if (compressor->algorithm != COMPRESSION_NONE) {
+        max_frame_length = max_frame_length == PROTOCOL_UNLIMITED_FRAME_LENGTH ?
+            PROTOCOL_MAX_COMPRESSED_CHUNK_LEN :
+            MIN(max_frame_length, PROTOCOL_MAX_COMPRESSED_CHUNK_LEN);
+    }
+    checksum_ctx_t checksum_ctx;
+    checksum_init(&checksum_ctx, data->checksum);
+    const long range_end = data->range_offset + data->range_length;
+    if (data->resume_offset > data->range_offset &&
+        !digest_mapped_file(fp, data->range_offset, data->resume_offset - data->range_offset, &checksum_ctx)) {
         return false;
     }
 
-    data->path = strdup(path);
-    data->server_addr.sin_addr = server_ip_addr;
-    data->server_addr.sin_port = htons(server_port);
-    data->server_addr.sin_family = AF_INET;
+    bool sent = false;
+    uint8_t digest[CHECKSUM_MAX_LENGTH] = {0};
+    const uint8_t* window = NULL;
+    long window_offset = 0;
+    size_t window_length = 0;
+    uint64_t frame_remaining = 0;
+    tlv_gather_t gather;
+    for (long offset = data->resume_offset; offset < range_end;) {
+        if (window == NULL || offset == window_offset + (long)window_length) {
+            if (window) {
+                sal_unmap_file(window, window_length);
+                window = NULL;
+            }
+            window_offset = offset - offset % SAL_MAP_ALIGNMENT;
+            window_length = MIN(range_end - window_offset, SEND_MAP_WINDOW_LEN);
+            if (sal_map_file(fp, window_offset, window_length, &window) != SAL_OK) {
+                window = NULL;
+                goto UNMAP;
+            }
+            if (window_offset + (long)window_length < range_end) {
+                sal_prefetch_file(
+                    fp,
+                    window_offset + window_length,
+                    MIN(range_end - (window_offset + (long)window_length), SEND_MAP_WINDOW_LEN));
+            }
+        }
+        const bool frame_start = frame_remaining == 0;
+        if (frame_start) {
+            frame_remaining = get_frame_length(range_end, offset, max_frame_length);
+        }
+        const size_t length = MIN(
+            MIN(frame_remaining, SEND_MAP_CHUNK_LEN),
+            (uint64_t)(window_offset + window_length - offset));
+        const uint8_t* content = window + (offset - window_offset);
+        trace_checksum_update(&checksum_ctx, content, length);
+        if (sal_check_mapped_file(window) != SAL_OK) {
+            goto UNMAP;
+        }
 
-    return true;
+        /* Frame header goes along the first chunk and digest along the last one */
+        init_tlv_gather(&gather);
+        if (compressor->algorithm != COMPRESSION_NONE) {
+            add_content_to_gather(&gather, compressor, content, length);
+        } else {
+            if (frame_start) {
+                add_tlv_header_to_gather(&gather, TLV_TYPE_FILE_CONTENT, frame_remaining);
+            }
+            add_buffer_to_gather(&gather, content, length);
+        }
+        offset += length;
+        frame_remaining -= length;
+        if (offset == range_end) {
+            checksum_final(&checksum_ctx, digest);
+            tlv_t tlv_checksum = new_checksum_tlv(data->arena, &data->protocol, data->checksum, digest);
+            add_tlv_to_gather(&gather, &tlv_checksum);
+        }
+        const bool sent_chunk = send_tlv_gather(socket, &gather);
+        if (offset == range_end) {
+            reset_tlv_arena(data->arena);
+        }
+        if (!sent_chunk) {
+            goto UNMAP;
+        }
+    }
+    /* Nothing was left to be sent, either an empty file or one the server fully has */
+    if (data->resume_offset == range_end) {
+        checksum_final(&checksum_ctx, digest);
+        tlv_t tlv_checksum = new_checksum_tlv(data->arena, &data->protocol, data->checksum, digest);
+        const bool sent_checksum = send_tlv_data(socket, &tlv_checksum);
+        reset_tlv_arena(data->arena);
+        if (!sent_checksum) {
+            goto UNMAP;
+        }
+    }
+    sent = check_reply(data);
+
+UNMAP:
+    if (window) {
+        sal_unmap_file(window, window_length);
+    }
+    return sent;
 }
 
 /**
- * @brief Releases client internal data.
+ * @brief Sends the file as a delta against the server copy, whose block
+ * signatures the server replies to the header with. The file is scanned with
+ * a rolling checksum, so blocks are found at any offset, e.g. after content
+ * was inserted. Matching blocks are sent as references, consecutive ones
+ * sharing a single reference, and the content between them as literal
+ * content chunks, compressed if negotiated. The digest still covers the whole
+ * file, so the server validates the file it rebuilt.
  *
  * @param data The client internal data
+ * @param fp The pointer to the opened file
+ * @param compressor The compressor, disabled if compression was not negotiated
  *
- * @return true if given arguments are valid
+ * @return true if file delta was sent and acknowledged successfully
  * @return false otherwise
  **/
-void release_client_data(client_data* data) {
-    free(data->path);
+bool send_file_delta(client_data* data, FILE* fp, compressor_t* compressor) {
+    long block_length = 0;
+    long block_count = 0;
+    uint8_t* signatures = receive_block_signatures(data, &block_length, &block_count);
+    if (signatures == NULL) {
+        return false;
+    }
+    delta_index_t* index = delta_index_create(signatures, block_count);
+    if (index == NULL) {
+        print_error("Indexing blocks failed");
+        free(signatures);
+        return false;
+    }
+
+    bool sent = false;
+    const long file_size = get_filesize(fp);
+    delta_sender sender = {0};
+    init_tlv_gather(&sender.gather);
+    if (sal_map_file(fp, 0, file_size, &sender.file) != SAL_OK) {
+        goto RELEASE;
+    }
+    long literal_offset = 0;
+    long offset = 0;
+    bool rolling = false;
+    uint32_t weak = 0;
+    while (block_count > 0 && offset + block_length <= file_size) {
+        if (!rolling) {
+            weak = delta_weak_checksum(sender.file + offset, block_length);
+            rolling = true;
+        }
+        const long block = delta_index_find(index, weak, sender.file + offset, block_length);
+        if (block >= 0) {
+            if ((offset > literal_offset &&
+                 !add_literal_content(data, &sender, compressor, literal_offset, offset - literal_offset)) ||
+                !add_block_reference(data, &sender, block)) {
+                goto UNMAP;
+            }
+            offset += block_length;
+            literal_offset = offset;
+            rolling = false;
+            continue;
+        }
+        if (offset - literal_offset == PROTOCOL_MAX_COMPRESSED_CHUNK_LEN) {
+            if (!add_literal_content(data, &sender, compressor, literal_offset, PROTOCOL_MAX_COMPRESSED_CHUNK_LEN)) {
+                goto UNMAP;
+            }
+            literal_offset = offset;
+        }
+        if (offset + block_length < file_size) {
+            weak = delta_roll_weak_checksum(weak, sender.file[offset], sender.file[offset + block_length], block_length);
+        }
+        ++offset;
+    }
+    for (offset = literal_offset; offset < file_size; offset += PROTOCOL_MAX_COMPRESSED_CHUNK_LEN) {
+        if (!add_literal_content(data, &sender, compressor, offset, MIN(file_size - offset, PROTOCOL_MAX_COMPRESSED_CHUNK_LEN))) {
+            goto UNMAP;
+        }
+    }
+    if (!flush_block_reference(data, &sender)) {
+        goto UNMAP;
+    }
+
+    uint8_t digest[CHECKSUM_MAX_LENGTH] = {0};
+    checksum_ctx_t checksum_ctx;
+    checksum_init(&checksum_ctx, data->checksum);
+    trace_checksum_update(&checksum_ctx, sender.file, file_size);
+    checksum_final(&checksum_ctx, digest);
+    /* The digest would otherwise validate a file the server can't rebuild */
+    if (sal_check_mapped_file(sender.file) != SAL_OK) {
+        goto UNMAP;
+    }
+    tlv_t tlv_checksum = new_checksum_tlv(data->arena, &data->protocol, data->checksum, digest);
+    add_tlv_to_gather(&sender.gather, &tlv_checksum);
+    sent = send_delta_gather(data, &sender);
+    reset_tlv_arena(data->arena);
+    sent = sent && check_reply(data);
+
+UNMAP:
+    sal_unmap_file(sender.file, file_size);
+RELEASE:
+    delta_index_destroy(index);
+    free(signatures);
+    return sent;
+}
+
+/**
+ * @brief Receives the delta basis the server replied to the header with, and
+ * the signatures of all blocks of its copy of the file.
+ * @note The signatures shall be released with free().
+ *
+ * @param data The client internal data
+ * @param[out] block_length The length of the blocks of the server copy
+ * @param[out] block_count The amount of blocks of the server copy, 0 if it has none
+ *
+ * @return the signatures, DELTA_SIGNATURE_LENGTH bytes per block
+ * @return NULL otherwise
+ **/
+uint8_t* receive_block_signatures(client_data* data, long* block_length, long* block_count) {
+    tlv_t tlv = {0};
+    bool valid = receive_tlv_data(data->transmission_socket, data->arena, &tlv) &&
+        parse_delta_basis(&tlv, block_length, block_count) &&
+        *block_length >= DELTA_MIN_BLOCK_LEN && *block_length <= DELTA_MAX_BLOCK_LEN &&
+        *block_count <= LONG_MAX / *block_length;
+    reset_tlv_arena(data->arena);
+    if (!valid) {
+        print_error("Protocol error");
+        return NULL;
+    }
+    /* One more byte, so that a server without a copy of the file is no allocation failure */
+    uint8_t* signatures = malloc(*block_count * DELTA_SIGNATURE_LENGTH + 1);
+    if (signatures == NULL) {
+        set_error_description("Out of memory");
+        print_error("Receiving block signatures failed");
+        return NULL;
+    }
+    for (long received = 0; received < *block_count;) {
+        valid = receive_tlv_data(data->transmission_socket, data->arena, &tlv) &&
+            get_tlv_type(&tlv) == TLV_TYPE_BLOCK_SIGNATURES &&
+            get_tlv_length(&tlv) % DELTA_SIGNATURE_LENGTH == 0 &&
+            get_tlv_length(&tlv) > 0 &&
+            get_tlv_length(&tlv) / DELTA_SIGNATURE_LENGTH <= (uint64_t)(*block_count - received);
+        if (valid) {
+            memcpy(signatures + received * DELTA_SIGNATURE_LENGTH, get_tlv_value_raw(&tlv), get_tlv_length(&tlv));
+            received += get_tlv_length(&tlv) / DELTA_SIGNATURE_LENGTH;
+        }
+        reset_tlv_arena(data->arena);
+        if (!valid) {
+            set_error_description("Invalid block signatures");
+            print_error("Protocol error");
+            free(signatures);
+            return NULL;
+        }
+    }
+    return signatures;
+}
+
+/**
+ * @brief Adds a matching block to the delta. Blocks following the one the
+ * pending reference ends with extend it, others start a new reference.
+ *
+ * @param data The client internal data
+ * @param sender The delta being sent
+ * @param block_index The index of the matching block
+ *
+ * @return true if the block was added successfully
+ * @return false otherwise
+ **/
+bool add_block_reference(client_data* data, delta_sender* sender, const long block_index) {
+    if (sender->block_count > 0 && block_index == sender->block_index + sender->block_count) {
+        ++sender->block_count;
+        return true;
+    }
+    if (!flush_block_reference(data, sender)) {
+        return false;
+    }
+    sender->block_index = block_index;
+    sender->block_count = 1;
+    return true;
+}
+
+/**
+ * @brief Gathers the pending reference, which no further block extends.
+ *
+ * @param data The client internal data
+ * @param sender The delta being sent
+ *
+ * @return true if the reference was gathered successfully
+ * @return false otherwise
+ **/
+bool flush_block_reference(client_data* data, delta_sender* sender) {
+    if (sender->block_count == 0) {
+        return true;
+    }
+    /* Both the reference header and its value take a gather buffer */
+    if (sender->gather.buffer_count + 2 > TLV_GATHER_MAX_BUFFERS && !send_delta_gather(data, sender)) {
+        return false;
+    }
+    uint8_t* value = sender->references[sender->reference_count++];
+    write_block_reference(value, sender->block_index, sender->block_count);
+    add_tlv_header_to_gather(&sender->gather, TLV_TYPE_BLOCK_REFERENCE, BLOCK_REFERENCE_LENGTH);
+    add_buffer_to_gather(&sender->gather, value, BLOCK_REFERENCE_LENGTH);
+    sender->block_count = 0;
+    return true;
+}
+
+/**
+ * @brief Adds literal file content to the delta, after the pending reference,
+ * and sends all gathered TLVs, as a compressed chunk is only kept until the
+ * next one.
+ *
+ * @param data The client internal data
+ * @param sender The delta being sent
+ * @param compressor The compressor, disabled if compression was not negotiated
+ * @param offset The literal content offset on file
+ * @param length The literal content length, up to PROTOCOL_MAX_COMPRESSED_CHUNK_LEN
+ *
+ * @return true if the literal content was sent successfully
+ * @return false otherwise
+ **/
+bool add_literal_content(
+    client_data* data,
+    delta_sender* sender,
+    compressor_t* compressor,
+    const long offset,
+    const size_t length) {
+    if (!flush_block_reference(data, sender) ||
+        (sender->gather.buffer_count + 2 > TLV_GATHER_MAX_BUFFERS && !send_delta_gather(data, sender))) {
+        return false;
+    }
+    add_content_to_gather(&sender->gather, compressor, sender->file + offset, length);
+    return send_delta_gather(data, sender);
+}
+
+/**
+ * @brief Sends the TLVs gathered for the delta.
+ *
+ * @param data The client internal data
+ * @param sender The delta being sent
+ *
+ * @return true if the TLVs were sent successfully
+ * @return false otherwise
+ **/
+bool send_delta_gather(client_data* data, delta_sender* sender) {
+    const bool sent = sender->gather.buffer_count == 0 || send_tlv_gather(data->transmission_socket, &sender->gather);
+    init_tlv_gather(&sender->gather);
+    sender->reference_count = 0;
+    return sent;
+}
+
+/**
+ * @brief Sends the file to a server chunk store. The file is split into
+ * content-defined chunks, so that content shared with other files, or with
+ * former versions of the file, is split alike whatever its offset. The hashes
+ * of all chunks are sent first, and only the content of the chunks the server
+ * replies it is missing follows, consecutive ones sent as a single run,
+ * compressed if negotiated. The digest still covers the whole file.
+ *
+ * @param data The client internal data
+ * @param fp The pointer to the opened file
+ * @param compressor The compressor, disabled if compression was not negotiated
+ *
+ * @return true if file chunks were sent and acknowledged successfully
+ * @return false otherwise
+ **/
+bool send_file_chunks(client_data* data, FILE* fp, compressor_t* compressor) {
+    bool sent = false;
+    const long file_size = get_filesize(fp);
+    const uint8_t* file = NULL;
+    uint8_t missing[CHUNK_LIST_BATCH_LEN / 8];
+    uint8_t* entries = malloc(CHUNK_LIST_BATCH_LEN * CHUNK_ENTRY_LENGTH);
+    if (entries == NULL) {
+        set_error_description("Out of memory");
+        print_error("Chunking file failed");
+        return false;
+    }
+    if (sal_map_file(fp, 0, file_size, &file) != SAL_OK) {
+        goto RELEASE;
+    }
+
+    /* Chunks are announced by batches, each followed by the content of its chunks the server is missing */
+    for (long offset = 0; offset < file_size;) {
+        long chunk_count = 0;
+        for (long cut = offset; cut < file_size && chunk_count < CHUNK_LIST_BATCH_LEN; ++chunk_count) {
+            const size_t length = fastcdc_cut(file + cut, file_size - cut);
+            chunk_write_entry(entries + chunk_count * CHUNK_ENTRY_LENGTH, file + cut, length);
+            cut += length;
+        }
+        if (sal_check_mapped_file(file) != SAL_OK ||
+            !send_chunk_list(data, entries, chunk_count) ||
+            !receive_missing_chunks(data, missing, chunk_count)) {
+            goto UNMAP;
+        }
+
+        long run_offset = 0;
+        long run_length = 0;
+        for (long chunk = 0; chunk < chunk_count; ++chunk) {
+            const uint8_t* entry = entries + chunk * CHUNK_ENTRY_LENGTH;
+            const long length = (long)entry[0] << 24 | entry[1] << 16 | entry[2] << 8 | entry[3];
+            if (missing[chunk / 8] & (0x80 >> chunk % 8)) {
+                run_offset = run_length > 0 ? run_offset : offset;
+                run_length += length;
+            } else if (run_length > 0) {
+                if (!send_chunk_content(data, compressor, file + run_offset, run_length)) {
+                    goto UNMAP;
+                }
+                run_length = 0;
+            }
+            offset += length;
+        }
+        if (run_length > 0 && !send_chunk_content(data, compressor, file + run_offset, run_length)) {
+            goto UNMAP;
+        }
+    }
+
+    uint8_t digest[CHECKSUM_MAX_LENGTH] = {0};
+    checksum_ctx_t checksum_ctx;
+    checksum_init(&checksum_ctx, data->checksum);
+    trace_checksum_update(&checksum_ctx, file, file_size);
+    checksum_final(&checksum_ctx, digest);
+    if (sal_check_mapped_file(file) != SAL_OK) {
+        goto UNMAP;
+    }
+    tlv_t tlv_checksum = new_checksum_tlv(data->arena, &data->protocol, data->checksum, digest);
+    sent = send_tlv_data(data->transmission_socket, &tlv_checksum);
+    reset_tlv_arena(data->arena);
+    sent = sent && check_reply(data);
+
+UNMAP:
+    sal_unmap_file(file, file_size);
+RELEASE:
+    free(entries);
+    return sent;
+}
+
+/**
+ * @brief Sends the entries of a batch of chunks, as many per TLV as fit.
+ *
+ * @param data The client internal data
+ * @param entries The chunk entries, CHUNK_ENTRY_LENGTH bytes each
+ * @param chunk_count The amount of chunks in the batch
+ *
+ * @return true if the chunk list was sent successfully
+ * @return false otherwise
+ **/
+bool send_chunk_list(client_data* data, const uint8_t* entries, const long chunk_count) {
+    const long entries_per_tlv = TLV_MAX_VALUE_LENGTH / CHUNK_ENTRY_LENGTH;
+    tlv_gather_t gather;
+    init_tlv_gather(&gather);
+    for (long first = 0; first < chunk_count; first += entries_per_tlv) {
+        const size_t length = MIN(chunk_count - first, entries_per_tlv) * CHUNK_ENTRY_LENGTH;
+        add_tlv_header_to_gather(&gather, TLV_TYPE_CHUNK_LIST, length);
+        add_buffer_to_gather(&gather, entries + first * CHUNK_ENTRY_LENGTH, length);
+        if (gather.buffer_count + 2 > TLV_GATHER_MAX_BUFFERS || first + entries_per_tlv >= chunk_count) {
+            if (!send_tlv_gather(data->transmission_socket, &gather)) {
+                return false;
+            }
+            init_tlv_gather(&gather);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Receives which chunks of a batch the server chunk store is missing,
+ * once it got the whole batch.
+ *
+ * @param data The client internal data
+ * @param[out] missing The bitmap, the most significant bit of its first byte standing for the first chunk
+ * @param chunk_count The amount of chunks in the batch
+ *
+ * @return true if the bitmap was received successfully
+ * @return false otherwise
+ **/
+bool receive_missing_chunks(client_data* data, uint8_t* missing, const long chunk_count) {
+    const size_t length = (chunk_count + 7) / 8;
+    for (size_t received = 0; received < length;) {
+        tlv_t tlv = {0};
+        const bool valid = receive_tlv_data(data->transmission_socket, data->arena, &tlv) &&
+            get_tlv_type(&tlv) == TLV_TYPE_MISSING_CHUNKS &&
+            get_tlv_length(&tlv) > 0 &&
+            get_tlv_length(&tlv) <= length - received;
+        if (valid) {
+            memcpy(missing + received, get_tlv_value_raw(&tlv), get_tlv_length(&tlv));
+            received += get_tlv_length(&tlv);
+        }
+        reset_tlv_arena(data->arena);
+        if (!valid) {
+            set_error_description("Invalid missing chunks");
+            print_error("Protocol error");
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Sends the content of consecutive missing chunks, as content chunks
+ * compressed each on its own if negotiated.
+ *
+ * @param data The client internal data
+ * @param compressor The compressor, disabled if compression was not negotiated
+ * @param content The content of the chunks
+ * @param length The content length
+ *
+ * @return true if the content was sent successfully
+ * @return false otherwise
+ **/
+bool send_chunk_content(client_data* data, compressor_t* compressor, const uint8_t* content, const size_t length) {
+    for (size_t offset = 0; offset < length; offset += PROTOCOL_MAX_COMPRESSED_CHUNK_LEN) {
+        tlv_gather_t gather;
+        init_tlv_gather(&gather);
+        add_content_to_gather(&gather, compressor, content + offset, MIN(length - offset, PROTOCOL_MAX_COMPRESSED_CHUNK_LEN));
+        if (!send_tlv_gather(data->transmission_socket, &gather)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Establishes a connection and negotiates the protocol parameters.
+ * Servers that only know protocol version 1 drop the connection on the
+ * hello TLV, so a new connection is established for using version 1.
+ *
+ * @param data The client internal data
+ *
+ * @return true if connection was established successfully
+ * @return false otherwise
+ **/
+bool open_connection(client_data* data) {
+    const protocol_hello local = {
+        .version = data->protocol_version,
+        .capabilities = get_local_capabilities(),
+        .max_frame_length = data->frame_length,
+        .max_streams = data->streams > 0 ? data->streams : PROTOCOL_MAX_STREAMS
+    };
+    data->protocol.version = PROTOCOL_VERSION_1;
+    data->protocol.capabilities = 0;
+    data->protocol.max_frame_length = TLV_MAX_VALUE_LENGTH;
+    data->protocol.max_streams = 1;
+
+    const uint64_t start = trace_clock();
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if ((data->transmission_socket = sal_create_socket()) == NULL) {
+            return false;
+        }
+        if (sal_connect(data->transmission_socket, &data->server_addr) != SAL_OK) {
+            goto DESTROY_SOCKET;
+        }
+        if (local.version == PROTOCOL_VERSION_1 || attempt > 0 ||
+            exchange_hello(data->transmission_socket, data->arena, &local, &data->protocol)) {
+            if (data->checksum != CHECKSUM_DEFAULT && !(data->protocol.capabilities & PROTOCOL_CAPABILITY_CHECKSUMS)) {
+                set_error_description("%s", get_checksum_name(data->checksum));
+                print_warning("Checksum algorithm not supported by server, falling back to default");
+                data->checksum = CHECKSUM_DEFAULT;
+            }
+            if (~data->protocol.capabilities & get_compression_capability(data->compression)) {
+                set_error_description("%s", get_compression_name(data->compression));
+                print_warning("Compression algorithm not supported by server, sending raw content");
+                data->compression = COMPRESSION_NONE;
+            }
+            data->connect_ns = trace_clock() - start;
+            return true;
+        }
+        print_warning("Protocol negotiation failed, falling back to version 1");
+        sal_close(data->transmission_socket);
+        sal_destroy_socket(data->transmission_socket);
+        data->transmission_socket = NULL;
+    }
+    return false;
+
+DESTROY_SOCKET:
+    sal_destroy_socket(data->transmission_socket);
+    data->transmission_socket = NULL;
+    return false;
+}
+
+/**
+ * @brief Sends a file, reconnecting after a failed transfer. Servers that
+ * support resuming continue an interrupted transfer from their partial file.
+ * Files the server rejected are not sent again.
+ *
+ * @param data The client internal data
+ *
+ * @return true if file was sent and acknowledged successfully
+ * @return false otherwise
+ **/
+bool send_file(client_data* data) {
+    FILE* fp = NULL;
+    if ((fp = fopen(data->path, "rb")) == NULL) {
+        set_error_description("%s", data->path);
+        print_error("Open file failed");
+        add_progress(data, 1, false, 0);
+        return false;
+    }
+    if (sal_get_file_identity(fp, &data->file_identity) != SAL_OK) {
+        data->file_identity = 0;
+    }
+
+    print_file_start(data, data->path, get_filesize(fp));
+    data->rejected = false;
+    data->wire_bytes = 0;
+    trace_begin(&data->trace);
+    PROBE2(file_start, data->path, get_filesize(fp));
+    bool sent = try_send_file(data, fp);
+    for (long retry = 1; !sent && !data->rejected && retry <= data->retries; ++retry) {
+        set_error_description("retry %ld of %ld", retry, data->retries);
+        print_warning("Transfer failed, reconnecting");
+        sal_sleep(RETRY_DELAY_MS * retry);
+        sent = try_send_file(data, fp);
+    }
+    report_file_outcome(data, &data->trace, data->path, get_filesize(fp), data->wire_bytes, sent);
+
+    fclose(fp);
+    fp = NULL;
+    return sent;
+}
+
+/**
+ * @brief Establishes a connection, unless one is already established, and
+ * sends a file through it.
+ *
+ * @param data The client internal data
+ * @param fp The pointer to the opened file
+ *
+ * @return true if file was sent and acknowledged successfully
+ * @return false otherwise
+ **/
+bool try_send_file(client_data* data, FILE* fp) {
+    if (fseek(fp, 0, SEEK_SET) != 0 || (data->transmission_socket == NULL && !open_connection(data))) {
+        return false;
+    }
+
+    const long file_size = get_filesize(fp);
+    const uint64_t sent_bytes = sal_get_sent_bytes(data->transmission_socket);
+    data->stream_count = get_stream_count(data, file_size);
+    data->range_offset = 0;
+    data->range_length = file_size;
+    bool sent = false;
+    if (file_size <= SMALL_FILE_MAX_LEN) {
+        sent = send_small_file(data, fp) && check_reply(data);
+    } else if (data->stream_count > 1) {
+        sent = send_file_streams(data, fp);
+    } else {
+        sent = send_file_range(data, fp);
+    }
+    data->wire_bytes += sal_get_sent_bytes(data->transmission_socket) - sent_bytes;
+
+    sal_close(data->transmission_socket);
+    sal_destroy_socket(data->transmission_socket);
+    data->transmission_socket = NULL;
+    return sent;
+}
+
+/**
+ * @brief Sends the header and the file range content through an established connection.
+ *
+ * @param data The client internal data
+ * @param fp The pointer to the opened file
+ *
+ * @return true if file range was sent and acknowledged successfully
+ * @return false otherwise
+ **/
+bool send_file_range(client_data* data, FILE* fp) {
+    if (data->zero_copy) {
+        return send_header(data, fp) && send_file_content_zero_copy(data, fp);
+    }
+    digest_pipeline_t* pipeline = NULL;
+    compressor_t compressor;
+    if (!compressor_init(&compressor, data->compression, data->compression_level)) {
+        return false;
+    }
+    bool sent = false;
+    if (is_delta(data, get_filesize(fp))) {
+        sent = send_header(data, fp) && send_file_delta(data, fp, &compressor);
+    } else if (is_dedup(data, get_filesize(fp))) {
+        sent = send_header(data, fp) && send_file_chunks(data, fp, &compressor);
+    } else if (data->mapped) {
+        sent = send_header(data, fp) && send_file_content_mapped(data, fp, &compressor);
+    } else {
+        sent = (!data->digest_thread || (pipeline = digest_pipeline_create(data->checksum)) != NULL) &&
+            send_header(data, fp) &&
+            send_file_content(data, fp, pipeline, &compressor);
+    }
+    digest_pipeline_destroy(pipeline);
+    compressor_release(&compressor);
+    return sent;
+}
+
+/**
+ * @brief Gets the amount of parallel streams a file is split into. A single
+ * connection rarely fills long distance links, while each stream costs a
+ * connection and its own hashing, so files get a stream per STREAM_RANGE_LEN
+ * bytes unless told otherwise, up to what the server allows.
+ *
+ * @param data The client internal data
+ * @param file_size The file size
+ *
+ * @return the amount of streams
+ **/
+long get_stream_count(const client_data* data, const long file_size) {
+    /* A delta is computed against the whole file */
+    if (file_size <= SMALL_FILE_MAX_LEN || (data->delta && (data->protocol.capabilities & PROTOCOL_CAPABILITY_DELTA))) {
+        return 1;
+    }
+    const long streams = data->streams > 0 ? data->streams : file_size / STREAM_RANGE_LEN;
+    return MAX(1, MIN(streams, data->protocol.max_streams));
+}
+
+/**
+ * @brief Sends a file split in ranges, each one over its own connection from
+ * its own thread. The established connection carries the first range. The
+ * ranges are aligned to SAL_MAP_ALIGNMENT, so they map and cache well on both ends.
+ *
+ * @param data The client internal data
+ * @param fp The pointer to the opened file
+ *
+ * @return true if all ranges were sent and acknowledged successfully
+ * @return false otherwise
+ **/
+bool send_file_streams(client_data* data, FILE* fp) {
+    const long file_size = get_filesize(fp);
+    long range_length = (file_size + data->stream_count - 1) / data->stream_count;
+    range_length += (SAL_MAP_ALIGNMENT - range_length % SAL_MAP_ALIGNMENT) % SAL_MAP_ALIGNMENT;
+    data->stream_count = (file_size + range_length - 1) / range_length;
+    if (sal_get_random((uint8_t*)&data->transfer_id, sizeof(data->transfer_id)) != SAL_OK) {
+        return false;
+    }
+
+    stream_data* streams = calloc(data->stream_count, sizeof(*streams));
+    if (streams == NULL) {
+        set_error_description("Out of memory");
+        print_error("Starting streams failed");
+        return false;
+    }
+    /* Every stream gets its resources before any of them connects, not to leave the server a partial transfer */
+    stream_start start = {0};
+    pthread_mutex_init(&start.lock, NULL);
+    pthread_cond_init(&start.decision, NULL);
+    bool sent = false;
+    for (long i = 0; i < data->stream_count; ++i) {
+        client_data* stream = i == 0 ? data : &streams[i].data;
+        if (i > 0) {
+            *stream = *data;
+            stream->transmission_socket = NULL;
+            stream->wire_bytes = 0;
+            streams[i].start = &start;
+            if ((stream->arena = acquire_tlv_arena()) == NULL) {
+                set_error_description("Stream %ld", i);
+                print_error("Starting streams failed");
+                goto RELEASE;
+            }
+        }
+        stream->range_offset = i * range_length;
+        stream->range_length = MIN(range_length, file_size - stream->range_offset);
+    }
+    long started = 1;
+    while (started < data->stream_count &&
+           pthread_create(&streams[started].thread, NULL, run_stream, &streams[started]) == 0) {
+        ++started;
+    }
+    if (started < data->stream_count) {
+        set_error_description("Stream %ld", started);
+        print_error("Starting streams failed");
+    }
+    decide_stream_start(&start, started == data->stream_count);
+
+    sent = started == data->stream_count && send_file_range(data, fp);
+    for (long i = 1; i < started; ++i) {
+        pthread_join(streams[i].thread, NULL);
+        sent = sent && streams[i].sent;
+        data->rejected = data->rejected || streams[i].data.rejected;
+        data->nacked = data->nacked || streams[i].data.nacked;
+        data->wire_bytes += streams[i].data.wire_bytes;
+        trace_merge(&data->trace, &streams[i].data.trace);
+    }
+
+RELEASE:
+    for (long i = 1; i < data->stream_count; ++i) {
+        release_tlv_arena(streams[i].data.arena);
+    }
+    pthread_cond_destroy(&start.decision);
+    pthread_mutex_destroy(&start.lock);
+    free(streams);
+    return sent;
+}
+
+/**
+ * @brief Lets the started stream threads connect, or stop if some stream
+ * thread could not be started.
+ *
+ * @param start The start of the streams of the file
+ * @param started Whether all stream threads were started
+ *
+ * @return No return
+ **/
+void decide_stream_start(stream_start* start, const bool started) {
+    pthread_mutex_lock(&start->lock);
+    start->decided = true;
+    start->started = started;
+    pthread_cond_broadcast(&start->decision);
+    pthread_mutex_unlock(&start->lock);
+}
+
+/**
+ * @brief Waits until all stream threads of the file were started.
+ *
+ * @param start The start of the streams of the file
+ *
+ * @return true if all stream threads were started
+ * @return false if some stream thread could not be started
+ **/
+bool wait_stream_start(stream_start* start) {
+    pthread_mutex_lock(&start->lock);
+    while (!start->decided) {
+        pthread_cond_wait(&start->decision, &start->lock);
+    }
+    const bool started = start->started;
+    pthread_mutex_unlock(&start->lock);
+    return started;
+}
+
+/**
+ * @brief Stream thread entry point: sends a file range over its own connection.
+ *
+ * @param arg The stream data
+ *
+ * @return NULL
+ **/
+void* run_stream(void* arg) {
+    stream_data* stream = arg;
+    client_data* data = &stream->data;
+    FILE* fp = NULL;
+    trace_begin(&data->trace);
+    if (!wait_stream_start(stream->start)) {
+        return NULL;
+    }
+    if ((fp = fopen(data->path, "rb")) == NULL) {
+        print_error("Open file failed");
+        return NULL;
+    }
+    if (open_connection(data)) {
+        /* A range sent without the capability would be taken for the whole file */
+        if (data->protocol.capabilities & PROTOCOL_CAPABILITY_MULTI_STREAM) {
+            const uint64_t sent_bytes = sal_get_sent_bytes(data->transmission_socket);
+            stream->sent = send_file_range(data, fp);
+            data->wire_bytes = sal_get_sent_bytes(data->transmission_socket) - sent_bytes;
+        } else {
+            set_error_description("Multi-stream transfer");
+            print_error("Capability not agreed");
+        }
+        sal_close(data->transmission_socket);
+        sal_destroy_socket(data->transmission_socket);
+        data->transmission_socket = NULL;
+    }
+    fclose(fp);
+    trace_collect(&data->trace);
+    return NULL;
+}
+
+/**
+ * @brief Checks server reply to ensure that file was received successfully,
+ * marking the file as nacked if the server refused it.
+ *
+ * @param data The client internal data
+ *
+ * @return true if the server acknowledged the file
+ * @return false otherwise
+ **/
+bool check_reply(client_data* data) {
+    tlv_t tlv = {0};
+    if (!receive_tlv_data(data->transmission_socket, data->arena, &tlv)) {
+        print_warning("Reply check failed");
+    }
+    bool ack = get_tlv_type(&tlv) == TLV_TYPE_ACK;
+    data->nacked = get_tlv_type(&tlv) == TLV_TYPE_NACK;
+    PROBE1(reply_received, ack);
+    reset_tlv_arena(data->arena);
+    return ack;
+}
+
+/**
+ * @brief Sends the files walked from the given paths through the requested
+ * amount of connections, each one served by its own thread taking the next
+ * file from the walk as it goes, until the walk is over. Each connection only
+ * holds the files of its session window and the one being sent, so memory
+ * and open files are bounded whatever the amount of files. Concurrent
+ * connections get their overall progress printed periodically, then once all
+ * files are sent.
+ *
+ * @param data The client internal data
+ *
+ * @return true if files were found, all of them sent and all paths walked
+ * @return false otherwise
+ **/
+bool send_tree(client_data* data) {
+    transfer_progress progress = {0};
+    progress.start_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC);
+    pthread_mutex_init(&progress.lock, NULL);
+    pthread_cond_init(&progress.finished, NULL);
+    worker_data* workers = calloc(data->connections, sizeof(*workers));
+    if (workers == NULL) {
+        set_error_description("Out of memory");
+        print_error("Starting connections failed");
+        goto RELEASE_PROGRESS;
+    }
+
+    long started = 0;
+    for (long i = 0; i < data->connections; ++i) {
+        client_data* worker = &workers[i].data;
+        *worker = *data;
+        worker->transmission_socket = NULL;
+        worker->path = NULL;
+        worker->path_count = 0;
+        worker->path_capacity = data->window + 1;
+        worker->concurrent = data->connections > 1;
+        worker->progress = &progress;
+        if ((worker->paths = calloc(worker->path_capacity, sizeof(*worker->paths))) == NULL ||
+            (worker->name_offsets = calloc(worker->path_capacity, sizeof(*worker->name_offsets))) == NULL) {
+            set_error_description("Out of memory");
+            print_error("Starting connection failed");
+            break;
+        }
+        if ((worker->arena = acquire_tlv_arena()) == NULL) {
+            break;
+        }
+        pthread_mutex_lock(&progress.lock);
+        ++progress.running;
+        pthread_mutex_unlock(&progress.lock);
+        if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+            pthread_mutex_lock(&progress.lock);
+            --progress.running;
+            pthread_mutex_unlock(&progress.lock);
+            reset_error_description();
+            print_error("Starting connection failed");
+            break;
+        }
+        started = i + 1;
+    }
+
+    pthread_mutex_lock(&progress.lock);
+    while (progress.running > 0) {
+        const uint64_t deadline_ns = sal_get_time_ns(SAL_CLOCK_WALL) + PROGRESS_INTERVAL_MS * 1000000ULL;
+        const struct timespec deadline = {deadline_ns / 1000000000ULL, deadline_ns % 1000000000ULL};
+        if (pthread_cond_timedwait(&progress.finished, &progress.lock, &deadline) == ETIMEDOUT && data->connections > 1) {
+            print_progress(data, &progress, "Progress:");
+        }
+    }
+    pthread_mutex_unlock(&progress.lock);
+    for (long i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for (long i = 0; i < data->connections; ++i) {
+        client_data* worker = &workers[i].data;
+        for (size_t j = 0; worker->paths != NULL && j < worker->path_capacity; ++j) {
+            free(worker->paths[j]);
+        }
+        free(worker->paths);
+        free(worker->name_offsets);
+        release_tlv_arena(worker->arena);
+    }
+    free(workers);
+    if (started > 0 && data->connections > 1) {
+        print_progress(data, &progress, "Total:");
+    }
+
+RELEASE_PROGRESS:
+    pthread_cond_destroy(&progress.finished);
+    pthread_mutex_destroy(&progress.lock);
+    /* Paths the walk skipped were reported as it went, and fail the transfer as files failing to be sent do */
+    const size_t walk_failures = path_walker_get_failures(data->walker);
+    if (progress.files_sent + progress.files_failed == 0 && walk_failures == 0) {
+        set_error_description("No files found");
+        print_error("Nothing to send");
+        return false;
+    }
+    return progress.files_failed == 0 && walk_failures == 0;
+}
+
+/**
+ * @brief Connection worker entry point: sends files taken from the walk
+ * through its own connection until the walk is over.
+ *
+ * @param arg The worker data
+ *
+ * @return NULL
+ **/
+void* run_worker(void* arg) {
+    worker_data* worker = arg;
+    send_files(&worker->data);
+    transfer_progress* progress = worker->data.progress;
+    pthread_mutex_lock(&progress->lock);
+    --progress->running;
+    pthread_cond_signal(&progress->finished);
+    pthread_mutex_unlock(&progress->lock);
+    return NULL;
+}
+
+/**
+ * @brief Prints the overall progress of the files sent through concurrent connections.
+ *
+ * @param data The client internal data
+ * @param progress The shared progress
+ * @param label The progress line label
+ *
+ * @return No return
+ **/
+void print_progress(const client_data* data, const transfer_progress* progress, const char* label) {
+    const unsigned long files_sent = __atomic_load_n(&progress->files_sent, __ATOMIC_RELAXED);
+    const unsigned long files_failed = __atomic_load_n(&progress->files_failed, __ATOMIC_RELAXED);
+    const uint64_t bytes_sent = __atomic_load_n(&progress->bytes_sent, __ATOMIC_RELAXED);
+    const double seconds = (sal_get_time_ns(SAL_CLOCK_MONOTONIC) - progress->start_ns) / 1e9;
+    print_msg(
+        "%s %lu files sent, %lu failed, %" PRIu64 " bytes in %.1f s (%.1f MB/s) through %ld connections\n",
+        label,
+        files_sent,
+        files_failed,
+        bytes_sent,
+        seconds,
+        seconds > 0 ? bytes_sent / seconds / 1e6 : 0,
+        data->connections);
+    fflush(stdout);
+}
+
+/**
+ * @brief Takes the next file to be sent from the walk, after the files
+ * taken so far. The paths ring only holds the files a session may still
+ * send again, so the path it overwrites was already replied.
+ *
+ * @param data The client internal data
+ *
+ * @return true if a file was taken
+ * @return false once the walk is over
+ **/
+bool take_path(client_data* data) {
+    char* path = NULL;
+    size_t name_offset = 0;
+    if (data->walker == NULL || path_walker_next(data->walker, &path, &name_offset, 1) == 0) {
+        return false;
+    }
+    char** slot = &data->paths[data->path_count % data->path_capacity];
+    free(*slot);
+    *slot = path;
+    data->name_offsets[data->path_count % data->path_capacity] = name_offset;
+    ++data->path_count;
+    return true;
+}
+
+/**
+ * @brief Gets the path of a file taken from the walk, which must not be
+ * older than the session window.
+ *
+ * @param data The client internal data
+ * @param index The file index, counting all files taken so far
+ *
+ * @return the file path
+ **/
+char* get_path(const client_data* data, const size_t index) {
+    return data->paths[index % data->path_capacity];
+}
+
+/**
+ * @brief Makes a file taken from the walk, which must not be older than the
+ * session window, the file being sent.
+ *
+ * @param data The client internal data
+ * @param index The file index, counting all files taken so far
+ *
+ * @return No return
+ **/
+void select_path(client_data* data, const size_t index) {
+    data->path = get_path(data, index);
+    data->name_offset = data->name_offsets[index % data->path_capacity];
+}
+
+/**
+ * @brief Sends many files over a single connection, as a session. Small files
+ * are sent ahead of their replies, up to the window, so that neither a round
+ * trip nor a connection setup is paid per file. After a connection failure,
+ * the session is reestablished from the first file not yet replied. Servers
+ * without sessions get a connection per file.
+ *
+ * @param data The client internal data
+ *
+ * @return No return
+ **/
+void send_files(client_data* data) {
+    size_t next = 0;
+    long retry = 0;
+    while (next < data->path_count || take_path(data)) {
+        const bool opened = open_connection(data);
+        if (opened && !(data->protocol.capabilities & PROTOCOL_CAPABILITY_SESSION)) {
+            /* The established connection carries the first file */
+            for (; next < data->path_count || take_path(data); ++next) {
+                select_path(data, next);
+                send_file(data);
+            }
+            return;
+        }
+        const size_t first = next;
+        if (opened) {
+            const bool sent = send_session_files(data, &next);
+            sal_close(data->transmission_socket);
+            sal_destroy_socket(data->transmission_socket);
+            data->transmission_socket = NULL;
+            if (sent) {
+                retry = 0;
+                continue;
+            }
+        }
+        if (next > first) {
+            retry = 0;
+        }
+        if (++retry > data->retries) {
+            set_error_description("%zu files not sent", data->path_count - next);
+            print_error("Session failed");
+            add_progress(data, data->path_count - next, false, 0);
+            return;
+        }
+        set_error_description("retry %ld of %ld", retry, data->retries);
+        print_warning("Session failed, reconnecting");
+        sal_sleep(RETRY_DELAY_MS * retry);
+    }
+}
+
+/**
+ * @brief Sends files over an established session connection. Large files
+ * wait for the pending replies, then go through the single file path with
+ * its streams and resuming. A file split in several streams ends the
+ * session, as servers serving a connection per thread may have queued one
+ * of its streams behind the session connection.
+ *
+ * @param data The client internal data
+ * @param[in,out] next The index of the first file to be sent, updated to the
+ * first file left for another session, or on failure to the first file not yet replied
+ *
+ * @return true if the session files were sent, whatever their reply
+ * @return false if the connection failed
+ **/
+bool send_session_files(client_data* data, size_t* next) {
+    session_window window;
+    window.head = 0;
+    window.count = 0;
+    for (size_t i = *next; i < data->path_count || take_path(data); ++i) {
+        select_path(data, i);
+        FILE* fp = NULL;
+        if ((fp = fopen(data->path, "rb")) == NULL) {
+            set_error_description("%s", data->path);
+            print_error("Open file failed");
+            add_progress(data, 1, false, 0);
+            continue;
+        }
+        const long file_size = get_filesize(fp);
+        data->stream_count = 1;
+        data->range_offset = 0;
+        data->range_length = file_size;
+        data->rejected = false;
+        data->nacked = false;
+        data->wire_bytes = 0;
+        bool sent = false;
+        if (file_size <= SMALL_FILE_MAX_LEN) {
+            sent = receive_session_replies(data, &window, data->window - 1);
+            trace_begin(&data->trace);
+            PROBE2(file_start, data->path, file_size);
+            const uint64_t sent_bytes = sal_get_sent_bytes(data->transmission_socket);
+            if (sent && (sent = send_small_file(data, fp))) {
+                trace_collect(&data->trace);
+                window.files[(window.head + window.count) % data->window] = (pending_file){
+                    i, file_size, sal_get_sent_bytes(data->transmission_socket) - sent_bytes, data->trace};
+                ++window.count;
+            }
+        } else if (receive_session_replies(data, &window, 0)) {
+            if (sal_get_file_identity(fp, &data->file_identity) != SAL_OK) {
+                data->file_identity = 0;
+            }
+            print_file_start(data, data->path, file_size);
+            trace_begin(&data->trace);
+            PROBE2(file_start, data->path, file_size);
+            data->stream_count = get_stream_count(data, file_size);
+            const uint64_t sent_bytes = sal_get_sent_bytes(data->transmission_socket);
+            sent = data->stream_count > 1 ? send_file_streams(data, fp) : send_file_range(data, fp);
+            data->wire_bytes += sal_get_sent_bytes(data->transmission_socket) - sent_bytes;
+            /* A file the connection failed under is sent again by the next session, its outcome not being known yet */
+            if (sent || data->rejected || data->nacked) {
+                report_file_outcome(data, &data->trace, data->path, file_size, data->wire_bytes, sent);
+            } else if (data->line_started) {
+                print_msg(" interrupted\n");
+                data->line_started = false;
+            }
+        }
+        fclose(fp);
+        fp = NULL;
+        /* A rejected or nacked file leaves the session usable, as the server is waiting for the next one */
+        if (!sent && !data->rejected && !data->nacked) {
+            *next = window.count > 0 ? window.files[window.head].index : i;
+            return false;
+        }
+        if (data->stream_count > 1) {
+            *next = i + 1;
+            return true;
+        }
+    }
+    if (!receive_session_replies(data, &window, 0)) {
+        *next = window.files[window.head].index;
+        return false;
+    }
+    *next = data->path_count;
+    return true;
+}
+
+/**
+ * @brief Receives the replies of the oldest files of a session, in the
+ * order they were sent, and reports their outcome.
+ *
+ * @param data The client internal data
+ * @param window The files waiting for their reply
+ * @param limit The amount of files left waiting for their reply
+ *
+ * @return true if the replies were received
+ * @return false if the connection failed
+ **/
+bool receive_session_replies(client_data* data, session_window* window, const size_t limit) {
+    while (window->count > limit) {
+        pending_file* file = &window->files[window->head];
+        tlv_t tlv = {0};
+        trace_resume(&file->trace);
+        if (!receive_tlv_data(data->transmission_socket, data->arena, &tlv)) {
+            reset_tlv_arena(data->arena);
+            print_warning("Reply check failed");
+            return false;
+        }
+        const tlv_type type = get_tlv_type(&tlv);
+        reset_tlv_arena(data->arena);
+        PROBE1(reply_received, type == TLV_TYPE_ACK);
+        if (type != TLV_TYPE_ACK && type != TLV_TYPE_NACK) {
+            set_error_description("Unexpected reply");
+            print_error("Protocol error");
+            return false;
+        }
+        report_file_outcome(
+            data,
+            &file->trace,
+            get_path(data, file->index),
+            file->file_size,
+            file->wire_bytes,
+            type == TLV_TYPE_ACK);
+        window->head = (window->head + 1) % data->window;
+        --window->count;
+    }
+    return true;
+}
+
+/**
+ * @brief Prints the start of the line reporting the file being sent, its
+ * outcome being printed once known. Files sent through concurrent connections
+ * get their whole line printed with their outcome instead, so that lines of
+ * different files don't get mixed.
+ *
+ * @param data The client internal data
+ * @param path The file path
+ * @param file_size The file size
+ *
+ * @return No return
+ **/
+void print_file_start(client_data* data, const char* path, const long file_size) {
+    if (!data->concurrent) {
+        print_msg("Sending file \"%s\" containing %ld bytes...", path, file_size);
+        fflush(stdout);
+        data->line_started = true;
+    }
+}
+
+/**
+ * @brief Reports the outcome of a sent file: its line is printed, its
+ * progress counted and, if tracing is enabled, its trace written. The first
+ * file sent through a connection carries the time establishing it.
+ *
+ * @param data The client internal data
+ * @param trace The file trace
+ * @param path The file path
+ * @param file_size The file size
+ * @param wire_bytes The bytes sent for the file, less than its size if resumed, deduplicated or compressed
+ * @param sent Whether the file was sent and acknowledged successfully
+ *
+ * @return No return
+ **/
+void report_file_outcome(
+    client_data* data,
+    trace_file_t* trace,
+    const char* path,
+    const long file_size,
+    const long wire_bytes,
+    bool sent) {
+    if (data->line_started) {
+        print_msg(sent ? " done\n" : " error\n");
+    } else {
+        print_msg("Sending file \"%s\" containing %ld bytes... %s\n", path, file_size, sent ? "done" : "error");
+    }
+    data->line_started = false;
+    add_progress(data, 1, sent, file_size);
+    PROBE2(file_done, path, sent);
+    trace->connect_ns = data->connect_ns;
+    data->connect_ns = 0;
+    trace_end(trace, "client", path, file_size, wire_bytes, sent);
+}
+
+/**
+ * @brief Counts files whose outcome is known on the shared progress, if any.
+ *
+ * @param data The client internal data
+ * @param files The amount of files
+ * @param sent Whether the files were sent and acknowledged successfully
+ * @param bytes The size of the files
+ *
+ * @return No return
+ **/
+void add_progress(client_data* data, const unsigned long files, const bool sent, const long bytes) {
+    transfer_progress* progress = data->progress;
+    if (progress == NULL) {
+        return;
+    }
+    if (sent) {
+        __atomic_add_fetch(&progress->files_sent, files, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&progress->bytes_sent, (uint64_t)bytes, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&progress->files_failed, files, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Parses input arguments and validate them.
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments values
+ * @param[out] data The client internal data
+ *
+ * @return true if given arguments are valid
+ * @return false otherwise
+ **/
+bool parse_input(const int argc, const char** argv, client_data* data) {
+    /* Paths come first, the destination follows them and options start with "--" */
+    int options = 1;
+    while (options < argc && strncmp(argv[options], "--", 2) != 0) {
+        ++options;
+    }
+    if (options < 3) {
+        return false;
+    }
+    const char* server_ip = argv[options - 2];
+    const char* server_port_arg = argv[options - 1];
+    const char* list_path = NULL;
+    data->protocol_version = PROTOCOL_VERSION;
+    data->frame_length = DEFAULT_FRAME_LENGTH;
+    data->checksum = CHECKSUM_DEFAULT;
+    data->compression = COMPRESSION_NONE;
+    data->compression_level = COMPRESSION_DEFAULT_LEVEL;
+    data->retries = DEFAULT_RETRIES;
+    data->streams = 0;
+    data->window = DEFAULT_WINDOW;
+    data->connections = 1;
+    for (int i = options; i < argc; ++i) {
+        if (strcmp(argv[i], "--sendfile") == 0) {
+            data->zero_copy = true;
+        } else if (strcmp(argv[i], "--digest-thread") == 0) {
+            data->digest_thread = true;
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            data->mapped = true;
+        } else if (strcmp(argv[i], "--delta") == 0) {
+            data->delta = true;
+        } else if (strcmp(argv[i], "--protocol") == 0 && i + 1 < argc) {
+            data->protocol_version = atol(argv[++i]);
+            if (data->protocol_version < PROTOCOL_VERSION_1 || data->protocol_version > PROTOCOL_VERSION) {
+                set_error_description("%ld", data->protocol_version);
+                print_error("Invalid protocol version");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--frame-length") == 0 && i + 1 < argc) {
+            data->frame_length = atol(argv[++i]);
+            if (data->frame_length < 0) {
+                set_error_description("%ld", data->frame_length);
+                print_error("Invalid frame length");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--checksum") == 0 && i + 1 < argc) {
+            if ((data->checksum = get_checksum_by_name(argv[++i])) == 0) {
+                set_error_description("%s", argv[i]);
+                print_error("Invalid checksum algorithm");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--compress") == 0 && i + 1 < argc) {
+            if (!get_compression_by_name(argv[++i], &data->compression)) {
+                set_error_description("%s", argv[i]);
+                print_error("Invalid compression algorithm");
+                return false;
+            }
+            if (!is_compression_supported(data->compression)) {
+                set_error_description("%s", argv[i]);
+                print_error("Compression library not installed");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--compress-level") == 0 && i + 1 < argc) {
+            data->compression_level = atoi(argv[++i]);
+            if (data->compression_level < 1 || data->compression_level > COMPRESSION_MAX_LEVEL) {
+                set_error_description("%d", data->compression_level);
+                print_error("Invalid compression level");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--streams") == 0 && i + 1 < argc) {
+            data->streams = atol(argv[++i]);
+            if (data->streams < 0 || data->streams > PROTOCOL_MAX_STREAMS) {
+                set_error_description("%ld", data->streams);
+                print_error("Invalid stream count");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            if (!trace_open(argv[++i])) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            data->window = atol(argv[++i]);
+            if (data->window < 1 || data->window > PROTOCOL_MAX_SESSION_WINDOW) {
+                set_error_description("%ld", data->window);
+                print_error("Invalid window");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            data->recursive = true;
+        } else if (strcmp(argv[i], "--files-from") == 0 && i + 1 < argc) {
+            list_path = argv[++i];
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            data->connections = atol(argv[++i]);
+            if (data->connections < 1 || data->connections > MAX_CONNECTIONS) {
+                set_error_description("%ld", data->connections);
+                print_error("Invalid connection count");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            data->retries = atol(argv[++i]);
+            if (data->retries < 0) {
+                set_error_description("%ld", data->retries);
+                print_error("Invalid retries");
+                return false;
+            }
+        } else {
+            set_error_description("%s", argv[i]);
+            print_error("Invalid option");
+            return false;
+        }
+    }
+
+    if (data->zero_copy && data->compression != COMPRESSION_NONE) {
+        set_error_description("--sendfile and --compress");
+        print_error("Incompatible options");
+        return false;
+    }
+    if (data->zero_copy && data->delta) {
+        set_error_description("--sendfile and --delta");
+        print_error("Incompatible options");
+        return false;
+    }
+    if (data->mapped && (data->zero_copy || data->digest_thread)) {
+        set_error_description("--mmap and %s", data->zero_copy ? "--sendfile" : "--digest-thread");
+        print_error("Incompatible options");
+        return false;
+    }
+
+    /* A single file is sent on its own, anything else is walked as it is sent */
+    if (options == 4 && list_path == NULL && sal_is_file_readable(argv[1]) == SAL_OK) {
+        if ((data->paths = malloc(sizeof(*data->paths))) == NULL || (data->paths[0] = strdup(argv[1])) == NULL) {
+            set_error_description("Out of memory");
+            print_error("Adding path failed");
+            return false;
+        }
+        data->path_capacity = 1;
+        data->path_count = 1;
+    } else {
+        if (options == 3 && list_path == NULL) {
+            return false;
+        }
+        if ((data->walker = path_walker_create(data->recursive)) == NULL) {
+            return false;
+        }
+        for (int i = 1; i < options - 2; ++i) {
+            if (!path_walker_add_path(data->walker, argv[i])) {
+                return false;
+            }
+        }
+        if (list_path != NULL && !path_walker_set_list(data->walker, list_path)) {
+            return false;
+        }
+    }
+
+    struct in_addr server_ip_addr = {0};
+    if (inet_aton(server_ip, &server_ip_addr) == 0) {
+        set_error_description("%s", server_ip);
+        print_error("Invalid destination IP");
+        return false;
+    }
+
+    const int server_port = atoi(server_port_arg);
+    if ((server_port <= 0) || (server_port > 65535)) {
+        set_error_description("%d", server_port);
+        print_error("Invalid destination port");
+        return false;
+    }
+
+    data->server_addr.sin_addr = server_ip_addr;
+    data->server_addr.sin_port = htons(server_port);
+    data->server_addr.sin_family = AF_INET;
+
+    return true;
+}
+
+/**
+ * @brief Releases client internal data.
+ *
+ * @param data The client internal data
+ *
+ * @return true if given arguments are valid
+ * @return false otherwise
+ **/
+void release_client_data(client_data* data) {
+    for (size_t i = 0; data->paths != NULL && i < data->path_capacity; ++i) {
+        free(data->paths[i]);
+    }
+    free(data->paths);
+    data->paths = NULL;
+    data->path_capacity = 0;
+    data->path_count = 0;
     data->path = NULL;
+    path_walker_destroy(data->walker);
+    data->walker = NULL;
     sal_destroy_socket(data->transmission_socket);
     data->transmission_socket = NULL;
+    release_tlv_arena(data->arena);
+    data->arena = NULL;
+    trace_close();
 }
@@ -6,7 +6,11 @@
 
 #include "common.h"
 
-static char root_error_log_buffer[LOG_MSG_MAX_LENGTH + 1];
+/**
+ * @brief The pending error description, kept per thread so that concurrent
+ * workers don't overwrite each other descriptions.
+ **/
+static __thread char root_error_log_buffer[LOG_MSG_MAX_LENGTH + 1];
 
 void set_error_description(const char * format, ...) {
     va_list args;
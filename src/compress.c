@@ -0,0 +1,179 @@
+#include <string.h> //strcmp
+#include <pthread.h>
+
+#include "compress.h"
+#include "sal.h"
+#include "common.h"
+
+#define LZ4_LIBRARY "liblz4.so.1"
+#define ZSTD_LIBRARY "libzstd.so.1"
+#define COMPRESSION_MIN_SAVING 16 ///< chunks shall shrink by at least 1/16th of their length to be sent compressed
+#define COMPRESSION_MAX_MISSES 4 ///< the amount of consecutive chunks not shrinking before chunks are skipped
+#define COMPRESSION_SKIPPED_CHUNKS 15 ///< the amount of chunks left raw between two tries on incompressible content
+
+/**
+ * @brief The LZ4 functions in use, as declared by lz4.h.
+ **/
+typedef struct {
+    int (*compress)(const char* src, char* dst, int src_size, int dst_capacity); ///< LZ4_compress_default
+    int (*decompress)(const char* src, char* dst, int compressed_size, int dst_capacity); ///< LZ4_decompress_safe
+} lz4_library;
+
+/**
+ * @brief The Zstandard functions in use, as declared by zstd.h.
+ **/
+typedef struct {
+    void* (*create_cctx)(void); ///< ZSTD_createCCtx
+    size_t (*free_cctx)(void* cctx); ///< ZSTD_freeCCtx
+    size_t (*compress)(void* cctx, void* dst, size_t dst_capacity, const void* src, size_t src_size, int level); ///< ZSTD_compressCCtx
+    void* (*create_dctx)(void); ///< ZSTD_createDCtx
+    size_t (*decompress)(void* dctx, void* dst, size_t dst_capacity, const void* src, size_t src_size); ///< ZSTD_decompressDCtx
+    unsigned (*is_error)(size_t code); ///< ZSTD_isError
+} zstd_library;
+
+static lz4_library lz4 = {0}; ///< the LZ4 functions, all NULL if the library is not installed
+static zstd_library zstd = {0}; ///< the Zstandard functions, all NULL if the library is not installed
+static pthread_once_t libraries_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Loads the compression libraries that are installed.
+ *
+ * @return No return
+ **/
+static void load_libraries() {
+    lz4_library loaded_lz4 = {0};
+    if (sal_load_symbol(LZ4_LIBRARY, "LZ4_compress_default", (void**)&loaded_lz4.compress) == SAL_OK &&
+        sal_load_symbol(LZ4_LIBRARY, "LZ4_decompress_safe", (void**)&loaded_lz4.decompress) == SAL_OK) {
+        lz4 = loaded_lz4;
+    }
+    zstd_library loaded_zstd = {0};
+    if (sal_load_symbol(ZSTD_LIBRARY, "ZSTD_createCCtx", (void**)&loaded_zstd.create_cctx) == SAL_OK &&
+        sal_load_symbol(ZSTD_LIBRARY, "ZSTD_freeCCtx", (void**)&loaded_zstd.free_cctx) == SAL_OK &&
+        sal_load_symbol(ZSTD_LIBRARY, "ZSTD_compressCCtx", (void**)&loaded_zstd.compress) == SAL_OK &&
+        sal_load_symbol(ZSTD_LIBRARY, "ZSTD_createDCtx", (void**)&loaded_zstd.create_dctx) == SAL_OK &&
+        sal_load_symbol(ZSTD_LIBRARY, "ZSTD_decompressDCtx", (void**)&loaded_zstd.decompress) == SAL_OK &&
+        sal_load_symbol(ZSTD_LIBRARY, "ZSTD_isError", (void**)&loaded_zstd.is_error) == SAL_OK) {
+        zstd = loaded_zstd;
+    }
+}
+
+bool is_compression_supported(const long algorithm) {
+    pthread_once(&libraries_once, load_libraries);
+    switch (algorithm) {
+    case COMPRESSION_NONE:
+        return true;
+    case COMPRESSION_LZ4:
+        return lz4.compress != NULL;
+    case COMPRESSION_ZSTD:
+        return zstd.compress != NULL;
+    }
+    return false;
+}
+
+bool get_compression_by_name(const char* name, compression_algorithm* algorithm) {
+    for (compression_algorithm candidate = COMPRESSION_NONE; candidate <= COMPRESSION_ZSTD; ++candidate) {
+        if (strcmp(name, get_compression_name(candidate)) == 0) {
+            *algorithm = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* get_compression_name(const compression_algorithm algorithm) {
+    switch (algorithm) {
+    case COMPRESSION_NONE:
+        return "none";
+    case COMPRESSION_LZ4:
+        return "lz4";
+    case COMPRESSION_ZSTD:
+        return "zstd";
+    }
+    return "unknown";
+}
+
+bool compressor_init(compressor_t* compressor, const compression_algorithm algorithm, const int level) {
+    memset(compressor, 0, sizeof(*compressor));
+    if (!is_compression_supported(algorithm)) {
+        set_error_description("%s", get_compression_name(algorithm));
+        print_error("Compression algorithm not available");
+        return false;
+    }
+    compressor->algorithm = algorithm;
+    compressor->level = level;
+    if (algorithm == COMPRESSION_ZSTD && (compressor->zstd_ctx = zstd.create_cctx()) == NULL) {
+        set_error_description("Out of memory");
+        print_error("Starting compression failed");
+        return false;
+    }
+    return true;
+}
+
+void compressor_release(compressor_t* compressor) {
+    if (compressor->zstd_ctx) {
+        zstd.free_cctx(compressor->zstd_ctx);
+        compressor->zstd_ctx = NULL;
+    }
+}
+
+size_t compressor_compress(compressor_t* compressor, const uint8_t* chunk, const size_t length, uint8_t* compressed) {
+    if (compressor->algorithm == COMPRESSION_NONE || length == 0) {
+        return 0;
+    }
+    if (compressor->skipped > 0) {
+        --compressor->skipped;
+        return 0;
+    }
+    /* Output not fitting the capacity is how both libraries report a chunk that does not shrink enough */
+    const size_t capacity = length - length / COMPRESSION_MIN_SAVING - 1;
+    size_t compressed_length = 0;
+    if (compressor->algorithm == COMPRESSION_LZ4) {
+        compressed_length = lz4.compress((const char*)chunk, (char*)compressed, length, capacity);
+    } else {
+        compressed_length = zstd.compress(compressor->zstd_ctx, compressed, capacity, chunk, length, compressor->level);
+        if (zstd.is_error(compressed_length)) {
+            compressed_length = 0;
+        }
+    }
+    if (compressed_length == 0) {
+        if (++compressor->misses >= COMPRESSION_MAX_MISSES) {
+            compressor->skipped = COMPRESSION_SKIPPED_CHUNKS;
+        }
+        return 0;
+    }
+    compressor->misses = 0;
+    return compressed_length;
+}
+
+bool decompress_chunk(
+    const compression_algorithm algorithm,
+    const uint8_t* compressed,
+    const size_t length,
+    uint8_t* chunk,
+    const size_t chunk_length) {
+    /* A context per thread, kept for the thread lifetime, as receiving threads live as long as the server */
+    static __thread void* zstd_dctx = NULL;
+
+    if (!is_compression_supported(algorithm) || algorithm == COMPRESSION_NONE) {
+        set_error_description("%s", get_compression_name(algorithm));
+        return false;
+    }
+    if (algorithm == COMPRESSION_LZ4) {
+        const int decompressed = lz4.decompress((const char*)compressed, (char*)chunk, length, chunk_length);
+        if (decompressed < 0 || (size_t)decompressed != chunk_length) {
+            set_error_description("Corrupted LZ4 chunk");
+            return false;
+        }
+        return true;
+    }
+    if (zstd_dctx == NULL && (zstd_dctx = zstd.create_dctx()) == NULL) {
+        set_error_description("Out of memory");
+        return false;
+    }
+    const size_t decompressed = zstd.decompress(zstd_dctx, chunk, chunk_length, compressed, length);
+    if (zstd.is_error(decompressed) || decompressed != chunk_length) {
+        set_error_description("Corrupted Zstandard chunk");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef _COMPRESS_H_
+#define _COMPRESS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+typedef enum {
+    COMPRESSION_NONE = 0, ///< file content is sent as is
+    COMPRESSION_LZ4, ///< the LZ4 block format, for speed
+    COMPRESSION_ZSTD ///< the Zstandard frame format, at a chosen level
+} compression_algorithm;
+
+#define COMPRESSION_DEFAULT_LEVEL 3 ///< the Zstandard level used unless told otherwise
+#define COMPRESSION_MAX_LEVEL 19 ///< the highest Zstandard level offered
+
+/**
+ * @brief Compresses chunks independently of each other. Chunks that do not
+ * shrink are left raw, and after a few of them in a row only one chunk in
+ * a while is tried, so incompressible content costs almost no CPU.
+ **/
+typedef struct {
+    compression_algorithm algorithm; ///< the algorithm in use, COMPRESSION_NONE if disabled
+    int level; ///< the compression level (Zstandard only)
+    void* zstd_ctx; ///< the Zstandard compression context, reused for every chunk
+    unsigned misses; ///< the amount of consecutive chunks that did not shrink
+    unsigned skipped; ///< the amount of chunks still to be left raw without trying
+} compressor_t;
+
+/**
+ * @brief Checks whether an algorithm identifier, as received from a peer, is
+ * supported. The compression libraries are loaded at runtime, on first use,
+ * so an algorithm is only supported if its library is installed.
+ *
+ * @param algorithm The algorithm identifier
+ *
+ * @return true if algorithm is supported
+ * @return false otherwise
+ **/
+bool is_compression_supported(const long algorithm);
+
+/**
+ * @brief Gets the algorithm identified by a name, as given on command line.
+ *
+ * @param name The algorithm name: none, lz4 or zstd
+ * @param[out] algorithm The algorithm
+ *
+ * @return true if name is known
+ * @return false otherwise
+ **/
+bool get_compression_by_name(const char* name, compression_algorithm* algorithm);
+
+/**
+ * @brief Gets the algorithm name.
+ *
+ * @param algorithm The given algorithm
+ *
+ * @return the algorithm name
+ **/
+const char* get_compression_name(const compression_algorithm algorithm);
+
+/**
+ * @brief Prepares a compressor.
+ * @note The compressor shall be released by compressor_release().
+ *
+ * @param[out] compressor The compressor
+ * @param algorithm The algorithm to be used, COMPRESSION_NONE to disable compression
+ * @param level The compression level (Zstandard only)
+ *
+ * @return true if compressor is ready
+ * @return false otherwise
+ **/
+bool compressor_init(compressor_t* compressor, const compression_algorithm algorithm, const int level);
+
+/**
+ * @brief Releases a compressor.
+ *
+ * @param compressor The compressor
+ *
+ * @return No return
+ **/
+void compressor_release(compressor_t* compressor);
+
+/**
+ * @brief Compresses a chunk, if it is worth it.
+ *
+ * @param compressor The compressor
+ * @param chunk The chunk
+ * @param length The chunk length
+ * @param[out] compressed The compressed chunk, at least length bytes long
+ *
+ * @return the compressed chunk length
+ * @return 0 if the chunk shall be sent raw
+ **/
+size_t compressor_compress(compressor_t* compressor, const uint8_t* chunk, const size_t length, uint8_t* compressed);
+
+/**
+ * @brief Decompresses a chunk compressed by compressor_compress().
+ *
+ * @param algorithm The algorithm the chunk was compressed with
+ * @param compressed The compressed chunk
+ * @param length The compressed chunk length
+ * @param[out] chunk The decompressed chunk
+ * @param chunk_length The original chunk length, as announced by the peer
+ *
+ * @return true if the chunk was decompressed to exactly its original length
+ * @return false otherwise
+ **/
+bool decompress_chunk(
+    const compression_algorithm algorithm,
+    const uint8_t* compressed,
+    const size_t length,
+    uint8_t* chunk,
+    const size_t chunk_length);
+
+#endif /* _COMPRESS_H_ */
@@ -0,0 +1,141 @@
+#include <string.h> //memcpy
+#include <pthread.h>
+
+#include "checksum_imp.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32C_X86 //SSE4.2 crc32 instruction, checked at runtime
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h> //getauxval
+#define CRC32C_ARM //ARMv8 CRC32 extension, checked at runtime
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#define CRC32C_POLYNOMIAL 0x82F63B78 ///< the reversed Castagnoli polynomial
+
+typedef uint32_t (*crc32c_kernel_t)(uint32_t crc, const uint8_t* data, size_t length);
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static crc32c_kernel_t kernel = NULL; ///< the implementation chosen for the running CPU
+static const char* kernel_name = NULL;
+static uint32_t table[8][256]; ///< the slicing-by-8 lookup tables (portable implementation only)
+
+/**
+ * @brief Computes CRC-32C 8 bytes at a time with lookup tables.
+ *
+ * @param crc The running CRC
+ * @param data The data
+ * @param length The data length
+ *
+ * @return the updated CRC
+ **/
+static uint32_t crc32c_portable(uint32_t crc, const uint8_t* data, size_t length) {
+    for (; length >= 8; data += 8, length -= 8) {
+        const uint32_t low = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24);
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^
+            table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+            table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+    }
+    for (; length > 0; ++data, --length) {
+        crc = table[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(CRC32C_X86)
+/**
+ * @brief Computes CRC-32C with the SSE4.2 crc32 instruction.
+ * @see crc32c_portable()
+ **/
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data, size_t length) {
+    uint64_t crc64 = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    for (; length > 0; ++data, --length) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+#elif defined(CRC32C_ARM)
+/**
+ * @brief Computes CRC-32C with the ARMv8 CRC32 instructions.
+ * @see crc32c_portable()
+ **/
+__attribute__((target("+crc")))
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t* data, size_t length) {
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; length > 0; ++data, --length) {
+        crc = __crc32cb(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+/**
+ * @brief Chooses the fastest implementation supported by the running CPU.
+ *
+ * @return No return
+ **/
+static void select_kernel() {
+#if defined(CRC32C_X86)
+    if (!is_portable_checksum_forced() && __builtin_cpu_supports("sse4.2")) {
+        kernel = crc32c_sse42;
+        kernel_name = "sse4.2";
+        return;
+    }
+#elif defined(CRC32C_ARM)
+    if (!is_portable_checksum_forced() && (getauxval(AT_HWCAP) & HWCAP_CRC32)) {
+        kernel = crc32c_armv8;
+        kernel_name = "armv8-crc";
+        return;
+    }
+#endif
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+        }
+        table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int slice = 1; slice < 8; ++slice) {
+            table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+        }
+    }
+    kernel = crc32c_portable;
+    kernel_name = "portable";
+}
+
+void crc32c_init(uint32_t* state) {
+    pthread_once(&kernel_once, select_kernel);
+    *state = 0xFFFFFFFF;
+}
+
+void crc32c_update(uint32_t* state, const uint8_t* data, size_t length) {
+    *state = kernel(*state, data, length);
+}
+
+void crc32c_final(const uint32_t* state, uint8_t* checksum) {
+    const uint32_t crc = ~*state;
+    for (int i = 0; i < CRC32C_LENGTH; ++i) {
+        checksum[i] = (crc >> ((CRC32C_LENGTH - i - 1) * 8)) & 0xFF;
+    }
+}
+
+const char* crc32c_kernel() {
+    pthread_once(&kernel_once, select_kernel);
+    return kernel_name;
+}
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h> //memcmp
+
+#include "delta.h"
+#include "checksum.h"
+#include "common.h"
+
+#define DELTA_WEAK_MODULUS 65536 ///< both halves of the rolling checksum are kept modulo 2^16
+#define DELTA_EMPTY_SLOT -1 ///< marks a free slot of the index
+
+/**
+ * @brief The block index, an open addressing hash table on the rolling
+ * checksums, twice as large as the amount of blocks.
+ **/
+struct Sdelta_index {
+    const uint8_t* signatures; ///< the signatures, owned by the caller
+    long* slots; ///< block indexes, or DELTA_EMPTY_SLOT
+    size_t mask; ///< the amount of slots minus one, a power of two minus one
+};
+
+/**
+ * @brief Reads the rolling checksum of a signature.
+ *
+ * @param signature The given signature
+ *
+ * @return the rolling checksum
+ **/
+static uint32_t get_signature_weak(const uint8_t* signature) {
+    return ((uint32_t)signature[0] << 24) | ((uint32_t)signature[1] << 16) | ((uint32_t)signature[2] << 8) | signature[3];
+}
+
+/**
+ * @brief Mixes a rolling checksum into a slot position, as its low bits alone
+ * only depend on the sum of the block bytes.
+ *
+ * @param weak The rolling checksum
+ * @param mask The index mask
+ *
+ * @return the first slot to be probed
+ **/
+static size_t get_slot(const uint32_t weak, const size_t mask) {
+    return (size_t)((weak * 0x9E3779B1u) >> 7) & mask;
+}
+
+long delta_get_block_length(const long basis_size) {
+    /* The square root, rounded up to a multiple of 1 KB */
+    long block_length = DELTA_MIN_BLOCK_LEN;
+    while (block_length < DELTA_MAX_BLOCK_LEN && block_length * block_length < basis_size) {
+        block_length += 1L << 10;
+    }
+    return block_length;
+}
+
+uint32_t delta_weak_checksum(const uint8_t* block, const size_t length) {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    for (size_t i = 0; i < length; ++i) {
+        a += block[i];
+        b += (uint32_t)(length - i) * block[i];
+    }
+    return ((b % DELTA_WEAK_MODULUS) << 16) | (a % DELTA_WEAK_MODULUS);
+}
+
+uint32_t delta_roll_weak_checksum(const uint32_t weak, const uint8_t removed, const uint8_t added, const size_t length) {
+    /* Unsigned wrap around is harmless, as 2^32 is a multiple of the modulus */
+    const uint32_t a = ((weak & 0xFFFF) - removed + added) % DELTA_WEAK_MODULUS;
+    const uint32_t b = ((weak >> 16) - (uint32_t)length * removed + a) % DELTA_WEAK_MODULUS;
+    return (b << 16) | a;
+}
+
+void delta_write_signature(const uint8_t* block, const size_t length, uint8_t* signature) {
+    const uint32_t weak = delta_weak_checksum(block, length);
+    signature[0] = weak >> 24;
+    signature[1] = weak >> 16;
+    signature[2] = weak >> 8;
+    signature[3] = weak;
+    checksum_ctx_t ctx;
+    checksum_init(&ctx, CHECKSUM_XXH3_128);
+    checksum_update(&ctx, block, length);
+    checksum_final(&ctx, signature + DELTA_WEAK_LENGTH);
+}
+
+delta_index_t* delta_index_create(const uint8_t* signatures, const long block_count) {
+    delta_index_t* index = malloc(sizeof(delta_index_t));
+    if (index == NULL) {
+        set_error_description("Out of memory");
+        return NULL;
+    }
+    size_t slot_count = 2;
+    while (slot_count < 2 * (size_t)block_count) {
+        slot_count <<= 1;
+    }
+    index->signatures = signatures;
+    index->mask = slot_count - 1;
+    index->slots = malloc(slot_count * sizeof(long));
+    if (index->slots == NULL) {
+        free(index);
+        set_error_description("Out of memory");
+        return NULL;
+    }
+    for (size_t i = 0; i < slot_count; ++i) {
+        index->slots[i] = DELTA_EMPTY_SLOT;
+    }
+    for (long block = 0; block < block_count; ++block) {
+        size_t slot = get_slot(get_signature_weak(signatures + block * DELTA_SIGNATURE_LENGTH), index->mask);
+        while (index->slots[slot] != DELTA_EMPTY_SLOT) {
+            slot = (slot + 1) & index->mask;
+        }
+        index->slots[slot] = block;
+    }
+    return index;
+}
+
+void delta_index_destroy(delta_index_t* index) {
+    if (index) {
+        free(index->slots);
+        free(index);
+    }
+}
+
+long delta_index_find(const delta_index_t* index, const uint32_t weak, const uint8_t* block, const size_t length) {
+    uint8_t strong[DELTA_STRONG_LENGTH];
+    bool strong_computed = false;
+    for (size_t slot = get_slot(weak, index->mask); index->slots[slot] != DELTA_EMPTY_SLOT;
+         slot = (slot + 1) & index->mask) {
+        const uint8_t* signature = index->signatures + index->slots[slot] * DELTA_SIGNATURE_LENGTH;
+        if (get_signature_weak(signature) != weak) {
+            continue;
+        }
+        if (!strong_computed) {
+            checksum_ctx_t ctx;
+            checksum_init(&ctx, CHECKSUM_XXH3_128);
+            checksum_update(&ctx, block, length);
+            checksum_final(&ctx, strong);
+            strong_computed = true;
+        }
+        if (memcmp(signature + DELTA_WEAK_LENGTH, strong, DELTA_STRONG_LENGTH) == 0) {
+            return index->slots[slot];
+        }
+    }
+    return -1;
+}
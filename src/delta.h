@@ -0,0 +1,103 @@
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define DELTA_MIN_BLOCK_LEN (2 << 10) ///< the shortest block of a delta basis
+#define DELTA_MAX_BLOCK_LEN (128 << 10) ///< the longest block of a delta basis
+#define DELTA_WEAK_LENGTH 4 ///< the length of the rolling checksum of a block
+#define DELTA_STRONG_LENGTH 16 ///< the length of the strong hash of a block, a XXH3-128 hash
+#define DELTA_SIGNATURE_LENGTH (DELTA_WEAK_LENGTH + DELTA_STRONG_LENGTH) ///< the length of a block signature
+
+/**
+ * @brief Finds blocks of the delta basis, i.e. the receiver copy of a file,
+ * by their signatures.
+ **/
+typedef struct Sdelta_index delta_index_t;
+
+/**
+ * @brief Gets the block length a basis file is split into. Longer blocks
+ * mean fewer signatures, shorter ones find more matches, so blocks grow with
+ * the square root of the file size, as rsync does.
+ *
+ * @param basis_size The basis file size
+ *
+ * @return the block length, from DELTA_MIN_BLOCK_LEN to DELTA_MAX_BLOCK_LEN
+ **/
+long delta_get_block_length(const long basis_size);
+
+/**
+ * @brief Computes the rolling checksum of a block.
+ *
+ * @param block The block
+ * @param length The block length
+ *
+ * @return the rolling checksum
+ **/
+uint32_t delta_weak_checksum(const uint8_t* block, const size_t length);
+
+/**
+ * @brief Moves the rolling checksum of a block one byte forward.
+ *
+ * @param weak The rolling checksum of the block
+ * @param removed The first byte of the block
+ * @param added The byte following the block
+ * @param length The block length
+ *
+ * @return the rolling checksum of the block starting one byte later
+ **/
+uint32_t delta_roll_weak_checksum(const uint32_t weak, const uint8_t removed, const uint8_t added, const size_t length);
+
+/**
+ * @brief Computes the signature of a block: its rolling checksum, big endian,
+ * followed by its strong hash.
+ *
+ * @param block The block
+ * @param length The block length
+ * @param[out] signature The signature, DELTA_SIGNATURE_LENGTH bytes long
+ *
+ * @return No return
+ **/
+void delta_write_signature(const uint8_t* block, const size_t length, uint8_t* signature);
+
+/**
+ * @brief Indexes the signatures of the basis blocks.
+ * @note The created index shall be released by delta_index_destroy().
+ *
+ * @param signatures The signatures of all blocks, in block order
+ * @param block_count The amount of blocks
+ *
+ * @return the created index
+ * @return NULL otherwise
+ **/
+delta_index_t* delta_index_create(const uint8_t* signatures, const long block_count);
+
+/**
+ * @brief Releases a block index.
+ *
+ * @param index The given index
+ *
+ * @return No return
+ **/
+void delta_index_destroy(delta_index_t* index);
+
+/**
+ * @brief Finds a basis block with the same content. The strong hash is only
+ * computed when the rolling checksum matches some block.
+ *
+ * @param index The given index
+ * @param weak The rolling checksum of the content
+ * @param block The content
+ * @param length The content length, i.e. the basis block length
+ *
+ * @return the index of the matching block
+ * @return -1 if no block matches
+ **/
+long delta_index_find(const delta_index_t* index, const uint32_t weak, const uint8_t* block, const size_t length);
+
+#endif /* _DELTA_H_ */
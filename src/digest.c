@@ -0,0 +1,158 @@
+#include <stdlib.h> //malloc
+#include <pthread.h>
+
+#include "digest.h"
+#include "common.h"
+
+struct Sdigest_pipeline {
+    uint8_t* chunks[DIGEST_QUEUE_LEN]; ///< the chunk buffers, used in circular order
+    size_t lengths[DIGEST_QUEUE_LEN]; ///< the submitted length of each chunk
+    int head; ///< the next chunk to be hashed
+    int tail; ///< the next chunk to be acquired and submitted
+    int queued; ///< the amount of submitted chunks not hashed yet
+    bool stopping; ///< the hashing thread shall exit
+    checksum_ctx_t checksum_ctx; ///< the checksum, only touched by the hashing thread while chunks are queued
+    pthread_t thread; ///< the hashing thread
+    pthread_mutex_t lock; ///< protects the queue state
+    pthread_cond_t submitted; ///< signaled when a chunk is queued or the thread shall exit
+    pthread_cond_t hashed; ///< signaled when a chunk is hashed
+};
+
+/**
+ * @brief Hashes the queued chunks in submission order, until the pipeline is destroyed.
+ *
+ * @param arg The pipeline
+ *
+ * @return NULL
+ **/
+static void* run_hashing(void* arg) {
+    digest_pipeline_t* pipeline = arg;
+    pthread_mutex_lock(&pipeline->lock);
+    while (true) {
+        while (pipeline->queued == 0 && !pipeline->stopping) {
+            pthread_cond_wait(&pipeline->submitted, &pipeline->lock);
+        }
+        if (pipeline->queued == 0) {
+            break;
+        }
+        const int chunk = pipeline->head;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        checksum_update(&pipeline->checksum_ctx, pipeline->chunks[chunk], pipeline->lengths[chunk]);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->head = (pipeline->head + 1) % DIGEST_QUEUE_LEN;
+        --pipeline->queued;
+        pthread_cond_signal(&pipeline->hashed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * @brief Releases the pipeline chunk buffers and synchronization primitives.
+ *
+ * @param pipeline The given pipeline
+ *
+ * @return No return
+ **/
+static void release_pipeline(digest_pipeline_t* pipeline) {
+    for (int i = 0; i < DIGEST_QUEUE_LEN; ++i) {
+        free(pipeline->chunks[i]);
+    }
+    pthread_cond_destroy(&pipeline->hashed);
+    pthread_cond_destroy(&pipeline->submitted);
+    pthread_mutex_destroy(&pipeline->lock);
+    free(pipeline);
+}
+
+digest_pipeline_t* digest_pipeline_create(const checksum_algorithm algorithm) {
+    digest_pipeline_t* pipeline = calloc(1, sizeof(*pipeline));
+    if (pipeline == NULL) {
+        set_error_description("Out of memory");
+        print_error("Starting digest pipeline failed");
+        return NULL;
+    }
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->submitted, NULL);
+    pthread_cond_init(&pipeline->hashed, NULL);
+    for (int i = 0; i < DIGEST_QUEUE_LEN; ++i) {
+        if ((pipeline->chunks[i] = malloc(DIGEST_CHUNK_LEN)) == NULL) {
+            set_error_description("Out of memory");
+            goto RELEASE_ON_ERROR;
+        }
+    }
+    checksum_init(&pipeline->checksum_ctx, algorithm);
+    if (pthread_create(&pipeline->thread, NULL, run_hashing, pipeline) != 0) {
+        reset_error_description();
+        goto RELEASE_ON_ERROR;
+    }
+    return pipeline;
+
+RELEASE_ON_ERROR:
+    print_error("Starting digest pipeline failed");
+    release_pipeline(pipeline);
+    return NULL;
+}
+
+void digest_pipeline_destroy(digest_pipeline_t* pipeline) {
+    if (pipeline == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->stopping = true;
+    pthread_cond_signal(&pipeline->submitted);
+    pthread_mutex_unlock(&pipeline->lock);
+    pthread_join(pipeline->thread, NULL);
+    release_pipeline(pipeline);
+}
+
+uint8_t* digest_pipeline_acquire(digest_pipeline_t* pipeline) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->queued == DIGEST_QUEUE_LEN) {
+        pthread_cond_wait(&pipeline->hashed, &pipeline->lock);
+    }
+    uint8_t* chunk = pipeline->chunks[pipeline->tail];
+    pthread_mutex_unlock(&pipeline->lock);
+    return chunk;
+}
+
+void digest_pipeline_submit(digest_pipeline_t* pipeline, const size_t length) {
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->lengths[pipeline->tail] = length;
+    pipeline->tail = (pipeline->tail + 1) % DIGEST_QUEUE_LEN;
+    ++pipeline->queued;
+    pthread_cond_signal(&pipeline->submitted);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * @brief Waits for all queued chunks to be hashed.
+ *
+ * @param pipeline The given pipeline
+ *
+ * @return No return
+ **/
+static void wait_hashed(digest_pipeline_t* pipeline) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->queued > 0) {
+        pthread_cond_wait(&pipeline->hashed, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+void digest_pipeline_finish(digest_pipeline_t* pipeline, uint8_t* digest) {
+    wait_hashed(pipeline);
+    checksum_final(&pipeline->checksum_ctx, digest);
+    checksum_init(&pipeline->checksum_ctx, pipeline->checksum_ctx.algorithm);
+}
+
+void digest_pipeline_save(digest_pipeline_t* pipeline, checksum_ctx_t* checksum_ctx) {
+    wait_hashed(pipeline);
+    *checksum_ctx = pipeline->checksum_ctx;
+}
+
+void digest_pipeline_restore(digest_pipeline_t* pipeline, const checksum_ctx_t* checksum_ctx) {
+    wait_hashed(pipeline);
+    pipeline->checksum_ctx = *checksum_ctx;
+}
@@ -0,0 +1,97 @@
+#ifndef _DIGEST_H_
+#define _DIGEST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "checksum.h"
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define DIGEST_CHUNK_LEN (1 << 18) ///< the capacity of each chunk buffer of a digest pipeline
+#define DIGEST_QUEUE_LEN 8 ///< the amount of chunk buffers of a digest pipeline
+
+/**
+ * @brief Computes a checksum on a separate thread, fed through a
+ * bounded queue of chunk buffers, so hashing overlaps with socket and disk I/O.
+ **/
+typedef struct Sdigest_pipeline digest_pipeline_t;
+
+/**
+ * @brief Starts a digest pipeline and its hashing thread.
+ * @note The created pipeline shall be released by digest_pipeline_destroy().
+ *
+ * @param algorithm The checksum algorithm
+ *
+ * @return the created pipeline
+ * @return NULL otherwise
+ **/
+digest_pipeline_t* digest_pipeline_create(const checksum_algorithm algorithm);
+
+/**
+ * @brief Stops the hashing thread and releases the pipeline.
+ *
+ * @param pipeline The given pipeline
+ *
+ * @return No return
+ **/
+void digest_pipeline_destroy(digest_pipeline_t* pipeline);
+
+/**
+ * @brief Gets the next free chunk buffer, waiting for the hashing thread
+ * when all of them are queued.
+ *
+ * @param pipeline The given pipeline
+ *
+ * @return the chunk buffer, DIGEST_CHUNK_LEN bytes long
+ **/
+uint8_t* digest_pipeline_acquire(digest_pipeline_t* pipeline);
+
+/**
+ * @brief Queues the chunk buffer got by the last digest_pipeline_acquire()
+ * call for hashing. The chunk may still be read until the next
+ * digest_pipeline_acquire() call, but not modified.
+ *
+ * @param pipeline The given pipeline
+ * @param length The amount of chunk bytes to be hashed
+ *
+ * @return No return
+ **/
+void digest_pipeline_submit(digest_pipeline_t* pipeline, const size_t length);
+
+/**
+ * @brief Waits for all queued chunks to be hashed and gets the digest.
+ * The pipeline is then ready for a new digest.
+ *
+ * @param pipeline The given pipeline
+ * @param[out] digest The checksum of all submitted chunks
+ *
+ * @return No return
+ **/
+void digest_pipeline_finish(digest_pipeline_t* pipeline, uint8_t* digest);
+
+/**
+ * @brief Waits for all queued chunks to be hashed and gets the intermediate
+ * checksum state, so the digest can be resumed later on.
+ *
+ * @param pipeline The given pipeline
+ * @param[out] checksum_ctx The checksum state of all submitted chunks
+ *
+ * @return No return
+ **/
+void digest_pipeline_save(digest_pipeline_t* pipeline, checksum_ctx_t* checksum_ctx);
+
+/**
+ * @brief Waits for all queued chunks to be hashed and replaces the checksum
+ * state, so the following chunks continue a previously saved digest.
+ *
+ * @param pipeline The given pipeline
+ * @param checksum_ctx The checksum state to be continued, of the pipeline algorithm
+ *
+ * @return No return
+ **/
+void digest_pipeline_restore(digest_pipeline_t* pipeline, const checksum_ctx_t* checksum_ctx);
+
+#endif /* _DIGEST_H_ */
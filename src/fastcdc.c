@@ -0,0 +1,51 @@
+#include <pthread.h>
+
+#include "fastcdc.h"
+
+/* The gear hash is shifted left, so its high bits depend on the last 64 bytes */
+#define FASTCDC_MASK_HARD 0xFFFE000000000000ULL ///< 15 bits, checked before the average length
+#define FASTCDC_MASK_EASY 0xFFE0000000000000ULL ///< 11 bits, checked after the average length
+
+static uint64_t gear[256] = {0}; ///< a random value per byte value
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Fills the gear table. The values only need to be random looking and
+ * the same on every peer, so they are generated with SplitMix64 from a fixed
+ * seed instead of being listed.
+ *
+ * @return No return
+ **/
+static void init_gear() {
+    uint64_t state = 0x6661737463646321ULL;
+    for (int i = 0; i < 256; ++i) {
+        uint64_t value = (state += 0x9E3779B97F4A7C15ULL);
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = value ^ (value >> 31);
+    }
+}
+
+size_t fastcdc_cut(const uint8_t* data, const size_t length) {
+    pthread_once(&gear_once, init_gear);
+    if (length <= FASTCDC_MIN_LEN) {
+        return length;
+    }
+    const size_t end = length < FASTCDC_MAX_LEN ? length : FASTCDC_MAX_LEN;
+    const size_t normal = end < FASTCDC_AVG_LEN ? end : FASTCDC_AVG_LEN;
+    uint64_t hash = 0;
+    size_t i = FASTCDC_MIN_LEN;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & FASTCDC_MASK_HARD)) {
+            return i + 1;
+        }
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & FASTCDC_MASK_EASY)) {
+            return i + 1;
+        }
+    }
+    return end;
+}
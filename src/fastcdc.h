@@ -0,0 +1,29 @@
+#ifndef _FASTCDC_H_
+#define _FASTCDC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define FASTCDC_MIN_LEN (2 << 10) ///< the shortest chunk, unless the content ends first
+#define FASTCDC_AVG_LEN (8 << 10) ///< the chunk length the cut points are normalized around
+#define FASTCDC_MAX_LEN (64 << 10) ///< the longest chunk
+
+/**
+ * @brief Finds the end of the next content-defined chunk, with FastCDC: a
+ * gear rolling hash is checked against a harder mask before the average
+ * length and an easier one after it, so chunk lengths cluster around the
+ * average. Cut points only depend on the content around them, so content
+ * shared by two files is split in the same chunks, wherever it lies.
+ *
+ * @param data The content, starting at the chunk
+ * @param length The content length
+ *
+ * @return the chunk length, at most FASTCDC_MAX_LEN, or length if the content
+ * ends before a cut point
+ **/
+size_t fastcdc_cut(const uint8_t* data, const size_t length);
+
+#endif /* _FASTCDC_H_ */
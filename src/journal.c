@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h> //memset
+
+#include "journal.h"
+#include "sal.h"
+#include "common.h"
+
+#define JOURNAL_MAGIC 0x4A524E4C ///< "JRNL"
+#define JOURNAL_VERSION 2
+#define JOURNAL_TEMP_SUFFIX ".tmp" ///< appended to the journal path while it is being written
+#define JOURNAL_PATH_LEN (MAX_PATH_LEN + sizeof(JOURNAL_DIR) + sizeof(JOURNAL_SUFFIX) + sizeof(JOURNAL_TEMP_SUFFIX))
+
+/**
+ * @brief The journal as stored on disk. It holds the raw checksum state, so
+ * it is only valid for the same build and architecture that wrote it, which
+ * the record length and version guard against.
+ **/
+typedef struct {
+    uint32_t magic; ///< JOURNAL_MAGIC
+    uint32_t version; ///< JOURNAL_VERSION
+    uint32_t record_length; ///< the size of the whole record
+    journal_t journal; ///< the journal
+} journal_record;
+
+/**
+ * @brief Builds the path of a file journal, or of the directory holding it.
+ *
+ * @param file_path The file path
+ * @param suffix The suffix appended after JOURNAL_SUFFIX, NULL for the directory path
+ * @param[out] journal_path The journal path, JOURNAL_PATH_LEN long
+ *
+ * @return true if path fits
+ * @return false otherwise
+ **/
+static bool get_journal_path(const char* file_path, const char* suffix, char* journal_path) {
+    const char* separator = strrchr(file_path, '/');
+    const int dir_length = separator ? separator - file_path + 1 : 0;
+    const int length = suffix ?
+        snprintf(
+            journal_path, JOURNAL_PATH_LEN, "%.*s%s/%s%s%s",
+            dir_length, file_path, JOURNAL_DIR, file_path + dir_length, JOURNAL_SUFFIX, suffix) :
+        snprintf(journal_path, JOURNAL_PATH_LEN, "%.*s%s", dir_length, file_path, JOURNAL_DIR);
+    return length > 0 && length < (int)JOURNAL_PATH_LEN;
+}
+
+bool journal_load(const char* file_path, journal_t* journal) {
+    char journal_path[JOURNAL_PATH_LEN];
+    if (!get_journal_path(file_path, "", journal_path)) {
+        return false;
+    }
+    FILE* fp = fopen(journal_path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    journal_record record;
+    const bool loaded = fread(&record, sizeof(record), 1, fp) == 1;
+    fclose(fp);
+    if (!loaded || record.magic != JOURNAL_MAGIC || record.version != JOURNAL_VERSION ||
+        record.record_length != sizeof(record)) {
+        set_error_description("%s", journal_path);
+        print_warning("Ignoring invalid journal");
+        return false;
+    }
+    *journal = record.journal;
+    journal->partial_name[JOURNAL_PARTIAL_NAME_LEN - 1] = '\0';
+    return true;
+}
+
+bool journal_save(const char* file_path, const journal_t* journal) {
+    char journal_dir[JOURNAL_PATH_LEN];
+    char journal_path[JOURNAL_PATH_LEN];
+    char temp_path[JOURNAL_PATH_LEN];
+    if (!get_journal_path(file_path, NULL, journal_dir) || !get_journal_path(file_path, "", journal_path) ||
+        !get_journal_path(file_path, JOURNAL_TEMP_SUFFIX, temp_path)) {
+        set_error_description("Path is too long");
+        goto PRINT_ERROR;
+    }
+    if (sal_create_dir(journal_dir) != SAL_OK) {
+        goto PRINT_ERROR;
+    }
+
+    journal_record record;
+    memset(&record, 0, sizeof(record));
+    record.magic = JOURNAL_MAGIC;
+    record.version = JOURNAL_VERSION;
+    record.record_length = sizeof(record);
+    record.journal = *journal;
+
+    FILE* fp = fopen(temp_path, "wb");
+    if (fp == NULL) {
+        reset_error_description();
+        goto PRINT_ERROR;
+    }
+    const bool written = fwrite(&record, sizeof(record), 1, fp) == 1 && sal_sync_file(fp) == SAL_OK;
+    fclose(fp);
+    if (!written || rename(temp_path, journal_path) != 0) {
+        remove(temp_path);
+        reset_error_description();
+        goto PRINT_ERROR;
+    }
+    return true;
+
+PRINT_ERROR:
+    print_error("Saving journal failed");
+    return false;
+}
+
+void journal_remove(const char* file_path) {
+    char journal_path[JOURNAL_PATH_LEN];
+    if (get_journal_path(file_path, "", journal_path)) {
+        remove(journal_path);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdbool.h>
+
+#include "checksum.h"
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define JOURNAL_DIR ".journal" ///< the directory holding the journals of the files of its parent directory
+#define JOURNAL_SUFFIX ".journal" ///< appended to the file name to get its journal name
+#define JOURNAL_PARTIAL_NAME_LEN 32 ///< the room for the name of the partial file
+
+/**
+ * @brief The state of an interrupted file reception, kept so that the
+ * transfer can be resumed later on. Journals are kept in the JOURNAL_DIR
+ * directory next to the file, so that no file name clashes with them. The
+ * content received so far is kept on a partial file of its own, which
+ * replaces the file once whole.
+ **/
+typedef struct {
+    long file_size; ///< the announced file size
+    long identity; ///< the identity of the sender file contents
+    long committed; ///< the amount of file content durably stored on the partial file
+    checksum_ctx_t checksum_ctx; ///< the checksum state of the committed content
+    char partial_name[JOURNAL_PARTIAL_NAME_LEN]; ///< the name of the partial file, within the directory the server receives files into
+} journal_t;
+
+/**
+ * @brief Loads the journal of a file.
+ *
+ * @param file_path The file path
+ * @param[out] journal The loaded journal
+ *
+ * @return true if a valid journal was found
+ * @return false otherwise
+ **/
+bool journal_load(const char* file_path, journal_t* journal);
+
+/**
+ * @brief Stores the journal of a file, replacing the previous one at once,
+ * so that a crash never leaves a partially written journal behind.
+ * @note The partial file content shall be synchronized beforehand.
+ *
+ * @param file_path The file path
+ * @param journal The journal to be stored
+ *
+ * @return true if journal was stored successfully
+ * @return false otherwise
+ **/
+bool journal_save(const char* file_path, const journal_t* journal);
+
+/**
+ * @brief Removes the journal of a file, if any.
+ *
+ * @param file_path The file path
+ *
+ * @return No return
+ **/
+void journal_remove(const char* file_path);
+
+#endif /* _JOURNAL_H_ */
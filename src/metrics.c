@@ -0,0 +1,364 @@
+#include <stdio.h> //snprintf
+#include <stdlib.h> //posix_memalign
+#include <string.h> //strstr
+#include <stdarg.h>
+#include <inttypes.h> //PRIu64
+#include <pthread.h>
+
+#include "metrics.h"
+#include "sal.h"
+#include "common.h"
+
+#define METRICS_REQUEST_LEN 4096 ///< the longest scrape request header read, the rest being ignored
+#define METRICS_RESPONSE_LEN (16 << 10) ///< the capacity of a scrape response
+#define DURATION_BUCKET_COUNT (sizeof(duration_buckets) / sizeof(duration_buckets[0]))
+#define THROUGHPUT_BUCKET_COUNT (sizeof(throughput_buckets) / sizeof(throughput_buckets[0]))
+
+/** @brief The upper bounds of the file latency histogram buckets, in seconds. **/
+static const double duration_buckets[] = {0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 60};
+/** @brief The upper bounds of the file throughput histogram buckets, in bytes per second. **/
+static const double throughput_buckets[] = {1e5, 1e6, 1e7, 1e8, 2.5e8, 5e8, 1e9, 2.5e9, 1e10};
+
+static const char* file_result_names[METRICS_FILE_RESULTS] = {"accepted", "rejected", "nacked"};
+
+/**
+ * @brief The metrics updated by a single thread. Only the owning thread
+ * writes them, while scrapes read them, so they are updated with relaxed
+ * atomics, and each block has cache lines of its own.
+ **/
+typedef struct metrics_block {
+    uint64_t received_bytes; ///< the received file content
+    uint64_t files[METRICS_FILE_RESULTS]; ///< the received files per result
+    uint64_t checksum_failures; ///< the files not matching their checksum
+    int64_t connections; ///< the connections accepted minus the ones released
+    uint64_t duration_counts[DURATION_BUCKET_COUNT + 1]; ///< the accepted files per latency bucket, the last one unbounded
+    uint64_t duration_sum_ns; ///< the latency of all accepted files
+    uint64_t throughput_counts[THROUGHPUT_BUCKET_COUNT + 1]; ///< the accepted files per throughput bucket, the last one unbounded
+    uint64_t throughput_sum; ///< the throughput of all accepted files, in bytes per second
+    struct metrics_block* next; ///< the block of another thread
+} __attribute__((aligned(64))) metrics_block;
+
+/**
+ * @brief A response being rendered.
+ **/
+typedef struct {
+    char* buffer; ///< the response
+    size_t length; ///< the response length so far
+} metrics_response;
+
+static bool metrics_enabled = false; ///< whether metrics are counted
+static metrics_block* blocks = NULL; ///< the blocks of all threads that counted any metric
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER; ///< serializes the registration of blocks
+static __thread metrics_block* thread_block = NULL; ///< the block of the calling thread, NULL until it counts a metric
+static sal_socket_t listen_sock = NULL; ///< the metrics endpoint listening socket
+
+/**
+ * @brief Gets the metrics block of the calling thread, registering it on
+ * first use. Blocks are never released, as their counts must outlive threads.
+ *
+ * @return the block
+ * @return NULL if out of memory
+ **/
+static metrics_block* get_thread_block() {
+    if (thread_block != NULL) {
+        return thread_block;
+    }
+    metrics_block* block = NULL;
+    if (posix_memalign((void**)&block, sizeof(*block), sizeof(*block)) != 0) {
+        return NULL;
+    }
+    memset(block, 0, sizeof(*block));
+    pthread_mutex_lock(&blocks_lock);
+    block->next = blocks;
+    __atomic_store_n(&blocks, block, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&blocks_lock);
+    thread_block = block;
+    return block;
+}
+
+/**
+ * @brief Adds a value to a counter of the calling thread.
+ *
+ * @param counter The counter
+ * @param value The value to be added
+ *
+ * @return No return
+ **/
+static inline void add(uint64_t* counter, const uint64_t value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Finds the histogram bucket of a value.
+ *
+ * @param bounds The bucket upper bounds
+ * @param count The amount of bounded buckets
+ * @param value The value
+ *
+ * @return the bucket index, count if it exceeds all bounds
+ **/
+static size_t find_bucket(const double* bounds, const size_t count, const double value) {
+    size_t bucket = 0;
+    while (bucket < count && value > bounds[bucket]) {
+        ++bucket;
+    }
+    return bucket;
+}
+
+/**
+ * @brief Appends formatted text to a response, truncating it when full.
+ *
+ * @param response The response
+ * @param format The text format
+ * @param ... The text arguments
+ *
+ * @return No return
+ **/
+static void append(metrics_response* response, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(
+        &response->buffer[response->length], METRICS_RESPONSE_LEN - response->length, format, args);
+    va_end(args);
+    if (length > 0) {
+        response->length = MIN(response->length + length, METRICS_RESPONSE_LEN - 1);
+    }
+}
+
+/**
+ * @brief Appends a histogram to a response, its buckets being cumulative.
+ *
+ * @param response The response
+ * @param name The histogram name
+ * @param help The histogram description
+ * @param bounds The bucket upper bounds
+ * @param counts The amount of values per bucket, the last one unbounded
+ * @param count The amount of bounded buckets
+ * @param sum The sum of all values
+ *
+ * @return No return
+ **/
+static void append_histogram(
+    metrics_response* response,
+    const char* name,
+    const char* help,
+    const double* bounds,
+    const uint64_t* counts,
+    const size_t count,
+    const double sum) {
+    append(response, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s histogram\n", name, help, name);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < count; ++i) {
+        cumulative += counts[i];
+        append(response, METRICS_PREFIX "%s_bucket{le=\"%g\"} %" PRIu64 "\n", name, bounds[i], cumulative);
+    }
+    cumulative += counts[count];
+    append(response, METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, cumulative);
+    append(response, METRICS_PREFIX "%s_sum %.6f\n", name, sum);
+    append(response, METRICS_PREFIX "%s_count %" PRIu64 "\n", name, cumulative);
+}
+
+/**
+ * @brief Renders the metrics of all threads in the Prometheus text format.
+ *
+ * @param response The response the metrics are appended to
+ *
+ * @return No return
+ **/
+static void render_metrics(metrics_response* response) {
+    metrics_block total;
+    memset(&total, 0, sizeof(total));
+    for (metrics_block* block = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        total.received_bytes += __atomic_load_n(&block->received_bytes, __ATOMIC_RELAXED);
+        for (int i = 0; i < METRICS_FILE_RESULTS; ++i) {
+            total.files[i] += __atomic_load_n(&block->files[i], __ATOMIC_RELAXED);
+        }
+        total.checksum_failures += __atomic_load_n(&block->checksum_failures, __ATOMIC_RELAXED);
+        total.connections += __atomic_load_n(&block->connections, __ATOMIC_RELAXED);
+        for (size_t i = 0; i <= DURATION_BUCKET_COUNT; ++i) {
+            total.duration_counts[i] += __atomic_load_n(&block->duration_counts[i], __ATOMIC_RELAXED);
+        }
+        total.duration_sum_ns += __atomic_load_n(&block->duration_sum_ns, __ATOMIC_RELAXED);
+        for (size_t i = 0; i <= THROUGHPUT_BUCKET_COUNT; ++i) {
+            total.throughput_counts[i] += __atomic_load_n(&block->throughput_counts[i], __ATOMIC_RELAXED);
+        }
+        total.throughput_sum += __atomic_load_n(&block->throughput_sum, __ATOMIC_RELAXED);
+    }
+
+    append(response, "# HELP " METRICS_PREFIX "received_bytes_total File content received.\n");
+    append(response, "# TYPE " METRICS_PREFIX "received_bytes_total counter\n");
+    append(response, METRICS_PREFIX "received_bytes_total %" PRIu64 "\n", total.received_bytes);
+    append(response, "# HELP " METRICS_PREFIX "files_total Files received, per result.\n");
+    append(response, "# TYPE " METRICS_PREFIX "files_total counter\n");
+    for (int i = 0; i < METRICS_FILE_RESULTS; ++i) {
+        append(response, METRICS_PREFIX "files_total{result=\"%s\"} %" PRIu64 "\n", file_result_names[i], total.files[i]);
+    }
+    append(response, "# HELP " METRICS_PREFIX "checksum_failures_total Files not matching their checksum.\n");
+    append(response, "# TYPE " METRICS_PREFIX "checksum_failures_total counter\n");
+    append(response, METRICS_PREFIX "checksum_failures_total %" PRIu64 "\n", total.checksum_failures);
+    append(response, "# HELP " METRICS_PREFIX "active_connections Connections being served.\n");
+    append(response, "# TYPE " METRICS_PREFIX "active_connections gauge\n");
+    append(response, METRICS_PREFIX "active_connections %" PRId64 "\n", total.connections);
+    append_histogram(
+        response,
+        "file_duration_seconds",
+        "Time from the header to the reply of accepted files.",
+        duration_buckets,
+        total.duration_counts,
+        DURATION_BUCKET_COUNT,
+        total.duration_sum_ns / 1e9);
+    append_histogram(
+        response,
+        "file_throughput_bytes_per_second",
+        "File content received per second of accepted files.",
+        throughput_buckets,
+        total.throughput_counts,
+        THROUGHPUT_BUCKET_COUNT,
+        total.throughput_sum);
+}
+
+/**
+ * @brief Answers a scrape request: the metrics for "GET /metrics", an error
+ * for anything else. Scrapes are answered one after the other, so a client
+ * not sending its request within METRICS_SCRAPE_TIMEOUT_MS is dropped rather
+ * than holding up the next ones.
+ *
+ * @param socket The scrape connection socket
+ *
+ * @return No return
+ **/
+static void serve_scrape(sal_socket_t socket) {
+    static char request[METRICS_REQUEST_LEN + 1];
+    static char body[METRICS_RESPONSE_LEN];
+    static char response[METRICS_RESPONSE_LEN + 256];
+
+    if (sal_set_timeout(socket, METRICS_SCRAPE_TIMEOUT_MS) != SAL_OK) {
+        return;
+    }
+    /* Each receive waits up to the timeout, and the request as a whole too, against clients trickling bytes */
+    const uint64_t deadline_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC) + METRICS_SCRAPE_TIMEOUT_MS * 1000000ULL;
+    size_t length = 0;
+    while (length < METRICS_REQUEST_LEN) {
+        size_t received = 0;
+        if (sal_get_time_ns(SAL_CLOCK_MONOTONIC) > deadline_ns ||
+            sal_try_receive_msg(socket, (uint8_t*)&request[length], METRICS_REQUEST_LEN - length, &received) != SAL_OK) {
+            return;
+        }
+        length += received;
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL) {
+            break;
+        }
+    }
+
+    metrics_response content = {body, 0};
+    const char* status = "200 OK";
+    if (strncmp(request, "GET /metrics ", strlen("GET /metrics ")) == 0) {
+        render_metrics(&content);
+    } else {
+        status = "404 Not Found";
+        append(&content, "Metrics are served on /metrics\n");
+    }
+    const int header_length = snprintf(
+        response,
+        sizeof(response) - METRICS_RESPONSE_LEN,
+        "HTTP/1.0 %s\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: close\r\n\r\n",
+        status,
+        content.length);
+    memcpy(&response[header_length], body, content.length);
+    sal_send_msg(socket, (const uint8_t*)response, header_length + content.length);
+}
+
+/**
+ * @brief Metrics endpoint thread entry point: answers scrapes one after the other.
+ *
+ * @param arg Unused
+ *
+ * @return NULL
+ **/
+static void* run_metrics_endpoint(void* arg) {
+    (void)arg;
+    sal_socket_t socket = NULL;
+    while ((socket = sal_accept(listen_sock)) != NULL) {
+        serve_scrape(socket);
+        sal_close(socket);
+        sal_destroy_socket(socket);
+    }
+    return NULL;
+}
+
+bool metrics_start(const int port) {
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if ((listen_sock = sal_create_socket()) == NULL) {
+        return false;
+    }
+    if (sal_bind(listen_sock, &addr) != SAL_OK ||
+        sal_listen(listen_sock, METRICS_CONNECTION_QUEUE_SIZE) != SAL_OK) {
+        goto RELEASE_SOCKET;
+    }
+    metrics_enabled = true;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, run_metrics_endpoint, NULL) != 0) {
+        metrics_enabled = false;
+        reset_error_description();
+        print_error("Starting metrics endpoint failed");
+        goto RELEASE_SOCKET;
+    }
+    pthread_detach(thread);
+    return true;
+
+RELEASE_SOCKET:
+    sal_close(listen_sock);
+    sal_destroy_socket(listen_sock);
+    listen_sock = NULL;
+    return false;
+}
+
+uint64_t metrics_clock() {
+    return metrics_enabled ? sal_get_time_ns(SAL_CLOCK_MONOTONIC) : 0;
+}
+
+void metrics_add_received_bytes(const uint64_t bytes) {
+    metrics_block* block = NULL;
+    if (metrics_enabled && (block = get_thread_block()) != NULL) {
+        add(&block->received_bytes, bytes);
+    }
+}
+
+void metrics_count_checksum_failure() {
+    metrics_block* block = NULL;
+    if (metrics_enabled && (block = get_thread_block()) != NULL) {
+        add(&block->checksum_failures, 1);
+    }
+}
+
+void metrics_add_connections(const int delta) {
+    metrics_block* block = NULL;
+    if (metrics_enabled && (block = get_thread_block()) != NULL) {
+        __atomic_store_n(&block->connections, block->connections + delta, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_count_file(const metrics_file_result result, const uint64_t bytes, const uint64_t start_ns) {
+    metrics_block* block = NULL;
+    if (!metrics_enabled || (block = get_thread_block()) == NULL) {
+        return;
+    }
+    add(&block->files[result], 1);
+    if (result != METRICS_FILE_ACCEPTED) {
+        return;
+    }
+    const uint64_t duration_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC) - start_ns;
+    const double seconds = MAX(duration_ns, 1) / 1e9;
+    const double throughput = bytes / seconds;
+    add(&block->duration_counts[find_bucket(duration_buckets, DURATION_BUCKET_COUNT, seconds)], 1);
+    add(&block->duration_sum_ns, duration_ns);
+    add(&block->throughput_counts[find_bucket(throughput_buckets, THROUGHPUT_BUCKET_COUNT, throughput)], 1);
+    add(&block->throughput_sum, (uint64_t)throughput);
+}
@@ -0,0 +1,78 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define METRICS_PREFIX "file_server_" ///< the prefix of all exposed metric names
+#define METRICS_CONNECTION_QUEUE_SIZE 8 ///< the pending scrape connections the metrics endpoint accepts
+#define METRICS_SCRAPE_TIMEOUT_MS 2000 ///< the time a scrape connection has to send its request and take the response
+
+typedef enum {
+    METRICS_FILE_ACCEPTED, ///< the file was received, validated and acknowledged
+    METRICS_FILE_REJECTED, ///< the file was refused before its content was received
+    METRICS_FILE_NACKED, ///< the file content was received but could not be written or validated
+    METRICS_FILE_RESULTS ///< the amount of file results
+} metrics_file_result;
+
+/**
+ * @brief Enables the metrics and serves them over HTTP on the loopback
+ * interface, in the Prometheus text format, from a thread of their own.
+ * Each thread updates its own counters without locking, and scrapes add
+ * them up, so scraping never stalls the threads receiving files.
+ *
+ * @param port The loopback port the metrics are served on
+ *
+ * @return true if the metrics endpoint is listening
+ * @return false otherwise
+ **/
+bool metrics_start(const int port);
+
+/**
+ * @brief Reads the monotonic clock, if metrics are enabled.
+ *
+ * @return the time in nanoseconds, 0 if metrics are disabled
+ **/
+uint64_t metrics_clock();
+
+/**
+ * @brief Counts received file content.
+ *
+ * @param bytes The amount of received bytes
+ *
+ * @return No return
+ **/
+void metrics_add_received_bytes(const uint64_t bytes);
+
+/**
+ * @brief Counts a file whose content did not match its checksum.
+ *
+ * @return No return
+ **/
+void metrics_count_checksum_failure();
+
+/**
+ * @brief Updates the amount of active connections.
+ *
+ * @param delta 1 when a connection is accepted, -1 when it is released
+ *
+ * @return No return
+ **/
+void metrics_add_connections(const int delta);
+
+/**
+ * @brief Counts the outcome of a file reception. The latency and throughput
+ * of accepted files are added to their histograms.
+ *
+ * @param result The file result
+ * @param bytes The amount of received file content
+ * @param start_ns When the file header was received, as read by metrics_clock()
+ *
+ * @return No return
+ **/
+void metrics_count_file(const metrics_file_result result, const uint64_t bytes, const uint64_t start_ns);
+
+#endif /* _METRICS_H_ */
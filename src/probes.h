@@ -0,0 +1,107 @@
+#ifndef _PROBES_H_
+#define _PROBES_H_
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define PROBES_PROVIDER transfer ///< the USDT provider of all probes, as in usdt:./server:transfer:frame_sent
+
+/*
+ * USDT probes, which bpftrace or perf attach to without rebuilding (see the
+ * scripts in tools/). Each probe site is a single NOP, its arguments being
+ * registers or constants already at hand, and the probe is described by a
+ * .note.stapsdt entry, so disabled probes cost the NOP alone.
+ *
+ * Probes come from <sys/sdt.h> when available. Otherwise, on x86-64 the
+ * notes are emitted the way <sys/sdt.h> emits them, every argument being
+ * passed as a signed 64-bit value. Elsewhere, or when built with
+ * "make PROBES=no", probes compile to nothing.
+ *
+ * Probes:
+ *   frame_sent(type, length), frame_received(type, length)
+ *   send_entry(fd, length), send_return(fd, bytes, errno)
+ *   recv_entry(fd, length), recv_return(fd, bytes, errno)
+ *   server: file_start(connection), header_parsed(connection, path, size),
+ *           checksum_verified(connection, match), file_reply(connection, path, ack)
+ *   client: file_start(path, size), reply_received(ack), file_done(path, ack)
+ */
+
+#if defined(NO_PROBES)
+#define PROBES_NONE
+#elif defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define PROBES_SDT
+#endif
+#endif
+
+#if defined(PROBES_NONE)
+
+#define PROBE1(name, a1) do { } while (0)
+#define PROBE2(name, a1, a2) do { } while (0)
+#define PROBE3(name, a1, a2, a3) do { } while (0)
+
+#elif defined(PROBES_SDT)
+
+#include <sys/sdt.h>
+
+#define PROBE1(name, a1) DTRACE_PROBE1(PROBES_PROVIDER, name, a1)
+#define PROBE2(name, a1, a2) DTRACE_PROBE2(PROBES_PROVIDER, name, a1, a2)
+#define PROBE3(name, a1, a2, a3) DTRACE_PROBE3(PROBES_PROVIDER, name, a1, a2, a3)
+
+#elif defined(__x86_64__)
+
+#include <stdint.h>
+
+#define PROBES_STRING(x) #x
+#define PROBES_EXPAND_STRING(x) PROBES_STRING(x)
+
+/**
+ * @brief Emits a probe site and its .note.stapsdt entry: the site address,
+ * the base the tools use to relocate it, no semaphore, the provider, the
+ * probe name and its argument locations. The base symbol is defined once
+ * per object, on a section the linker merges.
+ **/
+#define PROBES_SITE(name, args, ...) \
+    __asm__ __volatile__( \
+        "990: nop\n" \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+        ".balign 4\n" \
+        ".4byte 992f-991f, 994f-993f, 3\n" \
+        "991: .asciz \"stapsdt\"\n" \
+        "992: .balign 4\n" \
+        "993: .8byte 990b\n" \
+        ".8byte _.stapsdt.base\n" \
+        ".8byte 0\n" \
+        ".asciz \"" PROBES_EXPAND_STRING(PROBES_PROVIDER) "\"\n" \
+        ".asciz \"" #name "\"\n" \
+        ".asciz \"" args "\"\n" \
+        "994: .balign 4\n" \
+        ".popsection\n" \
+        ".ifndef _.stapsdt.base\n" \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+        ".weak _.stapsdt.base\n" \
+        ".hidden _.stapsdt.base\n" \
+        "_.stapsdt.base: .space 1\n" \
+        ".size _.stapsdt.base, 1\n" \
+        ".popsection\n" \
+        ".endif\n" \
+        : : __VA_ARGS__)
+
+#define PROBE1(name, x1) \
+    PROBES_SITE(name, "-8@%[a1]", [a1] "nor"((int64_t)(x1)))
+#define PROBE2(name, x1, x2) \
+    PROBES_SITE(name, "-8@%[a1] -8@%[a2]", [a1] "nor"((int64_t)(x1)), [a2] "nor"((int64_t)(x2)))
+#define PROBE3(name, x1, x2, x3) \
+    PROBES_SITE( \
+        name, "-8@%[a1] -8@%[a2] -8@%[a3]", \
+        [a1] "nor"((int64_t)(x1)), [a2] "nor"((int64_t)(x2)), [a3] "nor"((int64_t)(x3)))
+
+#else
+
+#define PROBE1(name, a1) do { } while (0)
+#define PROBE2(name, a1, a2) do { } while (0)
+#define PROBE3(name, a1, a2, a3) do { } while (0)
+
+#endif
+
+#endif /* _PROBES_H_ */
@@ -0,0 +1,236 @@
+#include <stddef.h> //NULL
+#include <string.h> //memcpy
+
+#include "protocol.h"
+#include "common.h"
+
+tlv_t new_hello_tlv(tlv_arena_t* arena, const protocol_hello* hello) {
+    tlv_t tlv_hello = new_tlv(arena, TLV_TYPE_HELLO, 0);
+    tlv_t sub_tlv_version = new_tlv(arena, TLV_TYPE_PROTOCOL_VERSION, sizeof(long));
+    set_tlv_value_long(&sub_tlv_version, hello->version);
+    tlv_t sub_tlv_capabilities = new_tlv(arena, TLV_TYPE_CAPABILITIES, sizeof(long));
+    set_tlv_value_long(&sub_tlv_capabilities, hello->capabilities);
+    tlv_t sub_tlv_max_frame_length = new_tlv(arena, TLV_TYPE_MAX_FRAME_LENGTH, sizeof(long));
+    set_tlv_value_long(&sub_tlv_max_frame_length, hello->max_frame_length);
+    tlv_t sub_tlv_max_streams = new_tlv(arena, TLV_TYPE_MAX_STREAMS, sizeof(long));
+    set_tlv_value_long(&sub_tlv_max_streams, hello->max_streams);
+
+    set_next_tlv(&sub_tlv_version, &sub_tlv_capabilities);
+    set_next_tlv(&sub_tlv_capabilities, &sub_tlv_max_frame_length);
+    set_next_tlv(&sub_tlv_max_frame_length, &sub_tlv_max_streams);
+    set_sub_tlv_list(&tlv_hello, &sub_tlv_version);
+    return tlv_hello;
+}
+
+bool parse_hello(tlv_t* tlv_hello, protocol_hello* hello) {
+    if (get_tlv_type(tlv_hello) != TLV_TYPE_HELLO) {
+        set_error_description("No hello received");
+        print_error("Protocol error");
+        return false;
+    }
+    hello->version = PROTOCOL_VERSION_1;
+    hello->capabilities = 0;
+    hello->max_frame_length = TLV_MAX_VALUE_LENGTH;
+    hello->max_streams = 1;
+
+    /* Unknown sub-TLVs are skipped, so that newer peers may advertise more parameters */
+    uint64_t offset = 0;
+    while (offset + TLV_HEADER_LENGTH <= get_tlv_length(tlv_hello)) {
+        tlv_t sub_tlv = {0};
+        parse_tlv(&get_tlv_value_raw(tlv_hello)[offset], &sub_tlv);
+        offset += TLV_HEADER_LENGTH + get_tlv_length(&sub_tlv);
+        if (offset > get_tlv_length(tlv_hello) || get_tlv_length(&sub_tlv) != sizeof(long)) {
+            continue;
+        }
+        switch (get_tlv_type(&sub_tlv)) {
+        case TLV_TYPE_PROTOCOL_VERSION:
+            hello->version = get_tlv_value_long(&sub_tlv);
+            break;
+        case TLV_TYPE_CAPABILITIES:
+            hello->capabilities = get_tlv_value_long(&sub_tlv);
+            break;
+        case TLV_TYPE_MAX_FRAME_LENGTH:
+            hello->max_frame_length = get_tlv_value_long(&sub_tlv);
+            break;
+        case TLV_TYPE_MAX_STREAMS:
+            hello->max_streams = get_tlv_value_long(&sub_tlv);
+            break;
+        default:
+            break;
+        }
+    }
+    if (hello->version < PROTOCOL_VERSION_2) {
+        set_error_description("Version %ld", hello->version);
+        print_error("Protocol error");
+        return false;
+    }
+    return true;
+}
+
+void negotiate_hello(const protocol_hello* local, const protocol_hello* remote, protocol_hello* agreed) {
+    agreed->version = MIN(local->version, remote->version);
+    agreed->capabilities = local->capabilities & remote->capabilities;
+    if (local->max_frame_length == PROTOCOL_UNLIMITED_FRAME_LENGTH) {
+        agreed->max_frame_length = remote->max_frame_length;
+    } else if (remote->max_frame_length == PROTOCOL_UNLIMITED_FRAME_LENGTH) {
+        agreed->max_frame_length = local->max_frame_length;
+    } else {
+        agreed->max_frame_length = MIN(local->max_frame_length, remote->max_frame_length);
+    }
+    if (!(agreed->capabilities & PROTOCOL_CAPABILITY_EXTENDED_FRAMES) &&
+        (agreed->max_frame_length == PROTOCOL_UNLIMITED_FRAME_LENGTH ||
+         agreed->max_frame_length > TLV_MAX_VALUE_LENGTH)) {
+        agreed->max_frame_length = TLV_MAX_VALUE_LENGTH;
+    }
+    agreed->max_streams = 1;
+    if (agreed->capabilities & PROTOCOL_CAPABILITY_MULTI_STREAM) {
+        agreed->max_streams = MAX(1, MIN(MIN(local->max_streams, remote->max_streams), PROTOCOL_MAX_STREAMS));
+    }
+}
+
+bool exchange_hello(sal_socket_t socket, tlv_arena_t* arena, const protocol_hello* local, protocol_hello* agreed) {
+    tlv_t tlv_hello = new_hello_tlv(arena, local);
+    bool sent = send_tlv_data(socket, &tlv_hello);
+    reset_tlv_arena(arena);
+    if (!sent) {
+        return false;
+    }
+
+    protocol_hello remote = {0};
+    tlv_t tlv_reply = {0};
+    bool received = receive_tlv_data(socket, arena, &tlv_reply) && parse_hello(&tlv_reply, &remote);
+    reset_tlv_arena(arena);
+    if (!received) {
+        return false;
+    }
+    negotiate_hello(local, &remote, agreed);
+    return true;
+}
+
+tlv_t new_checksum_tlv(
+    tlv_arena_t* arena,
+    const protocol_hello* protocol, const checksum_algorithm algorithm, const uint8_t* checksum) {
+    const size_t checksum_length = get_checksum_length(algorithm);
+    if (!(protocol->capabilities & PROTOCOL_CAPABILITY_CHECKSUMS)) {
+        tlv_t tlv_checksum = new_tlv(arena, TLV_TYPE_CHECKSUM_SHA512, checksum_length);
+        set_tlv_value_raw(&tlv_checksum, checksum);
+        return tlv_checksum;
+    }
+
+    uint8_t value[CHECKSUM_ALGORITHM_LENGTH + CHECKSUM_MAX_LENGTH] = {0};
+    value[0] = (algorithm >> 8) & 0xFF;
+    value[1] = algorithm & 0xFF;
+    memcpy(value + CHECKSUM_ALGORITHM_LENGTH, checksum, checksum_length);
+    tlv_t tlv_checksum = new_tlv(arena, TLV_TYPE_CHECKSUM, CHECKSUM_ALGORITHM_LENGTH + checksum_length);
+    set_tlv_value_raw(&tlv_checksum, value);
+    return tlv_checksum;
+}
+
+bool parse_checksum(tlv_t* tlv_checksum, const checksum_algorithm algorithm, const uint8_t** checksum) {
+    const uint64_t length = get_tlv_length(tlv_checksum);
+    const uint8_t* value = get_tlv_value_raw(tlv_checksum);
+    if (get_tlv_type(tlv_checksum) == TLV_TYPE_CHECKSUM_SHA512) {
+        if (algorithm != CHECKSUM_SHA512 || length != SHA512_DIGEST_LENGTH) {
+            set_error_description("Unexpected SHA-512 checksum");
+            return false;
+        }
+        *checksum = value;
+        return true;
+    }
+    if (length < CHECKSUM_ALGORITHM_LENGTH) {
+        set_error_description("Checksum too short");
+        return false;
+    }
+    const long received_algorithm = value[0] << 8 | value[1];
+    if (received_algorithm != algorithm || length != CHECKSUM_ALGORITHM_LENGTH + get_checksum_length(algorithm)) {
+        set_error_description("Unexpected checksum algorithm %ld", received_algorithm);
+        return false;
+    }
+    *checksum = value + CHECKSUM_ALGORITHM_LENGTH;
+    return true;
+}
+
+tlv_t new_delta_basis_tlv(tlv_arena_t* arena, const long block_length, const long block_count) {
+    tlv_t tlv_basis = new_tlv(arena, TLV_TYPE_DELTA_BASIS, 0);
+    tlv_t sub_tlv_block_length = new_tlv(arena, TLV_TYPE_BLOCK_LENGTH, sizeof(long));
+    set_tlv_value_long(&sub_tlv_block_length, block_length);
+    tlv_t sub_tlv_block_count = new_tlv(arena, TLV_TYPE_BLOCK_COUNT, sizeof(long));
+    set_tlv_value_long(&sub_tlv_block_count, block_count);
+
+    set_next_tlv(&sub_tlv_block_length, &sub_tlv_block_count);
+    set_sub_tlv_list(&tlv_basis, &sub_tlv_block_length);
+    return tlv_basis;
+}
+
+bool parse_delta_basis(tlv_t* tlv_basis, long* block_length, long* block_count) {
+    *block_length = 0;
+    *block_count = -1;
+    if (get_tlv_type(tlv_basis) != TLV_TYPE_DELTA_BASIS) {
+        set_error_description("No delta basis received");
+        return false;
+    }
+    uint64_t offset = 0;
+    while (offset + TLV_HEADER_LENGTH <= get_tlv_length(tlv_basis)) {
+        tlv_t sub_tlv = {0};
+        parse_tlv(&get_tlv_value_raw(tlv_basis)[offset], &sub_tlv);
+        offset += TLV_HEADER_LENGTH + get_tlv_length(&sub_tlv);
+        if (offset > get_tlv_length(tlv_basis) || get_tlv_length(&sub_tlv) != sizeof(long)) {
+            continue;
+        }
+        if (get_tlv_type(&sub_tlv) == TLV_TYPE_BLOCK_LENGTH) {
+            *block_length = get_tlv_value_long(&sub_tlv);
+        } else if (get_tlv_type(&sub_tlv) == TLV_TYPE_BLOCK_COUNT) {
+            *block_count = get_tlv_value_long(&sub_tlv);
+        }
+    }
+    if (*block_length <= 0 || *block_count < 0) {
+        set_error_description("Invalid delta basis");
+        return false;
+    }
+    return true;
+}
+
+void write_block_reference(uint8_t* value, const long block_index, const long block_count) {
+    for (int i = 0; i < 8; ++i) {
+        value[i] = ((uint64_t)block_index >> (56 - 8 * i)) & 0xFF;
+        value[8 + i] = ((uint64_t)block_count >> (56 - 8 * i)) & 0xFF;
+    }
+}
+
+bool parse_block_reference(tlv_t* tlv_reference, long* block_index, long* block_count) {
+    if (get_tlv_length(tlv_reference) != BLOCK_REFERENCE_LENGTH) {
+        set_error_description("Invalid block reference");
+        return false;
+    }
+    const uint8_t* value = get_tlv_value_raw(tlv_reference);
+    uint64_t index = 0;
+    uint64_t count = 0;
+    for (int i = 0; i < 8; ++i) {
+        index = index << 8 | value[i];
+        count = count << 8 | value[8 + i];
+    }
+    *block_index = (long)index;
+    *block_count = (long)count;
+    return true;
+}
+
+long get_compression_capability(const compression_algorithm algorithm) {
+    switch (algorithm) {
+    case COMPRESSION_LZ4:
+        return PROTOCOL_CAPABILITY_LZ4;
+    case COMPRESSION_ZSTD:
+        return PROTOCOL_CAPABILITY_ZSTD;
+    default:
+        return 0;
+    }
+}
+
+long get_local_capabilities() {
+    long capabilities = PROTOCOL_CAPABILITIES;
+    for (compression_algorithm algorithm = COMPRESSION_LZ4; algorithm <= COMPRESSION_ZSTD; ++algorithm) {
+        if (!is_compression_supported(algorithm)) {
+            capabilities &= ~get_compression_capability(algorithm);
+        }
+    }
+    return capabilities;
+}
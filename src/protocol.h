@@ -0,0 +1,196 @@
+#ifndef _PROTOCOL_H_
+#define _PROTOCOL_H_
+
+#include <stdbool.h>
+
+#include "sal.h"
+#include "checksum.h"
+#include "compress.h"
+#include "tlv.h"
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define PROTOCOL_VERSION_1 1 ///< the original protocol, no negotiation, 2 bytes TLV lengths
+#define PROTOCOL_VERSION_2 2 ///< negotiated capabilities, extended TLV lengths for streamed values
+#define PROTOCOL_VERSION PROTOCOL_VERSION_2 ///< the highest supported protocol version
+
+#define PROTOCOL_CAPABILITY_EXTENDED_FRAMES (1 << 0) ///< file content may be streamed in extended TLVs
+#define PROTOCOL_CAPABILITY_CHECKSUMS (1 << 1) ///< the checksum algorithm is chosen on the header TLV
+#define PROTOCOL_CAPABILITY_RESUME (1 << 2) ///< interrupted transfers are resumed from the server partial file
+#define PROTOCOL_CAPABILITY_MULTI_STREAM (1 << 3) ///< a file may be split in ranges sent over parallel connections
+#define PROTOCOL_CAPABILITY_SESSION (1 << 4) ///< many files may be sent over one connection, replies come in order
+#define PROTOCOL_CAPABILITY_LZ4 (1 << 5) ///< file content chunks may be compressed with LZ4
+#define PROTOCOL_CAPABILITY_ZSTD (1 << 6) ///< file content chunks may be compressed with Zstandard
+#define PROTOCOL_CAPABILITY_DELTA (1 << 7) ///< files may be sent as a delta against the server existing copy
+#define PROTOCOL_CAPABILITY_DEDUP (1 << 8) ///< the server stores chunks once, so chunks it has are not sent
+#define PROTOCOL_CAPABILITY_ADMISSION (1 << 9) ///< the server accepts or rejects large files before their content is sent
+
+#define PROTOCOL_CAPABILITIES ( \
+    PROTOCOL_CAPABILITY_EXTENDED_FRAMES | PROTOCOL_CAPABILITY_CHECKSUMS | \
+    PROTOCOL_CAPABILITY_RESUME | PROTOCOL_CAPABILITY_MULTI_STREAM | \
+    PROTOCOL_CAPABILITY_SESSION | PROTOCOL_CAPABILITY_LZ4 | \
+    PROTOCOL_CAPABILITY_ZSTD | PROTOCOL_CAPABILITY_DELTA | \
+    PROTOCOL_CAPABILITY_DEDUP | PROTOCOL_CAPABILITY_ADMISSION) ///< all supported capabilities
+
+#define CHECKSUM_ALGORITHM_LENGTH 2 ///< the algorithm identifier leading a checksum TLV value
+#define COMPRESSED_CHUNK_LENGTH_LENGTH 4 ///< the original chunk length leading a compressed content TLV value
+#define PROTOCOL_MAX_COMPRESSED_CHUNK_LEN (TLV_MAX_VALUE_LENGTH - COMPRESSED_CHUNK_LENGTH_LENGTH) ///< the longest chunk compressed on its own
+#define BLOCK_REFERENCE_LENGTH 16 ///< the block index and block count of a block reference TLV value, 8 bytes each
+
+#define PROTOCOL_UNLIMITED_FRAME_LENGTH 0 ///< no limit on the length of a streamed frame
+#define PROTOCOL_MAX_STREAMS 16 ///< the maximum amount of parallel streams a file may be split into
+#define PROTOCOL_MAX_SESSION_WINDOW 32 ///< the maximum amount of files of a session sent ahead of their reply
+#define PROTOCOL_ADMISSION_MIN_LEN (TLV_MAX_VALUE_LENGTH + 1) ///< the shortest file the server replies an admission to
+
+#define PROTOCOL_ADMISSION_ACCEPTED 0 ///< the file fits and was opened, its content may follow
+#define PROTOCOL_ADMISSION_NO_SPACE 1 ///< the file does not fit the server storage
+#define PROTOCOL_ADMISSION_FAILED 2 ///< the server could not open the file
+
+typedef struct {
+    long version; ///< the protocol version
+    long capabilities; ///< the PROTOCOL_CAPABILITY_* flags
+    long max_frame_length; ///< the maximum streamed frame length, or PROTOCOL_UNLIMITED_FRAME_LENGTH
+    long max_streams; ///< the maximum amount of parallel streams per file, 1 without the multi-stream capability
+} protocol_hello;
+
+/**
+ * @brief Builds the hello TLV, the first one exchanged by version 2 peers,
+ * on an arena.
+ *
+ * @param arena The arena holding the TLV
+ * @param hello The advertised protocol parameters
+ *
+ * @return the hello TLV
+ **/
+tlv_t new_hello_tlv(tlv_arena_t* arena, const protocol_hello* hello);
+
+/**
+ * @brief Parses the hello TLV sent by the remote peer.
+ *
+ * @param tlv_hello The received hello TLV
+ * @param[out] hello The remote peer protocol parameters
+ *
+ * @return true if hello TLV is valid
+ * @return false otherwise
+ **/
+bool parse_hello(tlv_t* tlv_hello, protocol_hello* hello);
+
+/**
+ * @brief Computes the protocol parameters that both peers support.
+ *
+ * @param local The local protocol parameters
+ * @param remote The remote peer protocol parameters
+ * @param[out] agreed The protocol parameters to be used
+ *
+ * @return No return
+ **/
+void negotiate_hello(const protocol_hello* local, const protocol_hello* remote, protocol_hello* agreed);
+
+/**
+ * @brief Sends the hello TLV and waits for the remote peer hello.
+ *
+ * @param socket The used socket
+ * @param arena The arena holding the exchanged TLVs, reset afterwards
+ * @param local The local protocol parameters
+ * @param[out] agreed The protocol parameters to be used
+ *
+ * @return true if the remote peer replied with a valid hello
+ * @return false otherwise, e.g. if it only knows protocol version 1
+ **/
+bool exchange_hello(sal_socket_t socket, tlv_arena_t* arena, const protocol_hello* local, protocol_hello* agreed);
+
+/**
+ * @brief Builds the TLV carrying a file checksum on an arena:
+ * a checksum TLV tagged with its algorithm if the checksums capability was
+ * agreed, the legacy SHA-512 TLV otherwise.
+ *
+ * @param arena The arena holding the TLV
+ * @param protocol The agreed protocol parameters
+ * @param algorithm The checksum algorithm, CHECKSUM_DEFAULT if the capability was not agreed
+ * @param checksum The checksum
+ *
+ * @return the checksum TLV
+ **/
+tlv_t new_checksum_tlv(
+    tlv_arena_t* arena,
+    const protocol_hello* protocol, const checksum_algorithm algorithm, const uint8_t* checksum);
+
+/**
+ * @brief Parses a received checksum TLV, either tagged with its algorithm or legacy SHA-512.
+ *
+ * @param tlv_checksum The received checksum TLV
+ * @param algorithm The algorithm announced on the header TLV
+ * @param[out] checksum The received checksum, pointing to the TLV value
+ *
+ * @return true if checksum TLV is valid and matches the announced algorithm
+ * @return false otherwise
+ **/
+bool parse_checksum(tlv_t* tlv_checksum, const checksum_algorithm algorithm, const uint8_t** checksum);
+
+/**
+ * @brief Builds the reply to a delta transfer on an arena,
+ * announcing how the server copy of the file was split in blocks. The block
+ * signatures follow it.
+ *
+ * @param arena The arena holding the TLV
+ * @param block_length The block length
+ * @param block_count The amount of blocks, 0 if the server has no copy of the file
+ *
+ * @return the delta basis TLV
+ **/
+tlv_t new_delta_basis_tlv(tlv_arena_t* arena, const long block_length, const long block_count);
+
+/**
+ * @brief Parses a received delta basis TLV.
+ *
+ * @param tlv_basis The received delta basis TLV
+ * @param[out] block_length The block length
+ * @param[out] block_count The amount of blocks
+ *
+ * @return true if delta basis TLV is valid
+ * @return false otherwise
+ **/
+bool parse_delta_basis(tlv_t* tlv_basis, long* block_length, long* block_count);
+
+/**
+ * @brief Writes the value of a block reference TLV.
+ *
+ * @param[out] value The TLV value, BLOCK_REFERENCE_LENGTH bytes long
+ * @param block_index The index of the first referenced block
+ * @param block_count The amount of consecutive referenced blocks
+ *
+ * @return No return
+ **/
+void write_block_reference(uint8_t* value, const long block_index, const long block_count);
+
+/**
+ * @brief Parses a received block reference TLV.
+ *
+ * @param tlv_reference The received block reference TLV
+ * @param[out] block_index The index of the first referenced block
+ * @param[out] block_count The amount of consecutive referenced blocks
+ *
+ * @return true if block reference TLV is well formed
+ * @return false otherwise
+ **/
+bool parse_block_reference(tlv_t* tlv_reference, long* block_index, long* block_count);
+
+/**
+ * @brief Gets the capability a compression algorithm depends on.
+ *
+ * @param algorithm The compression algorithm
+ *
+ * @return the PROTOCOL_CAPABILITY_* flag, 0 for COMPRESSION_NONE
+ **/
+long get_compression_capability(const compression_algorithm algorithm);
+
+/**
+ * @brief Gets the capabilities a peer offers: all of them, except the
+ * compression algorithms whose library is not installed.
+ *
+ * @return the PROTOCOL_CAPABILITY_* flags
+ **/
+long get_local_capabilities();
+
+#endif /* _PROTOCOL_H_ */
@@ -26,6 +26,22 @@ char* sal_get_filename(const char* path) {
     return ret;
 }
 
+sal_ret sal_list_dir_files(const char* dir, char*** paths, size_t* count) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_list_dir_files(dir, paths, count)) == SAL_ERROR) {
+        print_error("List directory failed");
+    }
+    return ret;
+}
+
+sal_ret sal_list_dir_entries(const char* dir, char*** files, size_t* file_count, char*** dirs, size_t* dir_count) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_list_dir_entries(dir, files, file_count, dirs, dir_count)) == SAL_ERROR) {
+        print_error("List directory failed");
+    }
+    return ret;
+}
+
 sal_socket_t sal_create_socket() {
     sal_socket_t ret = SAL_OK;
     if ((ret = sal_imp_create_socket()) == NULL) {
@@ -34,6 +50,14 @@ sal_socket_t sal_create_socket() {
     return ret;
 }
 
+sal_ret sal_create_socket_pair(sal_socket_t* first, sal_socket_t* second) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_create_socket_pair(first, second)) != SAL_OK) {
+        print_error("Socket pair creation failed");
+    }
+    return ret;
+}
+
 void sal_destroy_socket(sal_socket_t socket) {
     sal_imp_destroy_socket(socket);
 }
@@ -78,7 +102,7 @@ sal_ret sal_close(sal_socket_t socket) {
     return ret;
 }
 
-sal_ret sal_send_msg(sal_socket_t socket, const uint8_t* buffer, const uint16_t length) {
+sal_ret sal_send_msg(sal_socket_t socket, const uint8_t* buffer, const size_t length) {
     sal_ret ret = SAL_OK;
     if ((ret = sal_imp_send_msg(socket, buffer, length)) != SAL_OK) {
         print_error("Send failed");
@@ -86,10 +110,358 @@ sal_ret sal_send_msg(sal_socket_t socket, const uint8_t* buffer, const uint16_t
     return ret;
 }
 
-sal_ret sal_receive_msg(sal_socket_t socket, uint8_t* buffer, const uint16_t length) {
+sal_ret sal_send_msgv(sal_socket_t socket, const sal_buffer_t* buffers, const int count) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_send_msgv(socket, buffers, count)) != SAL_OK) {
+        print_error("Send failed");
+    }
+    return ret;
+}
+
+sal_ret sal_receive_msg(sal_socket_t socket, uint8_t* buffer, const size_t length) {
     sal_ret ret = SAL_OK;
     if ((ret = sal_imp_receive_msg(socket, buffer, length)) != SAL_OK) {
         print_error("Received failed");
     }
     return ret;
 }
+
+sal_ret sal_peek_msg(sal_socket_t socket, const size_t length, const uint8_t** data, size_t* available) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_peek_msg(socket, length, data, available)) != SAL_OK) {
+        print_error("Received failed");
+    }
+    return ret;
+}
+
+sal_ret sal_wait_msg(sal_socket_t socket) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_wait_msg(socket)) == SAL_ERROR) {
+        print_error("Received failed");
+    }
+    return ret;
+}
+
+void sal_consume_msg(sal_socket_t socket, const size_t length) {
+    sal_imp_consume_msg(socket, length);
+}
+
+sal_ret sal_set_nonblocking(sal_socket_t socket) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_set_nonblocking(socket)) != SAL_OK) {
+        print_error("Set non-blocking failed");
+    }
+    return ret;
+}
+
+sal_ret sal_try_accept(sal_socket_t listening_socket, sal_socket_t* accepted_socket) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_try_accept(listening_socket, accepted_socket)) == SAL_ERROR || ret == SAL_NO_DESCRIPTORS) {
+        print_error("Accept failed");
+    }
+    return ret;
+}
+
+sal_ret sal_try_send_msg(sal_socket_t socket, const uint8_t* buffer, const size_t length, size_t* sent) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_try_send_msg(socket, buffer, length, sent)) == SAL_ERROR) {
+        print_error("Send failed");
+    }
+    return ret;
+}
+
+sal_ret sal_try_receive_msg(sal_socket_t socket, uint8_t* buffer, const size_t length, size_t* received) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_try_receive_msg(socket, buffer, length, received)) == SAL_ERROR) {
+        print_error("Received failed");
+    }
+    return ret;
+}
+
+sal_poller_t sal_create_poller() {
+    sal_poller_t ret = NULL;
+    if ((ret = sal_imp_create_poller()) == NULL) {
+        print_error("Poller creation failed");
+    }
+    return ret;
+}
+
+void sal_destroy_poller(sal_poller_t poller) {
+    sal_imp_destroy_poller(poller);
+}
+
+sal_ret sal_poller_add(sal_poller_t poller, sal_socket_t socket, const uint32_t events, void* user_data) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_poller_add(poller, socket, events, user_data)) != SAL_OK) {
+        print_error("Poller registration failed");
+    }
+    return ret;
+}
+
+sal_ret sal_poller_modify(sal_poller_t poller, sal_socket_t socket, const uint32_t events, void* user_data) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_poller_modify(poller, socket, events, user_data)) != SAL_OK) {
+        print_error("Poller modification failed");
+    }
+    return ret;
+}
+
+sal_ret sal_poller_remove(sal_poller_t poller, sal_socket_t socket) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_poller_remove(poller, socket)) != SAL_OK) {
+        print_error("Poller removal failed");
+    }
+    return ret;
+}
+
+int sal_poller_wait(sal_poller_t poller, sal_poll_event_t* events, const int max_events, const int timeout_ms) {
+    int ret = 0;
+    if ((ret = sal_imp_poller_wait(poller, events, max_events, timeout_ms)) < 0) {
+        print_error("Poller wait failed");
+    }
+    return ret;
+}
+
+sal_ret sal_set_reuse_port(sal_socket_t socket) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_set_reuse_port(socket)) != SAL_OK) {
+        print_error("Set reuse port failed");
+    }
+    return ret;
+}
+
+sal_ret sal_set_timeout(sal_socket_t socket, const int timeout_ms) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_set_timeout(socket, timeout_ms)) != SAL_OK) {
+        print_error("Set timeout failed");
+    }
+    return ret;
+}
+
+uint64_t sal_get_sent_bytes(sal_socket_t socket) {
+    return sal_imp_get_sent_bytes(socket);
+}
+
+int sal_get_cpu_count() {
+    return sal_imp_get_cpu_count();
+}
+
+unsigned long sal_get_syscall_count() {
+    return sal_imp_syscall_count;
+}
+
+void sal_enable_io_timing() {
+    sal_imp_io_timing = true;
+}
+
+void sal_get_io_time(sal_io_time_t* time) {
+    *time = sal_imp_io_time;
+}
+
+uint64_t sal_get_time_ns(const sal_clock clock) {
+    return sal_imp_get_time_ns(clock);
+}
+
+sal_ret sal_set_thread_affinity(const int cpu) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_set_thread_affinity(cpu)) != SAL_OK) {
+        print_warning("Set thread affinity failed");
+    }
+    return ret;
+}
+
+sal_ret sal_send_file(sal_socket_t socket, FILE* fp, const long offset, const size_t length) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_send_file(socket, fp, offset, length)) != SAL_OK) {
+        print_error("Send file failed");
+    }
+    return ret;
+}
+
+sal_ret sal_map_file(FILE* fp, const long offset, const size_t length, const uint8_t** data) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_map_file(fp, offset, length, data)) != SAL_OK) {
+        print_error("Map file failed");
+    }
+    return ret;
+}
+
+void sal_unmap_file(const uint8_t* data, const size_t length) {
+    sal_imp_unmap_file(data, length);
+}
+
+sal_ret sal_check_mapped_file(const uint8_t* data) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_check_mapped_file(data)) != SAL_OK) {
+        print_error("Read mapped file failed");
+    }
+    return ret;
+}
+
+void sal_prefetch_file(FILE* fp, const long offset, const size_t length) {
+    sal_imp_prefetch_file(fp, offset, length);
+}
+
+sal_ret sal_splice_to_file(sal_socket_t socket, FILE* fp, const size_t length) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_splice_to_file(socket, fp, length)) != SAL_OK) {
+        print_error("Splice failed");
+    }
+    return ret;
+}
+
+sal_ret sal_get_file_identity(FILE* fp, long* identity) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_get_file_identity(fp, identity)) != SAL_OK) {
+        print_error("Get file identity failed");
+    }
+    return ret;
+}
+
+sal_ret sal_get_file_size(FILE* fp, long* size) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_get_file_size(fp, size)) != SAL_OK) {
+        print_error("Get file size failed");
+    }
+    return ret;
+}
+
+sal_ret sal_sync_file(FILE* fp) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_sync_file(fp)) != SAL_OK) {
+        print_error("Sync file failed");
+    }
+    return ret;
+}
+
+void sal_sleep(const long milliseconds) {
+    sal_imp_sleep(milliseconds);
+}
+
+sal_ret sal_open_shared_file(const char* path, FILE** fp) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_open_shared_file(path, fp)) != SAL_OK) {
+        print_error("Opening file failed");
+    }
+    return ret;
+}
+
+sal_ret sal_create_unique_file(char* path, FILE** fp) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_create_unique_file(path, fp)) != SAL_OK) {
+        print_error("Creating file failed");
+    }
+    return ret;
+}
+
+sal_ret sal_lock_file(FILE* fp) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_lock_file(fp)) == SAL_ERROR) {
+        print_error("Locking file failed");
+    }
+    return ret;
+}
+
+sal_ret sal_allocate_file(FILE* fp, const long length) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_allocate_file(fp, length)) != SAL_OK) {
+        print_error("Allocate file failed");
+    }
+    return ret;
+}
+
+sal_ret sal_get_space_for_file(const char* path, long* bytes) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_get_space_for_file(path, bytes)) != SAL_OK) {
+        print_error("Get free space failed");
+    }
+    return ret;
+}
+
+sal_ret sal_reserve_file(FILE* fp, const long length) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_reserve_file(fp, length)) != SAL_OK) {
+        print_error("Reserve file failed");
+    }
+    return ret;
+}
+
+sal_ret sal_load_symbol(const char* library, const char* name, void** symbol) {
+    return sal_imp_load_symbol(library, name, symbol);
+}
+
+sal_ret sal_get_random(uint8_t* buffer, const size_t length) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_get_random(buffer, length)) != SAL_OK) {
+        print_error("Get random failed");
+    }
+    return ret;
+}
+
+sal_ret sal_create_dir(const char* dir) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_create_dir(dir)) != SAL_OK) {
+        print_error("Create directory failed");
+    }
+    return ret;
+}
+
+size_t sal_take_buffered_msg(sal_socket_t socket, uint8_t* buffer, const size_t length) {
+    return sal_imp_take_buffered_msg(socket, buffer, length);
+}
+
+sal_ring_t sal_create_ring(const unsigned entries, const int slots) {
+    sal_ring_t ret = NULL;
+    if ((ret = sal_imp_create_ring(entries, slots)) == NULL) {
+        print_error("Ring creation failed");
+    }
+    return ret;
+}
+
+void sal_destroy_ring(sal_ring_t ring) {
+    sal_imp_destroy_ring(ring);
+}
+
+sal_ret sal_ring_register_buffer(sal_ring_t ring, uint8_t* buffer, const size_t length) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_ring_register_buffer(ring, buffer, length)) != SAL_OK) {
+        print_error("Ring buffer registration failed");
+    }
+    return ret;
+}
+
+sal_ret sal_ring_set_socket(sal_ring_t ring, const int slot, sal_socket_t socket) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_ring_set_socket(ring, slot, socket)) != SAL_OK) {
+        print_error("Ring slot registration failed");
+    }
+    return ret;
+}
+
+sal_ret sal_ring_set_file(sal_ring_t ring, const int slot, FILE* fp) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_ring_set_file(ring, slot, fp)) != SAL_OK) {
+        print_error("Ring slot registration failed");
+    }
+    return ret;
+}
+
+sal_ret sal_ring_prepare(sal_ring_t ring, const sal_ring_op_t* op) {
+    sal_ret ret = SAL_OK;
+    if ((ret = sal_imp_ring_prepare(ring, op)) != SAL_OK) {
+        print_error("Ring operation failed");
+    }
+    return ret;
+}
+
+int sal_ring_submit(
+    sal_ring_t ring,
+    sal_ring_completion_t* completions,
+    const int max_completions,
+    const int min_completions) {
+    int ret = 0;
+    if ((ret = sal_imp_ring_submit(ring, completions, max_completions, min_completions)) < 0) {
+        print_error("Ring submission failed");
+    }
+    return ret;
+}
@@ -2,12 +2,15 @@
 #define _SAL_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <arpa/inet.h>
 
-#define MSG_BUFFER_LEN 1024
+#define SAL_RECEIVE_BUFFER_LEN (1 << 18) ///< the per-socket receive buffer capacity
 #define MAX_PATH_LEN 1024
-#if MSG_BUFFER_LEN < 5
+#define SAL_MAP_ALIGNMENT (1 << 16) ///< the alignment of mapped file regions
+#if SAL_RECEIVE_BUFFER_LEN < 16
 #error Buffer is too small
 #endif
 
@@ -17,10 +20,65 @@ typedef enum {
     SAL_DIR_NOT_FOUND,
     SAL_DIR_NOT_WRITABLE,
     SAL_FILE_NOT_FOUND,
-    SAL_FILE_NOT_READABLE
+    SAL_FILE_NOT_READABLE,
+    SAL_WOULD_BLOCK,
+    SAL_CONNECTION_CLOSED,
+    SAL_NO_SPACE,
+    SAL_NO_DESCRIPTORS
 } sal_ret;
 
+#define SAL_POLL_IN 0x1 ///< the socket has data to be received
+#define SAL_POLL_OUT 0x2 ///< the socket can send data without blocking
+#define SAL_POLL_ERROR 0x4 ///< the socket has an error or was hung up
+
 typedef void* sal_socket_t;
+typedef void* sal_poller_t;
+typedef void* sal_ring_t;
+
+typedef struct {
+    const uint8_t* data; ///< the buffer data
+    size_t length; ///< the buffer length
+} sal_buffer_t;
+
+typedef struct {
+    uint32_t events; ///< the ready events (SAL_POLL_* flags)
+    void* user_data; ///< the user data given when the socket was registered
+} sal_poll_event_t;
+
+typedef enum {
+    SAL_RING_RECV, ///< receives exactly length bytes from a socket, unless the connection fails or closes
+    SAL_RING_SEND, ///< sends length bytes to a socket
+    SAL_RING_READ, ///< reads up to length bytes of a file at offset
+    SAL_RING_WRITE, ///< writes length bytes to a file at offset
+    SAL_RING_FSYNC, ///< waits for the written data of a file to reach the storage device
+    SAL_RING_OPENAT ///< opens path for reading and writing into the slot, creating the file if missing
+} sal_ring_opcode;
+
+typedef struct {
+    sal_ring_opcode opcode; ///< the operation
+    int slot; ///< the ring slot of the socket or file the operation applies to
+    uint8_t* buffer; ///< the data, used in place if within the buffer registered on the ring
+    size_t length; ///< the data length
+    long offset; ///< the file offset (read and write only)
+    const char* path; ///< the file path (openat only)
+    void* user_data; ///< the user data given back with the operation completion
+} sal_ring_op_t;
+
+typedef struct {
+    void* user_data; ///< the user data of the completed operation
+    long result; ///< the amount of transferred bytes, 0 for fsync and openat, negative on failure
+} sal_ring_completion_t;
+
+typedef enum {
+    SAL_CLOCK_MONOTONIC, ///< a clock not affected by system time changes, for measuring durations
+    SAL_CLOCK_WALL ///< the system time, since the Epoch
+} sal_clock;
+
+typedef struct {
+    uint64_t send_ns; ///< the time spent sending to sockets, sendfile() included
+    uint64_t receive_ns; ///< the time spent receiving from sockets
+    uint64_t file_ns; ///< the time spent writing received data straight to files
+} sal_io_time_t;
 
 /**
  * @brief Checks if a given directory exists and is writable.
@@ -54,6 +112,38 @@ sal_ret sal_is_file_readable(const char* path);
  **/
 char* sal_get_filename(const char* path);
 
+/**
+ * @brief Lists the regular files of a directory, sorted by name.
+ * @note The listed paths and the list itself are malloc'd values that must be freed by user.
+ *
+ * @param dir The directory path
+ * @param[out] paths The paths of the listed files, prefixed by the directory path
+ * @param[out] count The amount of listed files
+ *
+ * @return SAL_OK if directory was listed successfully
+ * @return SAL_DIR_NOT_FOUND, if the given path is not a directory
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_list_dir_files(const char* dir, char*** paths, size_t* count);
+
+/**
+ * @brief Lists the regular files and the subdirectories of a directory, each
+ * list sorted by name. Links to directories are not listed, so walking the
+ * subdirectories never loops.
+ * @note The listed paths and the lists themselves are malloc'd values that must be freed by user.
+ *
+ * @param dir The directory path
+ * @param[out] files The paths of the listed files, prefixed by the directory path
+ * @param[out] file_count The amount of listed files
+ * @param[out] dirs The paths of the listed subdirectories, prefixed by the directory path
+ * @param[out] dir_count The amount of listed subdirectories
+ *
+ * @return SAL_OK if directory was listed successfully
+ * @return SAL_DIR_NOT_FOUND, if the given path is not a directory
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_list_dir_entries(const char* dir, char*** files, size_t* file_count, char*** dirs, size_t* dir_count);
+
 /**
  * @brief Creates a socket.
  * @note The created socket shall be released by sal_destroy_socket().
@@ -62,6 +152,19 @@ char* sal_get_filename(const char* path);
  **/
 sal_socket_t sal_create_socket();
 
+/**
+ * @brief Creates a pair of connected local sockets, e.g. to measure the
+ * socket layer without a network stack in between.
+ * @note Both sockets shall be closed by sal_close() and released by sal_destroy_socket().
+ *
+ * @param[out] first The first socket
+ * @param[out] second The socket connected to the first one
+ *
+ * @return SAL_OK if sockets were created successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_create_socket_pair(sal_socket_t* first, sal_socket_t* second);
+
 /**
  * @brief Releases a socket.
  *
@@ -134,10 +237,25 @@ sal_ret sal_close(sal_socket_t socket);
  * @return SAL_OK if data was sent successfully
  * @return SAL_ERROR otherwise
  **/
-sal_ret sal_send_msg(sal_socket_t socket, const uint8_t* buffer, const uint16_t length);
+sal_ret sal_send_msg(sal_socket_t socket, const uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Sends many buffers through the given socket at once, as if they
+ * were a single contiguous message.
+ *
+ * @param socket The used socket
+ * @param buffers The data buffers, in sending order
+ * @param count The amount of buffers
+ *
+ * @return SAL_OK if data was sent successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_send_msgv(sal_socket_t socket, const sal_buffer_t* buffers, const int count);
 
 /**
  * @brief Receives a message from the given socket.
+ * @note Data is received in large chunks into a per-socket buffer, so data
+ * following the message may be kept there for the next calls.
  *
  * @param socket The used socket
  * @param[out] buffer The data buffer
@@ -146,6 +264,590 @@ sal_ret sal_send_msg(sal_socket_t socket, const uint8_t* buffer, const uint16_t
  * @return SAL_OK if data was sent successfully
  * @return SAL_ERROR otherwise
  **/
-sal_ret sal_receive_msg(sal_socket_t socket, uint8_t* buffer, const uint16_t length);
+sal_ret sal_receive_msg(sal_socket_t socket, uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Waits for data on the socket receive buffer and exposes it in place,
+ * without copying it. Data stays buffered until sal_consume_msg() is called.
+ *
+ * @param socket The used socket
+ * @param length The minimum amount of bytes to wait for, up to SAL_RECEIVE_BUFFER_LEN
+ * @param[out] data The buffered data
+ * @param[out] available The amount of buffered bytes, at least length
+ *
+ * @return SAL_OK if data is available
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_peek_msg(sal_socket_t socket, const size_t length, const uint8_t** data, size_t* available);
+
+/**
+ * @brief Waits until data can be received from the socket, or the remote
+ * peer closes the connection.
+ *
+ * @param socket The used socket
+ *
+ * @return SAL_OK if data is available
+ * @return SAL_CONNECTION_CLOSED if the connection was closed by the remote peer
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_wait_msg(sal_socket_t socket);
+
+/**
+ * @brief Discards data exposed by sal_peek_msg() from the socket receive buffer.
+ *
+ * @param socket The used socket
+ * @param length The amount of bytes to be discarded, up to the available ones
+ *
+ * @return No return
+ **/
+void sal_consume_msg(sal_socket_t socket, const size_t length);
+
+/**
+ * @brief Makes all further operations on a socket non-blocking.
+ *
+ * @param socket The given socket
+ *
+ * @return SAL_OK if socket mode was changed successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_set_nonblocking(sal_socket_t socket);
+
+/**
+ * @brief Accepts an incoming connection on a non-blocking listening socket.
+ * @note The accepted socket shall be released by sal_destroy_socket().
+ *
+ * @param listening_socket The listening socket
+ * @param[out] accepted_socket The created socket to handle the accepted connection
+ *
+ * @return SAL_OK if a connection was accepted
+ * @return SAL_WOULD_BLOCK if there is no pending connection
+ * @return SAL_NO_DESCRIPTORS if the process or the system ran out of file descriptors
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_try_accept(sal_socket_t listening_socket, sal_socket_t* accepted_socket);
+
+/**
+ * @brief Sends as much data as possible through a non-blocking socket.
+ *
+ * @param socket The used socket
+ * @param buffer The data buffer
+ * @param length The data buffer length
+ * @param[out] sent The amount of bytes actually sent
+ *
+ * @return SAL_OK if some data was sent
+ * @return SAL_WOULD_BLOCK if the socket send buffer is full
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_try_send_msg(sal_socket_t socket, const uint8_t* buffer, const size_t length, size_t* sent);
+
+/**
+ * @brief Receives the data available on a non-blocking socket.
+ *
+ * @param socket The used socket
+ * @param[out] buffer The data buffer
+ * @param length The data buffer length
+ * @param[out] received The amount of bytes actually received
+ *
+ * @return SAL_OK if some data was received
+ * @return SAL_WOULD_BLOCK if there is no data available
+ * @return SAL_CONNECTION_CLOSED if the remote peer closed the connection
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_try_receive_msg(sal_socket_t socket, uint8_t* buffer, const size_t length, size_t* received);
+
+/**
+ * @brief Creates a poller to wait for readiness of many sockets at once.
+ * @note The created poller shall be released by sal_destroy_poller().
+ *
+ * @return the created poller
+ * @return NULL otherwise
+ **/
+sal_poller_t sal_create_poller();
+
+/**
+ * @brief Releases a poller.
+ *
+ * @param poller The created poller
+ *
+ * @return No return
+ **/
+void sal_destroy_poller(sal_poller_t poller);
+
+/**
+ * @brief Registers a socket on a poller.
+ *
+ * @param poller The given poller
+ * @param socket The socket to be watched
+ * @param events The watched events (SAL_POLL_* flags)
+ * @param user_data The data reported back when the socket is ready
+ *
+ * @return SAL_OK if socket was registered successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_poller_add(sal_poller_t poller, sal_socket_t socket, const uint32_t events, void* user_data);
+
+/**
+ * @brief Changes the watched events of a socket registered on a poller.
+ *
+ * @param poller The given poller
+ * @param socket The registered socket
+ * @param events The watched events (SAL_POLL_* flags)
+ * @param user_data The data reported back when the socket is ready
+ *
+ * @return SAL_OK if socket registration was changed successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_poller_modify(sal_poller_t poller, sal_socket_t socket, const uint32_t events, void* user_data);
+
+/**
+ * @brief Unregisters a socket from a poller.
+ *
+ * @param poller The given poller
+ * @param socket The registered socket
+ *
+ * @return SAL_OK if socket was unregistered successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_poller_remove(sal_poller_t poller, sal_socket_t socket);
+
+/**
+ * @brief Waits until at least one registered socket is ready.
+ *
+ * @param poller The given poller
+ * @param[out] events The ready sockets
+ * @param max_events The maximum amount of reported sockets
+ * @param timeout_ms The maximum waiting time in milliseconds, or -1 to wait forever
+ *
+ * @return the amount of ready sockets (0 on timeout or interruption)
+ * @return -1 on error
+ **/
+int sal_poller_wait(sal_poller_t poller, sal_poll_event_t* events, const int max_events, const int timeout_ms);
+
+/**
+ * @brief Allows many sockets to be bound to the same address, with incoming
+ * connections being load balanced among them by the system.
+ *
+ * @param socket The given socket, not bound yet
+ *
+ * @return SAL_OK if option was set successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_set_reuse_port(sal_socket_t socket);
+
+/**
+ * @brief Bounds the time a blocking send or receive on a socket waits for
+ * the peer, after which it fails.
+ *
+ * @param socket The given socket
+ * @param timeout_ms The maximum waiting time in milliseconds
+ *
+ * @return SAL_OK if option was set successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_set_timeout(sal_socket_t socket, const int timeout_ms);
+
+/**
+ * @brief Gets the amount of bytes sent through a socket since it was created.
+ *
+ * @param socket The given socket
+ *
+ * @return the amount of sent bytes
+ **/
+uint64_t sal_get_sent_bytes(sal_socket_t socket);
+
+/**
+ * @brief Gets the amount of online CPUs.
+ *
+ * @return the amount of online CPUs (at least 1)
+ **/
+int sal_get_cpu_count();
+
+/**
+ * @brief Gets the amount of system calls the calling thread issued to move
+ * data through sockets, pipes and rings, i.e. the ones whose count depends
+ * on how transfers are chunked.
+ *
+ * @return the amount of system calls
+ **/
+unsigned long sal_get_syscall_count();
+
+/**
+ * @brief Starts measuring the time spent in the system calls counted by
+ * sal_get_syscall_count(), for all threads. It is not measured by default,
+ * as it takes two clock reads per system call.
+ *
+ * @return No return
+ **/
+void sal_enable_io_timing();
+
+/**
+ * @brief Gets the time the calling thread spent in the system calls counted
+ * by sal_get_syscall_count(), since sal_enable_io_timing() was called.
+ *
+ * @param[out] time The time spent per kind of system call
+ *
+ * @return No return
+ **/
+void sal_get_io_time(sal_io_time_t* time);
+
+/**
+ * @brief Reads a clock.
+ *
+ * @param clock The clock to be read
+ *
+ * @return the clock time in nanoseconds
+ **/
+uint64_t sal_get_time_ns(const sal_clock clock);
+
+/**
+ * @brief Pins the calling thread to a CPU.
+ *
+ * @param cpu The CPU index
+ *
+ * @return SAL_OK if thread was pinned successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_set_thread_affinity(const int cpu);
+
+/**
+ * @brief Sends a file region through the given socket, without copying it
+ * through user space.
+ *
+ * @param socket The used socket
+ * @param fp The pointer to the opened file
+ * @param offset The region offset on file
+ * @param length The region length
+ *
+ * @return SAL_OK if data was sent successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_send_file(sal_socket_t socket, FILE* fp, const long offset, const size_t length);
+
+/**
+ * @brief Maps a read-only file region into memory, advised to be read
+ * sequentially and, where the file system supports it, backed by huge pages.
+ * Should the file be truncated while mapped, the pages past its new end read
+ * as zeros instead of killing the process with SIGBUS, so the data read from
+ * the region shall only be trusted once sal_check_mapped_file() succeeds.
+ * When too many regions are mapped at once to guard another, the region is
+ * read into memory instead.
+ * @note The mapped region shall be released by sal_unmap_file().
+ *
+ * @param fp The pointer to the opened file
+ * @param offset The region offset on file, multiple of SAL_MAP_ALIGNMENT
+ * @param length The region length
+ * @param[out] data The mapped region
+ *
+ * @return SAL_OK if region was mapped successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_map_file(FILE* fp, const long offset, const size_t length, const uint8_t** data);
+
+/**
+ * @brief Releases a file region mapped by sal_map_file().
+ *
+ * @param data The mapped region
+ * @param length The region length
+ *
+ * @return No return
+ **/
+void sal_unmap_file(const uint8_t* data, const size_t length);
+
+/**
+ * @brief Checks that the file a region was mapped from was not truncated
+ * while the region was being read.
+ *
+ * @param data The mapped region
+ *
+ * @return SAL_OK if the data read from the region so far is the file content
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_check_mapped_file(const uint8_t* data);
+
+/**
+ * @brief Starts reading a file region into the page cache in the background,
+ * ahead of its use.
+ *
+ * @param fp The pointer to the opened file
+ * @param offset The region offset on file
+ * @param length The region length
+ *
+ * @return No return
+ **/
+void sal_prefetch_file(FILE* fp, const long offset, const size_t length);
+
+/**
+ * @brief Moves received data straight from the socket to the current position
+ * of a file, without copying it through user space.
+ *
+ * @param socket The used socket
+ * @param fp The pointer to the opened file
+ * @param length The amount of bytes to be moved
+ *
+ * @return SAL_OK if data was moved successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_splice_to_file(sal_socket_t socket, FILE* fp, const size_t length);
+
+/**
+ * @brief Gets a value identifying the current contents of a file, which
+ * changes whenever the file is modified (its modification time).
+ *
+ * @param fp The pointer to the opened file
+ * @param[out] identity The file identity
+ *
+ * @return SAL_OK if identity was got successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_get_file_identity(FILE* fp, long* identity);
+
+/**
+ * @brief Gets the size of an opened file, without moving its position.
+ *
+ * @param fp The pointer to the opened file
+ * @param[out] size The file size
+ *
+ * @return SAL_OK if size was got successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_get_file_size(FILE* fp, long* size);
+
+/**
+ * @brief Flushes the buffered data of a file and waits for it to reach the storage device.
+ *
+ * @param fp The pointer to the opened file
+ *
+ * @return SAL_OK if file was synchronized successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_sync_file(FILE* fp);
+
+/**
+ * @brief Suspends the calling thread.
+ *
+ * @param milliseconds The suspension time
+ *
+ * @return No return
+ **/
+void sal_sleep(const long milliseconds);
+
+/**
+ * @brief Opens a file for reading and writing, creating it if missing but
+ * keeping its content, so that several writers may fill different regions of it.
+ *
+ * @param path The file path
+ * @param[out] fp The pointer to the opened file
+ *
+ * @return SAL_OK if file was opened successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_open_shared_file(const char* path, FILE** fp);
+
+/**
+ * @brief Creates and opens a file of a unique name for reading and writing,
+ * e.g. to receive content that replaces another file once complete.
+ *
+ * @param[in,out] path The path of the file, its last 6 characters being
+ * "XXXXXX", which are replaced to make it unique
+ * @param[out] fp The pointer to the opened file
+ *
+ * @return SAL_OK if file was created successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_create_unique_file(char* path, FILE** fp);
+
+/**
+ * @brief Locks an opened file for the exclusive use of its opener, without
+ * waiting. The lock is released once the file is closed.
+ *
+ * @param fp The pointer to the opened file
+ *
+ * @return SAL_OK if file was locked successfully
+ * @return SAL_WOULD_BLOCK if the file is locked by another opener
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_lock_file(FILE* fp);
+
+/**
+ * @brief Sets the length of a file and reserves its storage up front, so
+ * that regions written out of order don't fragment it nor fail for lack of space.
+ *
+ * @param fp The pointer to the opened file
+ * @param length The file length
+ *
+ * @return SAL_OK if file was allocated successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_allocate_file(FILE* fp, const long length);
+
+/**
+ * @brief Gets the storage space a file may take: the space available to
+ * unprivileged users on its file system, plus the space taken by the file
+ * itself, if it exists, as it is about to be rewritten.
+ *
+ * @param path The file path
+ * @param[out] bytes The space, in bytes
+ *
+ * @return SAL_OK if space was obtained successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_get_space_for_file(const char* path, long* bytes);
+
+/**
+ * @brief Reserves the storage of a file about to be written sequentially,
+ * without changing its length, so that it is laid out contiguously and
+ * runs out of space before any content is written rather than midway. The
+ * file is also advised to be written sequentially, once. File systems
+ * unable to reserve storage only get the advice.
+ *
+ * @param fp The pointer to the opened file
+ * @param length The final file length
+ *
+ * @return SAL_OK if file storage was reserved, or can't be on its file system
+ * @return SAL_NO_SPACE if the file does not fit
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_reserve_file(FILE* fp, const long length);
+
+/**
+ * @brief Fills a buffer with random bytes, e.g. for unique identifiers.
+ *
+ * @param[out] buffer The buffer to be filled
+ * @param length The buffer length
+ *
+ * @return SAL_OK if buffer was filled successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_get_random(uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Resolves a symbol of a shared library, loading the library on first
+ * use, so that optional dependencies need neither headers nor linking at
+ * build time. Loaded libraries stay loaded for the process lifetime.
+ * @note Missing libraries are not reported, as the caller decides whether they are required.
+ *
+ * @param library The library file name, e.g. "libzstd.so.1"
+ * @param name The symbol name
+ * @param[out] symbol The symbol address
+ *
+ * @return SAL_OK if symbol was resolved successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_load_symbol(const char* library, const char* name, void** symbol);
+
+/**
+ * @brief Creates a directory, unless it already exists.
+ *
+ * @param dir The directory path
+ *
+ * @return SAL_OK if the directory exists
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_create_dir(const char* dir);
+
+/**
+ * @brief Moves the data a socket already received into its receive buffer,
+ * without waiting for more, e.g. before receiving further data through a ring.
+ *
+ * @param socket The used socket
+ * @param[out] buffer The destination buffer
+ * @param length The destination buffer length
+ *
+ * @return the amount of moved bytes
+ **/
+size_t sal_take_buffered_msg(sal_socket_t socket, uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Creates a ring of asynchronous operations: operations are queued,
+ * then many of them are submitted and their completions reaped with a single
+ * system call, while the calling thread only waits for the ones it needs.
+ * Operations refer to sockets and files through slots registered once on the
+ * ring, instead of descriptors looked up on every operation.
+ * @note The created ring shall be released by sal_destroy_ring().
+ *
+ * @param entries The maximum amount of operations queued at once
+ * @param slots The amount of socket and file slots
+ *
+ * @return the created ring
+ * @return NULL if rings are not supported by the system, or by the build
+ **/
+sal_ring_t sal_create_ring(const unsigned entries, const int slots);
+
+/**
+ * @brief Releases a ring. Operations still in flight shall have completed.
+ *
+ * @param ring The created ring
+ *
+ * @return No return
+ **/
+void sal_destroy_ring(sal_ring_t ring);
+
+/**
+ * @brief Registers a buffer on the ring, so that file reads and writes
+ * within it skip mapping the buffer pages on every operation.
+ *
+ * @param ring The used ring
+ * @param buffer The buffer, kept allocated as long as the ring
+ * @param length The buffer length
+ *
+ * @return SAL_OK if buffer was registered successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_ring_register_buffer(sal_ring_t ring, uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Sets the socket a ring slot refers to.
+ *
+ * @param ring The used ring
+ * @param slot The slot, from 0 to the amount of slots of the ring
+ * @param socket The socket, or NULL to empty the slot
+ *
+ * @return SAL_OK if slot was set successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_ring_set_socket(sal_ring_t ring, const int slot, sal_socket_t socket);
+
+/**
+ * @brief Sets the file a ring slot refers to. Ring operations bypass the
+ * stream buffer and position of the file.
+ *
+ * @param ring The used ring
+ * @param slot The slot, from 0 to the amount of slots of the ring
+ * @param fp The pointer to the opened file, or NULL to empty the slot
+ *
+ * @return SAL_OK if slot was set successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_ring_set_file(sal_ring_t ring, const int slot, FILE* fp);
+
+/**
+ * @brief Queues an operation on the ring. Queued operations are submitted by
+ * sal_ring_submit(), or when the queue is full.
+ *
+ * @param ring The used ring
+ * @param op The operation, whose buffer and path shall stay valid until its completion
+ *
+ * @return SAL_OK if operation was queued successfully
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret sal_ring_prepare(sal_ring_t ring, const sal_ring_op_t* op);
+
+/**
+ * @brief Submits the queued operations and reaps completed ones, waiting
+ * until at least the given amount of operations completed.
+ *
+ * @param ring The used ring
+ * @param[out] completions The completions of the reaped operations
+ * @param max_completions The maximum amount of reaped completions
+ * @param min_completions The amount of completions to wait for, 0 not to wait
+ *
+ * @return the amount of reaped completions
+ * @return -1 on failure
+ **/
+int sal_ring_submit(
+    sal_ring_t ring,
+    sal_ring_completion_t* completions,
+    const int max_completions,
+    const int min_completions);
 
 #endif /* _SAL_H_ */
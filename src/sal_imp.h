@@ -3,6 +3,26 @@
 
 #include "sal.h"
 
+/**
+ * @brief The data moving system calls issued by the calling thread, counted
+ * by the implementations right before each call.
+ * @see sal_get_syscall_count()
+ */
+extern __thread unsigned long sal_imp_syscall_count;
+
+/**
+ * @brief Whether the implementations measure the time spent in the counted
+ * system calls.
+ * @see sal_enable_io_timing()
+ */
+extern bool sal_imp_io_timing;
+
+/**
+ * @brief The time the calling thread spent in the counted system calls.
+ * @see sal_get_io_time()
+ */
+extern __thread sal_io_time_t sal_imp_io_time;
+
 /**
  * @brief Implements sal_is_dir_writable()
  * @see sal_is_dir_writable()
@@ -21,12 +41,30 @@ sal_ret sal_imp_is_file_readable(const char* path);
  */
 char* sal_imp_get_filename(const char* path);
 
+/**
+ * @brief Implements sal_list_dir_files()
+ * @see sal_list_dir_files()
+ */
+sal_ret sal_imp_list_dir_files(const char* dir, char*** paths, size_t* count);
+
+/**
+ * @brief Implements sal_list_dir_entries()
+ * @see sal_list_dir_entries()
+ */
+sal_ret sal_imp_list_dir_entries(const char* dir, char*** files, size_t* file_count, char*** dirs, size_t* dir_count);
+
 /**
  * @brief Implements sal_create_socket()
  * @see sal_create_socket()
  */
 sal_socket_t sal_imp_create_socket();
 
+/**
+ * @brief Implements sal_create_socket_pair()
+ * @see sal_create_socket_pair()
+ */
+sal_ret sal_imp_create_socket_pair(sal_socket_t* first, sal_socket_t* second);
+
 /**
  * @brief Implements sal_destroy_socket()
  * @see sal_destroy_socket()
@@ -67,12 +105,298 @@ sal_ret sal_imp_close(sal_socket_t socket);
  * @brief Implements sal_send_msg()
  * @see sal_send_msg()
  */
-sal_ret sal_imp_send_msg(sal_socket_t socket, const uint8_t* buffer, const uint16_t length);
+sal_ret sal_imp_send_msg(sal_socket_t socket, const uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Implements sal_send_msgv()
+ * @see sal_send_msgv()
+ */
+sal_ret sal_imp_send_msgv(sal_socket_t socket, const sal_buffer_t* buffers, const int count);
 
 /**
  * @brief Implements sal_receive_msg()
  * @see sal_receive_msg()
  */
-sal_ret sal_imp_receive_msg(sal_socket_t socket, uint8_t* buffer, const uint16_t length);
+sal_ret sal_imp_receive_msg(sal_socket_t socket, uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Implements sal_peek_msg()
+ * @see sal_peek_msg()
+ */
+sal_ret sal_imp_peek_msg(sal_socket_t socket, const size_t length, const uint8_t** data, size_t* available);
+
+/**
+ * @brief Implements sal_wait_msg()
+ * @see sal_wait_msg()
+ */
+sal_ret sal_imp_wait_msg(sal_socket_t socket);
+
+/**
+ * @brief Implements sal_consume_msg()
+ * @see sal_consume_msg()
+ */
+void sal_imp_consume_msg(sal_socket_t socket, const size_t length);
+
+/**
+ * @brief Implements sal_set_nonblocking()
+ * @see sal_set_nonblocking()
+ */
+sal_ret sal_imp_set_nonblocking(sal_socket_t socket);
+
+/**
+ * @brief Implements sal_try_accept()
+ * @see sal_try_accept()
+ */
+sal_ret sal_imp_try_accept(sal_socket_t listening_socket, sal_socket_t* accepted_socket);
+
+/**
+ * @brief Implements sal_try_send_msg()
+ * @see sal_try_send_msg()
+ */
+sal_ret sal_imp_try_send_msg(sal_socket_t socket, const uint8_t* buffer, const size_t length, size_t* sent);
+
+/**
+ * @brief Implements sal_try_receive_msg()
+ * @see sal_try_receive_msg()
+ */
+sal_ret sal_imp_try_receive_msg(sal_socket_t socket, uint8_t* buffer, const size_t length, size_t* received);
+
+/**
+ * @brief Implements sal_create_poller()
+ * @see sal_create_poller()
+ */
+sal_poller_t sal_imp_create_poller();
+
+/**
+ * @brief Implements sal_destroy_poller()
+ * @see sal_destroy_poller()
+ */
+void sal_imp_destroy_poller(sal_poller_t poller);
+
+/**
+ * @brief Implements sal_poller_add()
+ * @see sal_poller_add()
+ */
+sal_ret sal_imp_poller_add(sal_poller_t poller, sal_socket_t socket, const uint32_t events, void* user_data);
+
+/**
+ * @brief Implements sal_poller_modify()
+ * @see sal_poller_modify()
+ */
+sal_ret sal_imp_poller_modify(sal_poller_t poller, sal_socket_t socket, const uint32_t events, void* user_data);
+
+/**
+ * @brief Implements sal_poller_remove()
+ * @see sal_poller_remove()
+ */
+sal_ret sal_imp_poller_remove(sal_poller_t poller, sal_socket_t socket);
+
+/**
+ * @brief Implements sal_poller_wait()
+ * @see sal_poller_wait()
+ */
+int sal_imp_poller_wait(sal_poller_t poller, sal_poll_event_t* events, const int max_events, const int timeout_ms);
+
+/**
+ * @brief Implements sal_set_reuse_port()
+ * @see sal_set_reuse_port()
+ */
+sal_ret sal_imp_set_reuse_port(sal_socket_t socket);
+
+/**
+ * @brief Implements sal_set_timeout()
+ * @see sal_set_timeout()
+ */
+sal_ret sal_imp_set_timeout(sal_socket_t socket, const int timeout_ms);
+
+/**
+ * @brief Implements sal_get_sent_bytes()
+ * @see sal_get_sent_bytes()
+ */
+uint64_t sal_imp_get_sent_bytes(sal_socket_t socket);
+
+/**
+ * @brief Implements sal_get_cpu_count()
+ * @see sal_get_cpu_count()
+ */
+int sal_imp_get_cpu_count();
+
+/**
+ * @brief Implements sal_get_time_ns()
+ * @see sal_get_time_ns()
+ */
+uint64_t sal_imp_get_time_ns(const sal_clock clock);
+
+/**
+ * @brief Implements sal_set_thread_affinity()
+ * @see sal_set_thread_affinity()
+ */
+sal_ret sal_imp_set_thread_affinity(const int cpu);
+
+/**
+ * @brief Implements sal_send_file()
+ * @see sal_send_file()
+ */
+sal_ret sal_imp_send_file(sal_socket_t socket, FILE* fp, const long offset, const size_t length);
+
+/**
+ * @brief Implements sal_map_file()
+ * @see sal_map_file()
+ */
+sal_ret sal_imp_map_file(FILE* fp, const long offset, const size_t length, const uint8_t** data);
+
+/**
+ * @brief Implements sal_unmap_file()
+ * @see sal_unmap_file()
+ */
+void sal_imp_unmap_file(const uint8_t* data, const size_t length);
+
+/**
+ * @brief Implements sal_check_mapped_file()
+ * @see sal_check_mapped_file()
+ */
+sal_ret sal_imp_check_mapped_file(const uint8_t* data);
+
+/**
+ * @brief Implements sal_prefetch_file()
+ * @see sal_prefetch_file()
+ */
+void sal_imp_prefetch_file(FILE* fp, const long offset, const size_t length);
+
+/**
+ * @brief Implements sal_splice_to_file()
+ * @see sal_splice_to_file()
+ */
+sal_ret sal_imp_splice_to_file(sal_socket_t socket, FILE* fp, const size_t length);
+
+/**
+ * @brief Implements sal_get_file_identity()
+ * @see sal_get_file_identity()
+ */
+sal_ret sal_imp_get_file_identity(FILE* fp, long* identity);
+
+/**
+ * @brief Implements sal_get_file_size()
+ * @see sal_get_file_size()
+ */
+sal_ret sal_imp_get_file_size(FILE* fp, long* size);
+
+/**
+ * @brief Implements sal_sync_file()
+ * @see sal_sync_file()
+ */
+sal_ret sal_imp_sync_file(FILE* fp);
+
+/**
+ * @brief Implements sal_sleep()
+ * @see sal_sleep()
+ */
+void sal_imp_sleep(const long milliseconds);
+
+/**
+ * @brief Implements sal_open_shared_file()
+ * @see sal_open_shared_file()
+ */
+sal_ret sal_imp_open_shared_file(const char* path, FILE** fp);
+
+/**
+ * @brief Implements sal_create_unique_file()
+ * @see sal_create_unique_file()
+ */
+sal_ret sal_imp_create_unique_file(char* path, FILE** fp);
+
+/**
+ * @brief Implements sal_lock_file()
+ * @see sal_lock_file()
+ */
+sal_ret sal_imp_lock_file(FILE* fp);
+
+/**
+ * @brief Implements sal_allocate_file()
+ * @see sal_allocate_file()
+ */
+sal_ret sal_imp_allocate_file(FILE* fp, const long length);
+
+/**
+ * @brief Implements sal_get_space_for_file()
+ * @see sal_get_space_for_file()
+ */
+sal_ret sal_imp_get_space_for_file(const char* path, long* bytes);
+
+/**
+ * @brief Implements sal_reserve_file()
+ * @see sal_reserve_file()
+ */
+sal_ret sal_imp_reserve_file(FILE* fp, const long length);
+
+/**
+ * @brief Implements sal_get_random()
+ * @see sal_get_random()
+ */
+sal_ret sal_imp_get_random(uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Implements sal_load_symbol()
+ * @see sal_load_symbol()
+ */
+sal_ret sal_imp_load_symbol(const char* library, const char* name, void** symbol);
+
+/**
+ * @brief Implements sal_create_dir()
+ * @see sal_create_dir()
+ */
+sal_ret sal_imp_create_dir(const char* dir);
+
+/**
+ * @brief Implements sal_take_buffered_msg()
+ * @see sal_take_buffered_msg()
+ */
+size_t sal_imp_take_buffered_msg(sal_socket_t socket, uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Implements sal_create_ring()
+ * @see sal_create_ring()
+ */
+sal_ring_t sal_imp_create_ring(const unsigned entries, const int slots);
+
+/**
+ * @brief Implements sal_destroy_ring()
+ * @see sal_destroy_ring()
+ */
+void sal_imp_destroy_ring(sal_ring_t ring);
+
+/**
+ * @brief Implements sal_ring_register_buffer()
+ * @see sal_ring_register_buffer()
+ */
+sal_ret sal_imp_ring_register_buffer(sal_ring_t ring, uint8_t* buffer, const size_t length);
+
+/**
+ * @brief Implements sal_ring_set_socket()
+ * @see sal_ring_set_socket()
+ */
+sal_ret sal_imp_ring_set_socket(sal_ring_t ring, const int slot, sal_socket_t socket);
+
+/**
+ * @brief Implements sal_ring_set_file()
+ * @see sal_ring_set_file()
+ */
+sal_ret sal_imp_ring_set_file(sal_ring_t ring, const int slot, FILE* fp);
+
+/**
+ * @brief Implements sal_ring_prepare()
+ * @see sal_ring_prepare()
+ */
+sal_ret sal_imp_ring_prepare(sal_ring_t ring, const sal_ring_op_t* op);
+
+/**
+ * @brief Implements sal_ring_submit()
+ * @see sal_ring_submit()
+ */
+int sal_imp_ring_submit(
+    sal_ring_t ring,
+    sal_ring_completion_t* completions,
+    const int max_completions,
+    const int min_completions);
 
 #endif /* __SAL_IMP_H__ */
@@ -1,15 +1,173 @@
+#define _GNU_SOURCE //accept4, CPU_SET
 #include <unistd.h> //access
 #include <sys/stat.h> //stat
 #include <sys/socket.h>
 #include <libgen.h> //basename
+#include <dirent.h> //opendir
 #include <string.h> //strdup
 #include <string.h> //strdup
 #include <errno.h>
 #include <stdlib.h>
+#include <fcntl.h> //fcntl
+#include <sys/epoll.h>
+#include <sched.h> //sched_setaffinity
+#include <sys/sendfile.h>
+#include <sys/mman.h> //mmap
+#include <sys/uio.h> //iovec
+#include <limits.h> //IOV_MAX
+#include <time.h> //nanosleep, clock_gettime
+#include <sys/random.h> //getrandom
+#include <dlfcn.h> //dlopen
+#include <sys/statvfs.h> //statvfs
+#include <sys/file.h> //flock
+#include <sys/time.h> //timeval
+#include <signal.h> //sigaction
+#include <pthread.h> //pthread_once
 
 #include "sal_imp.h"
+#include "probes.h"
 #include "common.h"
 
+#define SPLICE_PIPE_LEN (1 << 20) ///< the requested capacity of the pipe used by splice()
+#define MAP_GUARD_COUNT 64 ///< the mapped regions guarded against truncation at once, others are read into memory
+#define MAP_GUARD_CLAIMED ((uintptr_t)-1) ///< the start of a guard being filled in
+
+/**
+ * @brief The socket representation. The descriptor is the first member, so
+ * a socket can be used wherever a pointer to its descriptor is expected.
+ **/
+typedef struct {
+    int fd; ///< the socket descriptor
+    int pipe_fds[2]; ///< the pipe used to splice received data, created on demand
+    size_t pipe_len; ///< the pipe capacity
+    uint8_t* rx_buffer; ///< the receive buffer, allocated on first blocking receive
+    size_t rx_start; ///< the offset of the first buffered byte
+    size_t rx_end; ///< the offset past the last buffered byte
+    uint64_t sent_bytes; ///< the amount of bytes sent through the socket
+} linux_socket;
+
+/**
+ * @brief A mapped file region, whose pages past the end of a truncated file
+ * are replaced by zero pages instead of raising SIGBUS. Guards are shared by
+ * all threads and looked up from the signal handler, so they are claimed and
+ * released with atomic operations only.
+ **/
+typedef struct {
+    uintptr_t start; ///< the region start, 0 if the guard is free
+    size_t length; ///< the region length
+    int truncated; ///< whether a page past the end of file was replaced
+} map_guard;
+
+static map_guard map_guards[MAP_GUARD_COUNT]; ///< the guards of the mapped regions
+static pthread_once_t map_guard_once = PTHREAD_ONCE_INIT; ///< installs the SIGBUS handler once
+static uintptr_t page_size = 0; ///< the memory page size, read once as the handler can't
+__thread unsigned long sal_imp_syscall_count = 0;
+bool sal_imp_io_timing = false;
+__thread sal_io_time_t sal_imp_io_time = {0};
+
+/**
+ * @brief Counts a data moving system call about to be issued, and starts
+ * measuring its time if I/O timing is enabled.
+ *
+ * @return the call start time, 0 if its time is not measured
+ **/
+static inline uint64_t begin_io_call() {
+    ++sal_imp_syscall_count;
+    return sal_imp_io_timing ? sal_imp_get_time_ns(SAL_CLOCK_MONOTONIC) : 0;
+}
+
+/**
+ * @brief Adds the time of a data moving system call to the given counter.
+ *
+ * @param[in,out] elapsed The time counter, one of sal_imp_io_time
+ * @param start The call start time, as returned by begin_io_call()
+ *
+ * @return No return
+ **/
+static inline void end_io_call(uint64_t* elapsed, const uint64_t start) {
+    if (start != 0) {
+        *elapsed += sal_imp_get_time_ns(SAL_CLOCK_MONOTONIC) - start;
+    }
+}
+
+/**
+ * @brief Allocates the representation of a socket descriptor.
+ *
+ * @param fd The socket descriptor
+ *
+ * @return the allocated socket
+ **/
+static linux_socket* new_socket(int fd) {
+    linux_socket* socket = malloc(sizeof(*socket));
+    socket->fd = fd;
+    socket->pipe_fds[0] = -1;
+    socket->pipe_fds[1] = -1;
+    socket->pipe_len = 0;
+    socket->rx_buffer = NULL;
+    socket->rx_start = 0;
+    socket->rx_end = 0;
+    socket->sent_bytes = 0;
+    return socket;
+}
+
+/**
+ * @brief Moves already buffered data to the given buffer.
+ *
+ * @param socket The given socket
+ * @param[out] buffer The destination buffer
+ * @param length The destination buffer length
+ *
+ * @return the amount of moved bytes
+ **/
+static size_t take_buffered(linux_socket* socket, uint8_t* buffer, const size_t length) {
+    const size_t taken = MIN(length, socket->rx_end - socket->rx_start);
+    if (taken > 0) {
+        memcpy(buffer, &socket->rx_buffer[socket->rx_start], taken);
+        sal_imp_consume_msg(socket, taken);
+    }
+    return taken;
+}
+
+/**
+ * @brief Receives as much data as possible into the socket receive buffer,
+ * waiting until at least the given amount of bytes is buffered.
+ *
+ * @param socket The given socket
+ * @param length The minimum amount of buffered bytes, up to SAL_RECEIVE_BUFFER_LEN
+ *
+ * @return SAL_OK if data was buffered successfully
+ * @return SAL_ERROR otherwise
+ **/
+static sal_ret fill_buffer(linux_socket* socket, const size_t length) {
+    if (socket->rx_buffer == NULL && (socket->rx_buffer = malloc(SAL_RECEIVE_BUFFER_LEN)) == NULL) {
+        set_error_description("Out of memory");
+        return SAL_ERROR;
+    }
+    /* Buffered data is kept contiguous, so it can be parsed in place */
+    if (socket->rx_start + length > SAL_RECEIVE_BUFFER_LEN) {
+        memmove(socket->rx_buffer, &socket->rx_buffer[socket->rx_start], socket->rx_end - socket->rx_start);
+        socket->rx_end -= socket->rx_start;
+        socket->rx_start = 0;
+    }
+    while (socket->rx_end - socket->rx_start < length) {
+        PROBE2(recv_entry, socket->fd, SAL_RECEIVE_BUFFER_LEN - socket->rx_end);
+        const uint64_t start = begin_io_call();
+        ssize_t bytes_received = recv(
+            socket->fd, &socket->rx_buffer[socket->rx_end], SAL_RECEIVE_BUFFER_LEN - socket->rx_end, 0);
+        end_io_call(&sal_imp_io_time.receive_ns, start);
+        PROBE3(recv_return, socket->fd, bytes_received, bytes_received < 0 ? errno : 0);
+        if (bytes_received <= 0) {
+            if (bytes_received < 0 && errno == EINTR) {
+                continue;
+            }
+            set_error_description("%s", bytes_received ? strerror(errno) : "No data");
+            return bytes_received ? SAL_ERROR : SAL_CONNECTION_CLOSED;
+        }
+        socket->rx_end += bytes_received;
+    }
+    return SAL_OK;
+}
+
 sal_ret sal_imp_is_dir_writable(const char* dir) {
     if (access(dir, W_OK) == 0) {
         return SAL_OK;
@@ -46,18 +204,156 @@ char* sal_imp_get_filename(const char* path) {
     return file_name;
 }
 
+/**
+ * @brief Compares two paths by name, for qsort().
+ *
+ * @param a The first path
+ * @param b The second path
+ *
+ * @return the strcmp() result
+ **/
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Appends a path to a growing list of paths.
+ *
+ * @param[in,out] list The list of paths
+ * @param[in,out] count The amount of listed paths
+ * @param[in,out] capacity The list capacity
+ * @param path The appended path
+ *
+ * @return true if path was appended
+ * @return false if out of memory
+ **/
+static bool append_path(char*** list, size_t* count, size_t* capacity, char* path) {
+    if (*count == *capacity) {
+        const size_t grown_capacity = *capacity ? *capacity * 2 : 64;
+        char** grown = realloc(*list, grown_capacity * sizeof(**list));
+        if (grown == NULL) {
+            return false;
+        }
+        *list = grown;
+        *capacity = grown_capacity;
+    }
+    (*list)[(*count)++] = path;
+    return true;
+}
+
+/**
+ * @brief Lists the regular files of a directory, and optionally its
+ * subdirectories, each list sorted by name.
+ *
+ * @param dir The directory path
+ * @param[out] files The paths of the listed files
+ * @param[out] file_count The amount of listed files
+ * @param[out] dirs The paths of the listed subdirectories, NULL if they are not listed
+ * @param[out] dir_count The amount of listed subdirectories
+ *
+ * @return SAL_OK if directory was listed successfully
+ * @return SAL_DIR_NOT_FOUND, if the given path is not a directory
+ * @return SAL_ERROR otherwise
+ **/
+static sal_ret list_dir(const char* dir, char*** files, size_t* file_count, char*** dirs, size_t* dir_count) {
+    DIR* dir_stream = opendir(dir);
+    if (dir_stream == NULL) {
+        set_error_description("%s", strerror(errno));
+        return errno == ENOTDIR || errno == ENOENT ? SAL_DIR_NOT_FOUND : SAL_ERROR;
+    }
+    char** list = NULL;
+    size_t list_count = 0;
+    size_t list_capacity = 0;
+    char** dir_list = NULL;
+    size_t dir_list_count = 0;
+    size_t dir_list_capacity = 0;
+    struct dirent* entry = NULL;
+    while ((entry = readdir(dir_stream)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char* path = malloc(strlen(dir) + 1 + strlen(entry->d_name) + 1);
+        if (path == NULL) {
+            goto RELEASE_ON_ERROR;
+        }
+        sprintf(path, "%s/%s", dir, entry->d_name);
+        struct stat path_stat;
+        bool appended = true;
+        if (stat(path, &path_stat) == 0 && S_ISREG(path_stat.st_mode)) {
+            appended = append_path(&list, &list_count, &list_capacity, path);
+        } else if (dirs != NULL && lstat(path, &path_stat) == 0 && S_ISDIR(path_stat.st_mode)) {
+            /* Links to directories are not followed, so that no walk loops */
+            appended = append_path(&dir_list, &dir_list_count, &dir_list_capacity, path);
+        } else {
+            free(path);
+        }
+        if (!appended) {
+            free(path);
+            goto RELEASE_ON_ERROR;
+        }
+    }
+    closedir(dir_stream);
+    qsort(list, list_count, sizeof(*list), compare_paths);
+    *files = list;
+    *file_count = list_count;
+    if (dirs != NULL) {
+        qsort(dir_list, dir_list_count, sizeof(*dir_list), compare_paths);
+        *dirs = dir_list;
+        *dir_count = dir_list_count;
+    }
+    return SAL_OK;
+
+RELEASE_ON_ERROR:
+    set_error_description("Out of memory");
+    closedir(dir_stream);
+    for (size_t i = 0; i < list_count; ++i) {
+        free(list[i]);
+    }
+    free(list);
+    for (size_t i = 0; i < dir_list_count; ++i) {
+        free(dir_list[i]);
+    }
+    free(dir_list);
+    return SAL_ERROR;
+}
+
+sal_ret sal_imp_list_dir_files(const char* dir, char*** paths, size_t* count) {
+    return list_dir(dir, paths, count, NULL, NULL);
+}
+
+sal_ret sal_imp_list_dir_entries(const char* dir, char*** files, size_t* file_count, char*** dirs, size_t* dir_count) {
+    return list_dir(dir, files, file_count, dirs, dir_count);
+}
+
 sal_socket_t sal_imp_create_socket() {
     int sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd == -1) {
         set_error_description("%s", strerror(errno));
         return NULL;
     }
-    int* socket = malloc(sizeof(int));
-    *socket = sockfd;
-    return socket;
+    return new_socket(sockfd);
+}
+
+sal_ret sal_imp_create_socket_pair(sal_socket_t* first, sal_socket_t* second) {
+    int fds[2] = {-1, -1};
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    *first = new_socket(fds[0]);
+    *second = new_socket(fds[1]);
+    return SAL_OK;
 }
 
 void sal_imp_destroy_socket(sal_socket_t socket) {
+    linux_socket* linux_socket = socket;
+    if (linux_socket && linux_socket->pipe_fds[0] != -1) {
+        close(linux_socket->pipe_fds[0]);
+        close(linux_socket->pipe_fds[1]);
+    }
+    if (linux_socket) {
+        free(linux_socket->rx_buffer);
+    }
     free(socket);
 }
 
@@ -79,9 +375,7 @@ sal_socket_t sal_imp_accept(sal_socket_t listening_socket) {
         return NULL;
     }
 
-    int* socket = malloc(sizeof(int));
-    *socket = connection_fd;
-    return socket;
+    return new_socket(connection_fd);
 }
 
 sal_ret sal_imp_bind(sal_socket_t socket, struct sockaddr_in* addr) {
@@ -108,35 +402,778 @@ sal_ret sal_imp_close(sal_socket_t socket) {
     return SAL_OK;
 }
 
-sal_ret sal_imp_send_msg(sal_socket_t socket, const uint8_t* buffer, const uint16_t length) {
+sal_ret sal_imp_send_msg(sal_socket_t socket, const uint8_t* buffer, const size_t length) {
     int sockfd = *((int*)socket);
-    uint16_t offset = 0;
+    size_t offset = 0;
     while (offset < length) {
-        uint16_t transmitting_bytes = MIN(length - offset, MSG_BUFFER_LEN);
-        if (send(sockfd, &buffer[offset], transmitting_bytes, 0) < 0) {
+        PROBE2(send_entry, sockfd, length - offset);
+        const uint64_t start = begin_io_call();
+        ssize_t bytes_sent = send(sockfd, &buffer[offset], length - offset, MSG_NOSIGNAL);
+        end_io_call(&sal_imp_io_time.send_ns, start);
+        PROBE3(send_return, sockfd, bytes_sent, bytes_sent < 0 ? errno : 0);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             set_error_description("%s", strerror(errno));
             return SAL_ERROR;
         }
-        offset += transmitting_bytes;
+        ((linux_socket*)socket)->sent_bytes += bytes_sent;
+        offset += bytes_sent;
     }
     return SAL_OK;
 }
 
-sal_ret sal_imp_receive_msg(sal_socket_t socket, uint8_t* buffer, const uint16_t length) {
+sal_ret sal_imp_send_msgv(sal_socket_t socket, const sal_buffer_t* buffers, const int count) {
     int sockfd = *((int*)socket);
-    uint16_t offset = 0;
+    struct iovec vectors[count];
+    size_t pending_length = 0;
+    for (int i = 0; i < count; ++i) {
+        vectors[i].iov_base = (void*)buffers[i].data;
+        vectors[i].iov_len = buffers[i].length;
+        pending_length += buffers[i].length;
+    }
+    struct iovec* pending = vectors;
+    int pending_count = count;
+    while (pending_count > 0) {
+        struct msghdr msg = {
+            .msg_iov = pending,
+            .msg_iovlen = MIN(pending_count, IOV_MAX)
+        };
+        PROBE2(send_entry, sockfd, pending_length);
+        const uint64_t start = begin_io_call();
+        ssize_t bytes_sent = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        end_io_call(&sal_imp_io_time.send_ns, start);
+        PROBE3(send_return, sockfd, bytes_sent, bytes_sent < 0 ? errno : 0);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error_description("%s", strerror(errno));
+            return SAL_ERROR;
+        }
+        ((linux_socket*)socket)->sent_bytes += bytes_sent;
+        pending_length -= bytes_sent;
+        /* Skips whatever was sent, which may end in the middle of a buffer */
+        while (pending_count > 0 && (size_t)bytes_sent >= pending->iov_len) {
+            bytes_sent -= pending->iov_len;
+            ++pending;
+            --pending_count;
+        }
+        if (pending_count > 0) {
+            pending->iov_base = (uint8_t*)pending->iov_base + bytes_sent;
+            pending->iov_len -= bytes_sent;
+        }
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_receive_msg(sal_socket_t socket, uint8_t* buffer, const size_t length) {
+    linux_socket* linux_socket = socket;
+    size_t offset = take_buffered(linux_socket, buffer, length);
     while (offset < length) {
-        uint16_t requested_bytes = MIN(length - offset, MSG_BUFFER_LEN);
-        ssize_t bytes_received = 0;
-        if ((bytes_received = recv(sockfd, &buffer[offset], requested_bytes, 0)) <= 0) {
-            if (bytes_received) {
+        if (fill_buffer(linux_socket, 1) != SAL_OK) {
+            return SAL_ERROR;
+        }
+        offset += take_buffered(linux_socket, &buffer[offset], length - offset);
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_peek_msg(sal_socket_t socket, const size_t length, const uint8_t** data, size_t* available) {
+    linux_socket* linux_socket = socket;
+    if (length > SAL_RECEIVE_BUFFER_LEN) {
+        set_error_description("Requested %zu bytes", length);
+        return SAL_ERROR;
+    }
+    if (linux_socket->rx_end - linux_socket->rx_start < MAX(length, 1) &&
+        fill_buffer(linux_socket, MAX(length, 1)) != SAL_OK) {
+        return SAL_ERROR;
+    }
+    *data = &linux_socket->rx_buffer[linux_socket->rx_start];
+    *available = linux_socket->rx_end - linux_socket->rx_start;
+    return SAL_OK;
+}
+
+sal_ret sal_imp_wait_msg(sal_socket_t socket) {
+    linux_socket* linux_socket = socket;
+    if (linux_socket->rx_start < linux_socket->rx_end) {
+        return SAL_OK;
+    }
+    return fill_buffer(linux_socket, 1);
+}
+
+void sal_imp_consume_msg(sal_socket_t socket, const size_t length) {
+    linux_socket* linux_socket = socket;
+    linux_socket->rx_start += MIN(length, linux_socket->rx_end - linux_socket->rx_start);
+    if (linux_socket->rx_start == linux_socket->rx_end) {
+        linux_socket->rx_start = 0;
+        linux_socket->rx_end = 0;
+    }
+}
+
+sal_ret sal_imp_set_nonblocking(sal_socket_t socket) {
+    int sockfd = *((int*)socket);
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_try_accept(sal_socket_t listening_socket, sal_socket_t* accepted_socket) {
+    int connection_fd = accept4(*(int*)listening_socket, NULL, NULL, SOCK_NONBLOCK);
+    if (connection_fd == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+            return SAL_WOULD_BLOCK;
+        }
+        set_error_description("%s", strerror(errno));
+        return errno == EMFILE || errno == ENFILE ? SAL_NO_DESCRIPTORS : SAL_ERROR;
+    }
+
+    *accepted_socket = new_socket(connection_fd);
+    return SAL_OK;
+}
+
+sal_ret sal_imp_try_send_msg(sal_socket_t socket, const uint8_t* buffer, const size_t length, size_t* sent) {
+    PROBE2(send_entry, *((int*)socket), length);
+    const uint64_t start = begin_io_call();
+    ssize_t bytes_sent = send(*((int*)socket), buffer, length, MSG_NOSIGNAL);
+    end_io_call(&sal_imp_io_time.send_ns, start);
+    PROBE3(send_return, *((int*)socket), bytes_sent, bytes_sent < 0 ? errno : 0);
+    if (bytes_sent < 0) {
+        *sent = 0;
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return SAL_WOULD_BLOCK;
+        }
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    ((linux_socket*)socket)->sent_bytes += bytes_sent;
+    *sent = bytes_sent;
+    return SAL_OK;
+}
+
+sal_ret sal_imp_try_receive_msg(sal_socket_t socket, uint8_t* buffer, const size_t length, size_t* received) {
+    linux_socket* linux_socket = socket;
+    if ((*received = take_buffered(linux_socket, buffer, length)) > 0) {
+        return SAL_OK;
+    }
+    PROBE2(recv_entry, linux_socket->fd, length);
+    const uint64_t start = begin_io_call();
+    ssize_t bytes_received = recv(linux_socket->fd, buffer, length, 0);
+    end_io_call(&sal_imp_io_time.receive_ns, start);
+    PROBE3(recv_return, linux_socket->fd, bytes_received, bytes_received < 0 ? errno : 0);
+    if (bytes_received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return SAL_WOULD_BLOCK;
+        }
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    } else if (bytes_received == 0) {
+        return SAL_CONNECTION_CLOSED;
+    }
+    *received = bytes_received;
+    return SAL_OK;
+}
+
+/**
+ * @brief Converts SAL_POLL_* flags to epoll events.
+ *
+ * @param events The SAL_POLL_* flags
+ *
+ * @return the epoll events
+ **/
+static uint32_t to_epoll_events(const uint32_t events) {
+    uint32_t epoll_events = 0;
+    if (events & SAL_POLL_IN) {
+        epoll_events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (events & SAL_POLL_OUT) {
+        epoll_events |= EPOLLOUT;
+    }
+    return epoll_events;
+}
+
+/**
+ * @brief Converts epoll events to SAL_POLL_* flags.
+ *
+ * @param epoll_events The epoll events
+ *
+ * @return the SAL_POLL_* flags
+ **/
+static uint32_t from_epoll_events(const uint32_t epoll_events) {
+    uint32_t events = 0;
+    if (epoll_events & (EPOLLIN | EPOLLRDHUP)) {
+        events |= SAL_POLL_IN;
+    }
+    if (epoll_events & EPOLLOUT) {
+        events |= SAL_POLL_OUT;
+    }
+    if (epoll_events & (EPOLLERR | EPOLLHUP)) {
+        events |= SAL_POLL_ERROR;
+    }
+    return events;
+}
+
+sal_poller_t sal_imp_create_poller() {
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+        set_error_description("%s", strerror(errno));
+        return NULL;
+    }
+    int* poller = malloc(sizeof(int));
+    *poller = epoll_fd;
+    return poller;
+}
+
+void sal_imp_destroy_poller(sal_poller_t poller) {
+    if (poller) {
+        close(*(int*)poller);
+    }
+    free(poller);
+}
+
+/**
+ * @brief Applies an epoll_ctl() operation on a socket.
+ *
+ * @param poller The given poller
+ * @param operation The epoll_ctl() operation
+ * @param socket The given socket
+ * @param events The watched events (SAL_POLL_* flags)
+ * @param user_data The data reported back when the socket is ready
+ *
+ * @return SAL_OK if operation succeeded
+ * @return SAL_ERROR otherwise
+ **/
+static sal_ret poller_control(
+    sal_poller_t poller, int operation, sal_socket_t socket, const uint32_t events, void* user_data) {
+    struct epoll_event event = {
+        .events = to_epoll_events(events),
+        .data.ptr = user_data
+    };
+    if (epoll_ctl(*(int*)poller, operation, *(int*)socket, &event) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_poller_add(sal_poller_t poller, sal_socket_t socket, const uint32_t events, void* user_data) {
+    return poller_control(poller, EPOLL_CTL_ADD, socket, events, user_data);
+}
+
+sal_ret sal_imp_poller_modify(sal_poller_t poller, sal_socket_t socket, const uint32_t events, void* user_data) {
+    return poller_control(poller, EPOLL_CTL_MOD, socket, events, user_data);
+}
+
+sal_ret sal_imp_poller_remove(sal_poller_t poller, sal_socket_t socket) {
+    return poller_control(poller, EPOLL_CTL_DEL, socket, 0, NULL);
+}
+
+int sal_imp_poller_wait(sal_poller_t poller, sal_poll_event_t* events, const int max_events, const int timeout_ms) {
+    struct epoll_event epoll_events[max_events];
+    int ready = epoll_wait(*(int*)poller, epoll_events, max_events, timeout_ms);
+    if (ready < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        set_error_description("%s", strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < ready; ++i) {
+        events[i].events = from_epoll_events(epoll_events[i].events);
+        events[i].user_data = epoll_events[i].data.ptr;
+    }
+    return ready;
+}
+
+sal_ret sal_imp_set_reuse_port(sal_socket_t socket) {
+    int enabled = 1;
+    if (setsockopt(*(int*)socket, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled)) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_set_timeout(sal_socket_t socket, const int timeout_ms) {
+    struct timeval timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    if (setsockopt(*(int*)socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        setsockopt(*(int*)socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+uint64_t sal_imp_get_sent_bytes(sal_socket_t socket) {
+    return ((linux_socket*)socket)->sent_bytes;
+}
+
+int sal_imp_get_cpu_count() {
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpu_count > 0 ? (int)cpu_count : 1;
+}
+
+uint64_t sal_imp_get_time_ns(const sal_clock clock) {
+    struct timespec now;
+    clock_gettime(clock == SAL_CLOCK_WALL ? CLOCK_REALTIME : CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+sal_ret sal_imp_set_thread_affinity(const int cpu) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_send_file(sal_socket_t socket, FILE* fp, const long offset, const size_t length) {
+    int sockfd = *((int*)socket);
+    off_t file_offset = offset;
+    size_t remaining = length;
+    while (remaining > 0) {
+        PROBE2(send_entry, sockfd, remaining);
+        const uint64_t start = begin_io_call();
+        ssize_t bytes_sent = sendfile(sockfd, fileno(fp), &file_offset, remaining);
+        end_io_call(&sal_imp_io_time.send_ns, start);
+        PROBE3(send_return, sockfd, bytes_sent, bytes_sent < 0 ? errno : 0);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error_description("%s", strerror(errno));
+            return SAL_ERROR;
+        } else if (bytes_sent == 0) {
+            set_error_description("Unexpected end of file");
+            return SAL_ERROR;
+        }
+        ((linux_socket*)socket)->sent_bytes += bytes_sent;
+        remaining -= bytes_sent;
+    }
+    return SAL_OK;
+}
+
+/**
+ * @brief Handles SIGBUS, raised when a mapped page past the end of a file is
+ * read: the rest of a guarded region is replaced by zero pages, and reading
+ * goes on. Faults outside guarded regions get the default action.
+ *
+ * @param signal The signal number
+ * @param info The signal information, holding the faulting address
+ * @param context The interrupted context
+ *
+ * @return No return
+ **/
+static void handle_map_fault(int signal, siginfo_t* info, void* context) {
+    (void)context;
+    const uintptr_t address = (uintptr_t)info->si_addr;
+    for (size_t i = 0; i < MAP_GUARD_COUNT; ++i) {
+        const uintptr_t start = __atomic_load_n(&map_guards[i].start, __ATOMIC_ACQUIRE);
+        if (start == 0 || start == MAP_GUARD_CLAIMED ||
+            address < start || address >= start + map_guards[i].length) {
+            continue;
+        }
+        const uintptr_t page = address - address % page_size;
+        if (mmap((void*)page, start + map_guards[i].length - page, PROT_READ,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+            __atomic_store_n(&map_guards[i].truncated, 1, __ATOMIC_RELEASE);
+            return;
+        }
+        break;
+    }
+    /* The faulting access is retried, and now kills the process */
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_DFL;
+    sigaction(signal, &action, NULL);
+}
+
+/**
+ * @brief Installs the SIGBUS handler of guarded regions.
+ *
+ * @return No return
+ **/
+static void install_map_fault_handler() {
+    page_size = sysconf(_SC_PAGESIZE);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_map_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, NULL);
+}
+
+/**
+ * @brief Finds the guard of a mapped region.
+ *
+ * @param data The mapped region
+ *
+ * @return the guard
+ * @return NULL if the region is not guarded
+ **/
+static map_guard* find_map_guard(const uint8_t* data) {
+    for (size_t i = 0; i < MAP_GUARD_COUNT; ++i) {
+        if (__atomic_load_n(&map_guards[i].start, __ATOMIC_ACQUIRE) == (uintptr_t)data) {
+            return &map_guards[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads a file region into anonymous memory, for when no guard is free
+ * to map it: a truncated file then shows as a short read instead of SIGBUS.
+ *
+ * @param fp The pointer to the opened file
+ * @param offset The region offset on file
+ * @param length The region length
+ * @param[out] data The read region, released by munmap()
+ *
+ * @return SAL_OK if the whole region was read
+ * @return SAL_ERROR otherwise
+ **/
+static sal_ret read_file_region(FILE* fp, const long offset, const size_t length, const uint8_t** data) {
+    uint8_t* addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    size_t done = 0;
+    while (done < length) {
+        const uint64_t start = begin_io_call();
+        ssize_t ret = pread(fileno(fp), addr + done, length - done, offset + done);
+        end_io_call(&sal_imp_io_time.file_ns, start);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            set_error_description("%s", ret < 0 ? strerror(errno) : "File truncated while mapped");
+            munmap(addr, length);
+            return SAL_ERROR;
+        }
+        done += ret;
+    }
+    mprotect(addr, length, PROT_READ);
+    *data = addr;
+    return SAL_OK;
+}
+
+sal_ret sal_imp_map_file(FILE* fp, const long offset, const size_t length, const uint8_t** data) {
+    pthread_once(&map_guard_once, install_map_fault_handler);
+    map_guard* guard = NULL;
+    for (size_t i = 0; i < MAP_GUARD_COUNT && !guard; ++i) {
+        uintptr_t free_start = 0;
+        if (__atomic_compare_exchange_n(
+                &map_guards[i].start, &free_start, MAP_GUARD_CLAIMED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            guard = &map_guards[i];
+        }
+    }
+    /* Unguarded, a truncation would kill the process, so the region is read instead */
+    if (!guard) {
+        return read_file_region(fp, offset, length, data);
+    }
+    void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(fp), offset);
+    if (addr == MAP_FAILED) {
+        set_error_description("%s", strerror(errno));
+        __atomic_store_n(&guard->start, 0, __ATOMIC_RELEASE);
+        return SAL_ERROR;
+    }
+    madvise(addr, length, MADV_SEQUENTIAL);
+    madvise(addr, length, MADV_HUGEPAGE);
+    guard->length = length;
+    guard->truncated = 0;
+    __atomic_store_n(&guard->start, (uintptr_t)addr, __ATOMIC_RELEASE);
+    *data = addr;
+    return SAL_OK;
+}
+
+void sal_imp_unmap_file(const uint8_t* data, const size_t length) {
+    /* Released first, as the address may be mapped again by another thread as soon as unmapped.
+     * Regions read into memory have no guard, and are unmapped alike */
+    map_guard* guard = find_map_guard(data);
+    if (guard) {
+        __atomic_store_n(&guard->start, 0, __ATOMIC_RELEASE);
+    }
+    munmap((void*)data, length);
+}
+
+sal_ret sal_imp_check_mapped_file(const uint8_t* data) {
+    const map_guard* guard = find_map_guard(data);
+    if (guard && __atomic_load_n(&guard->truncated, __ATOMIC_ACQUIRE)) {
+        set_error_description("File truncated while mapped");
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+void sal_imp_prefetch_file(FILE* fp, const long offset, const size_t length) {
+    posix_fadvise(fileno(fp), offset, length, POSIX_FADV_WILLNEED);
+}
+
+/**
+ * @brief Creates the socket splice pipe, if not created yet.
+ *
+ * @param socket The given socket
+ *
+ * @return SAL_OK if pipe is available
+ * @return SAL_ERROR otherwise
+ **/
+static sal_ret prepare_splice_pipe(linux_socket* socket) {
+    if (socket->pipe_fds[0] != -1) {
+        return SAL_OK;
+    }
+    if (pipe(socket->pipe_fds) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    /* A larger pipe moves more data per splice() call, but the system may limit its size */
+    int pipe_len = fcntl(socket->pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_LEN);
+    if (pipe_len == -1) {
+        pipe_len = fcntl(socket->pipe_fds[1], F_GETPIPE_SZ);
+    }
+    socket->pipe_len = pipe_len > 0 ? pipe_len : (1 << 16);
+    return SAL_OK;
+}
+
+sal_ret sal_imp_splice_to_file(sal_socket_t socket, FILE* fp, const size_t length) {
+    linux_socket* linux_socket = socket;
+    if (prepare_splice_pipe(linux_socket) != SAL_OK) {
+        return SAL_ERROR;
+    }
+    /* Data already buffered by previous receives doesn't go through the pipe */
+    size_t remaining = length;
+    while (remaining > 0 && linux_socket->rx_start < linux_socket->rx_end) {
+        const uint64_t start = begin_io_call();
+        ssize_t written = write(
+            fileno(fp), &linux_socket->rx_buffer[linux_socket->rx_start],
+            MIN(remaining, linux_socket->rx_end - linux_socket->rx_start));
+        end_io_call(&sal_imp_io_time.file_ns, start);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error_description("%s", strerror(errno));
+            return SAL_ERROR;
+        }
+        sal_imp_consume_msg(linux_socket, written);
+        remaining -= written;
+    }
+    while (remaining > 0) {
+        PROBE2(recv_entry, linux_socket->fd, MIN(remaining, linux_socket->pipe_len));
+        const uint64_t start = begin_io_call();
+        ssize_t in_pipe = splice(
+            linux_socket->fd, NULL, linux_socket->pipe_fds[1], NULL,
+            MIN(remaining, linux_socket->pipe_len), SPLICE_F_MOVE | SPLICE_F_MORE);
+        end_io_call(&sal_imp_io_time.receive_ns, start);
+        PROBE3(recv_return, linux_socket->fd, in_pipe, in_pipe < 0 ? errno : 0);
+        if (in_pipe < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error_description("%s", strerror(errno));
+            return SAL_ERROR;
+        } else if (in_pipe == 0) {
+            set_error_description("No data");
+            return SAL_ERROR;
+        }
+        remaining -= in_pipe;
+        while (in_pipe > 0) {
+            const uint64_t start = begin_io_call();
+            ssize_t written = splice(linux_socket->pipe_fds[0], NULL, fileno(fp), NULL, in_pipe, SPLICE_F_MOVE);
+            end_io_call(&sal_imp_io_time.file_ns, start);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
                 set_error_description("%s", strerror(errno));
-            } else {
-                set_error_description("No data");
+                /* The pipe still holds data that doesn't belong to any further transfer */
+                close(linux_socket->pipe_fds[0]);
+                close(linux_socket->pipe_fds[1]);
+                linux_socket->pipe_fds[0] = -1;
+                linux_socket->pipe_fds[1] = -1;
+                return SAL_ERROR;
+            }
+            in_pipe -= written;
+        }
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_get_file_identity(FILE* fp, long* identity) {
+    struct stat file_stat;
+    if (fstat(fileno(fp), &file_stat) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    *identity = file_stat.st_mtim.tv_sec * 1000000000L + file_stat.st_mtim.tv_nsec;
+    return SAL_OK;
+}
+
+sal_ret sal_imp_get_file_size(FILE* fp, long* size) {
+    struct stat file_stat;
+    if (fstat(fileno(fp), &file_stat) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    *size = file_stat.st_size;
+    return SAL_OK;
+}
+
+sal_ret sal_imp_sync_file(FILE* fp) {
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+void sal_imp_sleep(const long milliseconds) {
+    struct timespec remaining = {milliseconds / 1000, (milliseconds % 1000) * 1000000L};
+    while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR) {
+    }
+}
+
+sal_ret sal_imp_open_shared_file(const char* path, FILE** fp) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    if ((*fp = fdopen(fd, "r+b")) == NULL) {
+        set_error_description("%s", strerror(errno));
+        close(fd);
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_create_unique_file(char* path, FILE** fp) {
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd == -1) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    /* mkostemp() creates files only their owner may read, unlike fopen() */
+    if (fchmod(fd, 0644) != 0 || (*fp = fdopen(fd, "w+b")) == NULL) {
+        set_error_description("%s", strerror(errno));
+        close(fd);
+        unlink(path);
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_lock_file(FILE* fp) {
+    if (flock(fileno(fp), LOCK_EX | LOCK_NB) != 0) {
+        if (errno == EWOULDBLOCK) {
+            return SAL_WOULD_BLOCK;
+        }
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_allocate_file(FILE* fp, const long length) {
+    /* Truncation drops stale content past the end, allocation is merely advisory */
+    if (ftruncate(fileno(fp), length) != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    if (length > 0) {
+        int ret = posix_fallocate(fileno(fp), 0, length);
+        if (ret != 0 && ret != EOPNOTSUPP && ret != EINVAL) {
+            set_error_description("%s", strerror(ret));
+            return SAL_ERROR;
+        }
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_get_space_for_file(const char* path, long* bytes) {
+    /* dirname() can change path, as basename() does */
+    char* dir_path = strdup(path);
+    if (dir_path == NULL) {
+        set_error_description("Out of memory");
+        return SAL_ERROR;
+    }
+    struct statvfs fs;
+    const int ret = statvfs(dirname(dir_path), &fs);
+    free(dir_path);
+    dir_path = NULL;
+    if (ret != 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    *bytes = (long)(fs.f_bavail * fs.f_frsize);
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+        *bytes += (long)st.st_blocks * 512;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_reserve_file(FILE* fp, const long length) {
+    const int fd = fileno(fp);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+    if (length > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, length) != 0) {
+        if (errno == ENOSPC || errno == EDQUOT) {
+            set_error_description("%s", strerror(errno));
+            return SAL_NO_SPACE;
+        }
+        if (errno != EOPNOTSUPP && errno != ENOSYS && errno != EINVAL) {
+            set_error_description("%s", strerror(errno));
+            return SAL_ERROR;
+        }
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_get_random(uint8_t* buffer, const size_t length) {
+    size_t filled = 0;
+    while (filled < length) {
+        ssize_t ret = getrandom(buffer + filled, length - filled, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            set_error_description("%s", strerror(errno));
             return SAL_ERROR;
         }
-        offset += bytes_received;
+        filled += ret;
     }
     return SAL_OK;
 }
+
+sal_ret sal_imp_load_symbol(const char* library, const char* name, void** symbol) {
+    void* handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        set_error_description("%s", dlerror());
+        return SAL_ERROR;
+    }
+    if ((*symbol = dlsym(handle, name)) == NULL) {
+        set_error_description("%s", dlerror());
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ret sal_imp_create_dir(const char* dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        set_error_description("%s: %s", dir, strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+size_t sal_imp_take_buffered_msg(sal_socket_t socket, uint8_t* buffer, const size_t length) {
+    return take_buffered(socket, buffer, length);
+}
@@ -0,0 +1,367 @@
+#ifndef SAL_NO_URING
+#define _GNU_SOURCE //O_CLOEXEC
+#include <unistd.h> //syscall
+#include <sys/syscall.h>
+#include <sys/mman.h> //mmap
+#include <sys/socket.h> //MSG_WAITALL
+#include <sys/uio.h> //iovec
+#include <linux/io_uring.h>
+#include <fcntl.h> //AT_FDCWD
+#include <string.h> //strerror
+#include <errno.h>
+#include <stdlib.h>
+#endif
+
+#include "sal_imp.h"
+#include "common.h"
+
+#ifndef SAL_NO_URING
+
+/**
+ * @brief The ring representation: the submission and completion queues the
+ * kernel shares with the process, and what was registered on them.
+ **/
+typedef struct {
+    int fd; ///< the ring descriptor
+    unsigned* sq_head; ///< the first submission the kernel did not consume yet
+    unsigned* sq_tail; ///< the position past the last submission
+    unsigned sq_mask; ///< the mask of submission queue positions
+    unsigned* sq_array; ///< the submission queue, as indexes of sqes
+    struct io_uring_sqe* sqes; ///< the submission entries
+    unsigned* cq_head; ///< the first completion not reaped yet
+    unsigned* cq_tail; ///< the position past the last completion
+    unsigned cq_mask; ///< the mask of completion queue positions
+    struct io_uring_cqe* cqes; ///< the completion entries
+    unsigned entries; ///< the submission queue length
+    unsigned queued; ///< the amount of submissions not yet handed to the kernel
+    void* sq_ring; ///< the mapped submission queue
+    size_t sq_ring_len; ///< the mapped submission queue length
+    void* cq_ring; ///< the mapped completion queue, the submission one if mapped at once
+    size_t cq_ring_len; ///< the mapped completion queue length
+    int slots; ///< the amount of registered slots
+    uint8_t* buffer; ///< the registered buffer, NULL if none
+    size_t buffer_len; ///< the registered buffer length
+} uring;
+
+/**
+ * @brief Wraps the io_uring_setup() system call, which the C library does not.
+ **/
+static int uring_setup(unsigned entries, struct io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+/**
+ * @brief Wraps the io_uring_enter() system call, which the C library does not.
+ **/
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    ++sal_imp_syscall_count;
+    const uint64_t start = sal_imp_io_timing ? sal_imp_get_time_ns(SAL_CLOCK_MONOTONIC) : 0;
+    int ret = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    /* Rings receive file content, so waiting for their completions is accounted as receiving */
+    if (start != 0) {
+        sal_imp_io_time.receive_ns += sal_imp_get_time_ns(SAL_CLOCK_MONOTONIC) - start;
+    }
+    return ret;
+}
+
+/**
+ * @brief Wraps the io_uring_register() system call, which the C library does not.
+ **/
+static int uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Releases the mappings and descriptor of a ring, whatever was set up.
+ *
+ * @param ring The ring
+ *
+ * @return No return
+ **/
+static void release_ring(uring* ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+    }
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_len);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_len);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    free(ring);
+}
+
+/**
+ * @brief Hands the queued submissions to the kernel, and waits for completions.
+ *
+ * @param ring The ring
+ * @param min_complete The amount of completions to wait for
+ *
+ * @return SAL_OK if submissions were handed successfully
+ * @return SAL_ERROR otherwise
+ **/
+static sal_ret enter_ring(uring* ring, const unsigned min_complete) {
+    while (ring->queued > 0 || min_complete > 0) {
+        int submitted = uring_enter(ring->fd, ring->queued, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error_description("%s", strerror(errno));
+            return SAL_ERROR;
+        }
+        ring->queued -= MIN((unsigned)submitted, ring->queued);
+        /* The kernel only waits once all submissions were consumed */
+        if (ring->queued == 0) {
+            break;
+        }
+    }
+    return SAL_OK;
+}
+
+/**
+ * @brief Updates a slot of the registered files.
+ *
+ * @param ring The ring
+ * @param slot The slot
+ * @param fd The descriptor, or -1 to empty the slot
+ *
+ * @return SAL_OK if slot was updated successfully
+ * @return SAL_ERROR otherwise
+ **/
+static sal_ret update_slot(uring* ring, const int slot, int fd) {
+    if (slot < 0 || slot >= ring->slots) {
+        set_error_description("Invalid slot %d", slot);
+        return SAL_ERROR;
+    }
+    struct io_uring_files_update update = {
+        .offset = slot,
+        .fds = (uint64_t)(uintptr_t)&fd
+    };
+    if (uring_register(ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) < 0) {
+        set_error_description("%s", strerror(errno));
+        return SAL_ERROR;
+    }
+    return SAL_OK;
+}
+
+sal_ring_t sal_imp_create_ring(const unsigned entries, const int slots) {
+    uring* ring = calloc(1, sizeof(*ring));
+    if (ring == NULL) {
+        set_error_description("Out of memory");
+        return NULL;
+    }
+    struct io_uring_params params = {0};
+    if ((ring->fd = uring_setup(entries, &params)) < 0) {
+        set_error_description("io_uring: %s", strerror(errno));
+        free(ring);
+        return NULL;
+    }
+    ring->entries = params.sq_entries;
+    ring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    /* Recent kernels map both queues at once */
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_ring_len = MAX(ring->sq_ring_len, ring->cq_ring_len);
+    }
+    ring->sq_ring = mmap(
+        NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = params.features & IORING_FEAT_SINGLE_MMAP ? ring->sq_ring : mmap(
+        NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(
+        NULL, ring->entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        set_error_description("%s", strerror(errno));
+        release_ring(ring);
+        return NULL;
+    }
+    uint8_t* sq = ring->sq_ring;
+    uint8_t* cq = ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    /* All slots start empty, and are set as sockets and files come and go */
+    if (slots > 0) {
+        int* fds = malloc(slots * sizeof(int));
+        if (fds == NULL) {
+            set_error_description("Out of memory");
+            release_ring(ring);
+            return NULL;
+        }
+        for (int i = 0; i < slots; ++i) {
+            fds[i] = -1;
+        }
+        const int registered = uring_register(ring->fd, IORING_REGISTER_FILES, fds, slots);
+        free(fds);
+        if (registered < 0) {
+            set_error_description("%s", strerror(errno));
+            release_ring(ring);
+            return NULL;
+        }
+        ring->slots = slots;
+    }
+    return ring;
+}
+
+void sal_imp_destroy_ring(sal_ring_t ring) {
+    if (ring) {
+        release_ring(ring);
+    }
+}
+
+sal_ret sal_imp_ring_register_buffer(sal_ring_t ring, uint8_t* buffer, const size_t length) {
+    uring* uring = ring;
+    struct iovec iov = {.iov_base = buffer, .iov_len = length};
+    if (uring->buffer != NULL || uring_register(uring->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+        set_error_description("%s", uring->buffer ? "Buffer already registered" : strerror(errno));
+        return SAL_ERROR;
+    }
+    uring->buffer = buffer;
+    uring->buffer_len = length;
+    return SAL_OK;
+}
+
+sal_ret sal_imp_ring_set_socket(sal_ring_t ring, const int slot, sal_socket_t socket) {
+    return update_slot(ring, slot, socket ? *(int*)socket : -1);
+}
+
+sal_ret sal_imp_ring_set_file(sal_ring_t ring, const int slot, FILE* fp) {
+    return update_slot(ring, slot, fp ? fileno(fp) : -1);
+}
+
+sal_ret sal_imp_ring_prepare(sal_ring_t ring, const sal_ring_op_t* op) {
+    uring* uring = ring;
+    if (op->slot < 0 || op->slot >= uring->slots) {
+        set_error_description("Invalid slot %d", op->slot);
+        return SAL_ERROR;
+    }
+    if (*uring->sq_tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >= uring->entries &&
+        enter_ring(uring, 0) != SAL_OK) {
+        return SAL_ERROR;
+    }
+    const unsigned tail = *uring->sq_tail;
+    const unsigned index = tail & uring->sq_mask;
+    struct io_uring_sqe* sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = op->slot;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)op->buffer;
+    sqe->len = op->length;
+    sqe->user_data = (uint64_t)(uintptr_t)op->user_data;
+    const bool registered = uring->buffer && op->buffer >= uring->buffer &&
+        op->buffer + op->length <= uring->buffer + uring->buffer_len;
+    switch (op->opcode) {
+    case SAL_RING_RECV:
+        sqe->opcode = IORING_OP_RECV;
+        sqe->msg_flags = MSG_WAITALL;
+        break;
+    case SAL_RING_SEND:
+        sqe->opcode = IORING_OP_SEND;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        break;
+    case SAL_RING_READ:
+        sqe->opcode = registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->off = op->offset;
+        break;
+    case SAL_RING_WRITE:
+        sqe->opcode = registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->off = op->offset;
+        break;
+    case SAL_RING_FSYNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->addr = 0;
+        sqe->len = 0;
+        break;
+    case SAL_RING_OPENAT:
+        /* The opened file goes straight into the slot, without a descriptor of the process */
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->flags = 0;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)op->path;
+        sqe->len = 0644;
+        sqe->open_flags = O_RDWR | O_CREAT | O_CLOEXEC;
+        sqe->file_index = op->slot + 1;
+        break;
+    default:
+        set_error_description("Unknown operation %d", op->opcode);
+        return SAL_ERROR;
+    }
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++uring->queued;
+    return SAL_OK;
+}
+
+int sal_imp_ring_submit(
+    sal_ring_t ring,
+    sal_ring_completion_t* completions,
+    const int max_completions,
+    const int min_completions) {
+    uring* uring = ring;
+    if (enter_ring(uring, MIN(min_completions, max_completions)) != SAL_OK) {
+        return -1;
+    }
+    int reaped = 0;
+    unsigned head = *uring->cq_head;
+    const unsigned tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && reaped < max_completions) {
+        const struct io_uring_cqe* cqe = &uring->cqes[head & uring->cq_mask];
+        completions[reaped].user_data = (void*)(uintptr_t)cqe->user_data;
+        completions[reaped].result = cqe->res;
+        ++reaped;
+        ++head;
+    }
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+#else /* SAL_NO_URING */
+
+sal_ring_t sal_imp_create_ring(const unsigned entries, const int slots) {
+    set_error_description("Built without io_uring");
+    return NULL;
+}
+
+void sal_imp_destroy_ring(sal_ring_t ring) {
+}
+
+sal_ret sal_imp_ring_register_buffer(sal_ring_t ring, uint8_t* buffer, const size_t length) {
+    set_error_description("Built without io_uring");
+    return SAL_ERROR;
+}
+
+sal_ret sal_imp_ring_set_socket(sal_ring_t ring, const int slot, sal_socket_t socket) {
+    set_error_description("Built without io_uring");
+    return SAL_ERROR;
+}
+
+sal_ret sal_imp_ring_set_file(sal_ring_t ring, const int slot, FILE* fp) {
+    set_error_description("Built without io_uring");
+    return SAL_ERROR;
+}
+
+sal_ret sal_imp_ring_prepare(sal_ring_t ring, const sal_ring_op_t* op) {
+    set_error_description("Built without io_uring");
+    return SAL_ERROR;
+}
+
+int sal_imp_ring_submit(
+    sal_ring_t ring,
+    sal_ring_completion_t* completions,
+    const int max_completions,
+    const int min_completions) {
+    set_error_description("Built without io_uring");
+    return -1;
+}
+
+#endif /* SAL_NO_URING */
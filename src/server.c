@@ -1,38 +1,213 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h> //atoi
-#include <openssl/sha.h>
+#include <limits.h> //INT_MAX
+#include <pthread.h>
 
 #include "sal.h"
 #include "tlv.h"
+#include "protocol.h"
+#include "digest.h"
+#include "checksum.h"
+#include "journal.h"
+#include "transfer.h"
+#include "delta.h"
+#include "chunk_store.h"
+#include "trace.h"
+#include "metrics.h"
+#include "probes.h"
 #include "common.h"
 
 /* ========================================================================== *
  * Data definitions                                                           *
  * ========================================================================== */
 #define CONNECTION_QUEUE_SIZE 1
+#define EVENT_LOOP_CONNECTION_QUEUE_SIZE 1024
+#define EVENT_LOOP_MAX_EVENTS 256
+#define CONNECTION_IDLE_TIMEOUT_MS 60000 ///< the default longest silence of a client before its connection is dropped
+#define ACCEPT_BACKOFF_MS 100 ///< the pause in accepting connections once file descriptors ran out
+#define DIGEST_MAP_WINDOW_LEN (SAL_MAP_ALIGNMENT * 128) ///< the file region mapped at once for hashing
+#define CONNECTION_TX_BUFFER_LEN 256 ///< the room for pending replies, grown for block signatures
+#define STAGING_DIR ".staging" ///< the directory of the storage directory files are received into, until validated
+#define STAGING_FILE_TEMPLATE "file-XXXXXX" ///< the name of a file being received, made unique
+#define STAGING_PATH_LEN (MAX_PATH_LEN + sizeof(STAGING_DIR) + JOURNAL_PARTIAL_NAME_LEN)
+#define DELTA_SIGNATURES_PER_TLV (TLV_MAX_VALUE_LENGTH / DELTA_SIGNATURE_LENGTH) ///< the block signatures sent per TLV
+#define DELTA_SIGNATURE_BATCH_LEN DIGEST_MAP_WINDOW_LEN ///< the existing copy hashed at once for block signatures
+#define RING_SLICE_LEN (256 << 10) ///< the file content received by a single ring operation
+#define RING_SLICE_COUNT 8 ///< the slices of the ring buffer, i.e. the operations in flight per connection
+#define RING_SOCKET_SLOT 0 ///< the ring slot of the connection socket
+#define RING_FILE_SLOT 1 ///< the ring slot of the destination file
 
 typedef struct {
     struct sockaddr_in addr;
     sal_socket_t listen_sock;
     char* storage_dir;
+    bool event_loop; ///< serve all connections concurrently from a single event loop
+    int workers; ///< the amount of worker threads, each one with its own listening socket (0 if disabled)
+    bool pin_cpus; ///< pin each worker thread to its own CPU
+    bool splice; ///< move file content from socket to file with splice(), without copying it
+    bool digest_thread; ///< hash file content on a separate thread, overlapped with I/O
+    bool chunk_store; ///< store files as manifests of chunks, each unique chunk being stored once
+    bool io_uring; ///< receive and write file content through an io_uring ring
+    int metrics_port; ///< the loopback port the metrics are served on, 0 if not served
+    int idle_timeout_ms; ///< the longest a client may stay silent before its connection is dropped, 0 if never
+    transfer_registry_t* transfers; ///< the multi-stream transfers in progress, shared by all workers
 } server_data;
 
 typedef struct {
+    server_data server_data; ///< the worker copy of server data, owning its listening socket
+    int cpu; ///< the CPU the worker is pinned to, or -1 if not pinned
+    pthread_t thread; ///< the worker thread
+} worker_data;
+
+typedef enum {
+    CONNECTION_STATE_HEADER, ///< waiting for the header TLV
+    CONNECTION_STATE_CONTENT, ///< receiving file content until the digest arrives
+    CONNECTION_STATE_REPLY, ///< file was processed, the ACK/NACK reply is pending
+    CONNECTION_STATE_DONE ///< reply was sent, the connection can be released
+} connection_state;
+
+typedef enum {
+    CONTENT_PENDING, ///< more file content is expected
+    CONTENT_VALID, ///< file was written and matches the received digest
+    CONTENT_INVALID, ///< file could not be written or validated
+    CONTENT_INTERRUPTED ///< the connection failed before the whole file was received
+} content_status;
+
+typedef struct Sconnection_data {
     char file_path[MAX_PATH_LEN + 1];
     long file_size;
     sal_socket_t socket;
+    connection_state state;
+    FILE* fp; ///< the file being written
+    char content_path[STAGING_PATH_LEN]; ///< the file the content is received into, replacing file_path once validated
+    bool journaled; ///< a journal names the content file, which is kept for resuming unless validated
+    checksum_algorithm checksum; ///< the file checksum algorithm announced on the header
+    compression_algorithm compression; ///< the file content compression announced on the header
+    bool resume; ///< the client asked to resume an interrupted transfer of the same file
+    bool delta; ///< the client asked to send the file as a delta against the existing copy
+    FILE* basis_fp; ///< the existing copy blocks are copied from, if the file is being rebuilt from a delta
+    long block_length; ///< the length of the blocks the existing copy was split into
+    long block_count; ///< the amount of blocks of the existing copy
+    long signed_blocks; ///< the blocks of the existing copy whose signatures were queued
+    bool dedup; ///< the client announces the file chunks, and only sends the ones the chunk store is missing
+    chunk_writer_t* chunk_writer; ///< the file chunks being stored, if files are stored as chunks
+    long file_identity; ///< the identity of the client file contents, if resuming was asked
+    long transfer_id; ///< the identifier shared by all streams of a multi-stream transfer
+    long stream_count; ///< the amount of streams the file is split into, 1 if not split
+    long range_offset; ///< the file offset of the range received through this connection
+    long range_length; ///< the length of the range received through this connection
+    long files; ///< the amount of files received through this connection, many on a session
+    checksum_ctx_t checksum_ctx; ///< the checksum of received file content
+    digest_pipeline_t* digest_pipeline; ///< the checksum computed on a separate thread, if used instead of checksum_ctx
+    protocol_hello protocol; ///< the protocol parameters agreed with the client
+    uint64_t content_remaining; ///< the amount of streamed file content TLV value still expected (event loop only)
+    long received_bytes; ///< the amount of received file content
+    long digested_bytes; ///< the amount of received file content already hashed
+    tlv_type reply; ///< the reply to the sender (TLV_TYPE_ACK or TLV_TYPE_NACK), if already decided
+    long admission; ///< the admission of the file announced on the header (PROTOCOL_ADMISSION_*)
+    tlv_arena_t* arena; ///< the arena holding the TLVs exchanged through the connection
+    uint8_t* rx_buffer; ///< the partially received TLVs (event loop only)
+    size_t rx_start; ///< the offset of the first unprocessed byte in rx_buffer
+    size_t rx_end; ///< the offset past the last received byte in rx_buffer
+    uint8_t* tx_buffer; ///< the pending replies
+    size_t tx_capacity; ///< the tx_buffer length
+    size_t tx_offset; ///< the amount of already sent reply bytes
+    size_t tx_length; ///< the pending replies length
+    uint32_t poll_events; ///< the events the connection socket is watched for
+    uint64_t active_ns; ///< when the connection was last ready (event loop only)
+    struct Sconnection_data* older; ///< the connection ready before this one, NULL if the least recently ready
+    struct Sconnection_data* newer; ///< the connection ready after this one, NULL if the most recently ready
+    trace_file_t trace; ///< the trace of the file being received, if tracing is enabled
+    uint64_t header_time_ns; ///< when the file header was received, if metrics are enabled
 } connection_data;
 
+typedef struct {
+    sal_poller_t poller; ///< the poller watching the listening socket and the connections
+    connection_data* oldest; ///< the least recently ready connection, dropped first once idle
+    connection_data* newest; ///< the most recently ready connection
+    uint64_t accept_resume_ns; ///< when the listening socket is watched again, 0 if it is watched
+} event_loop;
+
 /* ========================================================================== *
  * Forward declarations to avoid concerning about function definition order   *
  * ========================================================================== */
 void print_usage(const char* app_name);
+void init_connection(connection_data* connection_data, sal_socket_t socket);
+long get_max_streams(const server_data* server_data);
+bool process_hello(const server_data* server_data, connection_data* connection_data, tlv_t* tlv_hello);
+bool parse_header(const server_data* server_data, connection_data* connection_data, tlv_t* tlv_header);
+bool parse_header_option(connection_data* connection_data, tlv_t* sub_tlv);
+bool is_valid_file_name(const char* name, const size_t length);
 bool receive_header(const server_data* server_data, connection_data* connection_data);
-bool receive_file_content(connection_data* connection_data);
+bool has_admission(const connection_data* connection_data);
+bool admit_file(const server_data* server_data, connection_data* connection_data);
+tlv_t new_admission_tlv(const connection_data* connection_data);
+bool open_file_content(const server_data* server_data, connection_data* connection_data);
+bool create_file_dirs(const server_data* server_data, const char* file_path);
+bool reserve_file_content(connection_data* connection_data);
+bool get_staging_path(const server_data* server_data, const char* name, char* path);
+bool create_staging_file(const server_data* server_data, connection_data* connection_data);
+bool resume_file_content(const server_data* server_data, connection_data* connection_data, journal_t* journal);
+void discard_journal(const server_data* server_data, const char* file_path);
+bool open_file_range(const server_data* server_data, connection_data* connection_data);
+bool open_delta_basis(const server_data* server_data, connection_data* connection_data);
+void queue_delta_basis(connection_data* connection_data);
+bool queue_delta_signatures(connection_data* connection_data);
+bool replace_file(connection_data* connection_data);
+content_status finish_file_content(connection_data* connection_data, const content_status status);
+content_status finish_file_range(
+    const server_data* server_data,
+    connection_data* connection_data,
+    const content_status status);
+void save_journal(connection_data* connection_data);
+tlv_t new_resume_offset_tlv(const connection_data* connection_data);
+content_status process_file_content(connection_data* connection_data, tlv_t* tlv);
+content_status process_compressed_content(connection_data* connection_data, tlv_t* tlv);
+content_status process_block_reference(connection_data* connection_data, tlv_t* tlv);
+content_status process_chunk_list(connection_data* connection_data, tlv_t* tlv);
+uint8_t* acquire_content_buffer(connection_data* connection_data, size_t* capacity);
+bool store_content(connection_data* connection_data, const uint8_t* content, const size_t length);
+bool digest_stored_content(connection_data* connection_data, bool flush);
+content_status splice_file_content(connection_data* connection_data, const uint64_t length);
+content_status receive_streamed_content(connection_data* connection_data, const uint64_t length);
+content_status receive_pipelined_content(connection_data* connection_data, const uint64_t length);
+sal_ring_t acquire_ring(uint8_t** slices);
+content_status receive_ring_content(connection_data* connection_data, const uint64_t length);
+bool is_valid_frame(const connection_data* connection_data, const tlv_t* tlv);
+bool fits_file_range(const connection_data* connection_data, const uint64_t length);
+void close_file_content(connection_data* connection_data);
+void release_digest_pipeline(connection_data* connection_data);
+bool receive_file_content(const server_data* server_data, connection_data* connection_data);
 bool receive_file(const server_data* server_data);
-void send_ack(sal_socket_t socket);
-void send_nack(sal_socket_t socket);
+bool has_next_file(connection_data* connection_data);
+void print_file_outcome(const server_data* server_data, connection_data* connection_data, bool done);
+void serve(const server_data* server_data);
+bool run_workers(const server_data* server_data);
+void* run_worker(void* arg);
+void run_event_loop(const server_data* server_data);
+sal_ret accept_connections(const server_data* server_data, event_loop* loop);
+void pause_accepting(const server_data* server_data, event_loop* loop);
+int get_event_loop_timeout(const server_data* server_data, const event_loop* loop);
+void touch_connection(event_loop* loop, connection_data* connection_data);
+void drop_idle_connections(const server_data* server_data, event_loop* loop);
+bool receive_connection_data(const server_data* server_data, connection_data* connection_data);
+void process_connection_data(const server_data* server_data, connection_data* connection_data);
+void queue_tlv(connection_data* connection_data, const tlv_t* tlv);
+void queue_data(connection_data* connection_data, const uint8_t* data, const size_t length);
+bool flush_replies(connection_data* connection_data);
+void queue_reply(connection_data* connection_data, const tlv_type type);
+void queue_rejection(connection_data* connection_data);
+void finish_session_file(const server_data* server_data, connection_data* connection_data);
+bool send_connection_data(connection_data* connection_data);
+void serve_connection(
+    const server_data* server_data,
+    event_loop* loop,
+    connection_data* connection_data,
+    const uint32_t events);
+void release_connection(const server_data* server_data, event_loop* loop, connection_data* connection_data);
+void send_ack(connection_data* connection_data);
+void send_nack(connection_data* connection_data);
 bool parse_input(const int argc, const char** argv, server_data* data);
 void release_server_data(server_data* data);
 bool start_listening(server_data* data);
@@ -50,16 +225,19 @@ int main(const int argc, const char** argv) {
         return EXIT_CODE_ON_ERROR;
     }
 
+    if (data.workers > 0) {
+        bool ret = run_workers(&data);
+        release_server_data(&data);
+        return ret ? EXIT_CODE_ON_SUCCESS : EXIT_CODE_ON_ERROR;
+    }
+
     if (!start_listening(&data)) {
         release_server_data(&data);
         return EXIT_CODE_ON_ERROR;
     }
 
     /* Keep receiving requests */
-    bool keep_running = true;
-    while (keep_running) {
-        receive_file(&data);
-    }
+    serve(&data);
     release_server_data(&data);
 
     return EXIT_CODE_ON_SUCCESS;
@@ -78,302 +256,2585 @@ int main(const int argc, const char** argv) {
 void print_usage(const char* app_name) {
     fprintf(
         stderr,
-        "Usage: %s <storage directory> <listening IP address> <listening port>\n",
+        "Usage: %s <storage directory> <listening IP address> <listening port> [options]\n"
+        "Options:\n"
+        "    --event-loop         Receive many files concurrently from a single epoll event loop\n"
+        "    --workers <count>    Serve from <count> threads sharing the listening port (0 for one per CPU)\n"
+        "    --pin-cpus           Pin each worker thread to its own CPU\n"
+        "    --splice             Move file content from socket to file with splice() (not with --event-loop)\n"
+        "    --digest-thread      Hash file content on a separate thread, overlapped with I/O\n"
+        "                         (not with --event-loop nor --splice)\n"
+        "    --chunk-store        Store files as lists of content-defined chunks, each unique chunk being\n"
+        "                         stored once, so clients skip sending the chunks already stored\n"
+        "                         (not with --splice nor --digest-thread)\n"
+        "    --io-uring           Receive and write large file content through io_uring, keeping several\n"
+        "                         operations in flight per connection (not with --event-loop, --splice\n"
+        "                         nor --digest-thread)\n"
+        "    --trace <file>       Append the timing of each received file to <file> as a JSON line\n"
+        "                         (\"-\" for the standard error)\n"
+        "    --metrics-port <port>\n"
+        "                         Serve Prometheus metrics on http://127.0.0.1:<port>/metrics\n"
+        "    --idle-timeout <seconds>\n"
+        "                         Drop connections of clients silent for <seconds> (60 by default, 0 for never)\n"
+        "Compressed file content is accepted with LZ4 and Zstandard, if their libraries are installed,\n"
+        "and files are rebuilt from a delta against their existing copy (neither with --splice).\n",
         app_name
     );
 }
 
 /**
- * @brief Receives TLV with header information.
+ * @brief Initializes the connection-specific internal data.
+ *
+ * @param[out] connection_data The connection-specific internal data
+ * @param socket The connection socket
+ *
+ * @return No return
+ **/
+void init_connection(connection_data* connection_data, sal_socket_t socket) {
+    bzero(connection_data, sizeof(*connection_data));
+    connection_data->socket = socket;
+    connection_data->state = CONNECTION_STATE_HEADER;
+    connection_data->protocol.version = PROTOCOL_VERSION_1;
+    connection_data->protocol.max_frame_length = TLV_MAX_VALUE_LENGTH;
+    connection_data->protocol.max_streams = 1;
+    connection_data->stream_count = 1;
+    trace_begin(&connection_data->trace);
+    PROBE1(file_start, connection_data);
+}
+
+/**
+ * @brief Gets the amount of parallel streams a file may be split into. A
+ * single threaded blocking server serves connections one after the other,
+ * so splitting files would bring no parallelism.
+ *
+ * @param server_data The server internal data
+ *
+ * @return the maximum amount of streams per file
+ **/
+long get_max_streams(const server_data* server_data) {
+    if (server_data->event_loop) {
+        return PROTOCOL_MAX_STREAMS;
+    }
+    return MAX(1, MIN(server_data->workers, PROTOCOL_MAX_STREAMS));
+}
+
+/**
+ * @brief Negotiates the protocol parameters with a version 2 client.
  *
  * @param server_data The server internal data
  * @param connection_data The connection-specific internal data
+ * @param tlv_hello The received hello TLV
  *
- * @return true if header information was received successfully
+ * @return true if client hello is valid
  * @return false otherwise
  **/
-bool receive_header(const server_data* server_data, connection_data* connection_data) {
-    tlv_t tlv_header = {0};
-    if (!receive_tlv_data(connection_data->socket, &tlv_header)) {
+bool process_hello(const server_data* server_data, connection_data* connection_data, tlv_t* tlv_hello) {
+    /* Spliced content never reaches user space, where it would be decompressed or merged with copied blocks */
+    const long user_space_content = PROTOCOL_CAPABILITY_LZ4 | PROTOCOL_CAPABILITY_ZSTD | PROTOCOL_CAPABILITY_DELTA;
+    /* Chunk stores write whole chunks in file order, never in place into an existing file */
+    const long in_place_content = PROTOCOL_CAPABILITY_RESUME | PROTOCOL_CAPABILITY_MULTI_STREAM | PROTOCOL_CAPABILITY_DELTA;
+    long capabilities = get_local_capabilities() & ~(server_data->splice ? user_space_content : 0);
+    capabilities &= server_data->chunk_store ? ~in_place_content : ~PROTOCOL_CAPABILITY_DEDUP;
+    const protocol_hello local = {
+        .version = PROTOCOL_VERSION,
+        .capabilities = capabilities,
+        .max_frame_length = PROTOCOL_UNLIMITED_FRAME_LENGTH,
+        .max_streams = get_max_streams(server_data)
+    };
+    protocol_hello remote = {0};
+    if (connection_data->protocol.version != PROTOCOL_VERSION_1 || !parse_hello(tlv_hello, &remote)) {
         return false;
     }
-    if (get_tlv_type(&tlv_header) != TLV_TYPE_HEADER) {
+    negotiate_hello(&local, &remote, &connection_data->protocol);
+    connection_data->trace.connect_ns = trace_elapsed(&connection_data->trace);
+    return true;
+}
+
+/**
+ * @brief Parses the header TLV and fills the connection file information.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ * @param tlv_header The received header TLV
+ *
+ * @return true if header information is valid
+ * @return false otherwise
+ **/
+bool parse_header(const server_data* server_data, connection_data* connection_data, tlv_t* tlv_header) {
+    if (get_tlv_type(tlv_header) != TLV_TYPE_HEADER) {
         set_error_description("No header received");
         print_error("Protocol error");
-        goto RELEASE_TLVS;
+        return false;
     }
     uint16_t offset = 0;
     tlv_t sub_tlv_file_name = {0};
-    if (!parse_tlv(&tlv_header.buffer[offset], &sub_tlv_file_name)) {
-        goto RELEASE_TLVS;
+    if (!parse_tlv(&tlv_header->buffer[offset], &sub_tlv_file_name)) {
+        return false;
     }
     offset += get_tlv_length(&sub_tlv_file_name) + TLV_HEADER_LENGTH;
     if (get_tlv_type(&sub_tlv_file_name) != TLV_TYPE_FILE_NAME) {
         set_error_description("No file name received");
         print_error("Protocol error");
-        goto RELEASE_TLVS;
+        return false;
     }
     if (get_tlv_length(&sub_tlv_file_name) == 0 ||
         strlen(server_data->storage_dir) + 1 + get_tlv_length(&sub_tlv_file_name) > MAX_PATH_LEN) {
         reset_error_description();
         print_error("Invalid filename");
-        goto RELEASE_TLVS;
+        return false;
     }
 
     strcpy(connection_data->file_path, server_data->storage_dir);
     strcat(connection_data->file_path, "/"),
-    strncat(connection_data->file_path, get_tlv_value_raw(&sub_tlv_file_name), MAX_PATH_LEN);
+    strncat(
+        connection_data->file_path,
+        get_tlv_value_raw(&sub_tlv_file_name),
+        MIN(get_tlv_length(&sub_tlv_file_name), MAX_PATH_LEN - strlen(connection_data->file_path)));
+    if (!is_valid_file_name(
+            &connection_data->file_path[strlen(server_data->storage_dir) + 1], get_tlv_length(&sub_tlv_file_name))) {
+        set_error_description("%s", &connection_data->file_path[strlen(server_data->storage_dir) + 1]);
+        print_error("Invalid filename");
+        return false;
+    }
 
     tlv_t sub_tlv_file_size = {0};
-    parse_tlv(&tlv_header.buffer[offset], &sub_tlv_file_size);
+    parse_tlv(&tlv_header->buffer[offset], &sub_tlv_file_size);
     offset += get_tlv_length(&sub_tlv_file_size) + TLV_HEADER_LENGTH;
     if (get_tlv_type(&sub_tlv_file_size) != TLV_TYPE_FILE_SIZE) {
         set_error_description("No file size received");
         print_error("Protocol error");
-        goto RELEASE_TLVS;
+        return false;
     }
     connection_data->file_size = get_tlv_value_long(&sub_tlv_file_size);
-    tlv_release_tlvs();
-    return true;
 
-RELEASE_TLVS:
-    tlv_release_tlvs();
-    return false;
+    /* Optional sub-TLVs follow, unknown ones are skipped */
+    connection_data->checksum = CHECKSUM_DEFAULT;
+    connection_data->compression = COMPRESSION_NONE;
+    connection_data->resume = false;
+    connection_data->delta = false;
+    connection_data->dedup = false;
+    connection_data->admission = PROTOCOL_ADMISSION_ACCEPTED;
+    connection_data->stream_count = 1;
+    connection_data->range_offset = 0;
+    connection_data->range_length = connection_data->file_size;
+    connection_data->received_bytes = 0;
+    while (offset + TLV_HEADER_LENGTH <= get_tlv_length(tlv_header)) {
+        tlv_t sub_tlv = {0};
+        parse_tlv(&tlv_header->buffer[offset], &sub_tlv);
+        offset += get_tlv_length(&sub_tlv) + TLV_HEADER_LENGTH;
+        if (offset <= get_tlv_length(tlv_header) && !parse_header_option(connection_data, &sub_tlv)) {
+            print_error("Protocol error");
+            return false;
+        }
+    }
+    if (connection_data->stream_count < 1 || connection_data->stream_count > PROTOCOL_MAX_STREAMS ||
+        connection_data->range_offset < 0 || connection_data->range_length < 0 ||
+        connection_data->range_offset > connection_data->file_size - connection_data->range_length) {
+        set_error_description("Invalid file range");
+        print_error("Protocol error");
+        return false;
+    }
+    /* Only whole files are resumed or sent as a delta, which rebuilds a new file instead of resuming one */
+    connection_data->delta = connection_data->delta && connection_data->stream_count == 1;
+    connection_data->resume = connection_data->resume && connection_data->stream_count == 1 && !connection_data->delta;
+    connection_data->dedup = connection_data->dedup && connection_data->file_size > 0;
+    connection_data->trace.header_ns = trace_elapsed(&connection_data->trace);
+    connection_data->header_time_ns = metrics_clock();
+    PROBE3(header_parsed, connection_data, connection_data->file_path, connection_data->file_size);
+    return true;
 }
 
 /**
- * @brief Receives file content and digest.
- * The received data is written to file and validated against a provided
- * checksum to ensure there was no transmission error.
+ * @brief Parses an optional sub-TLV of the header TLV. Sub-TLVs of
+ * capabilities that were not agreed are skipped, like unknown ones.
  *
  * @param connection_data The connection-specific internal data
+ * @param sub_tlv The header sub-TLV
  *
- * @return true if file content was received, written and validated successfully
+ * @return true if sub-TLV is valid or skipped
  * @return false otherwise
  **/
-bool receive_file_content(connection_data* connection_data) {
-    FILE* fp = fopen(connection_data->file_path, "w+b");
-    if (fp == NULL) {
-        print_error("Opening file failed");
+bool parse_header_option(connection_data* connection_data, tlv_t* sub_tlv) {
+    const long capabilities = connection_data->protocol.capabilities;
+    long* option = NULL;
+    switch (get_tlv_type(sub_tlv)) {
+    case TLV_TYPE_CHECKSUM_ALGORITHM:
+        if (get_tlv_length(sub_tlv) != sizeof(long) || !is_checksum_supported(get_tlv_value_long(sub_tlv))) {
+            set_error_description("Unsupported checksum algorithm");
+            return false;
+        }
+        connection_data->checksum = get_tlv_value_long(sub_tlv);
+        return true;
+    case TLV_TYPE_COMPRESSION:
+        if (get_tlv_length(sub_tlv) != sizeof(long) || !is_compression_supported(get_tlv_value_long(sub_tlv)) ||
+            (~capabilities & get_compression_capability(get_tlv_value_long(sub_tlv)))) {
+            set_error_description("Unsupported compression algorithm");
+            return false;
+        }
+        connection_data->compression = get_tlv_value_long(sub_tlv);
+        return true;
+    case TLV_TYPE_DELTA:
+        connection_data->delta = capabilities & PROTOCOL_CAPABILITY_DELTA;
+        return true;
+    case TLV_TYPE_DEDUP:
+        connection_data->dedup = capabilities & PROTOCOL_CAPABILITY_DEDUP;
+        return true;
+    case TLV_TYPE_FILE_IDENTITY:
+        connection_data->resume = capabilities & PROTOCOL_CAPABILITY_RESUME;
+        option = connection_data->resume ? &connection_data->file_identity : NULL;
+        break;
+    case TLV_TYPE_TRANSFER_ID:
+        option = capabilities & PROTOCOL_CAPABILITY_MULTI_STREAM ? &connection_data->transfer_id : NULL;
+        break;
+    case TLV_TYPE_STREAM_COUNT:
+        option = capabilities & PROTOCOL_CAPABILITY_MULTI_STREAM ? &connection_data->stream_count : NULL;
+        break;
+    case TLV_TYPE_RANGE_OFFSET:
+        option = capabilities & PROTOCOL_CAPABILITY_MULTI_STREAM ? &connection_data->range_offset : NULL;
+        break;
+    case TLV_TYPE_RANGE_LENGTH:
+        option = capabilities & PROTOCOL_CAPABILITY_MULTI_STREAM ? &connection_data->range_length : NULL;
+        break;
+    default:
+        break;
+    }
+    if (option == NULL) {
+        return true;
+    }
+    if (get_tlv_length(sub_tlv) != sizeof(long)) {
+        set_error_description("Invalid header option %d", get_tlv_type(sub_tlv));
         return false;
     }
+    *option = get_tlv_value_long(sub_tlv);
+    return true;
+}
 
-    SHA512_CTX sha512_ctx;
-    SHA512_Init(&sha512_ctx);
-    static uint8_t sha512_buffer[SHA512_DIGEST_LENGTH] = {0};
-    long received_bytes = 0;
-    bool eof = false;
-    while (!eof) {
-        tlv_t tlv = {0};
-        if (!receive_tlv_data(connection_data->socket, &tlv)) {
-            goto CLOSE_FILE;
-        }
-        uint16_t length = get_tlv_length(&tlv);
-        switch (get_tlv_type(&tlv)) {
-        case TLV_TYPE_FILE_CONTENT:
-            if (fwrite(get_tlv_value_raw(&tlv), 1, length, fp) != length) {
-                goto RELEASE_TLVS;
-            }
-            SHA512_Update(&sha512_ctx, get_tlv_value_raw(&tlv), length);
-            received_bytes += length;
-            break;
-        case TLV_TYPE_CHECKSUM_SHA512:
-            eof = true;
-            fclose(fp);
-            fp = NULL;
-            SHA512_Final(sha512_buffer, &sha512_ctx);
-            if (memcmp(sha512_buffer, get_tlv_value_raw(&tlv), SHA512_DIGEST_LENGTH) != 0) {
-                reset_error_description();
-                print_error("File validation failed");
-                goto CHECKSUM_ERROR;
+/**
+ * @brief Checks that a received file name names a file of the storage
+ * directory or of its subdirectories, other than the directories the server
+ * keeps its own state in. Names are relative paths, so none of their
+ * components may be empty, as in absolute paths, nor "." or "..".
+ *
+ * @param name The file name
+ * @param length The received file name length
+ *
+ * @return true if file name is valid
+ * @return false otherwise
+ **/
+bool is_valid_file_name(const char* name, const size_t length) {
+    const char* reserved[] = {"", ".", "..", STAGING_DIR, JOURNAL_DIR, CHUNK_STORE_DIR};
+    if (strlen(name) != length) {
+        return false;
+    }
+    for (const char* component = name; component != NULL;) {
+        const char* separator = strchr(component, '/');
+        const size_t component_length = separator ? (size_t)(separator - component) : strlen(component);
+        for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); ++i) {
+            if (component_length == strlen(reserved[i]) && strncmp(component, reserved[i], component_length) == 0) {
+                return false;
             }
-            break;
-        default:
-            set_error_description("Unknown TLV %d", get_tlv_type(&tlv));
-            print_error("Protocol error");
-            goto RELEASE_TLVS;
         }
-        tlv_release_tlvs();
+        component = separator ? separator + 1 : NULL;
     }
-    send_ack(connection_data->socket);
     return true;
-
-RELEASE_TLVS:
-    tlv_release_tlvs();
-CLOSE_FILE:
-    fclose(fp);
-    fp = NULL;
-CHECKSUM_ERROR:
-    tlv_release_tlvs();
-    send_nack(connection_data->socket);
-    return false;
 }
 
 /**
- * @brief Accepts an incoming connection and receives a file through it.
+ * @brief Receives TLV with header information.
  *
  * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
  *
- * @return true if file content was received, written and validated successfully
+ * @return true if header information was received successfully
  * @return false otherwise
  **/
-bool receive_file(const server_data* server_data) {
-    connection_data connection_data;
-    bzero(&connection_data, sizeof(connection_data));
-    if ((connection_data.socket = sal_accept(server_data->listen_sock)) == NULL) {
+bool receive_header(const server_data* server_data, connection_data* connection_data) {
+    tlv_t tlv_header = {0};
+    if (!receive_tlv_data(connection_data->socket, connection_data->arena, &tlv_header)) {
         return false;
     }
-
-    if (!receive_header(server_data, &connection_data)) {
-        goto RELEASE_CONNECTION;
-    }
-    print_msg(
-        "Receiving file \"%s\" containing %ld bytes...",
-        connection_data.file_path,
-        connection_data.file_size
-    );
-    fflush(stdout);
-    if (!receive_file_content(&connection_data)) {
-        goto PRINT_ERROR;
+    if (get_tlv_type(&tlv_header) == TLV_TYPE_HELLO) {
+        if (!process_hello(server_data, connection_data, &tlv_header)) {
+            goto RELEASE_TLVS;
+        }
+        reset_tlv_arena(connection_data->arena);
+        tlv_t tlv_hello = new_hello_tlv(connection_data->arena, &connection_data->protocol);
+        if (!send_tlv_data(connection_data->socket, &tlv_hello) ||
+            !receive_tlv_data(connection_data->socket, connection_data->arena, &tlv_header)) {
+            goto RELEASE_TLVS;
+        }
     }
+    bool ret = parse_header(server_data, connection_data, &tlv_header);
+    reset_tlv_arena(connection_data->arena);
+    return ret;
 
-    sal_close(connection_data.socket);
-    sal_destroy_socket(connection_data.socket);
-    connection_data.socket = NULL;
-    print_msg(" done\n");
-    return true;
+RELEASE_TLVS:
+    reset_tlv_arena(connection_data->arena);
+    return false;
+}
 
-PRINT_ERROR:
-    print_msg(" error\n");
-RELEASE_CONNECTION:
-    sal_close(connection_data.socket);
-    sal_destroy_socket(connection_data.socket);
-    connection_data.socket = NULL;
+/**
+ * @brief Checks whether the file announced on the header gets an admission
+ * reply. Files fitting a single TLV are sent at once, so they get none.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if the file is accepted or rejected before its content is sent
+ * @return false otherwise
+ **/
+bool has_admission(const connection_data* connection_data) {
+    return (connection_data->protocol.capabilities & PROTOCOL_CAPABILITY_ADMISSION) &&
+        connection_data->file_size >= PROTOCOL_ADMISSION_MIN_LEN;
+}
 
+/**
+ * @brief Checks that the announced file fits the storage before anything is
+ * written, so that a file which can't be stored doesn't get its content sent
+ * for nothing. The existing copy is kept until the received file replaces
+ * it, so its space doesn't count. Files fitting a single TLV are not
+ * checked, as they cost no more to receive than to reject.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if the file fits, or the free space is unknown
+ * @return false otherwise
+ **/
+bool admit_file(const server_data* server_data, connection_data* connection_data) {
+    if (connection_data->file_size < PROTOCOL_ADMISSION_MIN_LEN) {
+        return true;
+    }
+    char staging_path[STAGING_PATH_LEN];
+    long space = 0;
+    if (!get_staging_path(server_data, STAGING_FILE_TEMPLATE, staging_path) ||
+        sal_get_space_for_file(staging_path, &space) != SAL_OK || space >= connection_data->file_size) {
+        return true;
+    }
+    connection_data->admission = PROTOCOL_ADMISSION_NO_SPACE;
+    set_error_description("%ld bytes needed, %ld available", connection_data->file_size, space);
+    print_error("Not enough space");
     return false;
 }
 
 /**
- * @brief Replies that file was received successfully.
+ * @brief Builds the admission reply to the header on the connection arena.
  *
- * @param socket The used socket
+ * @param connection_data The connection-specific internal data
  *
- * @return No return
+ * @return the admission TLV
  **/
-void send_ack(sal_socket_t socket) {
-    tlv_t tlv_content = new_tlv(TLV_TYPE_ACK, 0);
-    if (!send_tlv_data(socket, &tlv_content)) {
-        print_warning("Ack reply failed");
+tlv_t new_admission_tlv(const connection_data* connection_data) {
+    tlv_t tlv_admission = new_tlv(connection_data->arena, TLV_TYPE_ADMISSION, sizeof(long));
+    set_tlv_value_long(&tlv_admission, connection_data->admission);
+    return tlv_admission;
+}
+
+/**
+ * @brief Opens the file the content is received into and prepares its digest.
+ * Files are received into the staging directory and only replace the
+ * destination once validated, so that concurrent receptions of the same file
+ * never mix their content, and a failed one leaves the existing copy as is.
+ * Files not longer than a single chunk are hashed inline, as starting the
+ * hashing thread would outweigh the overlap.
+ * If the client asked to resume and the file journal matches the announced
+ * file, reception continues after the committed content of the partial file,
+ * otherwise the file is received from scratch. Each stream of a multi-stream
+ * transfer receives its own range of a shared file. A file sent as a delta
+ * is rebuilt from its existing copy. In a chunk store, the file is replaced
+ * by its manifest. The subdirectories of a file are created first.
+ * Large files are only opened if they fit the storage, which is reserved
+ * for them up front.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if file was opened successfully
+ * @return false otherwise, the admission telling why
+ **/
+bool open_file_content(const server_data* server_data, connection_data* connection_data) {
+    connection_data->journaled = false;
+    if (!admit_file(server_data, connection_data)) {
+        return false;
+    }
+    /* Until the file is opened, a failure is replied as such */
+    connection_data->admission = PROTOCOL_ADMISSION_FAILED;
+    if (!create_file_dirs(server_data, connection_data->file_path)) {
+        return false;
+    }
+    journal_t journal = {0};
+    const bool resumed = connection_data->resume && resume_file_content(server_data, connection_data, &journal);
+    if (connection_data->stream_count > 1) {
+        if (!open_file_range(server_data, connection_data)) {
+            return false;
+        }
+        checksum_init(&journal.checksum_ctx, connection_data->checksum);
+    } else if (connection_data->delta) {
+        if (!open_delta_basis(server_data, connection_data)) {
+            return false;
+        }
+        checksum_init(&journal.checksum_ctx, connection_data->checksum);
+    } else if (!resumed) {
+        discard_journal(server_data, connection_data->file_path);
+        if (!create_staging_file(server_data, connection_data)) {
+            return false;
+        }
+        checksum_init(&journal.checksum_ctx, connection_data->checksum);
+    }
+    if (!server_data->chunk_store && connection_data->stream_count == 1 &&
+        connection_data->file_size >= PROTOCOL_ADMISSION_MIN_LEN && !reserve_file_content(connection_data)) {
+        close_file_content(connection_data);
+        return false;
+    }
+    if (server_data->chunk_store &&
+        (connection_data->chunk_writer = chunk_writer_create(
+             server_data->storage_dir, connection_data->fp, connection_data->file_size,
+             &connection_data->checksum_ctx)) == NULL) {
+        close_file_content(connection_data);
+        return false;
+    }
+    if (server_data->digest_thread && connection_data->range_length > DIGEST_CHUNK_LEN &&
+        (connection_data->digest_pipeline = digest_pipeline_create(connection_data->checksum)) == NULL) {
+        close_file_content(connection_data);
+        return false;
     }
-    tlv_release_tlvs();
+    if (connection_data->digest_pipeline && resumed) {
+        digest_pipeline_restore(connection_data->digest_pipeline, &journal.checksum_ctx);
+    }
+    connection_data->checksum_ctx = journal.checksum_ctx;
+    connection_data->received_bytes = journal.committed;
+    connection_data->digested_bytes = journal.committed;
+    connection_data->admission = PROTOCOL_ADMISSION_ACCEPTED;
+    return true;
 }
 
 /**
- * @brief Replies that file was not received successfully.
+ * @brief Creates the subdirectories of the storage directory a file is
+ * stored in, if not existing yet.
  *
- * @param socket The used socket
+ * @param server_data The server internal data
+ * @param file_path The file path
  *
- * @return No return
+ * @return true if the file directory exists
+ * @return false otherwise
  **/
-void send_nack(sal_socket_t socket) {
-    tlv_t tlv_content = new_tlv(TLV_TYPE_NACK, 0);
-    if (!send_tlv_data(socket, &tlv_content)) {
-        print_warning("Nack reply failed");
+bool create_file_dirs(const server_data* server_data, const char* file_path) {
+    char dir[MAX_PATH_LEN + 1];
+    const char* separator = strchr(&file_path[strlen(server_data->storage_dir) + 1], '/');
+    for (; separator != NULL; separator = strchr(separator + 1, '/')) {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(separator - file_path), file_path);
+        if (sal_create_dir(dir) != SAL_OK) {
+            return false;
+        }
     }
-    tlv_release_tlvs();
+    return true;
 }
 
 /**
- * @brief Parses input arguments and validate them.
+ * @brief Reserves the storage of the destination file, which is written
+ * sequentially from start to end. Only files with an admission reply fail
+ * for lack of space, so that their client is told so, the reservation
+ * being merely advisory otherwise.
  *
- * @param argc The number of arguments
- * @param argv The arguments values
- * @param[out] data The server internal data
+ * @param connection_data The connection-specific internal data
  *
- * @return true if given arguments are valid
+ * @return true if file storage was reserved, or did not need to be
  * @return false otherwise
  **/
-bool parse_input(const int argc, const char** argv, server_data* data) {
-    if (argc != 4) {
+bool reserve_file_content(connection_data* connection_data) {
+    if (sal_reserve_file(connection_data->fp, connection_data->file_size) == SAL_NO_SPACE &&
+        has_admission(connection_data)) {
+        connection_data->admission = PROTOCOL_ADMISSION_NO_SPACE;
         return false;
     }
+    return true;
+}
 
-    const char* storage_dir = argv[1];
-    switch (sal_is_dir_writable(storage_dir)) {
-    case SAL_DIR_NOT_FOUND:
-        set_error_description("%s", storage_dir);
-        print_error("Storage directory not found");
-        return false;
-        break;
-    case SAL_DIR_NOT_WRITABLE:
-        set_error_description("%s", storage_dir);
-        print_error("Storage directory is not writable");
+/**
+ * @brief Builds the path of a file of the staging directory.
+ *
+ * @param server_data The server internal data
+ * @param name The file name
+ * @param[out] path The file path, STAGING_PATH_LEN long
+ *
+ * @return true if path fits
+ * @return false otherwise
+ **/
+bool get_staging_path(const server_data* server_data, const char* name, char* path) {
+    const int length = snprintf(path, STAGING_PATH_LEN, "%s/%s/%s", server_data->storage_dir, STAGING_DIR, name);
+    return length > 0 && length < STAGING_PATH_LEN;
+}
+
+/**
+ * @brief Creates the file the content is received into, of a unique name in
+ * the staging directory.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if file was created successfully
+ * @return false otherwise
+ **/
+bool create_staging_file(const server_data* server_data, connection_data* connection_data) {
+    if (!get_staging_path(server_data, STAGING_FILE_TEMPLATE, connection_data->content_path)) {
+        set_error_description("Path is too long");
+        print_error("Opening file failed");
+        connection_data->content_path[0] = '\0';
         return false;
-        break;
-    default:
-        break;
     }
-
-    struct in_addr server_ip_addr = {0};
-    if (inet_aton(argv[2], &server_ip_addr) == 0) {
-        set_error_description("%s", argv[2]);
-        print_error("Invalid listening IP");
+    if (sal_create_unique_file(connection_data->content_path, &connection_data->fp) != SAL_OK) {
+        connection_data->content_path[0] = '\0';
         return false;
     }
+    return true;
+}
 
-    const int server_port = atoi(argv[3]);
-    if ((server_port <= 0) || (server_port > 65535)) {
-        set_error_description("%d", server_port);
-        print_error("Invalid listening port");
+/**
+ * @brief Reopens a partial file for resuming its reception, if its journal
+ * matches the announced file. The partial file is locked, and its journal
+ * read again, so that a partial file is only resumed by a single connection,
+ * and never once validated. The journal is kept until the file is either
+ * validated or interrupted again, as the committed content is never rewritten.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ * @param[out] journal The partial file journal
+ *
+ * @return true if file was reopened after the committed content
+ * @return false if it shall be received from scratch
+ **/
+bool resume_file_content(const server_data* server_data, connection_data* connection_data, journal_t* journal) {
+    journal_t loaded = {0};
+    if (!journal_load(connection_data->file_path, &loaded) ||
+        !get_staging_path(server_data, loaded.partial_name, connection_data->content_path)) {
         return false;
     }
-
-    data->storage_dir = strdup(storage_dir);
-    data->addr.sin_addr = server_ip_addr;
-    data->addr.sin_port = htons(server_port);
-    data->addr.sin_family = AF_INET;
-
+    char partial_name[JOURNAL_PARTIAL_NAME_LEN];
+    strcpy(partial_name, loaded.partial_name);
+    connection_data->fp = fopen(connection_data->content_path, "r+b");
+    if (connection_data->fp == NULL ||
+        sal_lock_file(connection_data->fp) != SAL_OK ||
+        !journal_load(connection_data->file_path, &loaded) ||
+        strcmp(loaded.partial_name, partial_name) != 0 ||
+        loaded.file_size != connection_data->file_size ||
+        loaded.identity != connection_data->file_identity ||
+        loaded.checksum_ctx.algorithm != connection_data->checksum ||
+        loaded.committed < 0 || loaded.committed > loaded.file_size) {
+        goto RECEIVE_FROM_SCRATCH;
+    }
+    /* The partial file may have been truncated meanwhile */
+    if (fseek(connection_data->fp, 0, SEEK_END) != 0 || ftell(connection_data->fp) < loaded.committed ||
+        fseek(connection_data->fp, loaded.committed, SEEK_SET) != 0) {
+        goto RECEIVE_FROM_SCRATCH;
+    }
+    *journal = loaded;
+    connection_data->journaled = true;
     return true;
+
+RECEIVE_FROM_SCRATCH:
+    close_file_content(connection_data);
+    connection_data->content_path[0] = '\0';
+    return false;
 }
 
 /**
- * @brief Releases server internal data.
+ * @brief Removes the journal of a file, along with the partial file it
+ * names, unless another connection is resuming it.
  *
- * @param data The server internal data
+ * @param server_data The server internal data
+ * @param file_path The file path
  *
- * @return true if given arguments are valid
- * @return false otherwise
+ * @return No return
  **/
-void release_server_data(server_data* data) {
-    if (data->listen_sock) {
-        stop_listening(data);
-        sal_destroy_socket(data->listen_sock);
-        data->listen_sock = NULL;
+void discard_journal(const server_data* server_data, const char* file_path) {
+    journal_t journal = {0};
+    char partial_path[STAGING_PATH_LEN];
+    FILE* fp = NULL;
+    if (journal_load(file_path, &journal) && get_staging_path(server_data, journal.partial_name, partial_path)) {
+        fp = fopen(partial_path, "r+b");
     }
-    if (data->storage_dir) {
-        free(data->storage_dir);
-        data->storage_dir = NULL;
+    /* The journal goes first, as a connection resuming the partial file reads it again once locked */
+    if (fp != NULL && sal_lock_file(fp) == SAL_OK) {
+        journal_remove(file_path);
+        remove(partial_path);
+    } else {
+        journal_remove(file_path);
+    }
+    if (fp != NULL) {
+        fclose(fp);
     }
 }
 
 /**
- * @brief Creates a listening socket for receiving connection requests.
+ * @brief Opens the file a range is received into. The file is shared by all
+ * streams of the transfer, being named after it in the staging directory, so
+ * it is neither truncated nor replaced: whichever stream comes first creates
+ * it, and every stream allocates it to its final length before writing its
+ * range in place. The last stream to finish moves it to the destination.
  *
  * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
  *
- * @return true if given arguments are valid
+ * @return true if file was opened at the range offset
  * @return false otherwise
  **/
-bool start_listening(server_data* data) {
-    if ((data->listen_sock = sal_create_socket()) == NULL) {
+bool open_file_range(const server_data* server_data, connection_data* connection_data) {
+    char name[JOURNAL_PARTIAL_NAME_LEN];
+    snprintf(name, sizeof(name), "transfer-%016lx", (unsigned long)connection_data->transfer_id);
+    if (!get_staging_path(server_data, name, connection_data->content_path)) {
+        set_error_description("Path is too long");
+        print_error("Opening file failed");
+        connection_data->content_path[0] = '\0';
         return false;
     }
+    if (sal_open_shared_file(connection_data->content_path, &connection_data->fp) != SAL_OK) {
+        connection_data->content_path[0] = '\0';
+        return false;
+    }
+    if (sal_allocate_file(connection_data->fp, connection_data->file_size) != SAL_OK ||
+        fseek(connection_data->fp, connection_data->range_offset, SEEK_SET) != 0) {
+        close_file_content(connection_data);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Opens the existing copy of the file as the basis of a delta transfer,
+ * and the file the delta is rebuilt into, which replaces the existing copy
+ * once validated. Without an existing copy of at least one block, there is
+ * no basis, as the delta will only carry literal content.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if files were opened successfully
+ * @return false otherwise
+ **/
+bool open_delta_basis(const server_data* server_data, connection_data* connection_data) {
+    long basis_size = 0;
+    FILE* basis_fp = fopen(connection_data->file_path, "rb");
+    if (basis_fp && fseek(basis_fp, 0, SEEK_END) == 0) {
+        basis_size = ftell(basis_fp);
+    }
+    connection_data->block_length = delta_get_block_length(basis_size);
+    connection_data->block_count = 0;
+    if (basis_size < connection_data->block_length) {
+        if (basis_fp) {
+            fclose(basis_fp);
+        }
+        discard_journal(server_data, connection_data->file_path);
+        return create_staging_file(server_data, connection_data);
+    }
+    if (!create_staging_file(server_data, connection_data)) {
+        fclose(basis_fp);
+        return false;
+    }
+    connection_data->basis_fp = basis_fp;
+    connection_data->block_count = basis_size / connection_data->block_length;
+    return true;
+}
+
+/**
+ * @brief Queues the first reply to a delta transfer, the delta basis TLV. The
+ * block signatures follow, queued a batch at a time by queue_delta_signatures().
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void queue_delta_basis(connection_data* connection_data) {
+    tlv_t tlv_basis = new_delta_basis_tlv(
+        connection_data->arena, connection_data->block_length, connection_data->block_count);
+    queue_tlv(connection_data, &tlv_basis);
+    reset_tlv_arena(connection_data->arena);
+    connection_data->signed_blocks = 0;
+}
+
+/**
+ * @brief Queues the signatures of the next blocks of the existing copy, as a
+ * TLV covering at most DELTA_SIGNATURE_BATCH_LEN bytes of it, so that a large
+ * copy is hashed a batch at a time while the previous ones are sent, instead
+ * of holding up the other connections of an event loop. The blocks are
+ * hashed straight from the page cache.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if signatures were queued
+ * @return false otherwise
+ **/
+bool queue_delta_signatures(connection_data* connection_data) {
+    uint8_t tlv[TLV_HEADER_LENGTH + DELTA_SIGNATURES_PER_TLV * DELTA_SIGNATURE_LENGTH];
+    const long block_length = connection_data->block_length;
+    const long batch_blocks = MAX(1, MIN(DELTA_SIGNATURES_PER_TLV, DELTA_SIGNATURE_BATCH_LEN / block_length));
+    const long signatures = MIN(connection_data->block_count - connection_data->signed_blocks, batch_blocks);
+    const long offset = connection_data->signed_blocks * block_length;
+    const long map_offset = offset - offset % SAL_MAP_ALIGNMENT;
+    const size_t skipped = offset - map_offset;
+    const size_t length = signatures * block_length;
+    const uint8_t* basis = NULL;
+    if (sal_map_file(connection_data->basis_fp, map_offset, skipped + length, &basis) != SAL_OK) {
+        return false;
+    }
+    write_tlv_header(tlv, TLV_TYPE_BLOCK_SIGNATURES, signatures * DELTA_SIGNATURE_LENGTH);
+    for (long block = 0; block < signatures; ++block) {
+        delta_write_signature(
+            basis + skipped + block * block_length, block_length,
+            &tlv[TLV_HEADER_LENGTH + block * DELTA_SIGNATURE_LENGTH]);
+    }
+    /* Signatures of zeros would have the client reference blocks the copy no longer has */
+    const bool valid = sal_check_mapped_file(basis) == SAL_OK;
+    sal_unmap_file(basis, skipped + length);
+    if (!valid) {
+        return false;
+    }
+    queue_data(connection_data, tlv, TLV_HEADER_LENGTH + signatures * DELTA_SIGNATURE_LENGTH);
+    connection_data->signed_blocks += signatures;
+    return true;
+}
+
+/**
+ * @brief Moves the validated file from the staging directory to its
+ * destination, replacing the existing copy at once. The file is removed if
+ * it can't be moved.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if file was moved successfully
+ * @return false otherwise
+ **/
+bool replace_file(connection_data* connection_data) {
+    if (rename(connection_data->content_path, connection_data->file_path) != 0) {
+        reset_error_description();
+        print_error("Replacing file failed");
+        remove(connection_data->content_path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Ends the reception of a file: the file the content was received
+ * into replaces the destination if it was validated, and is removed
+ * otherwise, unless kept for resuming. The streams of a multi-stream
+ * transfer leave their shared file to the last one finishing.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param status The outcome of the file reception
+ *
+ * @return the outcome to be replied
+ **/
+content_status finish_file_content(connection_data* connection_data, const content_status status) {
+    if (connection_data->basis_fp) {
+        fclose(connection_data->basis_fp);
+        connection_data->basis_fp = NULL;
+    }
+    close_file_content(connection_data);
+    content_status outcome = status;
+    if (connection_data->content_path[0] == '\0' || connection_data->stream_count > 1) {
+        /* Nothing to replace nor remove */
+    } else if (status == CONTENT_VALID) {
+        outcome = replace_file(connection_data) ? CONTENT_VALID : CONTENT_INVALID;
+    } else if (!connection_data->journaled) {
+        remove(connection_data->content_path);
+    }
+    connection_data->content_path[0] = '\0';
+    return outcome;
+}
+
+/**
+ * @brief Records the outcome of a stream of a multi-stream transfer. The
+ * reply of the last finished stream stands for the whole file, so it is only
+ * an ACK if all ranges were validated, the file then replacing the
+ * destination, and being removed otherwise.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ * @param status The outcome of the range received through this connection
+ *
+ * @return the outcome to be replied
+ **/
+content_status finish_file_range(
+    const server_data* server_data,
+    connection_data* connection_data,
+    const content_status status) {
+    if (connection_data->stream_count <= 1) {
+        return status;
+    }
+    bool transfer_valid = false;
+    if (!transfer_registry_finish_stream(
+            server_data->transfers,
+            connection_data->transfer_id,
+            connection_data->stream_count,
+            status == CONTENT_VALID,
+            &transfer_valid) ||
+        connection_data->content_path[0] == '\0') {
+        return status;
+    }
+    if (transfer_valid) {
+        return replace_file(connection_data) ? CONTENT_VALID : CONTENT_INVALID;
+    }
+    remove(connection_data->content_path);
+    if (status == CONTENT_VALID) {
+        reset_error_description();
+        print_error("Other file ranges failed");
+        return CONTENT_INVALID;
+    }
+    return status;
+}
+
+/**
+ * @brief Stores the journal of an interrupted reception, so that the client
+ * may resume it later on, the partial file being kept. The received content
+ * is hashed and synchronized to storage before the journal records it as committed.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void save_journal(connection_data* connection_data) {
+    journal_t journal = {
+        .file_size = connection_data->file_size,
+        .identity = connection_data->file_identity,
+        .committed = connection_data->received_bytes
+    };
+    if (connection_data->fp == NULL || !digest_stored_content(connection_data, true) ||
+        sal_sync_file(connection_data->fp) != SAL_OK) {
+        return;
+    }
+    snprintf(journal.partial_name, sizeof(journal.partial_name), "%s", strrchr(connection_data->content_path, '/') + 1);
+    if (connection_data->digest_pipeline) {
+        digest_pipeline_save(connection_data->digest_pipeline, &journal.checksum_ctx);
+    } else {
+        journal.checksum_ctx = connection_data->checksum_ctx;
+    }
+    if (journal_save(connection_data->file_path, &journal)) {
+        connection_data->journaled = true;
+    }
+}
+
+/**
+ * @brief Builds the reply to a resuming client, telling where to resume from,
+ * on the connection arena.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return the resume offset TLV
+ **/
+tlv_t new_resume_offset_tlv(const connection_data* connection_data) {
+    tlv_t tlv_offset = new_tlv(connection_data->arena, TLV_TYPE_RESUME_OFFSET, sizeof(long));
+    set_tlv_value_long(&tlv_offset, connection_data->received_bytes);
+    return tlv_offset;
+}
+
+/**
+ * @brief Processes a TLV received after the header, i.e. file content or digest.
+ * The received data is written to file and validated against a provided
+ * checksum to ensure there was no transmission error.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param tlv The received TLV
+ *
+ * @return CONTENT_PENDING if more file content is expected
+ * @return CONTENT_VALID if file was received, written and validated successfully
+ * @return CONTENT_INVALID otherwise
+ **/
+content_status process_file_content(connection_data* connection_data, tlv_t* tlv) {
+    uint8_t checksum_buffer[CHECKSUM_MAX_LENGTH] = {0};
+    const uint8_t* checksum = NULL;
+    size_t length = get_tlv_length(tlv);
+    switch (get_tlv_type(tlv)) {
+    case TLV_TYPE_FILE_CONTENT:
+        if (connection_data->chunk_writer) {
+            return store_content(connection_data, get_tlv_value_raw(tlv), length) ? CONTENT_PENDING : CONTENT_INVALID;
+        }
+        if (!fits_file_range(connection_data, length)) {
+            return CONTENT_INVALID;
+        }
+        if (trace_fwrite(get_tlv_value_raw(tlv), 1, length, connection_data->fp) != length) {
+            return CONTENT_INVALID;
+        }
+        trace_checksum_update(&connection_data->checksum_ctx, get_tlv_value_raw(tlv), length);
+        connection_data->received_bytes += length;
+        metrics_add_received_bytes(length);
+        connection_data->digested_bytes += length;
+        return CONTENT_PENDING;
+    case TLV_TYPE_COMPRESSED_CONTENT:
+        return process_compressed_content(connection_data, tlv);
+    case TLV_TYPE_BLOCK_REFERENCE:
+        return process_block_reference(connection_data, tlv);
+    case TLV_TYPE_CHUNK_LIST:
+        return process_chunk_list(connection_data, tlv);
+    case TLV_TYPE_CHECKSUM_SHA512:
+    case TLV_TYPE_CHECKSUM:
+        if (!parse_checksum(tlv, connection_data->checksum, &checksum)) {
+            print_error("Protocol error");
+            return CONTENT_INVALID;
+        }
+        /* Streams share a file, so a short one would leave a hole in it; deduplicated files only get missing chunks */
+        if (!connection_data->dedup && connection_data->received_bytes != connection_data->range_length) {
+            set_error_description("%ld of %ld bytes received", connection_data->received_bytes, connection_data->range_length);
+            print_error("File validation failed");
+            return CONTENT_INVALID;
+        }
+        if (!digest_stored_content(connection_data, true) ||
+            (connection_data->chunk_writer && !chunk_writer_finish(connection_data->chunk_writer))) {
+            return CONTENT_INVALID;
+        }
+        /* The journal goes before the partial file is released, so that no other connection resumes it */
+        if (connection_data->journaled) {
+            journal_remove(connection_data->file_path);
+            connection_data->journaled = false;
+        }
+        close_file_content(connection_data);
+        if (connection_data->digest_pipeline) {
+            digest_pipeline_finish(connection_data->digest_pipeline, checksum_buffer);
+        } else {
+            checksum_final(&connection_data->checksum_ctx, checksum_buffer);
+        }
+        const bool match = memcmp(checksum_buffer, checksum, get_checksum_length(connection_data->checksum)) == 0;
+        PROBE2(checksum_verified, connection_data, match);
+        if (!match) {
+            metrics_count_checksum_failure();
+            reset_error_description();
+            print_error("File validation failed");
+            return CONTENT_INVALID;
+        }
+        return CONTENT_VALID;
+    default:
+        set_error_description("Unknown TLV %d", get_tlv_type(tlv));
+        print_error("Protocol error");
+        return CONTENT_INVALID;
+    }
+}
+
+/**
+ * @brief Decompresses a compressed file content chunk, then writes and hashes
+ * it as received raw content, so the checksum covers the original content.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param tlv The received compressed content TLV
+ *
+ * @return CONTENT_PENDING if file content was stored successfully
+ * @return CONTENT_INVALID otherwise
+ **/
+content_status process_compressed_content(connection_data* connection_data, tlv_t* tlv) {
+    const uint8_t* value = get_tlv_value_raw(tlv);
+    const uint64_t length = get_tlv_length(tlv);
+    if (connection_data->compression == COMPRESSION_NONE || length < COMPRESSED_CHUNK_LENGTH_LENGTH) {
+        set_error_description("Unexpected compressed content");
+        print_error("Protocol error");
+        return CONTENT_INVALID;
+    }
+    const size_t chunk_length = (size_t)value[0] << 24 | value[1] << 16 | value[2] << 8 | value[3];
+    if (chunk_length > PROTOCOL_MAX_COMPRESSED_CHUNK_LEN) {
+        set_error_description("Compressed chunk too long");
+        print_error("Protocol error");
+        return CONTENT_INVALID;
+    }
+    size_t capacity = 0;
+    uint8_t* chunk = acquire_content_buffer(connection_data, &capacity);
+    if (!decompress_chunk(
+            connection_data->compression,
+            value + COMPRESSED_CHUNK_LENGTH_LENGTH,
+            length - COMPRESSED_CHUNK_LENGTH_LENGTH,
+            chunk,
+            chunk_length)) {
+        print_error("Decompression failed");
+        return CONTENT_INVALID;
+    }
+    return store_content(connection_data, chunk, chunk_length) ? CONTENT_PENDING : CONTENT_INVALID;
+}
+
+/**
+ * @brief Copies the referenced blocks of the existing copy of the file, then
+ * writes and hashes them as received raw content.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param tlv The received block reference TLV
+ *
+ * @return CONTENT_PENDING if blocks were stored successfully
+ * @return CONTENT_INVALID otherwise
+ **/
+content_status process_block_reference(connection_data* connection_data, tlv_t* tlv) {
+    long block_index = 0;
+    long block_count = 0;
+    if (!connection_data->delta || !parse_block_reference(tlv, &block_index, &block_count) ||
+        block_index < 0 || block_count <= 0 || block_index > connection_data->block_count - block_count) {
+        set_error_description("Unexpected block reference");
+        print_error("Protocol error");
+        return CONTENT_INVALID;
+    }
+    if (fseek(connection_data->basis_fp, block_index * connection_data->block_length, SEEK_SET) != 0) {
+        set_error_description("Seek failed");
+        print_error("Reading existing file failed");
+        return CONTENT_INVALID;
+    }
+    for (long remaining = block_count * connection_data->block_length; remaining > 0;) {
+        size_t capacity = 0;
+        uint8_t* buffer = acquire_content_buffer(connection_data, &capacity);
+        const size_t length = MIN((size_t)remaining, capacity);
+        if (trace_fread(buffer, 1, length, connection_data->basis_fp) != length) {
+            set_error_description("%s", ferror(connection_data->basis_fp) ? "I/O error" : "File truncated");
+            print_error("Reading existing file failed");
+            return CONTENT_INVALID;
+        }
+        if (!store_content(connection_data, buffer, length)) {
+            return CONTENT_INVALID;
+        }
+        remaining -= length;
+    }
+    return CONTENT_PENDING;
+}
+
+/**
+ * @brief Adds chunks announced by a client to the file, and once they complete
+ * a batch, queues the reply telling which ones the chunk store is missing: a
+ * bit per chunk of the batch, split over as many TLVs as needed.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param tlv The received chunk list TLV
+ *
+ * @return CONTENT_PENDING if chunks were added successfully
+ * @return CONTENT_INVALID otherwise
+ **/
+content_status process_chunk_list(connection_data* connection_data, tlv_t* tlv) {
+    const size_t length = get_tlv_length(tlv);
+    if (!connection_data->dedup || length == 0 || length % CHUNK_ENTRY_LENGTH != 0) {
+        set_error_description("Unexpected chunk list");
+        print_error("Protocol error");
+        return CONTENT_INVALID;
+    }
+    bool complete = false;
+    if (!chunk_writer_add_chunks(connection_data->chunk_writer, get_tlv_value_raw(tlv), length / CHUNK_ENTRY_LENGTH, &complete)) {
+        print_error("Protocol error");
+        return CONTENT_INVALID;
+    }
+    if (!complete) {
+        return CONTENT_PENDING;
+    }
+    size_t missing_length = 0;
+    const uint8_t* missing = chunk_writer_get_missing(connection_data->chunk_writer, &missing_length);
+    for (size_t offset = 0; offset < missing_length; offset += TLV_MAX_VALUE_LENGTH) {
+        const size_t piece_length = MIN(missing_length - offset, TLV_MAX_VALUE_LENGTH);
+        uint8_t header[TLV_HEADER_LENGTH];
+        write_tlv_header(header, TLV_TYPE_MISSING_CHUNKS, piece_length);
+        queue_data(connection_data, header, sizeof(header));
+        queue_data(connection_data, missing + offset, piece_length);
+    }
+    return CONTENT_PENDING;
+}
+
+/**
+ * @brief Gets a buffer for file content produced on the server, i.e.
+ * decompressed or copied: a digest pipeline chunk, so that it is hashed
+ * without copying it, or a buffer of the thread otherwise.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param[out] capacity The buffer length
+ *
+ * @return the buffer, valid until the next call
+ **/
+uint8_t* acquire_content_buffer(connection_data* connection_data, size_t* capacity) {
+    static __thread uint8_t buffer[PROTOCOL_MAX_COMPRESSED_CHUNK_LEN] = {0};
+
+    if (connection_data->digest_pipeline) {
+        *capacity = DIGEST_CHUNK_LEN;
+        return digest_pipeline_acquire(connection_data->digest_pipeline);
+    }
+    *capacity = sizeof(buffer);
+    return buffer;
+}
+
+/**
+ * @brief Writes and hashes file content held on a buffer got by acquire_content_buffer(),
+ * or hands it to the chunk writer, which hashes it in file order along with stored chunks.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param content The file content
+ * @param length The file content length
+ *
+ * @return true if file content was written successfully
+ * @return false otherwise
+ **/
+bool store_content(connection_data* connection_data, const uint8_t* content, const size_t length) {
+    if (!fits_file_range(connection_data, length)) {
+        return false;
+    }
+    if (connection_data->chunk_writer) {
+        if (!chunk_writer_write(connection_data->chunk_writer, content, length)) {
+            return false;
+        }
+    } else {
+        if (connection_data->digest_pipeline) {
+            digest_pipeline_submit(connection_data->digest_pipeline, length);
+        } else {
+            trace_checksum_update(&connection_data->checksum_ctx, content, length);
+        }
+        if (trace_fwrite(content, 1, length, connection_data->fp) != length) {
+            return false;
+        }
+    }
+    connection_data->received_bytes += length;
+    metrics_add_received_bytes(length);
+    connection_data->digested_bytes += length;
+    return true;
+}
+
+/**
+ * @brief Hashes file content that was stored without passing through user
+ * space, reading it back from the page cache through a file mapping.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param flush Whether all pending content shall be hashed, instead of only
+ * complete mapping windows
+ *
+ * @return true if pending content was hashed successfully
+ * @return false otherwise
+ **/
+bool digest_stored_content(connection_data* connection_data, bool flush) {
+    while (connection_data->received_bytes - connection_data->digested_bytes >= DIGEST_MAP_WINDOW_LEN ||
+           (flush && connection_data->received_bytes > connection_data->digested_bytes)) {
+        const long file_offset = connection_data->range_offset + connection_data->digested_bytes;
+        const long map_offset = file_offset - file_offset % SAL_MAP_ALIGNMENT;
+        const size_t skipped = file_offset - map_offset;
+        const size_t length = MIN(connection_data->received_bytes - connection_data->digested_bytes, DIGEST_MAP_WINDOW_LEN);
+        const uint8_t* data = NULL;
+        if (sal_map_file(connection_data->fp, map_offset, skipped + length, &data) != SAL_OK) {
+            return false;
+        }
+        trace_checksum_update(&connection_data->checksum_ctx, data + skipped, length);
+        const bool valid = sal_check_mapped_file(data) == SAL_OK;
+        sal_unmap_file(data, skipped + length);
+        if (!valid) {
+            return false;
+        }
+        connection_data->digested_bytes += length;
+    }
+    return true;
+}
+
+/**
+ * @brief Moves the value of a file content TLV straight from the socket to
+ * the destination file. The moved content is hashed later, from the page cache.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param length The TLV length
+ *
+ * @return CONTENT_PENDING if file content was stored successfully
+ * @return CONTENT_INTERRUPTED if connection failed
+ * @return CONTENT_INVALID otherwise
+ **/
+content_status splice_file_content(connection_data* connection_data, const uint64_t length) {
+    if (!fits_file_range(connection_data, length)) {
+        return CONTENT_INVALID;
+    }
+    if (sal_splice_to_file(connection_data->socket, connection_data->fp, length) != SAL_OK) {
+        return CONTENT_INTERRUPTED;
+    }
+    connection_data->received_bytes += length;
+    metrics_add_received_bytes(length);
+    return digest_stored_content(connection_data, false) ? CONTENT_PENDING : CONTENT_INVALID;
+}
+
+/**
+ * @brief Receives the value of a file content TLV piece by piece, so that
+ * TLVs longer than an arena can be streamed.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param length The TLV length
+ *
+ * @return CONTENT_PENDING if file content was stored successfully
+ * @return CONTENT_INTERRUPTED if connection failed
+ * @return CONTENT_INVALID otherwise
+ **/
+content_status receive_streamed_content(connection_data* connection_data, const uint64_t length) {
+    if (connection_data->digest_pipeline) {
+        return receive_pipelined_content(connection_data, length);
+    }
+    content_status status = CONTENT_PENDING;
+    uint64_t remaining = length;
+    while (remaining > 0 && status == CONTENT_PENDING) {
+        const uint8_t* data = NULL;
+        size_t available = 0;
+        if (sal_peek_msg(connection_data->socket, 1, &data, &available) != SAL_OK) {
+            return CONTENT_INTERRUPTED;
+        }
+        /* The piece is processed straight from the socket receive buffer */
+        tlv_t tlv_piece = {
+            .type = TLV_TYPE_FILE_CONTENT,
+            .length = MIN(remaining, available),
+            .buffer = (uint8_t*)data
+        };
+        status = process_file_content(connection_data, &tlv_piece);
+        sal_consume_msg(connection_data->socket, get_tlv_length(&tlv_piece));
+        remaining -= get_tlv_length(&tlv_piece);
+    }
+    return status;
+}
+
+/**
+ * @brief Receives the value of a file content TLV chunk by chunk, each one
+ * written to file while the digest pipeline hashes it.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param length The TLV length
+ *
+ * @return CONTENT_PENDING if file content was stored successfully
+ * @return CONTENT_INTERRUPTED if connection failed
+ * @return CONTENT_INVALID otherwise
+ **/
+content_status receive_pipelined_content(connection_data* connection_data, const uint64_t length) {
+    if (!fits_file_range(connection_data, length)) {
+        return CONTENT_INVALID;
+    }
+    for (uint64_t remaining = length; remaining > 0;) {
+        uint8_t* chunk = digest_pipeline_acquire(connection_data->digest_pipeline);
+        const size_t chunk_length = MIN(remaining, DIGEST_CHUNK_LEN);
+        if (sal_receive_msg(connection_data->socket, chunk, chunk_length) != SAL_OK) {
+            return CONTENT_INTERRUPTED;
+        }
+        digest_pipeline_submit(connection_data->digest_pipeline, chunk_length);
+        if (trace_fwrite(chunk, 1, chunk_length, connection_data->fp) != chunk_length) {
+            return CONTENT_INVALID;
+        }
+        connection_data->received_bytes += chunk_length;
+        metrics_add_received_bytes(chunk_length);
+        connection_data->digested_bytes += chunk_length;
+        remaining -= chunk_length;
+    }
+    return CONTENT_PENDING;
+}
+
+/**
+ * @brief Gets the io_uring ring of the thread, created on first use along
+ * with the buffer its operations receive and write file content through.
+ *
+ * @param[out] slices The ring buffer, RING_SLICE_COUNT slices of RING_SLICE_LEN bytes
+ *
+ * @return the ring, kept for the thread lifetime
+ * @return NULL otherwise
+ **/
+sal_ring_t acquire_ring(uint8_t** slices) {
+    /* Blocking threads live as long as the server, and serve a connection at a time */
+    static __thread sal_ring_t ring = NULL;
+    static __thread uint8_t* ring_slices = NULL;
+
+    if (ring == NULL) {
+        if ((ring_slices = malloc(RING_SLICE_COUNT * RING_SLICE_LEN)) == NULL) {
+            set_error_description("Out of memory");
+            print_error("Ring creation failed");
+            return NULL;
+        }
+        if ((ring = sal_create_ring(2 * RING_SLICE_COUNT, 2)) == NULL ||
+            sal_ring_register_buffer(ring, ring_slices, RING_SLICE_COUNT * RING_SLICE_LEN) != SAL_OK) {
+            sal_destroy_ring(ring);
+            ring = NULL;
+            free(ring_slices);
+            ring_slices = NULL;
+            return NULL;
+        }
+    }
+    *slices = ring_slices;
+    return ring;
+}
+
+/**
+ * @brief Receives the value of a file content TLV through the io_uring ring
+ * of the thread. Content is received slice by slice, and each received slice
+ * is hashed, then written at its file offset while the next one is received,
+ * so a single system call per slice submits a write and a receive and waits
+ * for whichever completes. A slice is only reused once its write completed.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param length The TLV length
+ *
+ * @return CONTENT_PENDING if file content was stored successfully
+ * @return CONTENT_INTERRUPTED if connection failed
+ * @return CONTENT_INVALID otherwise
+ **/
+content_status receive_ring_content(connection_data* connection_data, const uint64_t length) {
+    if (!fits_file_range(connection_data, length)) {
+        return CONTENT_INVALID;
+    }
+    uint8_t* slices = NULL;
+    sal_ring_t ring = acquire_ring(&slices);
+    /* Ring writes bypass the file stream, which is positioned past them afterwards */
+    if (ring == NULL || fflush(connection_data->fp) != 0 ||
+        sal_ring_set_socket(ring, RING_SOCKET_SLOT, connection_data->socket) != SAL_OK ||
+        sal_ring_set_file(ring, RING_FILE_SLOT, connection_data->fp) != SAL_OK) {
+        return CONTENT_INVALID;
+    }
+    long offset = ftell(connection_data->fp);
+    uint64_t remaining = length;
+    size_t slice_lengths[RING_SLICE_COUNT] = {0};
+    bool writing[RING_SLICE_COUNT] = {false};
+    bool receiving = false;
+    int in_flight = 0;
+    int next = 0;
+    content_status status = CONTENT_PENDING;
+
+    /* Content received along with the TLV header only needs to be written */
+    size_t received = sal_take_buffered_msg(connection_data->socket, slices, MIN(remaining, RING_SLICE_LEN));
+    while (in_flight > 0 || received > 0 || (remaining > 0 && status == CONTENT_PENDING)) {
+        if (received > 0) {
+            uint8_t* slice = slices + next * RING_SLICE_LEN;
+            trace_checksum_update(&connection_data->checksum_ctx, slice, received);
+            const sal_ring_op_t write_op = {
+                .opcode = SAL_RING_WRITE,
+                .slot = RING_FILE_SLOT,
+                .buffer = slice,
+                .length = received,
+                .offset = offset,
+                .user_data = (void*)(uintptr_t)(next << 1 | 1)
+            };
+            if (sal_ring_prepare(ring, &write_op) != SAL_OK) {
+                status = CONTENT_INVALID;
+            } else {
+                writing[next] = true;
+                slice_lengths[next] = received;
+                ++in_flight;
+            }
+            offset += received;
+            remaining -= received;
+            received = 0;
+            next = (next + 1) % RING_SLICE_COUNT;
+        }
+        if (status == CONTENT_PENDING && remaining > 0 && !receiving && !writing[next]) {
+            const sal_ring_op_t receive_op = {
+                .opcode = SAL_RING_RECV,
+                .slot = RING_SOCKET_SLOT,
+                .buffer = slices + next * RING_SLICE_LEN,
+                .length = MIN(remaining, RING_SLICE_LEN),
+                .user_data = (void*)(uintptr_t)(next << 1)
+            };
+            if (sal_ring_prepare(ring, &receive_op) != SAL_OK) {
+                status = CONTENT_INVALID;
+            } else {
+                receiving = true;
+                ++in_flight;
+            }
+        }
+        if (in_flight == 0) {
+            break;
+        }
+        sal_ring_completion_t completions[RING_SLICE_COUNT + 1];
+        const int reaped = sal_ring_submit(ring, completions, RING_SLICE_COUNT + 1, 1);
+        if (reaped < 0) {
+            /* Operations in flight may still use the slices, so the ring is not used again */
+            return CONTENT_INVALID;
+        }
+        for (int i = 0; i < reaped; ++i) {
+            const uintptr_t tag = (uintptr_t)completions[i].user_data;
+            const int slice = tag >> 1;
+            --in_flight;
+            if (tag & 1) {
+                writing[slice] = false;
+                if (completions[i].result != (long)slice_lengths[slice]) {
+                    set_error_description("Short write");
+                    print_error("Writing file failed");
+                    status = CONTENT_INVALID;
+                    continue;
+                }
+                connection_data->received_bytes += slice_lengths[slice];
+                metrics_add_received_bytes(slice_lengths[slice]);
+                connection_data->digested_bytes += slice_lengths[slice];
+            } else {
+                receiving = false;
+                if (completions[i].result <= 0) {
+                    status = status == CONTENT_PENDING ? CONTENT_INTERRUPTED : status;
+                } else if (status == CONTENT_PENDING) {
+                    received = completions[i].result;
+                }
+            }
+        }
+    }
+    sal_ring_set_socket(ring, RING_SOCKET_SLOT, NULL);
+    sal_ring_set_file(ring, RING_FILE_SLOT, NULL);
+    if (fseek(connection_data->fp, offset, SEEK_SET) != 0 && status == CONTENT_PENDING) {
+        status = CONTENT_INVALID;
+    }
+    return status;
+}
+
+/**
+ * @brief Checks whether a TLV length is allowed by the agreed protocol.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param tlv The received TLV header
+ *
+ * @return true if TLV length is allowed
+ * @return false otherwise
+ **/
+bool is_valid_frame(const connection_data* connection_data, const tlv_t* tlv) {
+    if (get_tlv_length(tlv) <= TLV_MAX_VALUE_LENGTH) {
+        return true;
+    }
+    if (get_tlv_type(tlv) == TLV_TYPE_FILE_CONTENT &&
+        (connection_data->protocol.capabilities & PROTOCOL_CAPABILITY_EXTENDED_FRAMES) &&
+        (connection_data->protocol.max_frame_length == PROTOCOL_UNLIMITED_FRAME_LENGTH ||
+         get_tlv_length(tlv) <= (uint64_t)connection_data->protocol.max_frame_length)) {
+        return true;
+    }
+    set_error_description("TLV %d is too long", get_tlv_type(tlv));
+    print_error("Protocol error");
+    return false;
+}
+
+/**
+ * @brief Checks that file content fits the range received through the
+ * connection, so that no stream writes over the range of another one.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param length The file content length
+ *
+ * @return true if file content fits the range
+ * @return false otherwise
+ **/
+bool fits_file_range(const connection_data* connection_data, const uint64_t length) {
+    if (length <= (uint64_t)(connection_data->range_length - connection_data->received_bytes)) {
+        return true;
+    }
+    set_error_description("Content past the file range");
+    print_error("Protocol error");
+    return false;
+}
+
+/**
+ * @brief Closes the destination file, if still opened, and releases its chunk writer.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void close_file_content(connection_data* connection_data) {
+    chunk_writer_destroy(connection_data->chunk_writer);
+    connection_data->chunk_writer = NULL;
+    if (connection_data->fp) {
+        fclose(connection_data->fp);
+        connection_data->fp = NULL;
+    }
+}
+
+/**
+ * @brief Stops the digest pipeline, if started.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void release_digest_pipeline(connection_data* connection_data) {
+    digest_pipeline_destroy(connection_data->digest_pipeline);
+    connection_data->digest_pipeline = NULL;
+}
+
+/**
+ * @brief Receives file content and digest.
+ * The received data is written to file and validated against a provided
+ * checksum to ensure there was no transmission error.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if file content was received, written and validated successfully
+ * @return false otherwise
+ **/
+bool receive_file_content(const server_data* server_data, connection_data* connection_data) {
+    if (!open_file_content(server_data, connection_data)) {
+        finish_file_range(server_data, connection_data, CONTENT_INVALID);
+        finish_file_content(connection_data, CONTENT_INVALID);
+        /* The rejection stands for the reply, as no content follows */
+        if (has_admission(connection_data)) {
+            tlv_t tlv_admission = new_admission_tlv(connection_data);
+            send_tlv_data(connection_data->socket, &tlv_admission);
+            reset_tlv_arena(connection_data->arena);
+        }
+        return false;
+    }
+
+    content_status status = CONTENT_PENDING;
+    if (has_admission(connection_data)) {
+        tlv_t tlv_admission = new_admission_tlv(connection_data);
+        if (!send_tlv_data(connection_data->socket, &tlv_admission)) {
+            status = CONTENT_INTERRUPTED;
+        }
+        reset_tlv_arena(connection_data->arena);
+    }
+    if (connection_data->resume && status == CONTENT_PENDING) {
+        tlv_t tlv_offset = new_resume_offset_tlv(connection_data);
+        if (!send_tlv_data(connection_data->socket, &tlv_offset)) {
+            status = CONTENT_INTERRUPTED;
+        }
+        reset_tlv_arena(connection_data->arena);
+    }
+    if (connection_data->delta && status == CONTENT_PENDING) {
+        queue_delta_basis(connection_data);
+        while (status == CONTENT_PENDING && connection_data->signed_blocks < connection_data->block_count) {
+            if (!queue_delta_signatures(connection_data)) {
+                status = CONTENT_INVALID;
+            } else if (!flush_replies(connection_data)) {
+                status = CONTENT_INTERRUPTED;
+            }
+        }
+        if (status == CONTENT_PENDING && !flush_replies(connection_data)) {
+            status = CONTENT_INTERRUPTED;
+        }
+    }
+    while (status == CONTENT_PENDING) {
+        tlv_t tlv = {0};
+        if (!receive_tlv_header(connection_data->socket, &tlv)) {
+            status = CONTENT_INTERRUPTED;
+        } else if (!is_valid_frame(connection_data, &tlv)) {
+            status = CONTENT_INVALID;
+        } else if (server_data->splice && get_tlv_type(&tlv) == TLV_TYPE_FILE_CONTENT) {
+            status = splice_file_content(connection_data, get_tlv_length(&tlv));
+        } else if (server_data->io_uring && get_tlv_type(&tlv) == TLV_TYPE_FILE_CONTENT &&
+                   get_tlv_length(&tlv) >= RING_SLICE_LEN && connection_data->chunk_writer == NULL) {
+            status = receive_ring_content(connection_data, get_tlv_length(&tlv));
+        } else if (get_tlv_type(&tlv) == TLV_TYPE_FILE_CONTENT) {
+            status = receive_streamed_content(connection_data, get_tlv_length(&tlv));
+        } else if (!receive_tlv_value(connection_data->socket, connection_data->arena, &tlv)) {
+            status = CONTENT_INTERRUPTED;
+        } else {
+            status = process_file_content(connection_data, &tlv);
+        }
+        reset_tlv_arena(connection_data->arena);
+        if (status == CONTENT_PENDING && !flush_replies(connection_data)) {
+            status = CONTENT_INTERRUPTED;
+        }
+    }
+    if (status == CONTENT_INTERRUPTED && connection_data->resume) {
+        save_journal(connection_data);
+    } else if (connection_data->resume) {
+        journal_remove(connection_data->file_path);
+        connection_data->journaled = false;
+    }
+    close_file_content(connection_data);
+    release_digest_pipeline(connection_data);
+
+    status = finish_file_content(connection_data, finish_file_range(server_data, connection_data, status));
+    if (status != CONTENT_VALID) {
+        send_nack(connection_data);
+        return false;
+    }
+    send_ack(connection_data);
+    return true;
+}
+
+/**
+ * @brief Accepts an incoming connection and receives a file through it, or
+ * all files of a session one after the other.
+ *
+ * @param server_data The server internal data
+ *
+ * @return true if the last file content was received, written and validated successfully
+ * @return false otherwise
+ **/
+bool receive_file(const server_data* server_data) {
+    connection_data connection_data;
+    sal_socket_t socket = NULL;
+    if ((socket = sal_accept(server_data->listen_sock)) == NULL) {
+        /* Pending connections keep failing the same way while file descriptors are exhausted */
+        sal_sleep(ACCEPT_BACKOFF_MS);
+        return false;
+    }
+    init_connection(&connection_data, socket);
+    if (server_data->idle_timeout_ms > 0 && sal_set_timeout(socket, server_data->idle_timeout_ms) != SAL_OK) {
+        sal_close(socket);
+        sal_destroy_socket(socket);
+        return false;
+    }
+    if ((connection_data.arena = acquire_tlv_arena()) == NULL) {
+        sal_close(socket);
+        sal_destroy_socket(socket);
+        return false;
+    }
+    metrics_add_connections(1);
+
+    bool received = false;
+    do {
+        if (!receive_header(server_data, &connection_data)) {
+            received = false;
+            break;
+        }
+        if (server_data->workers <= 1) {
+            print_msg(
+                "Receiving file \"%s\" containing %ld bytes...",
+                connection_data.file_path,
+                connection_data.file_size
+            );
+            fflush(stdout);
+        }
+        received = receive_file_content(server_data, &connection_data);
+        ++connection_data.files;
+        print_file_outcome(server_data, &connection_data, received);
+    } while (has_next_file(&connection_data));
+
+    sal_close(connection_data.socket);
+    sal_destroy_socket(connection_data.socket);
+    connection_data.socket = NULL;
+    release_tlv_arena(connection_data.arena);
+    connection_data.arena = NULL;
+    metrics_add_connections(-1);
+
+    return received;
+}
+
+/**
+ * @brief Checks whether another file follows on a session. Sessions end
+ * when the client closes the connection after its last reply, or after a
+ * file range, as the other streams of the file may be queued behind this one.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if the next file header is arriving
+ * @return false otherwise
+ **/
+bool has_next_file(connection_data* connection_data) {
+    return (connection_data->protocol.capabilities & PROTOCOL_CAPABILITY_SESSION) &&
+        connection_data->stream_count <= 1 &&
+        sal_wait_msg(connection_data->socket) == SAL_OK;
+}
+
+/**
+ * @brief Prints the outcome of a file reception. When files are received
+ * concurrently, the whole report is printed at once so that lines from
+ * different connections don't get mixed. The outcome is counted by the
+ * metrics, and if tracing is enabled, the file trace is written and the
+ * one of the next file of a session started.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ * @param done Whether the file was received successfully
+ *
+ * @return No return
+ **/
+void print_file_outcome(const server_data* server_data, connection_data* connection_data, bool done) {
+    if (server_data->event_loop || server_data->workers > 1) {
+        print_msg(
+            "Receiving file \"%s\" containing %ld bytes... %s\n",
+            connection_data->file_path,
+            connection_data->file_size,
+            done ? "done" : "error"
+        );
+    } else {
+        print_msg(done ? " done\n" : " error\n");
+    }
+    fflush(stdout);
+    metrics_count_file(
+        done ? METRICS_FILE_ACCEPTED :
+        connection_data->admission != PROTOCOL_ADMISSION_ACCEPTED ? METRICS_FILE_REJECTED : METRICS_FILE_NACKED,
+        connection_data->received_bytes,
+        connection_data->header_time_ns);
+    PROBE3(file_reply, connection_data, connection_data->file_path, done);
+    trace_end(
+        &connection_data->trace,
+        "server",
+        connection_data->file_path,
+        connection_data->file_size,
+        connection_data->received_bytes,
+        done);
+    trace_begin(&connection_data->trace);
+    PROBE1(file_start, connection_data);
+}
+
+/**
+ * @brief Keeps receiving files from the listening socket.
+ *
+ * @param server_data The server internal data
+ *
+ * @return No return
+ **/
+void serve(const server_data* server_data) {
+    if (server_data->event_loop) {
+        run_event_loop(server_data);
+    } else {
+        bool keep_running = true;
+        while (keep_running) {
+            receive_file(server_data);
+        }
+    }
+}
+
+/**
+ * @brief Starts the worker threads and waits for them. Each worker has its
+ * own listening socket bound to the same address, so the kernel spreads
+ * incoming connections among them, and serves its connections independently.
+ *
+ * @param server_data The server internal data
+ *
+ * @return true if all workers were started
+ * @return false otherwise
+ **/
+bool run_workers(const server_data* server_data) {
+    worker_data* workers = calloc(server_data->workers, sizeof(*workers));
+    if (workers == NULL) {
+        set_error_description("Out of memory");
+        print_error("Starting workers failed");
+        return false;
+    }
+
+    const int cpu_count = sal_get_cpu_count();
+    int started = 0;
+    for (int i = 0; i < server_data->workers; ++i) {
+        worker_data* worker = &workers[i];
+        worker->server_data = *server_data;
+        worker->server_data.listen_sock = NULL;
+        worker->cpu = server_data->pin_cpus ? i % cpu_count : -1;
+        if (!start_listening(&worker->server_data)) {
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+            reset_error_description();
+            print_error("Starting worker failed");
+            stop_listening(&worker->server_data);
+            sal_destroy_socket(worker->server_data.listen_sock);
+            break;
+        }
+        ++started;
+    }
+    if (started < server_data->workers) {
+        set_error_description("%d of %d", started, server_data->workers);
+        print_warning("Not all workers were started");
+    }
+
+    for (int i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        stop_listening(&workers[i].server_data);
+        sal_destroy_socket(workers[i].server_data.listen_sock);
+    }
+    free(workers);
+    return started == server_data->workers;
+}
+
+/**
+ * @brief Worker thread entry point.
+ *
+ * @param arg The worker data
+ *
+ * @return No return
+ **/
+void* run_worker(void* arg) {
+    worker_data* worker = arg;
+    if (worker->cpu >= 0) {
+        sal_set_thread_affinity(worker->cpu);
+    }
+    serve(&worker->server_data);
+    return NULL;
+}
+
+/**
+ * @brief Serves all connections from a single thread, waiting for socket
+ * readiness instead of blocking on any of them. Each connection progresses
+ * through its own state machine (header, content, reply) as data arrives.
+ *
+ * @param server_data The server internal data
+ *
+ * @return No return
+ **/
+void run_event_loop(const server_data* server_data) {
+    event_loop loop = {0};
+    if ((loop.poller = sal_create_poller()) == NULL) {
+        return;
+    }
+    if (sal_set_nonblocking(server_data->listen_sock) != SAL_OK ||
+        sal_poller_add(loop.poller, server_data->listen_sock, SAL_POLL_IN, NULL) != SAL_OK) {
+        sal_destroy_poller(loop.poller);
+        return;
+    }
+
+    sal_poll_event_t events[EVENT_LOOP_MAX_EVENTS];
+    bool keep_running = true;
+    while (keep_running) {
+        int ready = sal_poller_wait(loop.poller, events, EVENT_LOOP_MAX_EVENTS, get_event_loop_timeout(server_data, &loop));
+        if (ready < 0) {
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].user_data == NULL) {
+                if (accept_connections(server_data, &loop) == SAL_NO_DESCRIPTORS) {
+                    pause_accepting(server_data, &loop);
+                }
+            } else {
+                serve_connection(server_data, &loop, events[i].user_data, events[i].events);
+            }
+        }
+        drop_idle_connections(server_data, &loop);
+        if (loop.accept_resume_ns != 0 && sal_get_time_ns(SAL_CLOCK_MONOTONIC) >= loop.accept_resume_ns &&
+            sal_poller_add(loop.poller, server_data->listen_sock, SAL_POLL_IN, NULL) == SAL_OK) {
+            loop.accept_resume_ns = 0;
+        }
+    }
+    sal_destroy_poller(loop.poller);
+}
+
+/**
+ * @brief Accepts all pending connections and registers them on the poller.
+ *
+ * @param server_data The server internal data
+ * @param loop The event loop
+ *
+ * @return SAL_WOULD_BLOCK once no connection is pending
+ * @return SAL_NO_DESCRIPTORS if file descriptors ran out
+ * @return SAL_ERROR otherwise
+ **/
+sal_ret accept_connections(const server_data* server_data, event_loop* loop) {
+    sal_socket_t socket = NULL;
+    sal_ret ret = SAL_OK;
+    while ((ret = sal_try_accept(server_data->listen_sock, &socket)) == SAL_OK) {
+        connection_data* connection_data = calloc(1, sizeof(*connection_data));
+        uint8_t* rx_buffer = malloc(TLV_BUFFER_LEN);
+        tlv_arena_t* arena = acquire_tlv_arena();
+        if (connection_data == NULL || rx_buffer == NULL || arena == NULL) {
+            set_error_description("Out of memory");
+            print_error("Accept failed");
+            free(connection_data);
+            free(rx_buffer);
+            release_tlv_arena(arena);
+            sal_close(socket);
+            sal_destroy_socket(socket);
+            continue;
+        }
+        init_connection(connection_data, socket);
+        metrics_add_connections(1);
+        connection_data->rx_buffer = rx_buffer;
+        connection_data->arena = arena;
+        connection_data->poll_events = SAL_POLL_IN;
+        if (sal_poller_add(loop->poller, socket, connection_data->poll_events, connection_data) != SAL_OK) {
+            release_connection(server_data, NULL, connection_data);
+            continue;
+        }
+        touch_connection(loop, connection_data);
+    }
+    return ret;
+}
+
+/**
+ * @brief Stops watching the listening socket for a while, once file
+ * descriptors ran out: the pending connections keep it readable, so the
+ * event loop would otherwise spin failing to accept them.
+ *
+ * @param server_data The server internal data
+ * @param loop The event loop
+ *
+ * @return No return
+ **/
+void pause_accepting(const server_data* server_data, event_loop* loop) {
+    if (sal_poller_remove(loop->poller, server_data->listen_sock) == SAL_OK) {
+        loop->accept_resume_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC) + ACCEPT_BACKOFF_MS * 1000000ULL;
+    }
+}
+
+/**
+ * @brief Gets how long the event loop may wait for ready sockets: until the
+ * least recently ready connection gets idle, or accepting resumes.
+ *
+ * @param server_data The server internal data
+ * @param loop The event loop
+ *
+ * @return the waiting time in milliseconds, -1 to wait forever
+ **/
+int get_event_loop_timeout(const server_data* server_data, const event_loop* loop) {
+    uint64_t deadline_ns = loop->accept_resume_ns;
+    if (server_data->idle_timeout_ms > 0 && loop->oldest) {
+        const uint64_t idle_ns = loop->oldest->active_ns + server_data->idle_timeout_ms * 1000000ULL;
+        deadline_ns = deadline_ns == 0 ? idle_ns : MIN(deadline_ns, idle_ns);
+    }
+    if (deadline_ns == 0) {
+        return -1;
+    }
+    const uint64_t now_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC);
+    /* Rounded up, not to wake up just before the deadline */
+    return deadline_ns > now_ns ? (int)((deadline_ns - now_ns + 999999) / 1000000) : 0;
+}
+
+/**
+ * @brief Records that a connection is ready, moving it to the end of the
+ * connections dropped once idle.
+ *
+ * @param loop The event loop
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void touch_connection(event_loop* loop, connection_data* connection_data) {
+    connection_data->active_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC);
+    if (loop->newest == connection_data) {
+        return;
+    }
+    if (connection_data->older) {
+        connection_data->older->newer = connection_data->newer;
+    } else if (loop->oldest == connection_data) {
+        loop->oldest = connection_data->newer;
+    }
+    if (connection_data->newer) {
+        connection_data->newer->older = connection_data->older;
+    }
+    connection_data->older = loop->newest;
+    connection_data->newer = NULL;
+    if (loop->newest) {
+        loop->newest->newer = connection_data;
+    } else {
+        loop->oldest = connection_data;
+    }
+    loop->newest = connection_data;
+}
+
+/**
+ * @brief Drops the connections of clients that stayed silent for longer
+ * than the idle timeout, so that stalled clients don't hold their file
+ * descriptor and staging file forever.
+ *
+ * @param server_data The server internal data
+ * @param loop The event loop
+ *
+ * @return No return
+ **/
+void drop_idle_connections(const server_data* server_data, event_loop* loop) {
+    if (server_data->idle_timeout_ms <= 0) {
+        return;
+    }
+    const uint64_t now_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC);
+    while (loop->oldest && now_ns - loop->oldest->active_ns >= server_data->idle_timeout_ms * 1000000ULL) {
+        set_error_description("Silent for %d ms", server_data->idle_timeout_ms);
+        print_error("Connection dropped");
+        release_connection(server_data, loop, loop->oldest);
+    }
+}
+
+/**
+ * @brief Receives the data available on a connection and processes every
+ * complete TLV in it.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if the connection is still usable
+ * @return false if it was closed or failed
+ **/
+bool receive_connection_data(const server_data* server_data, connection_data* connection_data) {
+    /* A partial TLV reached the buffer end, so move it to the beginning to make room for the rest */
+    if (connection_data->rx_end == TLV_BUFFER_LEN) {
+        memmove(
+            connection_data->rx_buffer,
+            connection_data->rx_buffer + connection_data->rx_start,
+            connection_data->rx_end - connection_data->rx_start);
+        connection_data->rx_end -= connection_data->rx_start;
+        connection_data->rx_start = 0;
+    }
+
+    size_t received = 0;
+    switch (sal_try_receive_msg(
+        connection_data->socket,
+        connection_data->rx_buffer + connection_data->rx_end,
+        TLV_BUFFER_LEN - connection_data->rx_end,
+        &received)) {
+    case SAL_OK:
+        break;
+    case SAL_WOULD_BLOCK:
+        return true;
+    case SAL_CONNECTION_CLOSED:
+        /* Sessions end this way after their last file */
+        if ((connection_data->state == CONNECTION_STATE_HEADER &&
+             (connection_data->files == 0 || connection_data->rx_start != connection_data->rx_end)) ||
+            connection_data->state == CONNECTION_STATE_CONTENT) {
+            set_error_description("Connection closed by peer");
+            print_error("Received failed");
+        }
+        return false;
+    default:
+        return false;
+    }
+    connection_data->rx_end += received;
+    process_connection_data(server_data, connection_data);
+    return true;
+}
+
+/**
+ * @brief Processes every complete TLV already received on a connection.
+ * File content TLVs are processed as their value arrives, so they may be
+ * longer than the receive buffer.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void process_connection_data(const server_data* server_data, connection_data* connection_data) {
+    while (connection_data->state == CONNECTION_STATE_HEADER ||
+           connection_data->state == CONNECTION_STATE_CONTENT) {
+        uint8_t* data = connection_data->rx_buffer + connection_data->rx_start;
+        size_t available = connection_data->rx_end - connection_data->rx_start;
+        tlv_t tlv = {0};
+        content_status status = CONTENT_PENDING;
+
+        if (connection_data->content_remaining > 0) {
+            if (available == 0) {
+                break;
+            }
+            tlv.type = TLV_TYPE_FILE_CONTENT;
+            tlv.length = MIN(available, connection_data->content_remaining);
+            tlv.buffer = data;
+            connection_data->rx_start += tlv.length;
+            connection_data->content_remaining -= tlv.length;
+            status = process_file_content(connection_data, &tlv);
+        } else {
+            size_t header_length = parse_tlv_header(data, available, &tlv);
+            if (header_length == 0) {
+                break;
+            }
+            if (!is_valid_frame(connection_data, &tlv)) {
+                if (connection_data->state == CONNECTION_STATE_HEADER) {
+                    connection_data->state = CONNECTION_STATE_DONE;
+                    break;
+                }
+                status = CONTENT_INVALID;
+            } else if (connection_data->state == CONNECTION_STATE_CONTENT &&
+                       get_tlv_type(&tlv) == TLV_TYPE_FILE_CONTENT) {
+                connection_data->rx_start += header_length;
+                connection_data->content_remaining = get_tlv_length(&tlv);
+                PROBE2(frame_received, get_tlv_type(&tlv), get_tlv_length(&tlv));
+                continue;
+            } else if (available < header_length + get_tlv_length(&tlv)) {
+                break;
+            } else {
+                connection_data->rx_start += header_length + get_tlv_length(&tlv);
+                PROBE2(frame_received, get_tlv_type(&tlv), get_tlv_length(&tlv));
+                if (connection_data->state == CONNECTION_STATE_CONTENT) {
+                    status = process_file_content(connection_data, &tlv);
+                } else if (get_tlv_type(&tlv) == TLV_TYPE_HELLO) {
+                    if (!process_hello(server_data, connection_data, &tlv)) {
+                        connection_data->state = CONNECTION_STATE_DONE;
+                    } else {
+                        tlv_t tlv_hello = new_hello_tlv(connection_data->arena, &connection_data->protocol);
+                        queue_tlv(connection_data, &tlv_hello);
+                        reset_tlv_arena(connection_data->arena);
+                    }
+                    continue;
+                } else if (!parse_header(server_data, connection_data, &tlv)) {
+                    connection_data->state = CONNECTION_STATE_DONE;
+                    continue;
+                } else if (!open_file_content(server_data, connection_data)) {
+                    status = CONTENT_INVALID;
+                } else {
+                    if (has_admission(connection_data)) {
+                        tlv_t tlv_admission = new_admission_tlv(connection_data);
+                        queue_tlv(connection_data, &tlv_admission);
+                        reset_tlv_arena(connection_data->arena);
+                    }
+                    if (connection_data->resume) {
+                        tlv_t tlv_offset = new_resume_offset_tlv(connection_data);
+                        queue_tlv(connection_data, &tlv_offset);
+                        reset_tlv_arena(connection_data->arena);
+                    }
+                    /* The block signatures are queued by send_connection_data() as the replies drain */
+                    if (connection_data->delta) {
+                        queue_delta_basis(connection_data);
+                    }
+                    if (status == CONTENT_PENDING) {
+                        connection_data->state = CONNECTION_STATE_CONTENT;
+                        continue;
+                    }
+                }
+            }
+        }
+
+        /* Rejected files are neither opened nor written, so their journal still holds */
+        if (status != CONTENT_PENDING && connection_data->resume &&
+            connection_data->admission == PROTOCOL_ADMISSION_ACCEPTED) {
+            journal_remove(connection_data->file_path);
+            connection_data->journaled = false;
+        }
+        if (status != CONTENT_PENDING) {
+            status = finish_file_content(connection_data, finish_file_range(server_data, connection_data, status));
+        }
+        switch (status) {
+        case CONTENT_PENDING:
+            break;
+        case CONTENT_VALID:
+            close_file_content(connection_data);
+            queue_reply(connection_data, TLV_TYPE_ACK);
+            break;
+        case CONTENT_INVALID:
+        case CONTENT_INTERRUPTED:
+            close_file_content(connection_data);
+            if (has_admission(connection_data) && connection_data->admission != PROTOCOL_ADMISSION_ACCEPTED) {
+                queue_rejection(connection_data);
+            } else {
+                queue_reply(connection_data, TLV_TYPE_NACK);
+            }
+            break;
+        }
+        if (status != CONTENT_PENDING && (connection_data->protocol.capabilities & PROTOCOL_CAPABILITY_SESSION) &&
+            connection_data->stream_count <= 1) {
+            finish_session_file(server_data, connection_data);
+        }
+    }
+    if (connection_data->rx_start == connection_data->rx_end) {
+        connection_data->rx_start = 0;
+        connection_data->rx_end = 0;
+    }
+}
+
+/**
+ * @brief Appends a TLV built on the connection arena to the pending replies.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param tlv The TLV to be sent
+ *
+ * @return No return
+ **/
+void queue_tlv(connection_data* connection_data, const tlv_t* tlv) {
+    queue_data(connection_data, get_tlv_data(tlv), get_tlv_data_length(tlv));
+}
+
+/**
+ * @brief Appends encoded TLVs to the pending replies, growing the room for
+ * them if needed, e.g. for the block signatures of a delta transfer.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param data The encoded TLVs
+ * @param length The encoded TLVs length
+ *
+ * @return No return
+ **/
+void queue_data(connection_data* connection_data, const uint8_t* data, const size_t length) {
+    if (connection_data->tx_length + length > connection_data->tx_capacity) {
+        const size_t capacity = MAX(connection_data->tx_length + length, CONNECTION_TX_BUFFER_LEN);
+        uint8_t* tx_buffer = realloc(connection_data->tx_buffer, capacity);
+        if (tx_buffer == NULL) {
+            print_warning("Reply dropped");
+            return;
+        }
+        connection_data->tx_buffer = tx_buffer;
+        connection_data->tx_capacity = capacity;
+    }
+    memcpy(connection_data->tx_buffer + connection_data->tx_length, data, length);
+    connection_data->tx_length += length;
+}
+
+/**
+ * @brief Sends the pending replies at once, when connections are served by
+ * blocking threads, and releases the room they took.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if the pending replies were sent successfully
+ * @return false otherwise
+ **/
+bool flush_replies(connection_data* connection_data) {
+    if (connection_data->tx_length == 0) {
+        return true;
+    }
+    const bool sent = sal_send_msg(connection_data->socket, connection_data->tx_buffer, connection_data->tx_length) == SAL_OK;
+    free(connection_data->tx_buffer);
+    connection_data->tx_buffer = NULL;
+    connection_data->tx_capacity = 0;
+    connection_data->tx_length = 0;
+    return sent;
+}
+
+/**
+ * @brief Prepares the ACK/NACK reply to be sent once the socket is writable.
+ *
+ * @param connection_data The connection-specific internal data
+ * @param type The reply type (TLV_TYPE_ACK or TLV_TYPE_NACK)
+ *
+ * @return No return
+ **/
+void queue_reply(connection_data* connection_data, const tlv_type type) {
+    connection_data->reply = type;
+    tlv_t tlv_reply = new_tlv(connection_data->arena, type, 0);
+    queue_tlv(connection_data, &tlv_reply);
+    reset_tlv_arena(connection_data->arena);
+    connection_data->state = CONNECTION_STATE_REPLY;
+}
+
+/**
+ * @brief Prepares the rejection of a file to be sent once the socket is
+ * writable. It stands for the NACK reply, as the client sends no content.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void queue_rejection(connection_data* connection_data) {
+    connection_data->reply = TLV_TYPE_NACK;
+    tlv_t tlv_admission = new_admission_tlv(connection_data);
+    queue_tlv(connection_data, &tlv_admission);
+    reset_tlv_arena(connection_data->arena);
+    connection_data->state = CONNECTION_STATE_REPLY;
+}
+
+/**
+ * @brief Reports the outcome of a file received on a session and waits for
+ * the next header. Its reply is sent along with the following ones, as
+ * clients keep sending files ahead of their replies.
+ *
+ * @param server_data The server internal data
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void finish_session_file(const server_data* server_data, connection_data* connection_data) {
+    ++connection_data->files;
+    print_file_outcome(server_data, connection_data, connection_data->reply == TLV_TYPE_ACK);
+    connection_data->reply = 0;
+    connection_data->state = CONNECTION_STATE_HEADER;
+}
+
+/**
+ * @brief Sends as much of the pending replies as the socket accepts. Once they
+ * are all sent, the next batch of block signatures of a delta transfer is
+ * queued, a single one per call so that other connections are served in between.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return true if the connection is still usable
+ * @return false if it failed
+ **/
+bool send_connection_data(connection_data* connection_data) {
+    while (connection_data->tx_offset < connection_data->tx_length) {
+        size_t sent = 0;
+        switch (sal_try_send_msg(
+            connection_data->socket,
+            connection_data->tx_buffer + connection_data->tx_offset,
+            connection_data->tx_length - connection_data->tx_offset,
+            &sent)) {
+        case SAL_OK:
+            connection_data->tx_offset += sent;
+            break;
+        case SAL_WOULD_BLOCK:
+            return true;
+        default:
+            return false;
+        }
+    }
+    connection_data->tx_offset = 0;
+    connection_data->tx_length = 0;
+    if (connection_data->state == CONNECTION_STATE_CONTENT && connection_data->delta &&
+        connection_data->signed_blocks < connection_data->block_count) {
+        return queue_delta_signatures(connection_data);
+    }
+    /* Room grown for block signatures is not kept for the usual short replies */
+    if (connection_data->tx_capacity > CONNECTION_TX_BUFFER_LEN) {
+        free(connection_data->tx_buffer);
+        connection_data->tx_buffer = NULL;
+        connection_data->tx_capacity = 0;
+    }
+    if (connection_data->state == CONNECTION_STATE_REPLY) {
+        connection_data->state = CONNECTION_STATE_DONE;
+    }
+    return true;
+}
+
+/**
+ * @brief Drives a connection state machine on socket readiness.
+ *
+ * @param server_data The server internal data
+ * @param loop The event loop
+ * @param connection_data The connection-specific internal data
+ * @param events The ready events (SAL_POLL_* flags)
+ *
+ * @return No return
+ **/
+void serve_connection(
+    const server_data* server_data,
+    event_loop* loop,
+    connection_data* connection_data,
+    const uint32_t events) {
+    bool usable = true;
+    touch_connection(loop, connection_data);
+    /* The thread work is collected per connection, as the thread serves them all */
+    trace_resume(&connection_data->trace);
+    if (events & (SAL_POLL_IN | SAL_POLL_ERROR)) {
+        usable = receive_connection_data(server_data, connection_data);
+    }
+    if (usable && connection_data->tx_length > 0) {
+        usable = send_connection_data(connection_data);
+    }
+    if (usable && connection_data->state != CONNECTION_STATE_DONE) {
+        /* Waits for writability only while replies are pending, and stops reading once the file was processed */
+        uint32_t poll_events = connection_data->state == CONNECTION_STATE_REPLY ? 0 : SAL_POLL_IN;
+        if (connection_data->tx_length > 0) {
+            poll_events |= SAL_POLL_OUT;
+        }
+        if (poll_events != connection_data->poll_events) {
+            connection_data->poll_events = poll_events;
+            usable = sal_poller_modify(loop->poller, connection_data->socket, poll_events, connection_data) == SAL_OK;
+        }
+    }
+    trace_collect(&connection_data->trace);
+    if (!usable || connection_data->state == CONNECTION_STATE_DONE) {
+        release_connection(server_data, loop, connection_data);
+    }
+}
+
+/**
+ * @brief Reports the connection outcome and releases all its resources.
+ *
+ * @param server_data The server internal data
+ * @param loop The event loop, or NULL if connection was not registered
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void release_connection(const server_data* server_data, event_loop* loop, connection_data* connection_data) {
+    if (connection_data->state == CONNECTION_STATE_CONTENT || connection_data->reply) {
+        print_file_outcome(
+            server_data,
+            connection_data,
+            connection_data->state == CONNECTION_STATE_DONE && connection_data->reply == TLV_TYPE_ACK);
+    }
+    /* The connection failed while file content was still expected */
+    if (connection_data->state == CONNECTION_STATE_CONTENT && connection_data->resume) {
+        save_journal(connection_data);
+    }
+    if (connection_data->state == CONNECTION_STATE_CONTENT) {
+        finish_file_range(server_data, connection_data, CONTENT_INTERRUPTED);
+    }
+    finish_file_content(connection_data, CONTENT_INTERRUPTED);
+    if (loop) {
+        sal_poller_remove(loop->poller, connection_data->socket);
+        if (connection_data->older) {
+            connection_data->older->newer = connection_data->newer;
+        } else {
+            loop->oldest = connection_data->newer;
+        }
+        if (connection_data->newer) {
+            connection_data->newer->older = connection_data->older;
+        } else {
+            loop->newest = connection_data->older;
+        }
+    }
+    sal_close(connection_data->socket);
+    sal_destroy_socket(connection_data->socket);
+    free(connection_data->rx_buffer);
+    free(connection_data->tx_buffer);
+    release_tlv_arena(connection_data->arena);
+    free(connection_data);
+    metrics_add_connections(-1);
+}
+
+/**
+ * @brief Replies that file was received successfully.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void send_ack(connection_data* connection_data) {
+    tlv_t tlv_content = new_tlv(connection_data->arena, TLV_TYPE_ACK, 0);
+    if (!send_tlv_data(connection_data->socket, &tlv_content)) {
+        print_warning("Ack reply failed");
+    }
+    reset_tlv_arena(connection_data->arena);
+}
+
+/**
+ * @brief Replies that file was not received successfully.
+ *
+ * @param connection_data The connection-specific internal data
+ *
+ * @return No return
+ **/
+void send_nack(connection_data* connection_data) {
+    tlv_t tlv_content = new_tlv(connection_data->arena, TLV_TYPE_NACK, 0);
+    if (!send_tlv_data(connection_data->socket, &tlv_content)) {
+        print_warning("Nack reply failed");
+    }
+    reset_tlv_arena(connection_data->arena);
+}
+
+/**
+ * @brief Parses input arguments and validate them.
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments values
+ * @param[out] data The server internal data
+ *
+ * @return true if given arguments are valid
+ * @return false otherwise
+ **/
+bool parse_input(const int argc, const char** argv, server_data* data) {
+    if (argc < 4) {
+        return false;
+    }
+    data->idle_timeout_ms = CONNECTION_IDLE_TIMEOUT_MS;
+    for (int i = 4; i < argc; ++i) {
+        if (strcmp(argv[i], "--event-loop") == 0) {
+            data->event_loop = true;
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            data->workers = atoi(argv[++i]);
+            if (data->workers < 0) {
+                set_error_description("%d", data->workers);
+                print_error("Invalid worker count");
+                return false;
+            } else if (data->workers == 0) {
+                data->workers = sal_get_cpu_count();
+            }
+        } else if (strcmp(argv[i], "--pin-cpus") == 0) {
+            data->pin_cpus = true;
+        } else if (strcmp(argv[i], "--splice") == 0) {
+            data->splice = true;
+        } else if (strcmp(argv[i], "--digest-thread") == 0) {
+            data->digest_thread = true;
+        } else if (strcmp(argv[i], "--chunk-store") == 0) {
+            data->chunk_store = true;
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            data->io_uring = true;
+        } else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) {
+            data->metrics_port = atoi(argv[++i]);
+            if (data->metrics_port <= 0 || data->metrics_port > 65535) {
+                set_error_description("%d", data->metrics_port);
+                print_error("Invalid metrics port");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc) {
+            const int seconds = atoi(argv[++i]);
+            if (seconds < 0 || seconds > INT_MAX / 1000) {
+                set_error_description("%d", seconds);
+                print_error("Invalid idle timeout");
+                return false;
+            }
+            data->idle_timeout_ms = seconds * 1000;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            if (!trace_open(argv[++i])) {
+                return false;
+            }
+        } else {
+            set_error_description("%s", argv[i]);
+            print_error("Invalid option");
+            return false;
+        }
+    }
+    if (data->splice && data->event_loop) {
+        set_error_description("--splice and --event-loop");
+        print_error("Incompatible options");
+        return false;
+    }
+    if (data->digest_thread && (data->event_loop || data->splice)) {
+        set_error_description("--digest-thread and %s", data->event_loop ? "--event-loop" : "--splice");
+        print_error("Incompatible options");
+        return false;
+    }
+    if (data->chunk_store && (data->splice || data->digest_thread)) {
+        set_error_description("--chunk-store and %s", data->splice ? "--splice" : "--digest-thread");
+        print_error("Incompatible options");
+        return false;
+    }
+
+    if (data->io_uring && (data->event_loop || data->splice || data->digest_thread)) {
+        set_error_description(
+            "--io-uring and %s",
+            data->event_loop ? "--event-loop" : data->splice ? "--splice" : "--digest-thread");
+        print_error("Incompatible options");
+        return false;
+    }
+    if (data->io_uring) {
+        /* Kernels or builds without io_uring are reported before serving anything */
+        sal_ring_t ring = sal_create_ring(1, 0);
+        if (ring == NULL) {
+            return false;
+        }
+        sal_destroy_ring(ring);
+    }
+
+    const char* storage_dir = argv[1];
+    switch (sal_is_dir_writable(storage_dir)) {
+    case SAL_DIR_NOT_FOUND:
+        set_error_description("%s", storage_dir);
+        print_error("Storage directory not found");
+        return false;
+        break;
+    case SAL_DIR_NOT_WRITABLE:
+        set_error_description("%s", storage_dir);
+        print_error("Storage directory is not writable");
+        return false;
+        break;
+    default:
+        break;
+    }
+
+    struct in_addr server_ip_addr = {0};
+    if (inet_aton(argv[2], &server_ip_addr) == 0) {
+        set_error_description("%s", argv[2]);
+        print_error("Invalid listening IP");
+        return false;
+    }
+
+    const int server_port = atoi(argv[3]);
+    if ((server_port <= 0) || (server_port > 65535)) {
+        set_error_description("%d", server_port);
+        print_error("Invalid listening port");
+        return false;
+    }
+
+    char staging_dir[STAGING_PATH_LEN];
+    snprintf(staging_dir, sizeof(staging_dir), "%s/%s", storage_dir, STAGING_DIR);
+    if (sal_create_dir(staging_dir) != SAL_OK) {
+        return false;
+    }
+    if (data->chunk_store && !chunk_store_init(storage_dir)) {
+        return false;
+    }
+    if (data->metrics_port > 0 && !metrics_start(data->metrics_port)) {
+        return false;
+    }
+
+    data->storage_dir = strdup(storage_dir);
+    data->addr.sin_addr = server_ip_addr;
+    data->addr.sin_port = htons(server_port);
+    data->addr.sin_family = AF_INET;
+
+    return (data->transfers = transfer_registry_create()) != NULL;
+}
+
+/**
+ * @brief Releases server internal data.
+ *
+ * @param data The server internal data
+ *
+ * @return true if given arguments are valid
+ * @return false otherwise
+ **/
+void release_server_data(server_data* data) {
+    if (data->listen_sock) {
+        stop_listening(data);
+        sal_destroy_socket(data->listen_sock);
+        data->listen_sock = NULL;
+    }
+    if (data->storage_dir) {
+        free(data->storage_dir);
+        data->storage_dir = NULL;
+    }
+    transfer_registry_destroy(data->transfers);
+    data->transfers = NULL;
+    trace_close();
+}
+
+/**
+ * @brief Creates a listening socket for receiving connection requests.
+ *
+ * @param server_data The server internal data
+ *
+ * @return true if given arguments are valid
+ * @return false otherwise
+ **/
+bool start_listening(server_data* data) {
+    if ((data->listen_sock = sal_create_socket()) == NULL) {
+        return false;
+    }
+
+    if (data->workers > 0 && sal_set_reuse_port(data->listen_sock) != SAL_OK) {
+        goto RELEASE_SOCKET;
+    }
 
     if ((sal_bind(data->listen_sock, &data->addr)) != SAL_OK) {
         goto RELEASE_SOCKET;
     }
 
-    if (sal_listen(data->listen_sock, CONNECTION_QUEUE_SIZE) != 0) {
+    const int connection_queue_size = data->event_loop ? EVENT_LOOP_CONNECTION_QUEUE_SIZE : CONNECTION_QUEUE_SIZE;
+    if (sal_listen(data->listen_sock, connection_queue_size) != 0) {
         goto RELEASE_SOCKET;
     }
     return true;
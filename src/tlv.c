@@ -4,54 +4,78 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h> //malloc
+#include <pthread.h>
 
 #include "tlv.h"
 #include "sal.h"
-
-#define TLV_BUFFER_LEN (TLV_HEADER_LENGTH + TLV_MAX_VALUE_LENGTH)
+#include "probes.h"
+#include "common.h"
 
 /**
- * @brief The internal buffer for TLVs.
+ * @brief The storage TLVs are built and received on. Resetting it only moves
+ * its offset back, as TLVs are always written before being read.
  **/
-static uint16_t tlv_buffer_offset = 0;
+struct Stlv_arena {
+    size_t offset; ///< the offset of the first free byte of buffer
+    struct Stlv_arena* next; ///< the next arena of the pool, while released
+    uint8_t buffer[TLV_BUFFER_LEN]; ///< the built and received TLVs
+};
 
-/**
- * @brief Gets the internal TLV buffer.
- *
- * @returns the internal TLV buffer
- **/
-static uint8_t* get_tlv_buffer() {
-    static uint8_t tlv_buffer[TLV_BUFFER_LEN] = {0};
-    return tlv_buffer;
-}
+static tlv_arena_t* arena_pool = NULL; ///< the released arenas, reused before allocating new ones
+static pthread_mutex_t arena_pool_mutex = PTHREAD_MUTEX_INITIALIZER; ///< guards the pool, shared by all threads
 
 /**
- * @brief Gets the internal TLV buffer offset.
+ * @brief Takes an arena from the pool, or allocates one if the pool is empty.
+ * @note The arena shall be released by release_tlv_arena().
  *
- * @returns the internal TLV buffer offset
+ * @return the arena, empty
+ * @return NULL otherwise
  **/
-static uint16_t get_tlv_buffer_offset() {
-    return tlv_buffer_offset;
+tlv_arena_t* acquire_tlv_arena() {
+    pthread_mutex_lock(&arena_pool_mutex);
+    tlv_arena_t* arena = arena_pool;
+    if (arena) {
+        arena_pool = arena->next;
+    }
+    pthread_mutex_unlock(&arena_pool_mutex);
+    if (arena == NULL && (arena = malloc(sizeof(*arena))) == NULL) {
+        set_error_description("Out of memory");
+        print_error("Allocating TLV arena failed");
+        return NULL;
+    }
+    arena->offset = 0;
+    arena->next = NULL;
+    return arena;
 }
 
 /**
- * @brief Increases the internal TLV buffer offset.
+ * @brief Returns an arena to the pool, for another connection to reuse it.
  *
- * @param inc The increment value
+ * @param arena The arena, may be NULL
  *
  * @return No return
  **/
-static void increase_sending_tlv_buffer_offset(uint16_t inc) {
-    tlv_buffer_offset += inc;
+void release_tlv_arena(tlv_arena_t* arena) {
+    if (arena == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&arena_pool_mutex);
+    arena->next = arena_pool;
+    arena_pool = arena;
+    pthread_mutex_unlock(&arena_pool_mutex);
 }
 
 /**
- * @brief Resets the internal TLV buffer offset.
+ * @brief Releases all TLVs built or received on an arena, which are no
+ * longer valid afterwards.
+ *
+ * @param arena The arena
  *
  * @return No return
  **/
-static void reset_sending_tlv_buffer_offset() {
-    tlv_buffer_offset = 0;
+void reset_tlv_arena(tlv_arena_t* arena) {
+    arena->offset = 0;
 }
 
 /**
@@ -72,25 +96,122 @@ uint16_t get_tlv_type(const tlv_t* tlv) {
  *
  * @return The TLV length (length of Value field).
  **/
-uint16_t get_tlv_length(const tlv_t* tlv) {
+uint64_t get_tlv_length(const tlv_t* tlv) {
     return tlv->length;
 }
 
 /**
- * @brief Set the TLV header on internal buffer and increment its offset.
+ * @brief Gets the encoded TLV (header and value) built by new_tlv().
+ *
+ * @param tlv The given TLV
+ *
+ * @return pointer to the encoded TLV
+ **/
+const uint8_t* get_tlv_data(const tlv_t* tlv) {
+    return tlv->buffer - TLV_HEADER_LENGTH;
+}
+
+/**
+ * @brief Gets the encoded TLV length (header and value).
+ *
+ * @param tlv The given TLV
+ *
+ * @return the encoded TLV length
+ **/
+size_t get_tlv_data_length(const tlv_t* tlv) {
+    return TLV_HEADER_LENGTH + get_tlv_length(tlv);
+}
+
+/**
+ * @brief Encodes a TLV header (type and length) on a given buffer.
  *
+ * @param[out] buffer The buffer with at least TLV_HEADER_LENGTH bytes
  * @param type The TLV type
  * @param length The TLV length
  *
- * @return The new TLV.
+ * @return No return
  **/
-tlv_t new_tlv(const uint16_t type, const uint16_t length) {
-    uint16_t offset = get_tlv_buffer_offset();
-    uint8_t* buffer = get_tlv_buffer() + offset;
+void write_tlv_header(uint8_t* buffer, const uint16_t type, const uint16_t length) {
     buffer[0] = (type >> 8) & 0xFF;
     buffer[1] = (type >> 0) & 0xFF;
     buffer[2] = (length >> 8) & 0xFF;
     buffer[3] = (length >> 0) & 0xFF;
+}
+
+/**
+ * @brief Encodes the header of a TLV whose value is streamed instead of built
+ * on an arena. Values that don't fit on 2 bytes get an extended
+ * header, which is only understood by protocol version 2 peers.
+ *
+ * @param[out] buffer The buffer with at least TLV_EXTENDED_HEADER_LENGTH bytes
+ * @param type The TLV type
+ * @param length The TLV length
+ *
+ * @return the header length
+ **/
+size_t write_tlv_stream_header(uint8_t* buffer, const uint16_t type, const uint64_t length) {
+    if (length <= TLV_MAX_VALUE_LENGTH) {
+        write_tlv_header(buffer, type, length);
+        return TLV_HEADER_LENGTH;
+    }
+    const uint16_t extended_type = type | TLV_TYPE_EXTENDED_FLAG;
+    buffer[0] = (extended_type >> 8) & 0xFF;
+    buffer[1] = (extended_type >> 0) & 0xFF;
+    for (int i = 0; i < sizeof(length); ++i) {
+        buffer[2 + i] = (length >> ((sizeof(length) - i - 1) * 8)) & 0xFF;
+    }
+    return TLV_EXTENDED_HEADER_LENGTH;
+}
+
+/**
+ * @brief Parses a TLV header, either standard or extended, from a buffer
+ * that may not hold the whole header yet.
+ *
+ * @param buffer The buffer to be parsed
+ * @param available The amount of bytes available on buffer
+ * @param[out] tlv The parsed TLV, whose value starts right after the header
+ *
+ * @return the header length
+ * @return 0 if more bytes are needed to parse the header
+ **/
+size_t parse_tlv_header(const uint8_t* buffer, const size_t available, tlv_t* tlv) {
+    if (available < TLV_HEADER_LENGTH) {
+        return 0;
+    }
+    const uint16_t type = ((uint16_t)buffer[0] << 8) + buffer[1];
+    size_t header_length = TLV_HEADER_LENGTH;
+    uint64_t length = ((uint16_t)buffer[2] << 8) + buffer[3];
+    if (type & TLV_TYPE_EXTENDED_FLAG) {
+        if (available < TLV_EXTENDED_HEADER_LENGTH) {
+            return 0;
+        }
+        header_length = TLV_EXTENDED_HEADER_LENGTH;
+        length = 0;
+        for (int i = 2; i < TLV_EXTENDED_HEADER_LENGTH; ++i) {
+            length = (length << 8) + buffer[i];
+        }
+    }
+    tlv->type = type & ~TLV_TYPE_EXTENDED_FLAG;
+    tlv->length = length;
+    tlv->buffer = (uint8_t*)buffer + header_length;
+    tlv->next = NULL;
+    tlv->sub_tlv = NULL;
+    return header_length;
+}
+
+/**
+ * @brief Set the TLV header on an arena and increment its offset.
+ *
+ * @param arena The arena the TLV is built on
+ * @param type The TLV type
+ * @param length The TLV length
+ *
+ * @return The new TLV.
+ **/
+tlv_t new_tlv(tlv_arena_t* arena, const uint16_t type, const uint16_t length) {
+    assert(arena && arena->offset + TLV_HEADER_LENGTH + length <= TLV_BUFFER_LEN);
+    uint8_t* buffer = arena->buffer + arena->offset;
+    write_tlv_header(buffer, type, length);
     buffer += TLV_HEADER_LENGTH;
     tlv_t tlv = {
         .type = type,
@@ -99,7 +220,7 @@ tlv_t new_tlv(const uint16_t type, const uint16_t length) {
         .next = NULL,
         .sub_tlv = NULL
     };
-    increase_sending_tlv_buffer_offset(TLV_HEADER_LENGTH + length);
+    arena->offset += TLV_HEADER_LENGTH + length;
     return tlv;
 }
 
@@ -120,16 +241,6 @@ bool parse_tlv(uint8_t* buffer, tlv_t* tlv) {
     return true;
 }
 
-/**
- * @brief Resets the TLV internal buffer and offset.
- *
- * @return No return
- **/
-void tlv_release_tlvs() {
-    reset_sending_tlv_buffer_offset();
-    bzero(get_tlv_buffer(), TLV_BUFFER_LEN);
-}
-
 /**
  * @brief Sets the TLV length based on its sub-TLV list.
  *
@@ -186,7 +297,7 @@ void set_next_tlv(tlv_t* tlv, tlv_t* next_tlv) {
  * @return No return
  **/
 void set_tlv_value_raw(tlv_t* tlv, const uint8_t* src) {
-    assert(tlv && get_tlv_length(tlv));
+    assert(tlv && get_tlv_length(tlv) && get_tlv_length(tlv) <= TLV_MAX_VALUE_LENGTH);
     memcpy(tlv->buffer, src, get_tlv_length(tlv));
 }
 
@@ -243,31 +354,170 @@ long get_tlv_value_long(tlv_t* tlv) {
  * @return false otherwise
  **/
 bool send_tlv_data(sal_socket_t socket, const tlv_t* tlv) {
-    return sal_send_msg(
-        socket,
-        tlv->buffer - TLV_HEADER_LENGTH,
-        TLV_HEADER_LENGTH + (int)get_tlv_length(tlv)) == SAL_OK;
+    PROBE2(frame_sent, get_tlv_type(tlv), get_tlv_length(tlv));
+    return sal_send_msg(socket, get_tlv_data(tlv), get_tlv_data_length(tlv)) == SAL_OK;
 }
 
 /**
- * @brief Fills the TLV data from the given socket.
+ * @brief Prepares an empty gather list, used to send TLVs whose headers and
+ * values live in separate buffers with a single system call.
+ *
+ * @param[out] gather The gather list
+ *
+ * @return No return
+ **/
+void init_tlv_gather(tlv_gather_t* gather) {
+    gather->buffer_count = 0;
+    gather->header_count = 0;
+}
+
+/**
+ * @brief Appends a buffer to a gather list.
+ * @note The buffer is not copied, so it must be kept until the list is sent.
+ *
+ * @param gather The gather list
+ * @param data The buffer data
+ * @param length The buffer length
+ *
+ * @return true if buffer was appended
+ * @return false if gather list is full
+ **/
+bool add_buffer_to_gather(tlv_gather_t* gather, const uint8_t* data, const size_t length) {
+    if (gather->buffer_count == TLV_GATHER_MAX_BUFFERS) {
+        return false;
+    }
+    if (length > 0) {
+        gather->buffers[gather->buffer_count].data = data;
+        gather->buffers[gather->buffer_count].length = length;
+        ++gather->buffer_count;
+    }
+    return true;
+}
+
+/**
+ * @brief Appends a TLV built by new_tlv(), including its sub-TLVs, to a gather list.
+ *
+ * @param gather The gather list
+ * @param tlv The given TLV
+ *
+ * @return true if TLV was appended
+ * @return false if gather list is full
+ **/
+bool add_tlv_to_gather(tlv_gather_t* gather, const tlv_t* tlv) {
+    if (!add_buffer_to_gather(gather, get_tlv_data(tlv), get_tlv_data_length(tlv))) {
+        return false;
+    }
+    PROBE2(frame_sent, get_tlv_type(tlv), get_tlv_length(tlv));
+    return true;
+}
+
+/**
+ * @brief Appends a TLV header to a gather list. The header is stored on the
+ * list itself and its value is expected on the buffers appended next.
+ *
+ * @param gather The gather list
+ * @param type The TLV type
+ * @param length The TLV length
+ *
+ * @return true if TLV header was appended
+ * @return false if gather list is full
+ **/
+bool add_tlv_header_to_gather(tlv_gather_t* gather, const uint16_t type, const uint64_t length) {
+    if (gather->header_count == TLV_GATHER_MAX_BUFFERS) {
+        return false;
+    }
+    uint8_t* header = gather->headers[gather->header_count];
+    const size_t header_length = write_tlv_stream_header(header, type, length);
+    if (!add_buffer_to_gather(gather, header, header_length)) {
+        return false;
+    }
+    ++gather->header_count;
+    PROBE2(frame_sent, type, length);
+    return true;
+}
+
+/**
+ * @brief Sends all buffers of a gather list though the given socket.
+ * @note Its TLVs hit the frame_sent probe as they are appended to the list.
  *
  * @param socket The socket to be used
- * @param[out] tlv The given TLV
+ * @param gather The gather list
  *
- * @return true if TLV was retrieved successfully
+ * @return true if data was sent successfully
  * @return false otherwise
  **/
-bool receive_tlv_data(sal_socket_t socket, tlv_t* tlv) {
-    uint8_t header_buffer[TLV_HEADER_LENGTH] = {0};
-    if (sal_receive_msg(socket, header_buffer, sizeof(header_buffer)) != SAL_OK) {
+bool send_tlv_gather(sal_socket_t socket, const tlv_gather_t* gather) {
+    return sal_send_msgv(socket, gather->buffers, gather->buffer_count) == SAL_OK;
+}
+
+/**
+ * @brief Receives only the TLV header (type and length) from the given socket.
+ * The TLV value is left on the socket, to be received by receive_tlv_value()
+ * or consumed by other means.
+ *
+ * @param socket The socket to be used
+ * @param[out] tlv The given TLV, without value buffer
+ *
+ * @return true if TLV header was retrieved successfully
+ * @return false otherwise
+ **/
+bool receive_tlv_header(sal_socket_t socket, tlv_t* tlv) {
+    const uint8_t* data = NULL;
+    size_t available = 0;
+    if (sal_peek_msg(socket, TLV_HEADER_LENGTH, &data, &available) != SAL_OK) {
         return false;
     }
-    uint16_t type = ((uint16_t)header_buffer[0] << 8) + header_buffer[1];
-    uint16_t length = ((uint16_t)header_buffer[2] << 8) + header_buffer[3];
-    *tlv = new_tlv(type, length);
-    if (sal_receive_msg(socket, tlv->buffer, length) != SAL_OK) {
+    size_t header_length = parse_tlv_header(data, available, tlv);
+    if (header_length == 0 &&
+        (sal_peek_msg(socket, TLV_EXTENDED_HEADER_LENGTH, &data, &available) != SAL_OK ||
+         (header_length = parse_tlv_header(data, available, tlv)) == 0)) {
         return false;
     }
+    sal_consume_msg(socket, header_length);
+    tlv->buffer = NULL;
+    PROBE2(frame_received, get_tlv_type(tlv), get_tlv_length(tlv));
     return true;
 }
+
+/**
+ * @brief Receives the value of a TLV whose header was received by
+ * receive_tlv_header().
+ *
+ * @param socket The socket to be used
+ * @param arena The arena the TLV is received on
+ * @param[inout] tlv The given TLV
+ *
+ * @return true if TLV value was retrieved successfully
+ * @return false otherwise
+ **/
+bool receive_tlv_value(sal_socket_t socket, tlv_arena_t* arena, tlv_t* tlv) {
+    if (get_tlv_length(tlv) > TLV_MAX_VALUE_LENGTH) {
+        set_error_description("TLV %d is too long", get_tlv_type(tlv));
+        print_error("Protocol error");
+        return false;
+    }
+    if (arena->offset + TLV_HEADER_LENGTH + get_tlv_length(tlv) > TLV_BUFFER_LEN) {
+        set_error_description("TLV %d does not fit", get_tlv_type(tlv));
+        print_error("Receive TLV failed");
+        return false;
+    }
+    *tlv = new_tlv(arena, get_tlv_type(tlv), get_tlv_length(tlv));
+    if (sal_receive_msg(socket, tlv->buffer, get_tlv_length(tlv)) != SAL_OK) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Fills the TLV data from the given socket.
+ *
+ * @param socket The socket to be used
+ * @param arena The arena the TLV is received on
+ * @param[out] tlv The given TLV
+ *
+ * @return true if TLV was retrieved successfully
+ * @return false otherwise
+ **/
+bool receive_tlv_data(sal_socket_t socket, tlv_arena_t* arena, tlv_t* tlv) {
+    return receive_tlv_header(socket, tlv) && receive_tlv_value(socket, arena, tlv);
+}
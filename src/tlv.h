@@ -6,7 +6,10 @@
 #include "sal.h"
 
 #define TLV_HEADER_LENGTH 4 //Type (2) and Length(2)
+#define TLV_EXTENDED_HEADER_LENGTH 10 //Type (2) and Length(8), protocol version 2 only
 #define TLV_MAX_VALUE_LENGTH (0xFFFF - TLV_HEADER_LENGTH)
+#define TLV_BUFFER_LEN (TLV_HEADER_LENGTH + TLV_MAX_VALUE_LENGTH)
+#define TLV_TYPE_EXTENDED_FLAG 0x8000 ///< set on the wire type when the header has an 8 bytes length
 
 typedef enum {
     TLV_TYPE_HEADER = 1,
@@ -15,22 +18,69 @@ typedef enum {
     TLV_TYPE_CHECKSUM_SHA512,
     TLV_TYPE_FILE_CONTENT,
     TLV_TYPE_ACK,
-    TLV_TYPE_NACK
+    TLV_TYPE_NACK,
+    TLV_TYPE_HELLO,
+    TLV_TYPE_PROTOCOL_VERSION,
+    TLV_TYPE_CAPABILITIES,
+    TLV_TYPE_MAX_FRAME_LENGTH,
+    TLV_TYPE_CHECKSUM_ALGORITHM,
+    TLV_TYPE_CHECKSUM,
+    TLV_TYPE_FILE_IDENTITY,
+    TLV_TYPE_RESUME_OFFSET,
+    TLV_TYPE_MAX_STREAMS,
+    TLV_TYPE_TRANSFER_ID,
+    TLV_TYPE_STREAM_COUNT,
+    TLV_TYPE_RANGE_OFFSET,
+    TLV_TYPE_RANGE_LENGTH,
+    TLV_TYPE_COMPRESSION,
+    TLV_TYPE_COMPRESSED_CONTENT,
+    TLV_TYPE_DELTA,
+    TLV_TYPE_DELTA_BASIS,
+    TLV_TYPE_BLOCK_LENGTH,
+    TLV_TYPE_BLOCK_COUNT,
+    TLV_TYPE_BLOCK_SIGNATURES,
+    TLV_TYPE_BLOCK_REFERENCE,
+    TLV_TYPE_DEDUP,
+    TLV_TYPE_CHUNK_LIST,
+    TLV_TYPE_MISSING_CHUNKS,
+    TLV_TYPE_ADMISSION
 } tlv_type;
 
 typedef struct Stlv {
     uint16_t type;
-    uint16_t length;
+    uint64_t length;
     uint8_t* buffer;
     struct Stlv* sub_tlv;
     struct Stlv* next;
 } tlv_t;
 
-tlv_t new_tlv(const uint16_t type, const uint16_t length);
-void tlv_release_tlvs();
+/**
+ * @brief The storage TLVs are built and received on. Each connection owns
+ * one, so TLVs of concurrent connections never share storage.
+ **/
+typedef struct Stlv_arena tlv_arena_t;
+
+#define TLV_GATHER_MAX_BUFFERS 8
+
+typedef struct {
+    sal_buffer_t buffers[TLV_GATHER_MAX_BUFFERS]; ///< the gathered buffers, in sending order
+    int buffer_count; ///< the amount of gathered buffers
+    uint8_t headers[TLV_GATHER_MAX_BUFFERS][TLV_EXTENDED_HEADER_LENGTH]; ///< the storage of gathered TLV headers
+    int header_count; ///< the amount of stored TLV headers
+} tlv_gather_t;
+
+void write_tlv_header(uint8_t* buffer, const uint16_t type, const uint16_t length);
+size_t write_tlv_stream_header(uint8_t* buffer, const uint16_t type, const uint64_t length);
+size_t parse_tlv_header(const uint8_t* buffer, const size_t available, tlv_t* tlv);
+tlv_arena_t* acquire_tlv_arena();
+void release_tlv_arena(tlv_arena_t* arena);
+void reset_tlv_arena(tlv_arena_t* arena);
+tlv_t new_tlv(tlv_arena_t* arena, const uint16_t type, const uint16_t length);
 bool parse_tlv(uint8_t* buffer, tlv_t* tlv);
 uint16_t get_tlv_type(const tlv_t* tlv);
-uint16_t get_tlv_length(const tlv_t* tlv);
+uint64_t get_tlv_length(const tlv_t* tlv);
+const uint8_t* get_tlv_data(const tlv_t* tlv);
+size_t get_tlv_data_length(const tlv_t* tlv);
 void fill_tlv_length(tlv_t* tlv);
 void set_sub_tlv_list(tlv_t* tlv, tlv_t* sub_tlv);
 void set_next_tlv(tlv_t* tlv, tlv_t* next_tlv);
@@ -40,6 +90,13 @@ uint8_t* get_tlv_value_raw(tlv_t* tlv);
 long get_tlv_value_long(tlv_t* tlv);
 
 bool send_tlv_data(sal_socket_t socket, const tlv_t* tlv);
-bool receive_tlv_data(sal_socket_t socket, tlv_t* tlv);
+void init_tlv_gather(tlv_gather_t* gather);
+bool add_tlv_to_gather(tlv_gather_t* gather, const tlv_t* tlv);
+bool add_tlv_header_to_gather(tlv_gather_t* gather, const uint16_t type, const uint64_t length);
+bool add_buffer_to_gather(tlv_gather_t* gather, const uint8_t* data, const size_t length);
+bool send_tlv_gather(sal_socket_t socket, const tlv_gather_t* gather);
+bool receive_tlv_header(sal_socket_t socket, tlv_t* tlv);
+bool receive_tlv_value(sal_socket_t socket, tlv_arena_t* arena, tlv_t* tlv);
+bool receive_tlv_data(sal_socket_t socket, tlv_arena_t* arena, tlv_t* tlv);
 
 #endif /* _TLV_H_ */
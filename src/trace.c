@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h> //strcmp
+#include <stdint.h>
+#include <inttypes.h> //PRIu64
+
+#include "trace.h"
+#include "sal.h"
+#include "common.h"
+
+#define TRACE_LINE_LEN (8 * MAX_PATH_LEN) ///< the longest trace line, its path being fully escaped
+
+/**
+ * @brief The file content work of the calling thread, the socket work being
+ * counted by the SAL.
+ **/
+static __thread trace_counters_t thread_counters;
+static FILE* trace_fp = NULL; ///< the trace file, NULL if tracing is disabled
+
+/**
+ * @brief Gets the work done by the calling thread so far.
+ *
+ * @param[out] counters The thread counters
+ *
+ * @return No return
+ **/
+static void get_thread_counters(trace_counters_t* counters) {
+    sal_io_time_t io_time;
+    sal_get_io_time(&io_time);
+    *counters = thread_counters;
+    counters->send_ns = io_time.send_ns;
+    counters->receive_ns = io_time.receive_ns;
+    /* Received data written straight to files never went through fwrite() */
+    counters->disk_ns += io_time.file_ns;
+    counters->syscalls = sal_get_syscall_count();
+}
+
+/**
+ * @brief Adds the difference between two counter snapshots.
+ *
+ * @param[in,out] total The counters the difference is added to
+ * @param start The earlier snapshot
+ * @param end The later snapshot
+ *
+ * @return No return
+ **/
+static void add_counters(trace_counters_t* total, const trace_counters_t* start, const trace_counters_t* end) {
+    total->send_ns += end->send_ns - start->send_ns;
+    total->receive_ns += end->receive_ns - start->receive_ns;
+    total->disk_ns += end->disk_ns - start->disk_ns;
+    total->checksum_ns += end->checksum_ns - start->checksum_ns;
+    total->chunks += end->chunks - start->chunks;
+    total->syscalls += end->syscalls - start->syscalls;
+}
+
+/**
+ * @brief Appends a string to a trace line as a JSON string.
+ *
+ * @param[out] line The trace line
+ * @param length The trace line length so far
+ * @param value The string
+ *
+ * @return the trace line length
+ **/
+static size_t append_json_string(char* line, size_t length, const char* value) {
+    line[length++] = '"';
+    for (const char* c = value; *c != '\0' && length < TRACE_LINE_LEN - 8; ++c) {
+        if (*c == '"' || *c == '\\') {
+            line[length++] = '\\';
+            line[length++] = *c;
+        } else if ((unsigned char)*c < 0x20) {
+            length += sprintf(&line[length], "\\u%04x", (unsigned char)*c);
+        } else {
+            line[length++] = *c;
+        }
+    }
+    line[length++] = '"';
+    return length;
+}
+
+bool trace_open(const char* path) {
+    FILE* fp = strcmp(path, "-") == 0 ? stderr : fopen(path, "a");
+    if (fp == NULL) {
+        set_error_description("%s", path);
+        print_error("Open trace file failed");
+        return false;
+    }
+    /* Each trace line gets to the file with a single write, so lines written concurrently don't get mixed */
+    setvbuf(fp, NULL, _IOLBF, 0);
+    trace_fp = fp;
+    sal_enable_io_timing();
+    return true;
+}
+
+void trace_close() {
+    if (trace_fp != NULL && trace_fp != stderr) {
+        fclose(trace_fp);
+    }
+    trace_fp = NULL;
+}
+
+uint64_t trace_clock() {
+    return trace_fp != NULL ? sal_get_time_ns(SAL_CLOCK_MONOTONIC) : 0;
+}
+
+void trace_begin(trace_file_t* trace) {
+    if (trace_fp == NULL) {
+        return;
+    }
+    memset(trace, 0, sizeof(*trace));
+    trace->start_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC);
+    trace->wall_start_ns = sal_get_time_ns(SAL_CLOCK_WALL);
+    get_thread_counters(&trace->mark);
+}
+
+void trace_resume(trace_file_t* trace) {
+    if (trace_fp != NULL) {
+        get_thread_counters(&trace->mark);
+    }
+}
+
+void trace_collect(trace_file_t* trace) {
+    if (trace_fp == NULL) {
+        return;
+    }
+    trace_counters_t now;
+    get_thread_counters(&now);
+    add_counters(&trace->counters, &trace->mark, &now);
+    trace->mark = now;
+}
+
+void trace_merge(trace_file_t* trace, const trace_file_t* other) {
+    static const trace_counters_t none = {0};
+    if (trace_fp != NULL) {
+        add_counters(&trace->counters, &none, &other->counters);
+    }
+}
+
+uint64_t trace_elapsed(const trace_file_t* trace) {
+    return trace_fp != NULL ? sal_get_time_ns(SAL_CLOCK_MONOTONIC) - trace->start_ns : 0;
+}
+
+void trace_end(trace_file_t* trace, const char* side, const char* path, const long size, const long bytes, bool done) {
+    if (trace_fp == NULL) {
+        return;
+    }
+    trace_collect(trace);
+    const trace_counters_t* counters = &trace->counters;
+    const uint64_t total_ns = sal_get_time_ns(SAL_CLOCK_MONOTONIC) - trace->start_ns;
+
+    char line[TRACE_LINE_LEN + 512];
+    size_t length = sprintf(line, "{\"side\": \"%s\", \"file\": ", side);
+    length = append_json_string(line, length, path);
+    sprintf(
+        &line[length],
+        ", \"size\": %ld, \"bytes\": %ld, \"result\": \"%s\", \"start_us\": %" PRIu64 ", \"total_ms\": %.3f, "
+        "\"connect_ms\": %.3f, \"header_ms\": %.3f, \"send_ms\": %.3f, \"recv_ms\": %.3f, \"disk_ms\": %.3f, "
+        "\"checksum_ms\": %.3f, \"chunks\": %lu, \"syscalls\": %lu}\n",
+        size,
+        bytes,
+        done ? "done" : "error",
+        trace->wall_start_ns / 1000,
+        total_ns / 1e6,
+        trace->connect_ns / 1e6,
+        trace->header_ns / 1e6,
+        counters->send_ns / 1e6,
+        counters->receive_ns / 1e6,
+        counters->disk_ns / 1e6,
+        counters->checksum_ns / 1e6,
+        counters->chunks,
+        counters->syscalls);
+    fputs(line, trace_fp);
+}
+
+size_t trace_fread(void* buffer, size_t size, size_t count, FILE* fp) {
+    if (trace_fp == NULL) {
+        return fread(buffer, size, count, fp);
+    }
+    const uint64_t start = sal_get_time_ns(SAL_CLOCK_MONOTONIC);
+    const size_t read = fread(buffer, size, count, fp);
+    thread_counters.disk_ns += sal_get_time_ns(SAL_CLOCK_MONOTONIC) - start;
+    ++thread_counters.chunks;
+    return read;
+}
+
+size_t trace_fwrite(const void* buffer, size_t size, size_t count, FILE* fp) {
+    if (trace_fp == NULL) {
+        return fwrite(buffer, size, count, fp);
+    }
+    const uint64_t start = sal_get_time_ns(SAL_CLOCK_MONOTONIC);
+    const size_t written = fwrite(buffer, size, count, fp);
+    thread_counters.disk_ns += sal_get_time_ns(SAL_CLOCK_MONOTONIC) - start;
+    ++thread_counters.chunks;
+    return written;
+}
+
+void trace_checksum_update(checksum_ctx_t* checksum_ctx, const uint8_t* data, const size_t length) {
+    if (trace_fp == NULL) {
+        checksum_update(checksum_ctx, data, length);
+        return;
+    }
+    const uint64_t start = sal_get_time_ns(SAL_CLOCK_MONOTONIC);
+    checksum_update(checksum_ctx, data, length);
+    thread_counters.checksum_ns += sal_get_time_ns(SAL_CLOCK_MONOTONIC) - start;
+}
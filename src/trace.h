@@ -0,0 +1,148 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "checksum.h"
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+
+/**
+ * @brief The work done by a thread, as counted since tracing was enabled.
+ * Times are only measured while tracing is enabled.
+ **/
+typedef struct {
+    uint64_t send_ns; ///< the time blocked sending to sockets
+    uint64_t receive_ns; ///< the time blocked receiving from sockets
+    uint64_t disk_ns; ///< the time reading and writing file content
+    uint64_t checksum_ns; ///< the time hashing file content
+    unsigned long chunks; ///< the amount of file content chunks read or written
+    unsigned long syscalls; ///< the amount of data moving system calls
+} trace_counters_t;
+
+/**
+ * @brief The trace of a single file transfer. The work of the thread moving
+ * the file is collected into it while the file is being transferred, so
+ * threads serving several connections collect it per connection.
+ **/
+typedef struct {
+    uint64_t start_ns; ///< when the transfer started (monotonic clock)
+    uint64_t wall_start_ns; ///< when the transfer started (wall clock)
+    uint64_t connect_ns; ///< the time establishing the connection the file went through, if it was the first one
+    uint64_t header_ns; ///< the time from the transfer start until the header was processed by the peer
+    trace_counters_t counters; ///< the work already collected
+    trace_counters_t mark; ///< the thread counters when work was last collected
+} trace_file_t;
+
+/**
+ * @brief Opens the trace file and enables tracing. Each file transfer is then
+ * traced as one JSON object per line, appended to the file.
+ *
+ * @param path The trace file path, "-" for the standard error
+ *
+ * @return true if the trace file was opened
+ * @return false otherwise
+ **/
+bool trace_open(const char* path);
+
+/**
+ * @brief Flushes and closes the trace file, disabling tracing.
+ *
+ * @return No return
+ **/
+void trace_close();
+
+/**
+ * @brief Reads the monotonic clock, if tracing is enabled.
+ *
+ * @return the time in nanoseconds, 0 if tracing is disabled
+ **/
+uint64_t trace_clock();
+
+/**
+ * @brief Starts the trace of a file transfer, done by the calling thread.
+ *
+ * @param[out] trace The file trace
+ *
+ * @return No return
+ **/
+void trace_begin(trace_file_t* trace);
+
+/**
+ * @brief Resumes collecting work into a file trace, as the calling thread
+ * goes back to the file after serving other connections.
+ *
+ * @param trace The file trace
+ *
+ * @return No return
+ **/
+void trace_resume(trace_file_t* trace);
+
+/**
+ * @brief Collects the work done by the calling thread since the file trace
+ * was started, resumed or last collected.
+ *
+ * @param trace The file trace
+ *
+ * @return No return
+ **/
+void trace_collect(trace_file_t* trace);
+
+/**
+ * @brief Adds the work collected by another trace of the same file, such as
+ * the one of a stream sent by another thread.
+ *
+ * @param trace The file trace
+ * @param other The trace whose work is added
+ *
+ * @return No return
+ **/
+void trace_merge(trace_file_t* trace, const trace_file_t* other);
+
+/**
+ * @brief Gets the time elapsed since a file trace was started, such as the
+ * header latency.
+ *
+ * @param trace The file trace
+ *
+ * @return the elapsed time in nanoseconds, 0 if tracing is disabled
+ **/
+uint64_t trace_elapsed(const trace_file_t* trace);
+
+/**
+ * @brief Collects the remaining work of a file transfer and writes its trace.
+ *
+ * @param trace The file trace
+ * @param side The side writing the trace ("client" or "server")
+ * @param path The file path
+ * @param size The file size
+ * @param bytes The amount of file content received, or the bytes sent for the file when sending
+ * @param done Whether the file was transferred successfully
+ *
+ * @return No return
+ **/
+void trace_end(trace_file_t* trace, const char* side, const char* path, const long size, const long bytes, bool done);
+
+/**
+ * @brief Reads file content, accounting it as a disk chunk.
+ * @see fread()
+ **/
+size_t trace_fread(void* buffer, size_t size, size_t count, FILE* fp);
+
+/**
+ * @brief Writes file content, accounting it as a disk chunk.
+ * @see fwrite()
+ **/
+size_t trace_fwrite(const void* buffer, size_t size, size_t count, FILE* fp);
+
+/**
+ * @brief Hashes file content, accounting its time.
+ * @see checksum_update()
+ **/
+void trace_checksum_update(checksum_ctx_t* checksum_ctx, const uint8_t* data, const size_t length);
+
+#endif /* _TRACE_H_ */
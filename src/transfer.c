@@ -0,0 +1,84 @@
+#include <stdlib.h> //calloc
+#include <stdint.h>
+#include <pthread.h>
+
+#include "transfer.h"
+#include "common.h"
+
+typedef struct {
+    long transfer_id; ///< the transfer identifier
+    long finished; ///< the amount of finished streams, 0 if the entry is unused
+    bool valid; ///< all finished streams were validated
+    uint64_t last_update; ///< the registry update counter on the last finished stream
+} transfer_entry;
+
+struct Stransfer_registry {
+    transfer_entry entries[TRANSFER_REGISTRY_LEN]; ///< the tracked transfers
+    uint64_t updates; ///< the amount of recorded streams, used to find the least recently updated entry
+    pthread_mutex_t lock; ///< protects the entries
+};
+
+transfer_registry_t* transfer_registry_create() {
+    transfer_registry_t* registry = calloc(1, sizeof(*registry));
+    if (registry == NULL) {
+        set_error_description("Out of memory");
+        print_error("Creating transfer registry failed");
+        return NULL;
+    }
+    pthread_mutex_init(&registry->lock, NULL);
+    return registry;
+}
+
+void transfer_registry_destroy(transfer_registry_t* registry) {
+    if (registry == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&registry->lock);
+    free(registry);
+}
+
+/**
+ * @brief Finds the entry of a transfer, or takes over an unused or the least
+ * recently updated one.
+ *
+ * @param registry The given registry, locked
+ * @param transfer_id The transfer identifier
+ *
+ * @return the transfer entry
+ **/
+static transfer_entry* find_entry(transfer_registry_t* registry, const long transfer_id) {
+    transfer_entry* candidate = &registry->entries[0];
+    for (int i = 0; i < TRANSFER_REGISTRY_LEN; ++i) {
+        transfer_entry* entry = &registry->entries[i];
+        if (entry->finished > 0 && entry->transfer_id == transfer_id) {
+            return entry;
+        }
+        if (candidate->finished > 0 && (entry->finished == 0 || entry->last_update < candidate->last_update)) {
+            candidate = entry;
+        }
+    }
+    candidate->transfer_id = transfer_id;
+    candidate->finished = 0;
+    candidate->valid = true;
+    return candidate;
+}
+
+bool transfer_registry_finish_stream(
+    transfer_registry_t* registry,
+    const long transfer_id,
+    const long stream_count,
+    const bool stream_valid,
+    bool* transfer_valid) {
+    pthread_mutex_lock(&registry->lock);
+    transfer_entry* entry = find_entry(registry, transfer_id);
+    ++entry->finished;
+    entry->valid = entry->valid && stream_valid;
+    entry->last_update = ++registry->updates;
+    const bool last = entry->finished >= stream_count;
+    if (last) {
+        *transfer_valid = entry->valid;
+        entry->finished = 0;
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return last;
+}
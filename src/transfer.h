@@ -0,0 +1,57 @@
+#ifndef _TRANSFER_H_
+#define _TRANSFER_H_
+
+#include <stdbool.h>
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+#define TRANSFER_REGISTRY_LEN 64 ///< the amount of multi-stream transfers tracked at once
+
+/**
+ * @brief Tracks the streams of the multi-stream transfers in progress, so
+ * that the outcome of a file split over parallel connections is known once
+ * all its ranges were received. It may be shared by several threads.
+ **/
+typedef struct Stransfer_registry transfer_registry_t;
+
+/**
+ * @brief Creates an empty transfer registry.
+ * @note The created registry shall be released by transfer_registry_destroy().
+ *
+ * @return the created registry
+ * @return NULL otherwise
+ **/
+transfer_registry_t* transfer_registry_create();
+
+/**
+ * @brief Releases a transfer registry.
+ *
+ * @param registry The given registry
+ *
+ * @return No return
+ **/
+void transfer_registry_destroy(transfer_registry_t* registry);
+
+/**
+ * @brief Records the outcome of a stream of a multi-stream transfer. When
+ * the registry is full, the least recently updated transfer is forgotten,
+ * as its client is most likely gone.
+ *
+ * @param registry The given registry
+ * @param transfer_id The transfer identifier, chosen by the client
+ * @param stream_count The amount of streams of the transfer
+ * @param stream_valid Whether the stream range was received and validated successfully
+ * @param[out] transfer_valid Whether all ranges were validated, if it was the last stream
+ *
+ * @return true if it was the last stream of the transfer
+ * @return false otherwise
+ **/
+bool transfer_registry_finish_stream(
+    transfer_registry_t* registry,
+    const long transfer_id,
+    const long stream_count,
+    const bool stream_valid,
+    bool* transfer_valid);
+
+#endif /* _TRANSFER_H_ */
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h> //malloc
+#include <string.h> //strdup
+#include <errno.h>
+#include <pthread.h>
+
+#include "walker.h"
+#include "sal.h"
+#include "common.h"
+
+/**
+ * @brief The listing of a directory being walked, its files and
+ * subdirectories being taken in order.
+ **/
+typedef struct {
+    char** files; ///< the paths of the directory files
+    size_t file_count; ///< the amount of directory files
+    size_t next_file; ///< the first file not taken yet
+    char** dirs; ///< the paths of the subdirectories, NULL if not walked recursively
+    size_t dir_count; ///< the amount of subdirectories
+    size_t next_dir; ///< the first subdirectory not walked yet
+} walked_dir;
+
+struct Spath_walker {
+    pthread_mutex_t lock; ///< serializes taking files from the walk
+    bool recursive; ///< directories are walked into their subdirectories too
+    char** roots; ///< the added paths
+    size_t root_count; ///< the amount of added paths
+    size_t next_root; ///< the first added path not walked yet
+    size_t root_length; ///< the length of the directory path being walked, up to the names of its files
+    FILE* list_fp; ///< the file list, NULL if none or already read
+    walked_dir* dirs; ///< the directories being walked, each one a subdirectory of the previous one
+    size_t depth; ///< the amount of directories being walked
+    size_t dir_capacity; ///< the capacity of dirs
+    size_t failures; ///< the paths that could not be walked
+};
+
+/**
+ * @brief Releases the paths of a walked directory not taken yet.
+ *
+ * @param dir The walked directory
+ *
+ * @return No return
+ **/
+static void release_walked_dir(walked_dir* dir) {
+    for (size_t i = dir->next_file; i < dir->file_count; ++i) {
+        free(dir->files[i]);
+    }
+    free(dir->files);
+    for (size_t i = dir->next_dir; i < dir->dir_count; ++i) {
+        free(dir->dirs[i]);
+    }
+    free(dir->dirs);
+}
+
+/**
+ * @brief Closes the file list, if not the standard input.
+ *
+ * @param walker The given walker
+ *
+ * @return No return
+ **/
+static void close_list(path_walker_t* walker) {
+    if (walker->list_fp != NULL && walker->list_fp != stdin) {
+        fclose(walker->list_fp);
+    }
+    walker->list_fp = NULL;
+}
+
+/**
+ * @brief Gets the next added or listed path to be walked.
+ * @note The path is a malloc'd value that must be freed by user.
+ *
+ * @param walker The given walker
+ *
+ * @return the path
+ * @return NULL once all paths were walked
+ **/
+static char* next_root(path_walker_t* walker) {
+    if (walker->next_root < walker->root_count) {
+        char* root = walker->roots[walker->next_root];
+        walker->roots[walker->next_root++] = NULL;
+        return root;
+    }
+    while (walker->list_fp != NULL) {
+        char* line = NULL;
+        size_t capacity = 0;
+        if (getline(&line, &capacity, walker->list_fp) < 0) {
+            if (ferror(walker->list_fp)) {
+                set_error_description("%s", strerror(errno));
+                print_error("Reading file list failed");
+            }
+            free(line);
+            close_list(walker);
+            return NULL;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0') {
+            return line;
+        }
+        free(line);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reports a path that could not be walked, and counts it.
+ *
+ * @param walker The given walker
+ * @param path The path
+ * @param error The error message
+ *
+ * @return No return
+ **/
+static void fail_path(path_walker_t* walker, const char* path, const char* error) {
+    set_error_description("%s", path);
+    print_error(error);
+    ++walker->failures;
+}
+
+/**
+ * @brief Lists a directory and starts walking it.
+ *
+ * @param walker The given walker
+ * @param path The directory path
+ *
+ * @return SAL_OK if directory is being walked
+ * @return SAL_DIR_NOT_FOUND, if the given path is not a directory
+ * @return SAL_ERROR otherwise
+ **/
+static sal_ret push_dir(path_walker_t* walker, const char* path) {
+    walked_dir dir = {0};
+    const sal_ret ret = walker->recursive ?
+        sal_list_dir_entries(path, &dir.files, &dir.file_count, &dir.dirs, &dir.dir_count) :
+        sal_list_dir_files(path, &dir.files, &dir.file_count);
+    if (ret != SAL_OK) {
+        return ret;
+    }
+    if (walker->depth == walker->dir_capacity) {
+        const size_t grown_capacity = walker->dir_capacity ? walker->dir_capacity * 2 : 16;
+        walked_dir* grown = realloc(walker->dirs, grown_capacity * sizeof(*grown));
+        if (grown == NULL) {
+            release_walked_dir(&dir);
+            set_error_description("Out of memory");
+            print_error("Walking directory failed");
+            return SAL_ERROR;
+        }
+        walker->dirs = grown;
+        walker->dir_capacity = grown_capacity;
+    }
+    walker->dirs[walker->depth++] = dir;
+    return SAL_OK;
+}
+
+path_walker_t* path_walker_create(const bool recursive) {
+    path_walker_t* walker = calloc(1, sizeof(*walker));
+    if (walker == NULL) {
+        set_error_description("Out of memory");
+        print_error("Creating path walker failed");
+        return NULL;
+    }
+    pthread_mutex_init(&walker->lock, NULL);
+    walker->recursive = recursive;
+    return walker;
+}
+
+void path_walker_destroy(path_walker_t* walker) {
+    if (walker == NULL) {
+        return;
+    }
+    for (size_t i = walker->next_root; i < walker->root_count; ++i) {
+        free(walker->roots[i]);
+    }
+    free(walker->roots);
+    while (walker->depth > 0) {
+        release_walked_dir(&walker->dirs[--walker->depth]);
+    }
+    free(walker->dirs);
+    close_list(walker);
+    pthread_mutex_destroy(&walker->lock);
+    free(walker);
+}
+
+bool path_walker_add_path(path_walker_t* walker, const char* path) {
+    switch (sal_is_file_readable(path)) {
+    case SAL_FILE_NOT_READABLE:
+        set_error_description("%s", path);
+        print_error("File is not readable");
+        return false;
+        break;
+    case SAL_FILE_NOT_FOUND:
+        /* Whatever else exists is taken for a directory, and checked once walked */
+        if (sal_is_dir_writable(path) == SAL_DIR_NOT_FOUND) {
+            set_error_description("%s", path);
+            print_error("File not found");
+            return false;
+        }
+        break;
+    default:
+        break;
+    }
+
+    char** roots = realloc(walker->roots, (walker->root_count + 1) * sizeof(*roots));
+    if (roots == NULL) {
+        goto OUT_OF_MEMORY;
+    }
+    walker->roots = roots;
+    if ((roots[walker->root_count] = strdup(path)) == NULL) {
+        goto OUT_OF_MEMORY;
+    }
+    ++walker->root_count;
+    return true;
+
+OUT_OF_MEMORY:
+    set_error_description("Out of memory");
+    print_error("Adding path failed");
+    return false;
+}
+
+bool path_walker_set_list(path_walker_t* walker, const char* list_path) {
+    FILE* fp = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+    if (fp == NULL) {
+        set_error_description("%s", list_path);
+        print_error("Open file list failed");
+        return false;
+    }
+    close_list(walker);
+    walker->list_fp = fp;
+    return true;
+}
+
+size_t path_walker_next(path_walker_t* walker, char** paths, size_t* name_offsets, const size_t max_count) {
+    size_t count = 0;
+    pthread_mutex_lock(&walker->lock);
+    while (count < max_count) {
+        if (walker->depth > 0) {
+            walked_dir* dir = &walker->dirs[walker->depth - 1];
+            if (dir->next_file < dir->file_count) {
+                name_offsets[count] = walker->root_length;
+                paths[count++] = dir->files[dir->next_file++];
+            } else if (dir->next_dir < dir->dir_count) {
+                char* subdir = dir->dirs[dir->next_dir++];
+                /* A subdirectory failing to be listed is reported and skipped */
+                if (push_dir(walker, subdir) != SAL_OK) {
+                    fail_path(walker, subdir, "Walking directory failed");
+                }
+                free(subdir);
+            } else {
+                release_walked_dir(dir);
+                --walker->depth;
+            }
+            continue;
+        }
+        char* root = next_root(walker);
+        if (root == NULL) {
+            break;
+        }
+        switch (push_dir(walker, root)) {
+        case SAL_OK:
+            walker->root_length = strlen(root) + 1;
+            free(root);
+            break;
+        case SAL_DIR_NOT_FOUND:
+            if (sal_is_file_readable(root) == SAL_OK) {
+                reset_error_description();
+                name_offsets[count] = 0;
+                paths[count++] = root;
+            } else {
+                fail_path(walker, root, "File not found");
+                free(root);
+            }
+            break;
+        default:
+            fail_path(walker, root, "Walking directory failed");
+            free(root);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&walker->lock);
+    return count;
+}
+
+size_t path_walker_get_failures(path_walker_t* walker) {
+    pthread_mutex_lock(&walker->lock);
+    const size_t failures = walker->failures;
+    pthread_mutex_unlock(&walker->lock);
+    return failures;
+}
@@ -0,0 +1,91 @@
+#ifndef _WALKER_H_
+#define _WALKER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ========================================================================== *
+ * Data definitions                                                           *
+ * ========================================================================== */
+
+/**
+ * @brief Walks the files to be sent, lazily and in order: the given paths,
+ * then those read from a file list, directories being replaced by their
+ * files. Only the listings of the directories being walked are held, so
+ * memory is bounded by the tree depth and the largest directory rather than
+ * by the amount of files, and no directory is kept open. Many threads may
+ * take files from the same walker.
+ **/
+typedef struct Spath_walker path_walker_t;
+
+/**
+ * @brief Creates a walker, with no paths to walk yet.
+ * @note The created walker shall be released by path_walker_destroy().
+ *
+ * @param recursive Whether directories are walked into their subdirectories too
+ *
+ * @return the created walker
+ * @return NULL otherwise
+ **/
+path_walker_t* path_walker_create(const bool recursive);
+
+/**
+ * @brief Releases a walker, along with the paths it did not walk yet.
+ *
+ * @param walker The given walker
+ *
+ * @return No return
+ **/
+void path_walker_destroy(path_walker_t* walker);
+
+/**
+ * @brief Adds a file or directory path to be walked.
+ *
+ * @param walker The given walker
+ * @param path The file or directory path
+ *
+ * @return true if path exists and was added
+ * @return false otherwise
+ **/
+bool path_walker_add_path(path_walker_t* walker, const char* path);
+
+/**
+ * @brief Sets a file listing more file or directory paths to be walked, one
+ * per line, after the added paths. Listed paths are only checked once they
+ * are walked, the missing ones being reported and counted as failures.
+ *
+ * @param walker The given walker
+ * @param list_path The path of the file list, "-" for the standard input
+ *
+ * @return true if the file list was opened
+ * @return false otherwise
+ **/
+bool path_walker_set_list(path_walker_t* walker, const char* list_path);
+
+/**
+ * @brief Takes the next files of the walk. Files found in a directory are
+ * named by their path relative to that directory, so that a tree keeps its
+ * layout once sent.
+ * @note The taken paths are malloc'd values that must be freed by user.
+ *
+ * @param walker The given walker
+ * @param[out] paths The paths of the taken files
+ * @param[out] name_offsets The offsets of the file names in their paths, 0
+ * for the files given as such, which are named by their base name
+ * @param max_count The amount of files to take at most
+ *
+ * @return the amount of taken files, 0 once the walk is over
+ **/
+size_t path_walker_next(path_walker_t* walker, char** paths, size_t* name_offsets, const size_t max_count);
+
+/**
+ * @brief Gets the amount of paths the walk skipped so far: listed paths not
+ * found, and directories that could not be listed.
+ *
+ * @param walker The given walker
+ *
+ * @return the amount of skipped paths
+ **/
+size_t path_walker_get_failures(path_walker_t* walker);
+
+#endif /* _WALKER_H_ */
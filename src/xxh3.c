@@ -0,0 +1,485 @@
+#include <string.h> //memcpy
+#include <pthread.h>
+
+#include "checksum_imp.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define XXH3_AVX2 //checked at runtime
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define XXH3_NEON //always available on AArch64
+#endif
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define PRIME_MX1 0x165667919E3779F9ULL
+#define PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define SECRET_LEN 192
+#define SECRET_CONSUME_RATE 8 ///< the amount of secret bytes advanced for each stripe
+#define SECRET_LIMIT (SECRET_LEN - XXH3_STRIPE_LEN) ///< the offset of the scrambling secret
+#define SECRET_LASTACC_START 7
+#define SECRET_MERGEACCS_START 11
+#define STRIPES_PER_BLOCK (SECRET_LIMIT / SECRET_CONSUME_RATE)
+#define MIDSIZE_MAX 240 ///< the longest input hashed without accumulators
+#define MIDSIZE_STARTOFFSET 3
+#define MIDSIZE_LASTOFFSET 17
+#define SECRET_SIZE_MIN 136
+
+/**
+ * @brief The default secret, as defined by the XXH3 specification.
+ **/
+static const uint8_t secret[SECRET_LEN] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+typedef struct {
+    uint64_t low;
+    uint64_t high;
+} uint128_parts_t;
+
+typedef void (*accumulate_kernel_t)(uint64_t* acc, const uint8_t* input, const uint8_t* secret, size_t stripes);
+typedef void (*scramble_kernel_t)(uint64_t* acc, const uint8_t* secret);
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static accumulate_kernel_t accumulate = NULL; ///< the stripe accumulation chosen for the running CPU
+static scramble_kernel_t scramble = NULL; ///< the accumulators scrambling chosen for the running CPU
+static const char* kernel_name = NULL;
+
+static inline uint32_t read_le32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t read_le64(const uint8_t* p) {
+    return read_le32(p) | (uint64_t)read_le32(p + 4) << 32;
+}
+
+static inline uint64_t rotl64(const uint64_t x, const int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static inline uint64_t xorshift64(const uint64_t x, const int shift) {
+    return x ^ (x >> shift);
+}
+
+/**
+ * @brief Computes the full 128 bits product of two 64 bits values.
+ *
+ * @param lhs The left operand
+ * @param rhs The right operand
+ *
+ * @return the product
+ **/
+static inline uint128_parts_t mult64to128(const uint64_t lhs, const uint64_t rhs) {
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = (unsigned __int128)lhs * rhs;
+    return (uint128_parts_t){ .low = (uint64_t)product, .high = (uint64_t)(product >> 64) };
+#else
+    const uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+    const uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+    const uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+    const uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+    const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    return (uint128_parts_t){
+        .low = (cross << 32) | (lo_lo & 0xFFFFFFFF),
+        .high = (hi_lo >> 32) + (cross >> 32) + hi_hi
+    };
+#endif
+}
+
+static inline uint64_t mul128_fold64(const uint64_t lhs, const uint64_t rhs) {
+    const uint128_parts_t product = mult64to128(lhs, rhs);
+    return product.low ^ product.high;
+}
+
+static uint64_t xxh64_avalanche(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static uint64_t avalanche(uint64_t hash) {
+    hash = xorshift64(hash, 37);
+    hash *= PRIME_MX1;
+    return xorshift64(hash, 32);
+}
+
+static inline uint64_t mix16(const uint8_t* input, const uint8_t* key) {
+    return mul128_fold64(read_le64(input) ^ read_le64(key), read_le64(input + 8) ^ read_le64(key + 8));
+}
+
+static inline uint128_parts_t mix32(
+    uint128_parts_t acc,
+    const uint8_t* input_1,
+    const uint8_t* input_2,
+    const uint8_t* key) {
+    acc.low += mix16(input_1, key);
+    acc.low ^= read_le64(input_2) + read_le64(input_2 + 8);
+    acc.high += mix16(input_2, key + 16);
+    acc.high ^= read_le64(input_1) + read_le64(input_1 + 8);
+    return acc;
+}
+
+/**
+ * @brief Hashes inputs up to 16 bytes long.
+ *
+ * @param input The input
+ * @param length The input length
+ *
+ * @return the hash
+ **/
+static uint128_parts_t hash_short(const uint8_t* input, const size_t length) {
+    uint128_parts_t hash;
+    if (length > 8) {
+        const uint64_t bitflip_low = read_le64(secret + 32) ^ read_le64(secret + 40);
+        const uint64_t bitflip_high = read_le64(secret + 48) ^ read_le64(secret + 56);
+        uint64_t input_high = read_le64(input + length - 8);
+        uint128_parts_t m128 = mult64to128(read_le64(input) ^ input_high ^ bitflip_low, PRIME64_1);
+        m128.low += (uint64_t)(length - 1) << 54;
+        input_high ^= bitflip_high;
+        m128.high += input_high + (uint64_t)(uint32_t)input_high * (PRIME32_2 - 1);
+        m128.low ^= __builtin_bswap64(m128.high);
+        hash = mult64to128(m128.low, PRIME64_2);
+        hash.high += m128.high * PRIME64_2;
+        hash.low = avalanche(hash.low);
+        hash.high = avalanche(hash.high);
+    } else if (length >= 4) {
+        const uint64_t input_64 = read_le32(input) + ((uint64_t)read_le32(input + length - 4) << 32);
+        const uint64_t bitflip = read_le64(secret + 16) ^ read_le64(secret + 24);
+        hash = mult64to128(input_64 ^ bitflip, PRIME64_1 + (length << 2));
+        hash.high += hash.low << 1;
+        hash.low ^= hash.high >> 3;
+        hash.low = xorshift64(hash.low, 35);
+        hash.low *= PRIME_MX2;
+        hash.low = xorshift64(hash.low, 28);
+        hash.high = avalanche(hash.high);
+    } else if (length > 0) {
+        const uint32_t combined_low = (uint32_t)input[0] << 16 | (uint32_t)input[length >> 1] << 24 |
+            input[length - 1] | (uint32_t)length << 8;
+        const uint32_t swapped = __builtin_bswap32(combined_low);
+        const uint32_t combined_high = (swapped << 13) | (swapped >> 19);
+        hash.low = xxh64_avalanche(combined_low ^ (uint64_t)(read_le32(secret) ^ read_le32(secret + 4)));
+        hash.high = xxh64_avalanche(combined_high ^ (uint64_t)(read_le32(secret + 8) ^ read_le32(secret + 12)));
+    } else {
+        hash.low = xxh64_avalanche(read_le64(secret + 64) ^ read_le64(secret + 72));
+        hash.high = xxh64_avalanche(read_le64(secret + 80) ^ read_le64(secret + 88));
+    }
+    return hash;
+}
+
+/**
+ * @brief Hashes inputs from 17 to MIDSIZE_MAX bytes long.
+ *
+ * @param input The input
+ * @param length The input length
+ *
+ * @return the hash
+ **/
+static uint128_parts_t hash_medium(const uint8_t* input, const size_t length) {
+    uint128_parts_t acc = { .low = length * PRIME64_1, .high = 0 };
+    if (length <= 128) {
+        for (int i = (length - 1) / 32; i >= 0; --i) {
+            acc = mix32(acc, input + 16 * i, input + length - 16 * (i + 1), secret + 32 * i);
+        }
+    } else {
+        for (size_t i = 32; i < 160; i += 32) {
+            acc = mix32(acc, input + i - 32, input + i - 16, secret + i - 32);
+        }
+        acc.low = avalanche(acc.low);
+        acc.high = avalanche(acc.high);
+        for (size_t i = 160; i <= length; i += 32) {
+            acc = mix32(acc, input + i - 32, input + i - 16, secret + MIDSIZE_STARTOFFSET + i - 160);
+        }
+        acc = mix32(acc, input + length - 16, input + length - 32, secret + SECRET_SIZE_MIN - MIDSIZE_LASTOFFSET - 16);
+    }
+    uint128_parts_t hash;
+    hash.low = avalanche(acc.low + acc.high);
+    hash.high = 0 - avalanche(acc.low * PRIME64_1 + acc.high * PRIME64_4 + length * PRIME64_2);
+    return hash;
+}
+
+/**
+ * @brief Accumulates stripes, each one with the secret advanced by
+ * SECRET_CONSUME_RATE bytes, with plain 64 bits arithmetic.
+ *
+ * @param acc The accumulators
+ * @param input The stripes
+ * @param key The secret of the first stripe
+ * @param stripes The amount of stripes
+ *
+ * @return No return
+ **/
+static void accumulate_portable(uint64_t* acc, const uint8_t* input, const uint8_t* key, size_t stripes) {
+    for (size_t n = 0; n < stripes; ++n, input += XXH3_STRIPE_LEN, key += SECRET_CONSUME_RATE) {
+        for (int lane = 0; lane < 8; ++lane) {
+            const uint64_t data_value = read_le64(input + lane * 8);
+            const uint64_t data_key = data_value ^ read_le64(key + lane * 8);
+            acc[lane ^ 1] += data_value;
+            acc[lane] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+        }
+    }
+}
+
+/**
+ * @brief Scrambles the accumulators after a block, with plain 64 bits arithmetic.
+ *
+ * @param acc The accumulators
+ * @param key The scrambling secret
+ *
+ * @return No return
+ **/
+static void scramble_portable(uint64_t* acc, const uint8_t* key) {
+    for (int lane = 0; lane < 8; ++lane) {
+        acc[lane] = (xorshift64(acc[lane], 47) ^ read_le64(key + lane * 8)) * PRIME32_1;
+    }
+}
+
+#if defined(XXH3_AVX2)
+/**
+ * @brief Accumulates stripes with AVX2, 4 lanes per instruction.
+ * @see accumulate_portable()
+ **/
+__attribute__((target("avx2")))
+static void accumulate_avx2(uint64_t* acc, const uint8_t* input, const uint8_t* key, size_t stripes) {
+    __m256i acc_vec[2] = {
+        _mm256_loadu_si256((const __m256i*)acc),
+        _mm256_loadu_si256((const __m256i*)(acc + 4))
+    };
+    for (size_t n = 0; n < stripes; ++n, input += XXH3_STRIPE_LEN, key += SECRET_CONSUME_RATE) {
+        for (int i = 0; i < 2; ++i) {
+            const __m256i data_vec = _mm256_loadu_si256((const __m256i*)input + i);
+            const __m256i key_vec = _mm256_loadu_si256((const __m256i*)key + i);
+            const __m256i data_key = _mm256_xor_si256(data_vec, key_vec);
+            const __m256i product = _mm256_mul_epu32(data_key, _mm256_srli_epi64(data_key, 32));
+            const __m256i data_swap = _mm256_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2));
+            acc_vec[i] = _mm256_add_epi64(_mm256_add_epi64(acc_vec[i], data_swap), product);
+        }
+    }
+    _mm256_storeu_si256((__m256i*)acc, acc_vec[0]);
+    _mm256_storeu_si256((__m256i*)(acc + 4), acc_vec[1]);
+}
+
+/**
+ * @brief Scrambles the accumulators with AVX2.
+ * @see scramble_portable()
+ **/
+__attribute__((target("avx2")))
+static void scramble_avx2(uint64_t* acc, const uint8_t* key) {
+    const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 2; ++i) {
+        const __m256i acc_vec = _mm256_loadu_si256((const __m256i*)acc + i);
+        const __m256i key_vec = _mm256_loadu_si256((const __m256i*)key + i);
+        const __m256i data_key = _mm256_xor_si256(_mm256_xor_si256(acc_vec, _mm256_srli_epi64(acc_vec, 47)), key_vec);
+        const __m256i product_low = _mm256_mul_epu32(data_key, prime);
+        const __m256i product_high = _mm256_mul_epu32(_mm256_srli_epi64(data_key, 32), prime);
+        _mm256_storeu_si256((__m256i*)acc + i, _mm256_add_epi64(product_low, _mm256_slli_epi64(product_high, 32)));
+    }
+}
+#endif
+
+#if defined(XXH3_NEON)
+/**
+ * @brief Accumulates stripes with NEON, 2 lanes per instruction.
+ * @see accumulate_portable()
+ **/
+static void accumulate_neon(uint64_t* acc, const uint8_t* input, const uint8_t* key, size_t stripes) {
+    uint64x2_t acc_vec[4];
+    for (int i = 0; i < 4; ++i) {
+        acc_vec[i] = vld1q_u64(acc + 2 * i);
+    }
+    for (size_t n = 0; n < stripes; ++n, input += XXH3_STRIPE_LEN, key += SECRET_CONSUME_RATE) {
+        for (int i = 0; i < 4; ++i) {
+            const uint64x2_t data_vec = vreinterpretq_u64_u8(vld1q_u8(input + 16 * i));
+            const uint64x2_t key_vec = vreinterpretq_u64_u8(vld1q_u8(key + 16 * i));
+            const uint64x2_t data_key = veorq_u64(data_vec, key_vec);
+            acc_vec[i] = vaddq_u64(acc_vec[i], vextq_u64(data_vec, data_vec, 1));
+            acc_vec[i] = vmlal_u32(acc_vec[i], vmovn_u64(data_key), vshrn_n_u64(data_key, 32));
+        }
+    }
+    for (int i = 0; i < 4; ++i) {
+        vst1q_u64(acc + 2 * i, acc_vec[i]);
+    }
+}
+
+/**
+ * @brief Scrambles the accumulators with NEON.
+ * @see scramble_portable()
+ **/
+static void scramble_neon(uint64_t* acc, const uint8_t* key) {
+    const uint32x2_t prime = vdup_n_u32(PRIME32_1);
+    for (int i = 0; i < 4; ++i) {
+        uint64x2_t acc_vec = vld1q_u64(acc + 2 * i);
+        const uint64x2_t key_vec = vreinterpretq_u64_u8(vld1q_u8(key + 16 * i));
+        acc_vec = veorq_u64(veorq_u64(acc_vec, vshrq_n_u64(acc_vec, 47)), key_vec);
+        const uint64x2_t product_high = vshlq_n_u64(vmull_u32(vshrn_n_u64(acc_vec, 32), prime), 32);
+        vst1q_u64(acc + 2 * i, vmlal_u32(product_high, vmovn_u64(acc_vec), prime));
+    }
+}
+#endif
+
+/**
+ * @brief Chooses the fastest implementation supported by the running CPU.
+ *
+ * @return No return
+ **/
+static void select_kernel() {
+    accumulate = accumulate_portable;
+    scramble = scramble_portable;
+    kernel_name = "portable";
+    if (is_portable_checksum_forced()) {
+        return;
+    }
+#if defined(XXH3_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        accumulate = accumulate_avx2;
+        scramble = scramble_avx2;
+        kernel_name = "avx2";
+    }
+#elif defined(XXH3_NEON)
+    accumulate = accumulate_neon;
+    scramble = scramble_neon;
+    kernel_name = "neon";
+#endif
+}
+
+/**
+ * @brief Accumulates stripes that may cross block boundaries, scrambling
+ * the accumulators at the end of each block.
+ *
+ * @param acc The accumulators
+ * @param[inout] stripes_so_far The amount of stripes already accumulated in the current block
+ * @param input The stripes
+ * @param stripes The amount of stripes
+ *
+ * @return the input past the accumulated stripes
+ **/
+static const uint8_t* consume_stripes(uint64_t* acc, size_t* stripes_so_far, const uint8_t* input, size_t stripes) {
+    while (stripes >= STRIPES_PER_BLOCK - *stripes_so_far) {
+        const size_t block_stripes = STRIPES_PER_BLOCK - *stripes_so_far;
+        accumulate(acc, input, secret + *stripes_so_far * SECRET_CONSUME_RATE, block_stripes);
+        scramble(acc, secret + SECRET_LIMIT);
+        input += block_stripes * XXH3_STRIPE_LEN;
+        stripes -= block_stripes;
+        *stripes_so_far = 0;
+    }
+    if (stripes > 0) {
+        accumulate(acc, input, secret + *stripes_so_far * SECRET_CONSUME_RATE, stripes);
+        input += stripes * XXH3_STRIPE_LEN;
+        *stripes_so_far += stripes;
+    }
+    return input;
+}
+
+/**
+ * @brief Merges the accumulators into a 64 bits hash.
+ *
+ * @param acc The accumulators
+ * @param key The merging secret
+ * @param start The initial value
+ *
+ * @return the merged hash
+ **/
+static uint64_t merge_accumulators(const uint64_t* acc, const uint8_t* key, const uint64_t start) {
+    uint64_t result = start;
+    for (int i = 0; i < 4; ++i) {
+        result += mul128_fold64(acc[2 * i] ^ read_le64(key + 16 * i), acc[2 * i + 1] ^ read_le64(key + 16 * i + 8));
+    }
+    return avalanche(result);
+}
+
+void xxh3_128_init(xxh3_state_t* state) {
+    pthread_once(&kernel_once, select_kernel);
+    static const uint64_t initial_acc[8] = {
+        PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1
+    };
+    memcpy(state->acc, initial_acc, sizeof(initial_acc));
+    state->buffered = 0;
+    state->stripes_so_far = 0;
+    state->total_len = 0;
+}
+
+void xxh3_128_update(xxh3_state_t* state, const uint8_t* data, size_t length) {
+    state->total_len += length;
+    if (length <= XXH3_BUFFER_LEN - state->buffered) {
+        memcpy(state->buffer + state->buffered, data, length);
+        state->buffered += length;
+        return;
+    }
+
+    /* The buffer is consumed only when more input follows, so the last stripe is never consumed early */
+    const uint8_t* end = data + length;
+    if (state->buffered > 0) {
+        const size_t load = XXH3_BUFFER_LEN - state->buffered;
+        memcpy(state->buffer + state->buffered, data, load);
+        data += load;
+        consume_stripes(state->acc, &state->stripes_so_far, state->buffer, XXH3_BUFFER_LEN / XXH3_STRIPE_LEN);
+        state->buffered = 0;
+    }
+    if (end - data > XXH3_BUFFER_LEN) {
+        const size_t stripes = (end - 1 - data) / XXH3_STRIPE_LEN;
+        data = consume_stripes(state->acc, &state->stripes_so_far, data, stripes);
+        memcpy(state->buffer + XXH3_BUFFER_LEN - XXH3_STRIPE_LEN, data - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+    }
+    memcpy(state->buffer, data, end - data);
+    state->buffered = end - data;
+}
+
+void xxh3_128_final(const xxh3_state_t* state, uint8_t* checksum) {
+    uint128_parts_t hash;
+    if (state->total_len > MIDSIZE_MAX) {
+        /* The state is left untouched, the remaining stripes are accumulated on a copy */
+        uint64_t acc[8];
+        memcpy(acc, state->acc, sizeof(acc));
+        uint8_t last_stripe[XXH3_STRIPE_LEN];
+        const uint8_t* last_stripe_ptr = last_stripe;
+        if (state->buffered >= XXH3_STRIPE_LEN) {
+            size_t stripes_so_far = state->stripes_so_far;
+            consume_stripes(acc, &stripes_so_far, state->buffer, (state->buffered - 1) / XXH3_STRIPE_LEN);
+            last_stripe_ptr = state->buffer + state->buffered - XXH3_STRIPE_LEN;
+        } else {
+            const size_t catchup = XXH3_STRIPE_LEN - state->buffered;
+            memcpy(last_stripe, state->buffer + XXH3_BUFFER_LEN - catchup, catchup);
+            memcpy(last_stripe + catchup, state->buffer, state->buffered);
+        }
+        accumulate(acc, last_stripe_ptr, secret + SECRET_LIMIT - SECRET_LASTACC_START, 1);
+        hash.low = merge_accumulators(acc, secret + SECRET_MERGEACCS_START, state->total_len * PRIME64_1);
+        hash.high = merge_accumulators(
+            acc, secret + SECRET_LEN - sizeof(acc) - SECRET_MERGEACCS_START, ~(state->total_len * PRIME64_2));
+    } else if (state->total_len > 16) {
+        hash = hash_medium(state->buffer, state->total_len);
+    } else {
+        hash = hash_short(state->buffer, state->total_len);
+    }
+
+    /* Canonical representation: big endian, high half first */
+    for (int i = 0; i < 8; ++i) {
+        checksum[i] = hash.high >> (56 - 8 * i);
+        checksum[8 + i] = hash.low >> (56 - 8 * i);
+    }
+}
+
+const char* xxh3_128_kernel() {
+    pthread_once(&kernel_once, select_kernel);
+    return kernel_name;
+}
@@ -0,0 +1,35 @@
+#!/bin/bash
+#
+# Checks that a scrape connection sending nothing does not hold up the
+# metrics endpoint: a second scrape completes, and the idle connection is
+# closed by the server.
+#
+# Usage: tests/metrics_idle.sh
+#
+# Run from the repository root after building the server.
+
+PORT=${PORT:-$((20000 + $$ % 20000))}
+METRICS_PORT=$((PORT + 1))
+WORK_DIR=$(mktemp -d)
+trap 'kill "$server_pid" 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+
+./server "$WORK_DIR" 127.0.0.1 "$PORT" --metrics-port "$METRICS_PORT" >/dev/null 2>&1 &
+server_pid=$!
+sleep 0.5
+
+# The idle connection is accepted first, and never sends its request
+exec 3<>"/dev/tcp/127.0.0.1/$METRICS_PORT" || { echo "FAIL: cannot connect to the metrics endpoint"; exit 1; }
+sleep 0.2
+
+exec 4<>"/dev/tcp/127.0.0.1/$METRICS_PORT"
+printf 'GET /metrics HTTP/1.0\r\n\r\n' >&4
+if ! timeout 10 cat <&4 | grep -q '^HTTP/1.0 200 OK'; then
+    echo "FAIL: scrape not answered while another connection is idle"
+    exit 1
+fi
+
+if ! timeout 5 cat <&3 >/dev/null; then
+    echo "FAIL: idle scrape connection not closed"
+    exit 1
+fi
+echo "PASS"